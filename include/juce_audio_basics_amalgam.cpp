@@ -42,6 +42,18 @@
 
 #include "juce_audio_basics_amalgam.h"
 
+#ifndef JUCE_USE_SSE_INTRINSICS
+ #define JUCE_USE_SSE_INTRINSICS 1
+#endif
+
+#if ! (JUCE_INTEL && (JUCE_64BIT || JUCE_MSVC || defined (__SSE2__)))
+ #undef JUCE_USE_SSE_INTRINSICS
+#endif
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#endif
+
 namespace juce
 {
 
@@ -1153,6 +1165,225 @@ float AudioSampleBuffer::getRMSLevel (const int channel,
 
 /*** End of inlined file: juce_AudioSampleBuffer.cpp ***/
 
+/*** Start of inlined file: juce_FloatVectorOperations.cpp ***/
+void FloatVectorOperations::clear (float* dest, const int numValues) noexcept
+{
+	zeromem (dest, sizeof (float) * (size_t) numValues);
+}
+
+void FloatVectorOperations::copy (float* dest, const float* src, const int numValues) noexcept
+{
+	memcpy (dest, src, sizeof (float) * (size_t) numValues);
+}
+
+void FloatVectorOperations::multiply (float* dest, const float multiplier, int numValues) noexcept
+{
+   #if JUCE_USE_SSE_INTRINSICS
+	const __m128 mult = _mm_set1_ps (multiplier);
+
+	for (int i = numValues / 4; --i >= 0;)
+	{
+		_mm_storeu_ps (dest, _mm_mul_ps (_mm_loadu_ps (dest), mult));
+		dest += 4;
+	}
+
+	numValues &= 3;
+   #endif
+
+	while (--numValues >= 0)
+		*dest++ *= multiplier;
+}
+
+void FloatVectorOperations::convertFixedToFloat (float* dest, const int* src, const float multiplier, int numValues) noexcept
+{
+   #if JUCE_USE_SSE_INTRINSICS
+	const __m128 mult = _mm_set1_ps (multiplier);
+
+	for (int i = numValues / 4; --i >= 0;)
+	{
+		const __m128i ints = _mm_loadu_si128 ((const __m128i*) src);
+		_mm_storeu_ps (dest, _mm_mul_ps (_mm_cvtepi32_ps (ints), mult));
+		src += 4;
+		dest += 4;
+	}
+
+	numValues &= 3;
+   #endif
+
+	while (--numValues >= 0)
+		*dest++ = *src++ * multiplier;
+}
+
+void FloatVectorOperations::findMinAndMax (const float* src, int numValues, float& minResult, float& maxResult) noexcept
+{
+	if (numValues <= 0)
+	{
+		minResult = 0;
+		maxResult = 0;
+		return;
+	}
+
+	float mn = *src, mx = mn;
+
+   #if JUCE_USE_SSE_INTRINSICS
+	if (numValues >= 8)
+	{
+		__m128 mns = _mm_loadu_ps (src);
+		__m128 mxs = mns;
+
+		for (int i = numValues / 4; --i > 0;)
+		{
+			src += 4;
+			const __m128 v = _mm_loadu_ps (src);
+			mns = _mm_min_ps (mns, v);
+			mxs = _mm_max_ps (mxs, v);
+		}
+
+		src += 4;
+		numValues &= 3;
+
+		float mnValues[4], mxValues[4];
+		_mm_storeu_ps (mnValues, mns);
+		_mm_storeu_ps (mxValues, mxs);
+
+		mn = jmin (jmin (mnValues[0], mnValues[1]), jmin (mnValues[2], mnValues[3]));
+		mx = jmax (jmax (mxValues[0], mxValues[1]), jmax (mxValues[2], mxValues[3]));
+	}
+   #endif
+
+	while (--numValues >= 0)
+	{
+		const float v = *src++;
+		if (v < mn)  mn = v;
+		if (v > mx)  mx = v;
+	}
+
+	minResult = mn;
+	maxResult = mx;
+}
+
+double FloatVectorOperations::findSumOfSquares (const float* src, int numValues) noexcept
+{
+	double sum = 0;
+
+   #if JUCE_USE_SSE_INTRINSICS
+	// Accumulate in double-precision lanes, so that long blocks don't lose accuracy
+	__m128d sumLo = _mm_setzero_pd(), sumHi = _mm_setzero_pd();
+
+	for (int i = numValues / 4; --i >= 0;)
+	{
+		const __m128 v = _mm_loadu_ps (src);
+		const __m128 sq = _mm_mul_ps (v, v);
+		sumLo = _mm_add_pd (sumLo, _mm_cvtps_pd (sq));
+		sumHi = _mm_add_pd (sumHi, _mm_cvtps_pd (_mm_movehl_ps (sq, sq)));
+		src += 4;
+	}
+
+	double sums[2];
+	_mm_storeu_pd (sums, _mm_add_pd (sumLo, sumHi));
+	sum = sums[0] + sums[1];
+	numValues &= 3;
+   #endif
+
+	while (--numValues >= 0)
+	{
+		const float v = *src++;
+		sum += v * v;
+	}
+
+	return sum;
+}
+
+#if JUCE_UNIT_TESTS
+
+class FloatVectorOperationsTests  : public UnitTest
+{
+public:
+	FloatVectorOperationsTests() : UnitTest ("FloatVectorOperations") {}
+
+	void runTest()
+	{
+		beginTest ("Comparing with simple loops");
+
+		Random r (0x12345);
+		HeapBlock<float> data (numValues + 4), result (numValues + 4);
+		HeapBlock<int> ints (numValues + 4);
+
+		// Use every length up to a few SIMD widths, starting at each alignment..
+		for (int offset = 0; offset < 4; ++offset)
+		{
+			for (int num = 0; num <= numValues; ++num)
+			{
+				fillWithRandomValues (r, data + offset, num);
+
+				float mn, mx;
+				FloatVectorOperations::findMinAndMax (data + offset, num, mn, mx);
+
+				float expectedMin = 0, expectedMax = 0;
+				double expectedSum = 0;
+
+				for (int i = 0; i < num; ++i)
+				{
+					const float v = data [offset + i];
+					expectedMin = (i == 0 || v < expectedMin) ? v : expectedMin;
+					expectedMax = (i == 0 || v > expectedMax) ? v : expectedMax;
+					expectedSum += v * v;
+				}
+
+				expectEquals (mn, expectedMin);
+				expectEquals (mx, expectedMax);
+				expect (std::abs (FloatVectorOperations::findSumOfSquares (data + offset, num) - expectedSum)
+						  <= expectedSum * 1.0e-6);
+
+				FloatVectorOperations::copy (result + offset, data + offset, num);
+				FloatVectorOperations::multiply (result + offset, 0.3f, num);
+
+				for (int i = 0; i < num; ++i)
+					expectEquals (result [offset + i], data [offset + i] * 0.3f);
+
+				for (int i = 0; i < num; ++i)
+					ints [offset + i] = r.nextInt();
+
+				FloatVectorOperations::convertFixedToFloat (result + offset, ints + offset, 1.0f / 0x7fffffff, num);
+
+				for (int i = 0; i < num; ++i)
+					expectEquals (result [offset + i], ints [offset + i] * (1.0f / 0x7fffffff));
+			}
+		}
+
+		// ..and make sure that the extreme values are found wherever they are
+		for (int pos = 0; pos < numValues; ++pos)
+		{
+			for (int i = 0; i < numValues; ++i)
+				data[i] = 0.5f;
+
+			data[pos] = -2.0f;
+			data[numValues - 1 - pos] = 3.0f;
+
+			float mn, mx;
+			FloatVectorOperations::findMinAndMax (data, numValues, mn, mx);
+			expectEquals (mn, pos == numValues - 1 - pos ? 0.5f : -2.0f);
+			expectEquals (mx, 3.0f);
+		}
+	}
+
+private:
+	enum { numValues = 37 };
+
+	static void fillWithRandomValues (Random& r, float* dest, int num)
+	{
+		while (--num >= 0)
+			*dest++ = r.nextFloat() * 4.0f - 2.0f;
+	}
+};
+
+static FloatVectorOperationsTests floatVectorOperationsTests;
+
+#endif
+
+/*** End of inlined file: juce_FloatVectorOperations.cpp ***/
+
+
 
 /*** Start of inlined file: juce_IIRFilter.cpp ***/
 #if JUCE_INTEL
@@ -3656,6 +3887,14 @@ void BufferingAudioSource::getNextAudioBlock (const AudioSourceChannelInfo& info
 	}
 }
 
+bool BufferingAudioSource::isNextBlockReady (const int numSamples) const
+{
+	const ScopedLock sl (bufferStartPosLock);
+
+	return nextPlayPos >= bufferValidStart
+			&& nextPlayPos + numSamples <= bufferValidEnd;
+}
+
 int64 BufferingAudioSource::getNextReadPosition() const
 {
 	jassert (source->getTotalLength() > 0);
@@ -3686,16 +3925,16 @@ bool BufferingAudioSource::readNextBufferChunk()
 			bufferValidEnd = 0;
 		}
 
-		newBVS = jmax ((int64) 0, nextPlayPos);
-		newBVE = newBVS + buffer.getNumSamples() - 4;
+		const int64 playPos = jmax ((int64) 0, nextPlayPos);
 		sectionToReadStart = 0;
 		sectionToReadEnd = 0;
 
 		const int maxChunkSize = 2048;
 
-		if (newBVS < bufferValidStart || newBVS >= bufferValidEnd)
+		if (playPos < bufferValidStart || playPos >= bufferValidEnd)
 		{
-			newBVE = jmin (newBVE, newBVS + maxChunkSize);
+			newBVS = playPos;
+			newBVE = jmin (newBVS + buffer.getNumSamples() - 4, newBVS + maxChunkSize);
 
 			sectionToReadStart = newBVS;
 			sectionToReadEnd = newBVE;
@@ -3703,9 +3942,16 @@ bool BufferingAudioSource::readNextBufferChunk()
 			bufferValidStart = 0;
 			bufferValidEnd = 0;
 		}
-		else if (std::abs ((int) (newBVS - bufferValidStart)) > 512
-				  || std::abs ((int) (newBVE - bufferValidEnd)) > 512)
+		else
 		{
+			// Up to a quarter of the buffer is kept behind the play position, so that
+			// short jumps backwards can be served without having to re-read anything.
+			newBVS = jmax (bufferValidStart, playPos - buffer.getNumSamples() / 4);
+			newBVE = newBVS + buffer.getNumSamples() - 4;
+
+			if (newBVS - bufferValidStart <= 512 && newBVE - bufferValidEnd <= 512)
+				return false;
+
 			newBVE = jmin (newBVE, bufferValidEnd + maxChunkSize);
 
 			sectionToReadStart = bufferValidEnd;
@@ -4881,6 +5127,37 @@ SynthesiserVoice* Synthesiser::findFreeVoice (SynthesiserSound* soundToPlay,
 
 /*** End of inlined file: juce_Synthesiser.cpp ***/
 
+
+/*** Start of inlined file: juce_AudioPlayHead.cpp ***/
+bool AudioPlayHead::CurrentPositionInfo::operator== (const CurrentPositionInfo& other) const noexcept
+{
+	return timeInSeconds == other.timeInSeconds
+		&& ppqPosition == other.ppqPosition
+		&& editOriginTime == other.editOriginTime
+		&& ppqPositionOfLastBarStart == other.ppqPositionOfLastBarStart
+		&& frameRate == other.frameRate
+		&& isPlaying == other.isPlaying
+		&& isRecording == other.isRecording
+		&& bpm == other.bpm
+		&& timeSigNumerator == other.timeSigNumerator
+		&& timeSigDenominator == other.timeSigDenominator;
+}
+
+bool AudioPlayHead::CurrentPositionInfo::operator!= (const CurrentPositionInfo& other) const noexcept
+{
+	return ! operator== (other);
+}
+
+void AudioPlayHead::CurrentPositionInfo::resetToDefault()
+{
+	zerostruct (*this);
+	timeSigNumerator = 4;
+	timeSigDenominator = 4;
+	bpm = 120;
+}
+
+/*** End of inlined file: juce_AudioPlayHead.cpp ***/
+
 // END_AUTOINCLUDE
 
 }
@@ -33,7 +33,7 @@
 namespace juce
 {
 
-// START_AUTOINCLUDE buffers, effects, midi, sources, synthesisers
+// START_AUTOINCLUDE buffers, effects, midi, sources, synthesisers, audio_play_head
 #ifndef __JUCE_AUDIODATACONVERTERS_JUCEHEADER__
 
 /*** Start of inlined file: juce_AudioDataConverters.h ***/
@@ -1046,6 +1046,52 @@ private:
 /*** End of inlined file: juce_AudioSampleBuffer.h ***/
 
 
+#endif
+#ifndef __JUCE_FLOATVECTOROPERATIONS_JUCEHEADER__
+
+/*** Start of inlined file: juce_FloatVectorOperations.h ***/
+#ifndef __JUCE_FLOATVECTOROPERATIONS_JUCEHEADER__
+#define __JUCE_FLOATVECTOROPERATIONS_JUCEHEADER__
+
+/**
+	A collection of simple vector operations on arrays of floats, accelerated with
+	SIMD instructions where possible.
+
+	On Intel machines these use SSE intrinsics (unless JUCE_USE_SSE_INTRINSICS has been
+	set to 0), and fall back to plain C++ loops elsewhere. None of the pointers need
+	to be aligned.
+*/
+class JUCE_API  FloatVectorOperations
+{
+public:
+	/** Clears a vector of floats. */
+	static void clear (float* dest, int numValues) noexcept;
+
+	/** Copies a vector of floats. */
+	static void copy (float* dest, const float* src, int numValues) noexcept;
+
+	/** Multiplies each element of a vector by a fixed value. */
+	static void multiply (float* dest, float multiplier, int numValues) noexcept;
+
+	/** Converts a stream of integers to floats, multiplying each one by the given multiplier.
+		The source and destination may be the same block of memory.
+	*/
+	static void convertFixedToFloat (float* dest, const int* src, float multiplier, int numValues) noexcept;
+
+	/** Finds the minimum and maximum values in the given array.
+		If numValues is 0, both results will be set to 0.
+	*/
+	static void findMinAndMax (const float* src, int numValues, float& minResult, float& maxResult) noexcept;
+
+	/** Returns the sum of the squares of all the values in the array. */
+	static double findSumOfSquares (const float* src, int numValues) noexcept;
+};
+
+#endif   // __JUCE_FLOATVECTOROPERATIONS_JUCEHEADER__
+
+/*** End of inlined file: juce_FloatVectorOperations.h ***/
+
+
 #endif
 #ifndef __JUCE_DECIBELS_JUCEHEADER__
 
@@ -3526,6 +3572,16 @@ public:
 	/** Implements the PositionableAudioSource method. */
 	bool isLooping() const                      { return source->isLooping(); }
 
+	/** Returns true if all the data that the next call to getNextAudioBlock() will need
+		has already been read into the buffer, i.e. if that call won't have to output
+		any silence.
+
+		Some of the data behind the current play position is kept in the buffer, so that
+		a short jump backwards can be played straight away, just like a jump forwards to
+		a position that's already been read.
+	*/
+	bool isNextBlockReady (int numSamples) const;
+
 private:
 
 	OptionalScopedPointer<PositionableAudioSource> source;
@@ -4444,6 +4500,121 @@ private:
 /*** End of inlined file: juce_Synthesiser.h ***/
 
 
+#endif
+#ifndef __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
+
+/*** Start of inlined file: juce_AudioPlayHead.h ***/
+#ifndef __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
+#define __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
+
+/**
+	A subclass of AudioPlayHead can supply information about the position and
+	status of a moving play head during audio playback.
+
+	One of these can be supplied to an AudioProcessor object so that it can find
+	out about the position of the audio that it is rendering.
+
+	@see AudioProcessor::setPlayHead, AudioProcessor::getPlayHead
+*/
+class JUCE_API  AudioPlayHead
+{
+protected:
+
+	AudioPlayHead() {}
+
+public:
+	virtual ~AudioPlayHead() {}
+
+	/** Frame rate types. */
+	enum FrameRateType
+	{
+		fps24           = 0,
+		fps25           = 1,
+		fps2997         = 2,
+		fps30           = 3,
+		fps2997drop     = 4,
+		fps30drop       = 5,
+		fpsUnknown      = 99
+	};
+
+	/** This structure is filled-in by the AudioPlayHead::getCurrentPosition() method.
+	*/
+	struct JUCE_API  CurrentPositionInfo
+	{
+		/** The tempo in BPM */
+		double bpm;
+
+		/** Time signature numerator, e.g. the 3 of a 3/4 time sig */
+		int timeSigNumerator;
+		/** Time signature denominator, e.g. the 4 of a 3/4 time sig */
+		int timeSigDenominator;
+
+		/** The current play position, in seconds from the start of the edit. */
+		double timeInSeconds;
+
+		/** For timecode, the position of the start of the edit, in seconds from 00:00:00:00. */
+		double editOriginTime;
+
+		/** The current play position in pulses-per-quarter-note.
+
+			This is the number of quarter notes since the edit start.
+		*/
+		double ppqPosition;
+
+		/** The position of the start of the last bar, in pulses-per-quarter-note.
+
+			This is the number of quarter notes from the start of the edit to the
+			start of the current bar.
+
+			Note - this value may be unavailable on some hosts, e.g. Pro-Tools. If
+			it's not available, the value will be 0.
+		*/
+		double ppqPositionOfLastBarStart;
+
+		/** The video frame rate, if applicable. */
+		FrameRateType frameRate;
+
+		/** True if the transport is currently playing. */
+		bool isPlaying;
+
+		/** True if the transport is currently recording.
+
+			(When isRecording is true, then isPlaying will also be true).
+		*/
+		bool isRecording;
+
+		/** The current cycle start position in pulses-per-quarter-note.
+			Note that not all hosts or plugin formats may provide this value.
+			@see isLooping
+		*/
+		double ppqLoopStart;
+
+		/** The current cycle end position in pulses-per-quarter-note.
+			Note that not all hosts or plugin formats may provide this value.
+			@see isLooping
+		*/
+		double ppqLoopEnd;
+
+		/** True if the transport is currently looping. */
+		bool isLooping;
+
+		bool operator== (const CurrentPositionInfo& other) const noexcept;
+		bool operator!= (const CurrentPositionInfo& other) const noexcept;
+
+		void resetToDefault();
+	};
+
+	/** Fills-in the given structure with details about the transport's
+		position at the start of the current processing block.
+	*/
+	virtual bool getCurrentPosition (CurrentPositionInfo& result) = 0;
+};
+
+#endif   // __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioPlayHead.h ***/
+
+
 #endif
 // END_AUTOINCLUDE
 
@@ -393,6 +393,18 @@
 
 #include "juce_audio_devices_amalgam.h"
 
+#ifndef JUCE_USE_SSE_INTRINSICS
+ #define JUCE_USE_SSE_INTRINSICS 1
+#endif
+
+#if ! (JUCE_INTEL && (JUCE_64BIT || JUCE_MSVC || defined (__SSE2__)))
+ #undef JUCE_USE_SSE_INTRINSICS
+#endif
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#endif
+
 #if JUCE_MAC
  #define Point CarbonDummyPointName
  #define Component CarbonDummyCompName
@@ -463,6 +475,7 @@
 	 just set the JUCE_ALSA flag to 0.
   */
   #include <alsa/asoundlib.h>
+  #include <sys/resource.h>
  #endif
 
  #if JUCE_JACK
@@ -513,16 +526,234 @@ bool AudioDeviceManager::AudioDeviceSetup::operator== (const AudioDeviceManager:
 			&& useDefaultOutputChannels == other.useDefaultOutputChannels;
 }
 
+AudioDeviceManager::CallbackTimingReport::CallbackTimingReport() noexcept
+	: blockDurationMs (0), numCallbacks (0), numMissedDeadlines (0),
+	  meanMs (0), worstMs (0), worstMsInLastSecond (0),
+	  worstMsInLast10Seconds (0), worstMsInLastMinute (0)
+{
+	zeromem (histogram, sizeof (histogram));
+}
+
+/*  Gathers the figures for getCallbackTimingReport().
+
+	Only the audio thread ever writes to the figures, and it does so between two
+	increments of a sequence counter. A reader just copies the whole lot, and tries
+	again if the counter was odd or changed while it was copying, so the audio thread
+	never has to wait for anyone.
+*/
+class AudioDeviceManager::CallbackTimer
+{
+public:
+	CallbackTimer() noexcept
+		: sampleRate (0), resetsApplied (0)
+	{
+		zerostruct (figures);
+		zeromem (pendingMs, sizeof (pendingMs));
+	}
+
+	enum { maxNumCallbacks = 32, numWindowSlots = 600, msPerWindowSlot = 100 };
+
+	// These are called by the manager while the audio thread isn't running its callbacks
+	void setSampleRate (const double newRate) noexcept      { sampleRate = newRate; }
+
+	void requestReset() noexcept                            { ++resetsRequested; }
+
+	// Called on the audio thread after each of the registered callbacks has been run..
+	void addCallbackTime (const int index, const double ms) noexcept
+	{
+		if (isPositiveAndBelow (index, (int) maxNumCallbacks))
+			pendingMs [index] = ms;
+	}
+
+	// ..and then once at the end of the device callback.
+	void addDeviceCallback (const Array<AudioIODeviceCallback*>& callbacks, const int numSamples,
+							const double startTime, const double endTime) noexcept
+	{
+		const int resetCount = resetsRequested.get();
+
+		++sequence;
+
+		if (resetCount != resetsApplied)
+		{
+			resetsApplied = resetCount;
+			zerostruct (figures);
+		}
+
+		updateCallbackList (callbacks);
+
+		const double ms = endTime - startTime;
+		figures.blockDurationMs = sampleRate > 0 ? 1000.0 * numSamples / sampleRate : 0.0;
+		++figures.numCallbacks;
+		figures.totalMs += ms;
+		figures.worstMs = jmax (figures.worstMs, ms);
+
+		if (figures.blockDurationMs > 0)
+		{
+			if (ms > figures.blockDurationMs)
+				++figures.numMissedDeadlines;
+
+			++figures.histogram [jmin ((int) CallbackTimingReport::numHistogramBins - 1,
+									   (int) (10.0 * ms / figures.blockDurationMs))];
+		}
+
+		const int64 slot = (int64) (endTime / msPerWindowSlot);
+
+		if (slot != figures.latestSlot)
+		{
+			for (int64 i = jmin (slot - figures.latestSlot, (int64) numWindowSlots); --i >= 0;)
+				figures.slotWorstMs [(slot - i) % numWindowSlots] = 0;
+
+			figures.latestSlot = slot;
+		}
+
+		float& slotWorst = figures.slotWorstMs [slot % numWindowSlots];
+		slotWorst = jmax (slotWorst, (float) ms);
+
+		for (int i = figures.numTrackedCallbacks; --i >= 0;)
+		{
+			++figures.callbackNumCalls[i];
+			figures.callbackTotalMs[i] += pendingMs[i];
+			figures.callbackWorstMs[i] = jmax (figures.callbackWorstMs[i], pendingMs[i]);
+		}
+
+		++sequence;
+	}
+
+	void fillReport (CallbackTimingReport& report) const
+	{
+		Figures f;
+
+		for (;;)
+		{
+			const int startSequence = sequence.get();
+
+			if ((startSequence & 1) == 0)
+			{
+				memcpy (&f, &figures, sizeof (f));
+
+				if (sequence.get() == startSequence)
+					break;
+			}
+
+			Thread::yield();
+		}
+
+		report.blockDurationMs      = f.blockDurationMs;
+		report.numCallbacks         = f.numCallbacks;
+		report.numMissedDeadlines   = f.numMissedDeadlines;
+		report.meanMs               = f.numCallbacks > 0 ? f.totalMs / f.numCallbacks : 0.0;
+		report.worstMs              = f.worstMs;
+
+		const int64 currentSlot = (int64) (Time::getMillisecondCounterHiRes() / msPerWindowSlot);
+		report.worstMsInLastSecond    = getWorstInWindow (f, currentSlot, 1000 / msPerWindowSlot);
+		report.worstMsInLast10Seconds = getWorstInWindow (f, currentSlot, 10000 / msPerWindowSlot);
+		report.worstMsInLastMinute    = getWorstInWindow (f, currentSlot, 60000 / msPerWindowSlot);
+
+		memcpy (report.histogram, f.histogram, sizeof (report.histogram));
+
+		report.callbackTimes.clearQuick();
+
+		for (int i = 0; i < f.numTrackedCallbacks; ++i)
+		{
+			CallbackTimingReport::CallbackTime t;
+			t.callback = f.callbacks[i];
+			t.numCalls = f.callbackNumCalls[i];
+			t.meanMs = t.numCalls > 0 ? f.callbackTotalMs[i] / t.numCalls : 0.0;
+			t.worstMs = f.callbackWorstMs[i];
+			report.callbackTimes.add (t);
+		}
+	}
+
+private:
+	struct Figures
+	{
+		double blockDurationMs;
+		int64 numCallbacks, numMissedDeadlines;
+		double totalMs, worstMs;
+		int64 histogram [CallbackTimingReport::numHistogramBins];
+
+		int64 latestSlot;
+		float slotWorstMs [numWindowSlots];
+
+		int numTrackedCallbacks;
+		AudioIODeviceCallback* callbacks [maxNumCallbacks];
+		int64 callbackNumCalls [maxNumCallbacks];
+		double callbackTotalMs [maxNumCallbacks], callbackWorstMs [maxNumCallbacks];
+	};
+
+	Figures figures;
+	double pendingMs [maxNumCallbacks];
+	double sampleRate;
+	Atomic<int> sequence, resetsRequested;
+	int resetsApplied;
+
+	// If callbacks have been added or removed, this rearranges the per-callback figures to
+	// match the new list, keeping the totals for any callbacks that are still present.
+	void updateCallbackList (const Array<AudioIODeviceCallback*>& callbacks) noexcept
+	{
+		const int num = jmin (callbacks.size(), (int) maxNumCallbacks);
+
+		if (num == figures.numTrackedCallbacks)
+		{
+			int i = 0;
+			while (i < num && figures.callbacks[i] == callbacks.getUnchecked (i))
+				++i;
+
+			if (i == num)
+				return;
+		}
+
+		Figures old;
+		memcpy (&old, &figures, sizeof (old));
+
+		for (int i = 0; i < num; ++i)
+		{
+			AudioIODeviceCallback* const cb = callbacks.getUnchecked (i);
+			figures.callbacks[i] = cb;
+			figures.callbackNumCalls[i] = 0;
+			figures.callbackTotalMs[i] = 0;
+			figures.callbackWorstMs[i] = 0;
+
+			for (int j = old.numTrackedCallbacks; --j >= 0;)
+			{
+				if (old.callbacks[j] == cb)
+				{
+					figures.callbackNumCalls[i] = old.callbackNumCalls[j];
+					figures.callbackTotalMs[i]  = old.callbackTotalMs[j];
+					figures.callbackWorstMs[i]  = old.callbackWorstMs[j];
+					break;
+				}
+			}
+		}
+
+		figures.numTrackedCallbacks = num;
+	}
+
+	static double getWorstInWindow (const Figures& f, const int64 currentSlot, const int numSlots) noexcept
+	{
+		float worst = 0;
+
+		for (int64 slot = jmax (currentSlot - numSlots + 1, f.latestSlot - numWindowSlots + 1, (int64) 0);
+			 slot <= f.latestSlot; ++slot)
+			worst = jmax (worst, f.slotWorstMs [slot % numWindowSlots]);
+
+		return worst;
+	}
+
+	JUCE_DECLARE_NON_COPYABLE (CallbackTimer);
+};
+
 AudioDeviceManager::AudioDeviceManager()
 	: numInputChansNeeded (0),
 	  numOutputChansNeeded (2),
 	  listNeedsScanning (true),
 	  useInputNames (false),
-	  inputLevelMeasurementEnabledCount (0),
 	  inputLevel (0),
+	  testSoundPosition (0),
 	  tempBuffer (2, 2),
 	  cpuUsageMs (0),
-	  timeToCpuScale (0)
+	  timeToCpuScale (0),
+	  callbackTimer (new CallbackTimer())
 {
 	callbackHandler.owner = this;
 }
@@ -531,6 +762,9 @@ AudioDeviceManager::~AudioDeviceManager()
 {
 	currentAudioDevice = nullptr;
 	defaultMidiOutput = nullptr;
+
+	delete activeCallbacks.exchange (nullptr);
+	setTestSound (nullptr);
 }
 
 void AudioDeviceManager::createDeviceTypesIfNeeded()
@@ -578,6 +812,27 @@ void AudioDeviceManager::createAudioDeviceTypes (OwnedArray <AudioIODeviceType>&
 	addIfNotNull (list, AudioIODeviceType::createAudioIODeviceType_JACK());
 	addIfNotNull (list, AudioIODeviceType::createAudioIODeviceType_OpenSLES());
 	addIfNotNull (list, AudioIODeviceType::createAudioIODeviceType_Android());
+
+   #if JUCE_USE_VIRTUAL_AUDIO_DEVICE
+	addIfNotNull (list, AudioIODeviceType::createAudioIODeviceType_Virtual());
+   #endif
+}
+
+void AudioDeviceManager::addAudioDeviceType (AudioIODeviceType* const newDeviceType)
+{
+	if (newDeviceType != nullptr)
+	{
+		createDeviceTypesIfNeeded();
+
+		jassert (lastDeviceTypeConfigs.size() == availableDeviceTypes.size());
+		availableDeviceTypes.add (newDeviceType);
+		lastDeviceTypeConfigs.add (new AudioDeviceSetup());
+
+		if (availableDeviceTypes.size() == 1)
+			currentDeviceType = newDeviceType->getTypeName();
+
+		newDeviceType->addListener (&callbackHandler);
+	}
 }
 
 String AudioDeviceManager::initialise (const int numInputChannelsNeeded,
@@ -963,7 +1218,7 @@ void AudioDeviceManager::stopDevice()
 	if (currentAudioDevice != nullptr)
 		currentAudioDevice->stop();
 
-	testSound = nullptr;
+	setTestSound (nullptr);
 }
 
 void AudioDeviceManager::closeAudioDevice()
@@ -1042,7 +1297,7 @@ void AudioDeviceManager::updateXml()
 void AudioDeviceManager::addAudioCallback (AudioIODeviceCallback* newCallback)
 {
 	{
-		const ScopedLock sl (audioCallbackLock);
+		const ScopedLock sl (callbackListLock);
 		if (callbacks.contains (newCallback))
 			return;
 	}
@@ -1050,8 +1305,9 @@ void AudioDeviceManager::addAudioCallback (AudioIODeviceCallback* newCallback)
 	if (currentAudioDevice != nullptr && newCallback != nullptr)
 		newCallback->audioDeviceAboutToStart (currentAudioDevice);
 
-	const ScopedLock sl (audioCallbackLock);
+	const ScopedLock sl (callbackListLock);
 	callbacks.add (newCallback);
+	publishCallbackList();
 }
 
 void AudioDeviceManager::removeAudioCallback (AudioIODeviceCallback* callbackToRemove)
@@ -1061,10 +1317,13 @@ void AudioDeviceManager::removeAudioCallback (AudioIODeviceCallback* callbackToR
 		bool needsDeinitialising = currentAudioDevice != nullptr;
 
 		{
-			const ScopedLock sl (audioCallbackLock);
+			const ScopedLock sl (callbackListLock);
 
 			needsDeinitialising = needsDeinitialising && callbacks.contains (callbackToRemove);
 			callbacks.removeValue (callbackToRemove);
+
+			// once this returns, the audio thread can't be inside the callback any more
+			publishCallbackList();
 		}
 
 		if (needsDeinitialising)
@@ -1072,15 +1331,41 @@ void AudioDeviceManager::removeAudioCallback (AudioIODeviceCallback* callbackToR
 	}
 }
 
+void AudioDeviceManager::publishCallbackList()
+{
+	// The audio thread only ever sees a complete copy of the list. The old copy gets deleted
+	// here once it has been released, so nothing is ever freed on the audio thread.
+	const ScopedPointer <const Array <AudioIODeviceCallback*> > oldList
+		(activeCallbacks.exchange (callbacks.size() > 0 ? new Array <AudioIODeviceCallback*> (callbacks) : nullptr));
+}
+
+void AudioDeviceManager::setTestSound (AudioSampleBuffer* const newSound)
+{
+	const ScopedPointer <AudioSampleBuffer> oldSound (testSound.exchange (nullptr));
+
+	// the audio thread isn't using the old sound now, so the position can be reset
+	testSoundPosition = 0;
+	testSound.exchange (newSound);
+}
+
 void AudioDeviceManager::audioDeviceIOCallbackInt (const float** inputChannelData,
 												   int numInputChannels,
 												   float** outputChannelData,
 												   int numOutputChannels,
 												   int numSamples)
 {
-	const ScopedLock sl (audioCallbackLock);
+	const double deviceCallbackStartTime = Time::getMillisecondCounterHiRes();
+
+	// Anyone holding the callback lock is relying on the callbacks not being run, but
+	// rather than waiting for them, this block is just left silent.
+	const ScopedTryLock stl (audioCallbackLock);
 
-	if (inputLevelMeasurementEnabledCount > 0 && numInputChannels > 0)
+	const AudioThreadPointer <const Array <AudioIODeviceCallback*> >::ScopedReader activeList (activeCallbacks);
+	static const Array <AudioIODeviceCallback*> noCallbacks;
+	const Array <AudioIODeviceCallback*>& callbacksToUse = (stl.isLocked() && activeList.get() != nullptr)
+															  ? *activeList.get() : noCallbacks;
+
+	if (inputLevelMeasurementEnabledCount.get() > 0 && numInputChannels > 0)
 	{
 		for (int j = 0; j < numSamples; ++j)
 		{
@@ -1106,22 +1391,28 @@ void AudioDeviceManager::audioDeviceIOCallbackInt (const float** inputChannelDat
 		inputLevel = 0;
 	}
 
-	if (callbacks.size() > 0)
+	if (callbacksToUse.size() > 0)
 	{
 		const double callbackStartTime = Time::getMillisecondCounterHiRes();
 
 		tempBuffer.setSize (jmax (1, numOutputChannels), jmax (1, numSamples), false, false, true);
 
-		callbacks.getUnchecked(0)->audioDeviceIOCallback (inputChannelData, numInputChannels,
+		callbacksToUse.getUnchecked(0)->audioDeviceIOCallback (inputChannelData, numInputChannels,
 														  outputChannelData, numOutputChannels, numSamples);
 
+		callbackTimer->addCallbackTime (0, Time::getMillisecondCounterHiRes() - callbackStartTime);
+
 		float** const tempChans = tempBuffer.getArrayOfChannels();
 
-		for (int i = callbacks.size(); --i > 0;)
+		for (int i = callbacksToUse.size(); --i > 0;)
 		{
-			callbacks.getUnchecked(i)->audioDeviceIOCallback (inputChannelData, numInputChannels,
+			const double startTime = Time::getMillisecondCounterHiRes();
+
+			callbacksToUse.getUnchecked(i)->audioDeviceIOCallback (inputChannelData, numInputChannels,
 															  tempChans, numOutputChannels, numSamples);
 
+			callbackTimer->addCallbackTime (i, Time::getMillisecondCounterHiRes() - startTime);
+
 			for (int chan = 0; chan < numOutputChannels; ++chan)
 			{
 				const float* const src = tempChans [chan];
@@ -1143,19 +1434,22 @@ void AudioDeviceManager::audioDeviceIOCallbackInt (const float** inputChannelDat
 			zeromem (outputChannelData[i], sizeof (float) * (size_t) numSamples);
 	}
 
-	if (testSound != nullptr)
+	const AudioThreadPointer <AudioSampleBuffer>::ScopedReader sound (testSound);
+
+	if (sound.get() != nullptr && testSoundPosition < sound->getNumSamples())
 	{
-		const int numSamps = jmin (numSamples, testSound->getNumSamples() - testSoundPosition);
-		const float* const src = testSound->getSampleData (0, testSoundPosition);
+		const int numSamps = jmin (numSamples, sound->getNumSamples() - testSoundPosition);
+		const float* const src = sound->getSampleData (0, testSoundPosition);
 
 		for (int i = 0; i < numOutputChannels; ++i)
 			for (int j = 0; j < numSamps; ++j)
 				outputChannelData [i][j] += src[j];
 
 		testSoundPosition += numSamps;
-		if (testSoundPosition >= testSound->getNumSamples())
-			testSound = nullptr;
 	}
+
+	callbackTimer->addDeviceCallback (callbacksToUse, numSamples, deviceCallbackStartTime,
+									  Time::getMillisecondCounterHiRes());
 }
 
 void AudioDeviceManager::audioDeviceAboutToStartInt (AudioIODevice* const device)
@@ -1171,8 +1465,10 @@ void AudioDeviceManager::audioDeviceAboutToStartInt (AudioIODevice* const device
 		timeToCpuScale = (msPerBlock > 0.0) ? (1.0 / msPerBlock) : 0.0;
 	}
 
+	callbackTimer->setSampleRate (sampleRate);
+
 	{
-		const ScopedLock sl (audioCallbackLock);
+		const ScopedLock sl (callbackListLock);
 		for (int i = callbacks.size(); --i >= 0;)
 			callbacks.getUnchecked(i)->audioDeviceAboutToStart (device);
 	}
@@ -1186,7 +1482,7 @@ void AudioDeviceManager::audioDeviceStoppedInt()
 	timeToCpuScale = 0;
 	sendChangeMessage();
 
-	const ScopedLock sl (audioCallbackLock);
+	const ScopedLock sl (callbackListLock);
 	for (int i = callbacks.size(); --i >= 0;)
 		callbacks.getUnchecked(i)->audioDeviceStopped();
 }
@@ -1196,6 +1492,18 @@ double AudioDeviceManager::getCpuUsage() const
 	return jlimit (0.0, 1.0, timeToCpuScale * cpuUsageMs);
 }
 
+AudioDeviceManager::CallbackTimingReport AudioDeviceManager::getCallbackTimingReport() const
+{
+	CallbackTimingReport report;
+	callbackTimer->fillReport (report);
+	return report;
+}
+
+void AudioDeviceManager::resetCallbackTimingReport()
+{
+	callbackTimer->requestReset();
+}
+
 void AudioDeviceManager::setMidiInputEnabled (const String& name,
 											  const bool enabled)
 {
@@ -1289,9 +1597,10 @@ void AudioDeviceManager::setDefaultMidiOutput (const String& deviceName)
 		Array <AudioIODeviceCallback*> oldCallbacks;
 
 		{
-			const ScopedLock sl (audioCallbackLock);
+			const ScopedLock sl (callbackListLock);
 			oldCallbacks = callbacks;
 			callbacks.clear();
+			publishCallbackList();
 		}
 
 		if (currentAudioDevice != nullptr)
@@ -1309,8 +1618,9 @@ void AudioDeviceManager::setDefaultMidiOutput (const String& deviceName)
 				oldCallbacks.getUnchecked(i)->audioDeviceAboutToStart (currentAudioDevice);
 
 		{
-			const ScopedLock sl (audioCallbackLock);
+			const ScopedLock sl (callbackListLock);
 			callbacks = oldCallbacks;
+			publishCallbackList();
 		}
 
 		updateXml();
@@ -1349,16 +1659,7 @@ void AudioDeviceManager::CallbackHandler::audioDeviceListChanged()
 
 void AudioDeviceManager::playTestSound()
 {
-	{ // cunningly nested to swap, unlock and delete in that order.
-		ScopedPointer <AudioSampleBuffer> oldSound;
-
-		{
-			const ScopedLock sl (audioCallbackLock);
-			oldSound = testSound;
-		}
-	}
-
-	testSoundPosition = 0;
+	setTestSound (nullptr);
 
 	if (currentAudioDevice != nullptr)
 	{
@@ -1379,15 +1680,12 @@ void AudioDeviceManager::playTestSound()
 		newSound->applyGainRamp (0, 0, soundLength / 10, 0.0f, 1.0f);
 		newSound->applyGainRamp (0, soundLength - soundLength / 4, soundLength / 4, 1.0f, 0.0f);
 
-		const ScopedLock sl (audioCallbackLock);
-		testSound = newSound;
+		setTestSound (newSound);
 	}
 }
 
 void AudioDeviceManager::enableInputLevelMeasurement (const bool enableMeasurement)
 {
-	const ScopedLock sl (audioCallbackLock);
-
 	if (enableMeasurement)
 		++inputLevelMeasurementEnabledCount;
 	else
@@ -1398,203 +1696,2206 @@ void AudioDeviceManager::enableInputLevelMeasurement (const bool enableMeasureme
 
 double AudioDeviceManager::getCurrentInputLevel() const
 {
-	jassert (inputLevelMeasurementEnabledCount > 0); // you need to call enableInputLevelMeasurement() before using this!
+	jassert (inputLevelMeasurementEnabledCount.get() > 0); // you need to call enableInputLevelMeasurement() before using this!
 	return inputLevel;
 }
 
-/*** End of inlined file: juce_AudioDeviceManager.cpp ***/
-
 
+#if JUCE_UNIT_TESTS
 
-/*** Start of inlined file: juce_AudioIODevice.cpp ***/
-AudioIODevice::AudioIODevice (const String& deviceName, const String& typeName_)
-	: name (deviceName),
-	  typeName (typeName_)
+class AudioDeviceManagerTests  : public UnitTest
 {
-}
+public:
+	AudioDeviceManagerTests() : UnitTest ("AudioDeviceManager") {}
 
-AudioIODevice::~AudioIODevice()
-{
-}
+	void runTest()
+	{
+		beginTest ("Adding and removing callbacks while running");
 
-bool AudioIODevice::hasControlPanel() const
-{
-	return false;
-}
+		AudioDeviceManager manager;
+		manager.addAudioDeviceType (new VirtualAudioIODeviceType (2, 2));
+		manager.setCurrentAudioDeviceType ("Virtual", true);
 
-bool AudioIODevice::showControlPanel()
-{
-	jassertfalse;    // this should only be called for devices which return true from
-					 // their hasControlPanel() method.
-	return false;
-}
+		AudioDeviceManager::AudioDeviceSetup setup;
+		manager.getAudioDeviceSetup (setup);
+		setup.outputDeviceName = VirtualAudioIODeviceType::freeRunningDeviceName;
+		setup.bufferSize = 64;
+		setup.sampleRate = 44100;
 
-void AudioIODeviceCallback::audioDeviceError (const String&) {}
+		expect (manager.initialise (0, 2, nullptr, false, String::empty, &setup).isEmpty());
+		expect (manager.getCurrentAudioDevice() != nullptr);
 
-/*** End of inlined file: juce_AudioIODevice.cpp ***/
+		const int numCallbacks = 8;
+		OwnedArray<CheckingCallback> callbacks;
 
+		for (int i = 0; i < numCallbacks; ++i)
+			callbacks.add (new CheckingCallback());
 
-/*** Start of inlined file: juce_AudioIODeviceType.cpp ***/
-AudioIODeviceType::AudioIODeviceType (const String& name)
-	: typeName (name)
-{
-}
+		ToneGeneratorAudioSource tone1, tone2;
+		AudioSourcePlayer player;
+		manager.addAudioCallback (&player);
 
-AudioIODeviceType::~AudioIODeviceType()
-{
-}
+		Random r (0x1234);
 
-void AudioIODeviceType::addListener (Listener* l)      { listeners.add (l); }
-void AudioIODeviceType::removeListener (Listener* l)   { listeners.remove (l); }
+		for (int i = 0; i < 2000; ++i)
+		{
+			CheckingCallback& c = *callbacks.getUnchecked (r.nextInt (numCallbacks));
 
-void AudioIODeviceType::callDeviceChangeListeners()
-{
-	listeners.call (&AudioIODeviceType::Listener::audioDeviceListChanged);
-}
+			if (c.isRegistered)
+			{
+				manager.removeAudioCallback (&c);
+				c.isRegistered = false;
+			}
+			else
+			{
+				c.isRegistered = true;
+				manager.addAudioCallback (&c);
+			}
 
-#if ! JUCE_MAC
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_CoreAudio()       { return nullptr; }
-#endif
+			if ((i & 15) == 0)
+			{
+				player.setSource ((i & 16) != 0 ? &tone1 : (r.nextBool() ? &tone2 : nullptr));
 
-#if ! JUCE_IOS
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_iOSAudio()        { return nullptr; }
-#endif
+				// give the audio thread a chance to run, even on a single core
+				Thread::sleep (1);
+			}
+		}
 
-#if ! (JUCE_WINDOWS && JUCE_WASAPI)
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_WASAPI()          { return nullptr; }
-#endif
+		for (int i = 0; i < numCallbacks; ++i)
+		{
+			manager.removeAudioCallback (callbacks.getUnchecked (i));
+			callbacks.getUnchecked (i)->isRegistered = false;
+		}
 
-#if ! (JUCE_WINDOWS && JUCE_DIRECTSOUND)
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_DirectSound()     { return nullptr; }
-#endif
+		manager.removeAudioCallback (&player);
+		player.setSource (nullptr);
+		manager.closeAudioDevice();
 
-#if ! (JUCE_WINDOWS && JUCE_ASIO)
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_ASIO()            { return nullptr; }
-#endif
+		int totalCalls = 0, totalStrayCalls = 0;
 
-#if ! (JUCE_LINUX && JUCE_ALSA)
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_ALSA()            { return nullptr; }
-#endif
+		for (int i = 0; i < numCallbacks; ++i)
+		{
+			totalCalls += callbacks.getUnchecked (i)->numCalls.get();
+			totalStrayCalls += callbacks.getUnchecked (i)->numStrayCalls.get();
+		}
 
-#if ! (JUCE_LINUX && JUCE_JACK)
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_JACK()            { return nullptr; }
-#endif
+		expect (totalCalls > 0);
+		expectEquals (totalStrayCalls, 0);
 
-#if ! JUCE_ANDROID
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_Android()         { return nullptr; }
-#endif
+		testCallbackLock();
+		testTimingReport();
+	}
 
-#if ! (JUCE_ANDROID && JUCE_USE_ANDROID_OPENSLES)
-AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_OpenSLES()        { return nullptr; }
-#endif
+private:
+	void testCallbackLock()
+	{
+		beginTest ("Holding the audio callback lock");
 
-/*** End of inlined file: juce_AudioIODeviceType.cpp ***/
+		AudioDeviceManager manager;
+		manager.addAudioDeviceType (new VirtualAudioIODeviceType (2, 2));
+		manager.setCurrentAudioDeviceType ("Virtual", true);
 
+		AudioDeviceManager::AudioDeviceSetup setup;
+		manager.getAudioDeviceSetup (setup);
+		setup.outputDeviceName = VirtualAudioIODeviceType::freeRunningDeviceName;
+		setup.bufferSize = 64;
+		setup.sampleRate = 44100;
 
-/*** Start of inlined file: juce_MidiMessageCollector.cpp ***/
-MidiMessageCollector::MidiMessageCollector()
-	: lastCallbackTime (0),
-	  sampleRate (44100.0001)
-{
-}
+		CheckingCallback callback;
+		callback.isRegistered = true;
+		manager.addAudioCallback (&callback);
+		expect (manager.initialise (0, 2, nullptr, false, String::empty, &setup).isEmpty());
 
-MidiMessageCollector::~MidiMessageCollector()
-{
-}
+		expect (waitForCalls (callback, 1));
 
-void MidiMessageCollector::reset (const double sampleRate_)
-{
-	jassert (sampleRate_ > 0);
+		{
+			const ScopedLock sl (manager.getAudioCallbackLock());
 
-	const ScopedLock sl (midiCallbackLock);
-	sampleRate = sampleRate_;
-	incomingMessages.clear();
-	lastCallbackTime = Time::getMillisecondCounterHiRes();
-}
+			// the device keeps running while the lock's held, but the callback mustn't be called
+			const int numCallsBefore = callback.numCalls.get();
+			const int64 numBlocksBefore = waitForCallbacks (manager, 0).numCallbacks;
+			Thread::sleep (50);
 
-void MidiMessageCollector::addMessageToQueue (const MidiMessage& message)
-{
-	// you need to call reset() to set the correct sample rate before using this object
-	jassert (sampleRate != 44100.0001);
+			expectEquals (callback.numCalls.get(), numCallsBefore);
+			expect (waitForCallbacks (manager, 0).numCallbacks > numBlocksBefore);
+		}
 
-	// the messages that come in here need to be time-stamped correctly - see MidiInput
-	// for details of what the number should be.
-	jassert (message.getTimeStamp() != 0);
+		expect (waitForCalls (callback, callback.numCalls.get() + 1));
 
-	const ScopedLock sl (midiCallbackLock);
+		manager.removeAudioCallback (&callback);
+		manager.closeAudioDevice();
+	}
 
-	const int sampleNumber
-		= (int) ((message.getTimeStamp() - 0.001 * lastCallbackTime) * sampleRate);
+	void testTimingReport()
+	{
+		beginTest ("Callback timing report");
 
-	incomingMessages.addEvent (message, sampleNumber);
+		AudioDeviceManager manager;
+		manager.addAudioDeviceType (new VirtualAudioIODeviceType (2, 2));
+		manager.setCurrentAudioDeviceType ("Virtual", true);
 
-	// if the messages don't get used for over a second, we'd better
-	// get rid of any old ones to avoid the queue getting too big
-	if (sampleNumber > sampleRate)
-		incomingMessages.clear (0, sampleNumber - (int) sampleRate);
-}
+		AudioDeviceManager::AudioDeviceSetup setup;
+		manager.getAudioDeviceSetup (setup);
+		setup.outputDeviceName = VirtualAudioIODeviceType::freeRunningDeviceName;
+		setup.bufferSize = 64;
+		setup.sampleRate = 44100;
 
-void MidiMessageCollector::removeNextBlockOfMessages (MidiBuffer& destBuffer,
-													  const int numSamples)
-{
-	// you need to call reset() to set the correct sample rate before using this object
-	jassert (sampleRate != 44100.0001);
+		// each block lasts about 1.45ms, so a callback that takes 3ms misses every deadline
+		SlowCallback slow (3.0);
+		CheckingCallback quick;
+		quick.isRegistered = true;
 
-	const double timeNow = Time::getMillisecondCounterHiRes();
-	const double msElapsed = timeNow - lastCallbackTime;
+		// (these are added before the device starts, so that every block is run through both)
+		manager.addAudioCallback (&slow);
+		manager.addAudioCallback (&quick);
 
-	const ScopedLock sl (midiCallbackLock);
-	lastCallbackTime = timeNow;
+		expect (manager.initialise (0, 2, nullptr, false, String::empty, &setup).isEmpty());
 
-	if (! incomingMessages.isEmpty())
-	{
-		int numSourceSamples = jmax (1, roundToInt (msElapsed * 0.001 * sampleRate));
+		AudioDeviceManager::CallbackTimingReport report (waitForCallbacks (manager, 20));
+		expect (report.numCallbacks >= 20);
+		expectEquals (report.blockDurationMs, 1000.0 * 64 / 44100);
+		expect (report.numMissedDeadlines == report.numCallbacks);
+		expect (report.meanMs >= 3.0 && report.worstMs >= report.meanMs);
+		expect (report.worstMsInLastSecond >= 3.0);
+		expect (report.worstMsInLastMinute >= report.worstMsInLastSecond);
 
-		int startSample = 0;
-		int scale = 1 << 16;
+		int64 totalInHistogram = 0;
+		for (int i = 0; i < AudioDeviceManager::CallbackTimingReport::numHistogramBins; ++i)
+			totalInHistogram += report.histogram[i];
 
-		const uint8* midiData;
-		int numBytes, samplePosition;
+		expect (totalInHistogram == report.numCallbacks);
+		expect (report.histogram [AudioDeviceManager::CallbackTimingReport::numHistogramBins - 1] == report.numCallbacks);
 
-		MidiBuffer::Iterator iter (incomingMessages);
+		expectEquals (report.callbackTimes.size(), 2);
 
-		if (numSourceSamples > numSamples)
+		if (report.callbackTimes.size() == 2)
 		{
-			// if our list of events is longer than the buffer we're being
-			// asked for, scale them down to squeeze them all in..
-			const int maxBlockLengthToUse = numSamples << 5;
+			const AudioDeviceManager::CallbackTimingReport::CallbackTime& s = report.callbackTimes.getReference (0);
+			const AudioDeviceManager::CallbackTimingReport::CallbackTime& q = report.callbackTimes.getReference (1);
 
-			if (numSourceSamples > maxBlockLengthToUse)
-			{
-				startSample = numSourceSamples - maxBlockLengthToUse;
-				numSourceSamples = maxBlockLengthToUse;
-				iter.setNextSamplePosition (startSample);
-			}
+			expect (s.callback == &slow && q.callback == &quick);
+			expect (s.numCalls > 0 && s.meanMs >= 3.0 && s.worstMs >= s.meanMs);
+			expect (q.numCalls > 0 && q.meanMs < s.meanMs);
+		}
 
-			scale = (numSamples << 10) / numSourceSamples;
+		beginTest ("Resetting the callback timing report");
 
-			while (iter.getNextEvent (midiData, numBytes, samplePosition))
+		// every block so far has missed its deadline, but once the slow callback has gone,
+		// hardly any should, so the count only drops if the old figures have been cleared
+		const int64 numMissedBeforeReset = report.numMissedDeadlines;
+		manager.removeAudioCallback (&slow);
+		manager.resetCallbackTimingReport();
+
+		const uint32 timeout = Time::getMillisecondCounter() + 5000;
+
+		do
+		{
+			Thread::sleep (1);
+			report = manager.getCallbackTimingReport();
+		}
+		while ((report.numCallbacks == 0 || report.numMissedDeadlines >= numMissedBeforeReset)
+				 && Time::getMillisecondCounter() < timeout);
+
+		expect (report.numCallbacks > 0 && report.numMissedDeadlines < numMissedBeforeReset);
+		expectEquals (report.callbackTimes.size(), 1);
+
+		if (report.callbackTimes.size() == 1)
+			expect (report.callbackTimes.getReference (0).callback == &quick);
+
+		manager.removeAudioCallback (&quick);
+		manager.closeAudioDevice();
+	}
+
+	static AudioDeviceManager::CallbackTimingReport waitForCallbacks (AudioDeviceManager& manager, const int num)
+	{
+		const uint32 timeout = Time::getMillisecondCounter() + 5000;
+		AudioDeviceManager::CallbackTimingReport report (manager.getCallbackTimingReport());
+
+		while (report.numCallbacks < num && Time::getMillisecondCounter() < timeout)
+		{
+			Thread::sleep (1);
+			report = manager.getCallbackTimingReport();
+		}
+
+		return report;
+	}
+
+	// Takes a fixed amount of time over each callback.
+	struct SlowCallback  : public AudioIODeviceCallback
+	{
+		SlowCallback (const double ms) : durationMs (ms) {}
+
+		void audioDeviceIOCallback (const float**, int, float**, int, int)
+		{
+			const double endTime = Time::getMillisecondCounterHiRes() + durationMs;
+
+			while (Time::getMillisecondCounterHiRes() < endTime)
+			{}
+		}
+
+		void audioDeviceAboutToStart (AudioIODevice*) {}
+		void audioDeviceStopped() {}
+
+		const double durationMs;
+	};
+
+	// Counts any calls that arrive when it isn't supposed to be registered.
+	struct CheckingCallback  : public AudioIODeviceCallback
+	{
+		CheckingCallback() : isRegistered (false) {}
+
+		void audioDeviceIOCallback (const float**, int, float**, int, int)
+		{
+			++numCalls;
+
+			if (! isRegistered)
+				++numStrayCalls;
+		}
+
+		void audioDeviceAboutToStart (AudioIODevice*) {}
+		void audioDeviceStopped() {}
+
+		volatile bool isRegistered;
+		Atomic<int> numCalls, numStrayCalls;
+	};
+
+	static bool waitForCalls (CheckingCallback& callback, const int num)
+	{
+		const uint32 timeout = Time::getMillisecondCounter() + 5000;
+
+		while (callback.numCalls.get() < num && Time::getMillisecondCounter() < timeout)
+			Thread::sleep (1);
+
+		return callback.numCalls.get() >= num;
+	}
+};
+
+static AudioDeviceManagerTests audioDeviceManagerTests;
+
+#endif
+
+/*** End of inlined file: juce_AudioDeviceManager.cpp ***/
+
+
+
+/*** Start of inlined file: juce_AudioIODevice.cpp ***/
+AudioIODevice::AudioIODevice (const String& deviceName, const String& typeName_)
+	: name (deviceName),
+	  typeName (typeName_)
+{
+}
+
+AudioIODevice::~AudioIODevice()
+{
+}
+
+bool AudioIODevice::hasControlPanel() const
+{
+	return false;
+}
+
+bool AudioIODevice::showControlPanel()
+{
+	jassertfalse;    // this should only be called for devices which return true from
+					 // their hasControlPanel() method.
+	return false;
+}
+
+int AudioIODevice::getXRunCount() const noexcept
+{
+	return -1;
+}
+
+AudioIODevice::CallbackTimingStatistics AudioIODevice::getCallbackTimingStatistics() const
+{
+	return CallbackTimingStatistics();
+}
+
+AudioPlayHead* AudioIODevice::getPlayHead()
+{
+	return nullptr;
+}
+
+AudioIODevice::CallbackTimingStatistics::CallbackTimingStatistics() noexcept
+	: numIntervals (0), minimumIntervalMs (0), maximumIntervalMs (0),
+	  totalMs (0), totalSquaredMs (0)
+{
+}
+
+void AudioIODevice::CallbackTimingStatistics::addInterval (const double intervalMs) noexcept
+{
+	if (numIntervals == 0)
+	{
+		minimumIntervalMs = intervalMs;
+		maximumIntervalMs = intervalMs;
+	}
+	else
+	{
+		minimumIntervalMs = jmin (minimumIntervalMs, intervalMs);
+		maximumIntervalMs = jmax (maximumIntervalMs, intervalMs);
+	}
+
+	++numIntervals;
+	totalMs += intervalMs;
+	totalSquaredMs += intervalMs * intervalMs;
+}
+
+double AudioIODevice::CallbackTimingStatistics::getMeanIntervalMs() const noexcept
+{
+	return numIntervals > 0 ? totalMs / (double) numIntervals : 0.0;
+}
+
+double AudioIODevice::CallbackTimingStatistics::getJitterMs() const noexcept
+{
+	if (numIntervals < 2)
+		return 0.0;
+
+	const double mean = getMeanIntervalMs();
+	return std::sqrt (jmax (0.0, totalSquaredMs / (double) numIntervals - mean * mean));
+}
+
+void AudioIODeviceCallback::audioDeviceError (const String&) {}
+
+/*** End of inlined file: juce_AudioIODevice.cpp ***/
+
+
+/*** Start of inlined file: juce_AudioIODeviceType.cpp ***/
+AudioIODeviceType::AudioIODeviceType (const String& name)
+	: typeName (name)
+{
+}
+
+AudioIODeviceType::~AudioIODeviceType()
+{
+}
+
+void AudioIODeviceType::addListener (Listener* l)      { listeners.add (l); }
+void AudioIODeviceType::removeListener (Listener* l)   { listeners.remove (l); }
+
+void AudioIODeviceType::callDeviceChangeListeners()
+{
+	listeners.call (&AudioIODeviceType::Listener::audioDeviceListChanged);
+}
+
+#if ! JUCE_MAC
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_CoreAudio()       { return nullptr; }
+#endif
+
+#if ! JUCE_IOS
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_iOSAudio()        { return nullptr; }
+#endif
+
+#if ! (JUCE_WINDOWS && JUCE_WASAPI)
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_WASAPI()          { return nullptr; }
+#endif
+
+#if ! (JUCE_WINDOWS && JUCE_DIRECTSOUND)
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_DirectSound()     { return nullptr; }
+#endif
+
+#if ! (JUCE_WINDOWS && JUCE_ASIO)
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_ASIO()            { return nullptr; }
+#endif
+
+#if ! (JUCE_LINUX && JUCE_ALSA)
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_ALSA()            { return nullptr; }
+#endif
+
+#if ! (JUCE_LINUX && JUCE_JACK)
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_JACK()            { return nullptr; }
+#endif
+
+#if ! JUCE_ANDROID
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_Android()         { return nullptr; }
+#endif
+
+#if ! (JUCE_ANDROID && JUCE_USE_ANDROID_OPENSLES)
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_OpenSLES()        { return nullptr; }
+#endif
+
+/*** End of inlined file: juce_AudioIODeviceType.cpp ***/
+
+/*** Start of inlined file: juce_VirtualAudioIODevice.cpp ***/
+VirtualAudioIODevice::TimingStatistics::TimingStatistics() noexcept
+	: numCallbacks (0), numLateCallbacks (0),
+	  minimumSlackMs (0), averageSlackMs (0), maximumCallbackMs (0)
+{
+}
+
+VirtualAudioIODevice::VirtualAudioIODevice (const String& deviceName, const bool runInRealTime,
+											const int numInputChannels, const int numOutputChannels)
+	: AudioIODevice (deviceName, "Virtual"),
+	  Thread ("Virtual audio device"),
+	  realTime (runInRealTime),
+	  numInputs (jmax (0, numInputChannels)),
+	  numOutputs (jmax (0, numOutputChannels)),
+	  deviceIsOpen (false),
+	  sampleRate (44100.0),
+	  clockSpeed (1.0),
+	  bufferSize (512),
+	  inputBuffer (1, 1),
+	  outputBuffer (1, 1),
+	  samplePosition (0),
+	  callback (nullptr),
+	  readerChannels ((size_t) numInputs + 1),
+	  writerChannels (1),
+	  inputReaderPosition (0),
+	  measurementFifo (measurementFifoSize),
+	  measurements ((size_t) measurementFifoSize),
+	  totalSlackMs (0),
+	  lastCallbackTime (0),
+	  slackLog ((size_t) slackLogSize),
+	  slackLogPosition (0)
+{
+}
+
+VirtualAudioIODevice::~VirtualAudioIODevice()
+{
+	close();
+}
+
+//==============================================================================
+void VirtualAudioIODevice::setInputReader (AudioFormatReader* const reader, const bool deleteReaderWhenRemoved)
+{
+	OptionalScopedPointer<AudioFormatReader> newReader (reader, deleteReaderWhenRemoved);
+
+	const SpinLock::ScopedLockType sl (sourceLock);
+	inputReader.swapWith (newReader);
+	inputReaderPosition = 0;
+}
+
+void VirtualAudioIODevice::setClockSpeed (const double speedRatio) noexcept
+{
+	jassert (speedRatio > 0);
+	clockSpeed = speedRatio;
+}
+
+void VirtualAudioIODevice::setOutputWriter (AudioFormatWriter* const writer, const bool deleteWriterWhenRemoved)
+{
+	OptionalScopedPointer<AudioFormatWriter> newWriter (writer, deleteWriterWhenRemoved);
+	HeapBlock<float*> newChannels ((size_t) (writer != nullptr ? writer->getNumChannels() : 0) + 1);
+
+	// (the old writer gets deleted after the lock has been released)
+	const SpinLock::ScopedLockType sl (sourceLock);
+	outputWriter.swapWith (newWriter);
+	writerChannels.swapWith (newChannels);
+}
+
+VirtualAudioIODevice::TimingStatistics VirtualAudioIODevice::getTimingStatistics() const
+{
+	const SpinLock::ScopedLockType sl (statsLock);
+	TimingStatistics s (stats);
+
+	if (s.numCallbacks > 0)
+		s.averageSlackMs = totalSlackMs / (double) s.numCallbacks;
+
+	return s;
+}
+
+void VirtualAudioIODevice::resetTimingStatistics()
+{
+	const SpinLock::ScopedLockType sl (statsLock);
+	measurementFifo.finishedRead (measurementFifo.getNumReady());
+	stats = TimingStatistics();
+	intervals = CallbackTimingStatistics();
+	totalSlackMs = 0;
+	lastCallbackTime = 0;
+	slackLogPosition = 0;
+}
+
+void VirtualAudioIODevice::getSlackLog (Array<float>& slackValuesMs) const
+{
+	slackValuesMs.clearQuick();
+	slackValuesMs.ensureStorageAllocated ((int) slackLogSize);
+
+	const SpinLock::ScopedLockType sl (statsLock);
+	const int numStored = (int) jmin (stats.numCallbacks, (int64) slackLogSize);
+
+	for (int i = slackLogPosition - numStored; i < slackLogPosition; ++i)
+		slackValuesMs.add (slackLog [(i + slackLogSize) % slackLogSize]);
+}
+
+int VirtualAudioIODevice::getXRunCount() const noexcept
+{
+	const SpinLock::ScopedLockType sl (statsLock);
+	return (int) stats.numLateCallbacks;
+}
+
+AudioIODevice::CallbackTimingStatistics VirtualAudioIODevice::getCallbackTimingStatistics() const
+{
+	const SpinLock::ScopedLockType sl (statsLock);
+	return intervals;
+}
+
+// This is called on the device thread, so instead of waiting for the lock, it queues the
+// figures, and only adds them to the statistics if no other thread is reading them.
+void VirtualAudioIODevice::addTimingMeasurement (const double callbackStartTime, const double slackMs, const double callbackMs)
+{
+	int start1, size1, start2, size2;
+	measurementFifo.prepareToWrite (1, start1, size1, start2, size2);
+
+	if (size1 + size2 > 0)
+	{
+		Measurement& m = measurements [size1 > 0 ? start1 : start2];
+		m.callbackStartTime = callbackStartTime;
+		m.slackMs = slackMs;
+		m.callbackMs = callbackMs;
+		measurementFifo.finishedWrite (1);
+	}
+
+	const GenericScopedTryLock<SpinLock> sl (statsLock);
+
+	if (sl.isLocked())
+		collectTimingMeasurements();
+}
+
+// (the caller must hold the statsLock)
+void VirtualAudioIODevice::collectTimingMeasurements()
+{
+	int start1, size1, start2, size2;
+	measurementFifo.prepareToRead (measurementFifo.getNumReady(), start1, size1, start2, size2);
+
+	for (int i = 0; i < size1 + size2; ++i)
+	{
+		const Measurement& m = measurements [i < size1 ? start1 + i : start2 + i - size1];
+
+		if (lastCallbackTime > 0)
+			intervals.addInterval (m.callbackStartTime - lastCallbackTime);
+
+		lastCallbackTime = m.callbackStartTime;
+
+		if (stats.numCallbacks == 0 || m.slackMs < stats.minimumSlackMs)
+			stats.minimumSlackMs = m.slackMs;
+
+		stats.maximumCallbackMs = jmax (stats.maximumCallbackMs, m.callbackMs);
+
+		if (m.slackMs < 0)
+			++stats.numLateCallbacks;
+
+		++stats.numCallbacks;
+		totalSlackMs += m.slackMs;
+
+		slackLog [slackLogPosition] = (float) m.slackMs;
+		slackLogPosition = (slackLogPosition + 1) % slackLogSize;
+	}
+
+	measurementFifo.finishedRead (size1 + size2);
+}
+
+//==============================================================================
+StringArray VirtualAudioIODevice::getOutputChannelNames()
+{
+	StringArray s;
+
+	for (int i = 0; i < numOutputs; ++i)
+		s.add ("Output " + String (i + 1));
+
+	return s;
+}
+
+StringArray VirtualAudioIODevice::getInputChannelNames()
+{
+	StringArray s;
+
+	for (int i = 0; i < numInputs; ++i)
+		s.add ("Input " + String (i + 1));
+
+	return s;
+}
+
+namespace
+{
+	const int virtualDeviceSampleRates[] = { 22050, 32000, 44100, 48000, 88200, 96000, 176400, 192000 };
+}
+
+int VirtualAudioIODevice::getNumSampleRates()               { return numElementsInArray (virtualDeviceSampleRates); }
+double VirtualAudioIODevice::getSampleRate (int index)      { return virtualDeviceSampleRates [jlimit (0, getNumSampleRates() - 1, index)]; }
+int VirtualAudioIODevice::getNumBufferSizesAvailable()      { return 9; }
+int VirtualAudioIODevice::getBufferSizeSamples (int index)  { return 16 << jlimit (0, 8, index); }
+int VirtualAudioIODevice::getDefaultBufferSize()            { return 512; }
+
+String VirtualAudioIODevice::open (const BigInteger& inputChannels, const BigInteger& outputChannels,
+								   double newSampleRate, int newBufferSize)
+{
+	close();
+
+	sampleRate = newSampleRate > 0 ? newSampleRate : 44100.0;
+	bufferSize = newBufferSize > 0 ? newBufferSize : getDefaultBufferSize();
+
+	activeInputs = inputChannels;
+	activeInputs.setRange (numInputs, jmax (0, activeInputs.getHighestBit() + 1 - numInputs), false);
+	activeOutputs = outputChannels;
+	activeOutputs.setRange (numOutputs, jmax (0, activeOutputs.getHighestBit() + 1 - numOutputs), false);
+
+	// (the output buffer has an extra silent channel which is used for padding when
+	// the output is being recorded by a writer with more channels than the device)
+	inputBuffer.setSize (jmax (1, numInputs), bufferSize);
+	outputBuffer.setSize (numOutputs + 1, bufferSize);
+	inputBuffer.clear();
+	outputBuffer.clear();
+
+	inputPointers.clearQuick();
+	outputPointers.clearQuick();
+
+	for (int i = 0; i < numInputs; ++i)
+		if (activeInputs [i])
+			inputPointers.add (inputBuffer.getSampleData (i));
+
+	for (int i = 0; i < numOutputs; ++i)
+		if (activeOutputs [i])
+			outputPointers.add (outputBuffer.getSampleData (i));
+
+	samplePosition = 0;
+	resetTimingStatistics();
+	deviceIsOpen = true;
+	return String::empty;
+}
+
+void VirtualAudioIODevice::close()
+{
+	stop();
+	deviceIsOpen = false;
+}
+
+bool VirtualAudioIODevice::isOpen()                                 { return deviceIsOpen; }
+bool VirtualAudioIODevice::isPlaying()                              { return callback != nullptr; }
+String VirtualAudioIODevice::getLastError()                         { return String::empty; }
+int VirtualAudioIODevice::getCurrentBufferSizeSamples()             { return bufferSize; }
+double VirtualAudioIODevice::getCurrentSampleRate()                 { return sampleRate; }
+int VirtualAudioIODevice::getCurrentBitDepth()                      { return 32; }
+BigInteger VirtualAudioIODevice::getActiveOutputChannels() const    { return activeOutputs; }
+BigInteger VirtualAudioIODevice::getActiveInputChannels() const     { return activeInputs; }
+int VirtualAudioIODevice::getOutputLatencyInSamples()               { return bufferSize; }
+int VirtualAudioIODevice::getInputLatencyInSamples()                { return bufferSize; }
+
+void VirtualAudioIODevice::start (AudioIODeviceCallback* newCallback)
+{
+	if (! deviceIsOpen)
+		newCallback = nullptr;
+
+	if (newCallback != callback)
+	{
+		stop();
+
+		if (newCallback != nullptr)
+		{
+			newCallback->audioDeviceAboutToStart (this);
+
+			// (the device thread isn't running, so this doesn't need a lock)
+			callback = newCallback;
+			startThread (realTime ? 9 : 5);
+		}
+	}
+}
+
+void VirtualAudioIODevice::stop()
+{
+	stopThread (5000);
+
+	{
+		// pick up any measurements that the device thread couldn't add
+		const SpinLock::ScopedLockType sl (statsLock);
+		collectTimingMeasurements();
+	}
+
+	AudioIODeviceCallback* const oldCallback = callback;
+	callback = nullptr;
+
+	if (oldCallback != nullptr)
+		oldCallback->audioDeviceStopped();
+}
+
+//==============================================================================
+void VirtualAudioIODevice::run()
+{
+	const double blockLengthMs = 1000.0 * bufferSize / (sampleRate * clockSpeed);
+	double blockStartTime = Time::getMillisecondCounterHiRes();
+
+	readInput();
+
+	while (! threadShouldExit())
+	{
+		// A real device would need this block to be finished by the time the next one
+		// starts, so that's the deadline against which the slack is measured.
+		const double deadline = blockStartTime + blockLengthMs;
+		const double callbackStartTime = Time::getMillisecondCounterHiRes();
+
+		processBlock();
+
+		const double callbackEndTime = Time::getMillisecondCounterHiRes();
+		addTimingMeasurement (callbackStartTime, deadline - callbackEndTime, callbackEndTime - callbackStartTime);
+
+		writeOutput();
+		readInput();
+
+		if (realTime)
+		{
+			// if the deadline was missed, a real device would have dropped the block and
+			// carried on from the current time, so the clock does the same.
+			blockStartTime = jmax (deadline, callbackEndTime);
+
+			for (;;)
+			{
+				const double msToWait = blockStartTime - Time::getMillisecondCounterHiRes();
+
+				if (msToWait <= 0 || threadShouldExit())
+					break;
+
+				if (msToWait > 2.0)
+					wait ((int) (msToWait - 1.0));
+				else
+					Thread::yield();
+			}
+		}
+		else
+		{
+			blockStartTime = Time::getMillisecondCounterHiRes();
+		}
+	}
+}
+
+void VirtualAudioIODevice::processBlock()
+{
+	if (callback != nullptr)
+		callback->audioDeviceIOCallback (inputPointers.getRawDataPointer(), inputPointers.size(),
+										 outputPointers.getRawDataPointer(), outputPointers.size(),
+										 bufferSize);
+
+	samplePosition += bufferSize;
+}
+
+void VirtualAudioIODevice::readInput()
+{
+	inputBuffer.clear();
+
+	// (if another thread is busy changing the reader, this block is left silent)
+	const GenericScopedTryLock<SpinLock> sl (sourceLock);
+
+	if (! sl.isLocked() || inputReader == nullptr || inputReader->lengthInSamples <= 0 || numInputs == 0)
+		return;
+
+	const int64 readerLength = inputReader->lengthInSamples;
+	int** const chans = readerChannels;
+	chans [numInputs] = nullptr;
+
+	for (int done = 0; done < bufferSize;)
+	{
+		if (inputReaderPosition >= readerLength)
+			inputReaderPosition = 0;
+
+		const int numThisTime = (int) jmin ((int64) (bufferSize - done), readerLength - inputReaderPosition);
+
+		for (int i = 0; i < numInputs; ++i)
+			chans[i] = reinterpret_cast<int*> (inputBuffer.getSampleData (i, done));
+
+		inputReader->read (chans, numInputs, inputReaderPosition, numThisTime, true);
+
+		if (! inputReader->usesFloatingPointData)
+			for (int i = 0; i < numInputs; ++i)
+				FloatVectorOperations::convertFixedToFloat (reinterpret_cast<float*> (chans[i]), chans[i],
+															1.0f / 0x7fffffff, numThisTime);
+
+		inputReaderPosition += numThisTime;
+		done += numThisTime;
+	}
+}
+
+void VirtualAudioIODevice::writeOutput()
+{
+	const GenericScopedTryLock<SpinLock> sl (sourceLock);
+
+	if (sl.isLocked() && outputWriter != nullptr)
+	{
+		const int numWriterChannels = outputWriter->getNumChannels();
+		float** const chans = writerChannels;
+
+		for (int i = 0; i < numWriterChannels; ++i)
+			chans[i] = outputBuffer.getSampleData (jmin (i, numOutputs));
+
+		const AudioSampleBuffer buffer (chans, numWriterChannels, bufferSize);
+		outputWriter->writeFromAudioSampleBuffer (buffer, 0, bufferSize);
+	}
+}
+
+//==============================================================================
+const char* const VirtualAudioIODeviceType::realTimeDeviceName = "Virtual Device (real-time)";
+const char* const VirtualAudioIODeviceType::freeRunningDeviceName = "Virtual Device (as fast as possible)";
+
+VirtualAudioIODeviceType::VirtualAudioIODeviceType (const int numInputChannels, const int numOutputChannels)
+	: AudioIODeviceType ("Virtual"),
+	  numInputs (numInputChannels),
+	  numOutputs (numOutputChannels)
+{
+}
+
+VirtualAudioIODeviceType::~VirtualAudioIODeviceType()
+{
+}
+
+void VirtualAudioIODeviceType::scanForDevices()
+{
+}
+
+StringArray VirtualAudioIODeviceType::getDeviceNames (bool) const
+{
+	StringArray s;
+	s.add (realTimeDeviceName);
+	s.add (freeRunningDeviceName);
+	return s;
+}
+
+int VirtualAudioIODeviceType::getDefaultDeviceIndex (bool) const
+{
+	return 0;
+}
+
+int VirtualAudioIODeviceType::getIndexOfDevice (AudioIODevice* device, bool) const
+{
+	const VirtualAudioIODevice* const d = dynamic_cast <VirtualAudioIODevice*> (device);
+
+	if (d == nullptr)
+		return -1;
+
+	return d->isRunningInRealTime() ? 0 : 1;
+}
+
+bool VirtualAudioIODeviceType::hasSeparateInputsAndOutputs() const
+{
+	return false;
+}
+
+AudioIODevice* VirtualAudioIODeviceType::createDevice (const String& outputDeviceName, const String& inputDeviceName)
+{
+	const String name (outputDeviceName.isNotEmpty() ? outputDeviceName : inputDeviceName);
+	const int index = getDeviceNames (false).indexOf (name);
+
+	if (index < 0)
+		return nullptr;
+
+	return new VirtualAudioIODevice (name, index == 0, numInputs, numOutputs);
+}
+
+AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_Virtual()
+{
+	return new VirtualAudioIODeviceType();
+}
+
+/*** End of inlined file: juce_VirtualAudioIODevice.cpp ***/
+
+/*** Start of inlined file: juce_AggregateAudioIODevice.cpp ***/
+namespace AggregateDeviceHelpers
+{
+	/*  A windowed-sinc interpolator for audio whose rate differs from the output's by
+		a small ratio that may change from one block to the next.
+
+		Input is appended with getWritePointer() and advanceWritePosition(), and read()
+		then produces as many output samples as it can from what's been buffered.
+
+		The nominalRatio is the number of input samples that read() will usually step
+		through for each output sample. When it's above 1, the filter's cut-off is lowered
+		to match the output's nyquist, so that the input's top octave doesn't alias.
+	*/
+	class Resampler
+	{
+	public:
+		Resampler (const int numChannels_, const int maxInputSamples, const double nominalRatio = 1.0)
+			: numChannels (numChannels_),
+			  capacity (maxInputSamples + numTaps + 2),
+			  buffer ((size_t) (jmax (1, numChannels_) * capacity)),
+			  kernel ((size_t) ((numPhases + 1) * numTaps))
+		{
+			// (the cut-off is a little below nyquist, to leave room for the window's transition band)
+			const double cutoff = 0.9 * jmin (1.0, 1.0 / nominalRatio);
+
+			for (int phase = 0; phase <= numPhases; ++phase)
+			{
+				float* const k = kernel + phase * numTaps;
+				double total = 0;
+
+				for (int i = 0; i < numTaps; ++i)
+				{
+					const double x = i - halfTaps + 1 - phase / (double) numPhases;
+					const double w = x / halfTaps;
+					const double window = std::abs (w) >= 1.0 ? 0.0
+															  : 0.42 + 0.5 * std::cos (double_Pi * w) + 0.08 * std::cos (2.0 * double_Pi * w);
+					const double sinc = x == 0 ? 1.0 : std::sin (double_Pi * cutoff * x) / (double_Pi * cutoff * x);
+
+					k[i] = (float) (sinc * window);
+					total += k[i];
+				}
+
+				// (normalising each phase keeps the gain at unity, whatever the cut-off)
+				for (int i = 0; i < numTaps; ++i)
+					k[i] = (float) (k[i] / total);
+			}
+
+			reset();
+		}
+
+		void reset() noexcept
+		{
+			// starts with enough silence that the first output sample is the first input sample
+			buffer.clear ((size_t) (jmax (1, numChannels) * capacity));
+			numBuffered = halfTaps - 1;
+			position = halfTaps - 1;
+		}
+
+		// Returns the number of input samples that must be added before read() can produce numOutputSamples.
+		int getNumInputSamplesNeeded (const int numOutputSamples, const double ratio) const noexcept
+		{
+			return jmax (0, (int) (position + (numOutputSamples - 1) * ratio) + halfTaps + 1 - numBuffered);
+		}
+
+		int getFreeSpace() const noexcept                       { return capacity - numBuffered; }
+		float* getWritePointer (const int channel) noexcept     { return buffer + channel * capacity + numBuffered; }
+
+		void advanceWritePosition (const int numSamples) noexcept
+		{
+			jassert (numSamples <= getFreeSpace());
+			numBuffered += numSamples;
+		}
+
+		// Returns how far the read position is behind the end of the buffered input.
+		double getNumSamplesBuffered() const noexcept           { return numBuffered - position; }
+
+		// Produces up to maxOutputSamples, stepping through the input by ratio for each one.
+		int read (float* const* dest, const int maxOutputSamples, const double ratio) noexcept
+		{
+			int numDone = 0;
+
+			for (; numDone < maxOutputSamples; ++numDone)
+			{
+				const int index = (int) position;
+
+				if (index + halfTaps >= numBuffered)
+					break;
+
+				const double phase = (position - index) * numPhases;
+				const int phaseIndex = (int) phase;
+				const float alpha = (float) (phase - phaseIndex);
+				const float* const k1 = kernel + phaseIndex * numTaps;
+				const float* const k2 = k1 + numTaps;
+
+				for (int ch = 0; ch < numChannels; ++ch)
+				{
+					const float* const src = buffer + ch * capacity + index - halfTaps + 1;
+					float a = 0, b = 0;
+
+					for (int i = 0; i < numTaps; ++i)
+					{
+						a += src[i] * k1[i];
+						b += src[i] * k2[i];
+					}
+
+					dest[ch][numDone] = a + alpha * (b - a);
+				}
+
+				position += ratio;
+			}
+
+			const int numToDiscard = jmin (numBuffered, (int) position - halfTaps + 1);
+
+			if (numToDiscard > 0)
+			{
+				for (int ch = 0; ch < numChannels; ++ch)
+					memmove (buffer + ch * capacity, buffer + ch * capacity + numToDiscard,
+							 sizeof (float) * (size_t) (numBuffered - numToDiscard));
+
+				numBuffered -= numToDiscard;
+				position -= numToDiscard;
+			}
+
+			return numDone;
+		}
+
+		enum { halfTaps = 8, numTaps = halfTaps * 2, numPhases = 128 };
+
+	private:
+		const int numChannels, capacity;
+		HeapBlock<float> buffer, kernel;
+		int numBuffered;
+		double position;
+
+		JUCE_DECLARE_NON_COPYABLE (Resampler);
+	};
+
+	// Copies between a set of channels and a FIFO's storage, which has one block of fifoSize samples per channel.
+	void copyToFifo (float* const fifoData, const int fifoSize, const int numChannels,
+					 const float* const* source, const int numSourceChannels, const int sourceOffset,
+					 const int fifoStart, const int numSamples) noexcept
+	{
+		for (int ch = 0; ch < numChannels; ++ch)
+		{
+			float* const dest = fifoData + ch * fifoSize + fifoStart;
+
+			if (ch < numSourceChannels && source[ch] != nullptr)
+				memcpy (dest, source[ch] + sourceOffset, sizeof (float) * (size_t) numSamples);
+			else
+				zeromem (dest, sizeof (float) * (size_t) numSamples);
+		}
+	}
+
+	void copyFromFifo (const float* const fifoData, const int fifoSize, const int numChannels,
+					   float* const* dest, const int destOffset, const int fifoStart, const int numSamples) noexcept
+	{
+		for (int ch = 0; ch < numChannels; ++ch)
+			memcpy (dest[ch] + destOffset, fifoData + ch * fifoSize + fifoStart, sizeof (float) * (size_t) numSamples);
+	}
+}
+
+//==============================================================================
+/*  Each device apart from the master has one of these, which is its callback.
+
+	On the device's own thread, the callback just moves data between the device and a
+	pair of FIFOs. All the resampling is done on the master's thread, which also watches
+	how full the FIFOs are, relative to an estimate of where the device's clock has got
+	to, and adjusts the resampling ratio with a PI controller to hold that steady.
+*/
+class AggregateAudioIODevice::Slave  : public AudioIODeviceCallback
+{
+public:
+	Slave (AudioIODevice& device_, const int deviceIndex_,
+		   const int numInputs_, const int numOutputs_,
+		   const double masterSampleRate, const int masterBlockSize)
+		: device (device_),
+		  deviceIndex (deviceIndex_),
+		  numInputs (numInputs_),
+		  numOutputs (numOutputs_),
+		  sampleRate (device_.getCurrentSampleRate()),
+		  masterRate (masterSampleRate),
+		  nominalRatio (sampleRate / masterSampleRate),
+		  maxMasterBlock (masterBlockSize * 2),
+		  targetLevel (2 * (device_.getCurrentBufferSizeSamples() + roundToInt (masterBlockSize * nominalRatio))
+						 + AggregateDeviceHelpers::Resampler::numTaps),
+		  fifoSize (4 * targetLevel + 2 * maxMasterBlock),
+		  inputFifo (fifoSize),
+		  outputFifo (fifoSize),
+		  inputFifoData ((size_t) (jmax (1, numInputs) * fifoSize)),
+		  outputFifoData ((size_t) (jmax (1, numOutputs) * fifoSize)),
+		  inputResampler (numInputs, roundToInt (maxMasterBlock * nominalRatio * 2) + 32, nominalRatio),
+		  outputResampler (numOutputs, maxMasterBlock, 1.0 / nominalRatio),
+		  inputBlock (jmax (1, numInputs), maxMasterBlock),
+		  outputBlock (jmax (1, numOutputs), maxMasterBlock),
+		  resampledOutput (jmax (1, numOutputs), roundToInt (maxMasterBlock * nominalRatio * 2) + 32)
+	{
+		// These control the loop which tracks the device's clock. It's critically damped,
+		// and takes a few seconds to lock on.
+		const double loopFrequency = 1.0;
+		proportionalGain = 2.0 * loopFrequency / masterRate;
+		integralGain = loopFrequency * loopFrequency / masterRate;
+
+		reset();
+	}
+
+	// Only called while the devices are stopped.
+	void reset() noexcept
+	{
+		inputFifo.reset();
+		outputFifo.reset();
+		inputResampler.reset();
+		outputResampler.reset();
+		ratio = nominalRatio;
+		integral = 0;
+		filteredInputError = filteredOutputError = 0;
+		numPulled = numPushed = 0;
+		inputPrimed = false;
+		outputPrimed = false;
+		numInputWritten = numOutputRead = 0;
+		lastCallbackTime = 0;
+		numGlitches = 0;
+	}
+
+	//==============================================================================
+	// These are called on the device's own thread:
+	void audioDeviceIOCallback (const float** inputs, int numInputChannels,
+								float** outputs, int numOutputChannels, int numSamples)
+	{
+		using namespace AggregateDeviceHelpers;
+		const double now = Time::getMillisecondCounterHiRes();
+
+		int start1, size1, start2, size2;
+		inputFifo.prepareToWrite (numSamples, start1, size1, start2, size2);
+
+		if (size1 + size2 < numSamples)
+			++numGlitches;
+
+		copyToFifo (inputFifoData, fifoSize, numInputs, inputs, numInputChannels, 0, start1, size1);
+		copyToFifo (inputFifoData, fifoSize, numInputs, inputs, numInputChannels, size1, start2, size2);
+		inputFifo.finishedWrite (size1 + size2);
+
+		int numRead = 0;
+
+		if (! outputPrimed)
+			outputPrimed = outputFifo.getNumReady() >= targetLevel;
+
+		if (outputPrimed)
+		{
+			outputFifo.prepareToRead (numSamples, start1, size1, start2, size2);
+
+			if (size1 + size2 < numSamples)
+				++numGlitches;
+
+			numRead = size1 + size2;
+			const int numChans = jmin (numOutputs, numOutputChannels);
+			copyFromFifo (outputFifoData, fifoSize, numChans, outputs, 0, start1, size1);
+			copyFromFifo (outputFifoData, fifoSize, numChans, outputs, size1, start2, size2);
+			outputFifo.finishedRead (numRead);
+		}
+
+		for (int i = 0; i < numOutputChannels; ++i)
+			if (outputs[i] != nullptr)
+				zeromem (outputs[i] + numRead, sizeof (float) * (size_t) (numSamples - numRead));
+
+		// publishes the device's clock position for the master thread
+		++clockSequence;
+		numInputWritten += size1 + size2;
+		numOutputRead += numRead;
+		lastCallbackTime = now;
+		++clockSequence;
+	}
+
+	void audioDeviceAboutToStart (AudioIODevice*)   {}
+	void audioDeviceStopped()                       {}
+
+	//==============================================================================
+	// These are called on the master's thread:
+	void updateClock (const double now, const int numMasterSamples) noexcept
+	{
+		int64 written, read;
+		double callbackTime;
+		int sequence;
+
+		do
+		{
+			sequence = clockSequence.get();
+			written = numInputWritten;
+			read = numOutputRead;
+			callbackTime = lastCallbackTime;
+		}
+		while ((sequence & 1) != 0 || sequence != clockSequence.get());
+
+		if (callbackTime <= 0)
+			return;
+
+		// where the device's clock will have got to by now
+		const double elapsed = jlimit (0.0, (double) targetLevel, (now - callbackTime) * 0.001 * sampleRate);
+		const double blockTime = numMasterSamples / masterRate;
+		const double smoothing = jmin (1.0, blockTime / 0.1);
+
+		if (inputPrimed)
+		{
+			const double inputError = (written + elapsed) - (numPulled - inputResampler.getNumSamplesBuffered()) - targetLevel;
+			filteredInputError += smoothing * (inputError - filteredInputError);
+
+			integral += integralGain * filteredInputError * blockTime;
+
+			// (real clocks are never more than a fraction of a percent apart, so anything
+			// outside this range would just be the loop reacting to a glitch)
+			ratio = nominalRatio * jlimit (0.95, 1.05, 1.0 + (integral + proportionalGain * filteredInputError) / nominalRatio);
+		}
+
+		if (outputPrimed)
+		{
+			const double outputError = numPushed - (read + elapsed) - targetLevel;
+			filteredOutputError += smoothing * (outputError - filteredOutputError);
+		}
+	}
+
+	void pullInputs (const int numSamples) noexcept
+	{
+		float* const* const dest = inputBlock.getArrayOfChannels();
+
+		if (! inputPrimed)
+			inputPrimed = inputFifo.getNumReady() >= targetLevel;
+
+		if (! inputPrimed)
+		{
+			inputBlock.clear();
+			return;
+		}
+
+		const int numNeeded = jmin (inputResampler.getNumInputSamplesNeeded (numSamples, ratio),
+									inputResampler.getFreeSpace());
+
+		int start1, size1, start2, size2;
+		inputFifo.prepareToRead (numNeeded, start1, size1, start2, size2);
+
+		for (int part = 0; part < 2; ++part)
+		{
+			const int start = part == 0 ? start1 : start2;
+			const int size  = part == 0 ? size1 : size2;
+
+			for (int ch = 0; ch < numInputs; ++ch)
+				memcpy (inputResampler.getWritePointer (ch), inputFifoData + ch * fifoSize + start, sizeof (float) * (size_t) size);
+
+			inputResampler.advanceWritePosition (size);
+		}
+
+		inputFifo.finishedRead (size1 + size2);
+
+		const int shortfall = numNeeded - (size1 + size2);
+
+		if (shortfall > 0)
+		{
+			++numGlitches;
+
+			for (int ch = 0; ch < numInputs; ++ch)
+				zeromem (inputResampler.getWritePointer (ch), sizeof (float) * (size_t) shortfall);
+
+			inputResampler.advanceWritePosition (shortfall);
+		}
+
+		numPulled += numNeeded;
+
+		const int numDone = inputResampler.read (dest, numSamples, ratio);
+
+		for (int ch = 0; ch < numInputs; ++ch)
+			zeromem (dest[ch] + numDone, sizeof (float) * (size_t) (numSamples - numDone));
+	}
+
+	void pushOutputs (const int numSamples) noexcept
+	{
+		for (int ch = 0; ch < numOutputs; ++ch)
+			memcpy (outputResampler.getWritePointer (ch), outputBlock.getSampleData (ch), sizeof (float) * (size_t) numSamples);
+
+		outputResampler.advanceWritePosition (numSamples);
+
+		// (the output ratio is nudged to stop the output FIFO wandering away from its target)
+		const double outputRatio = jmax (0.5 * nominalRatio, ratio - proportionalGain * filteredOutputError);
+		const int numDone = outputResampler.read (resampledOutput.getArrayOfChannels(),
+												  resampledOutput.getNumSamples(), 1.0 / outputRatio);
+
+		int start1, size1, start2, size2;
+		outputFifo.prepareToWrite (numDone, start1, size1, start2, size2);
+
+		if (size1 + size2 < numDone)
+			++numGlitches;
+
+		using namespace AggregateDeviceHelpers;
+		const float* const* const source = resampledOutput.getArrayOfChannels();
+		copyToFifo (outputFifoData, fifoSize, numOutputs, source, numOutputs, 0, start1, size1);
+		copyToFifo (outputFifoData, fifoSize, numOutputs, source, numOutputs, size1, start2, size2);
+		outputFifo.finishedWrite (size1 + size2);
+
+		numPushed += numDone;
+	}
+
+	AudioIODevice& device;
+	const int deviceIndex, numInputs, numOutputs;
+	const double sampleRate, masterRate, nominalRatio;
+	const int maxMasterBlock, targetLevel, fifoSize;
+
+	AbstractFifo inputFifo, outputFifo;
+	HeapBlock<float> inputFifoData, outputFifoData;
+	AggregateDeviceHelpers::Resampler inputResampler, outputResampler;
+	AudioSampleBuffer inputBlock, outputBlock, resampledOutput;
+
+	double ratio, integral, proportionalGain, integralGain, filteredInputError, filteredOutputError;
+	int64 numPulled, numPushed;
+	bool inputPrimed;
+	volatile bool outputPrimed;
+	Atomic<int> numGlitches;
+
+	// The device's clock position, which is published by its thread with a sequence counter.
+	Atomic<int> clockSequence;
+	int64 numInputWritten, numOutputRead;
+	double lastCallbackTime;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (Slave);
+};
+
+//==============================================================================
+class AggregateAudioIODevice::MasterCallback  : public AudioIODeviceCallback
+{
+public:
+	MasterCallback (AggregateAudioIODevice& owner_) : owner (owner_) {}
+
+	void audioDeviceIOCallback (const float** inputs, int numInputs, float** outputs, int numOutputs, int numSamples)
+	{
+		owner.processMasterBlock (inputs, numInputs, outputs, numOutputs, numSamples);
+	}
+
+	void audioDeviceAboutToStart (AudioIODevice*)   {}
+	void audioDeviceStopped()                       {}
+
+	void audioDeviceError (const String& errorMessage)
+	{
+		AudioIODeviceCallback* const c = owner.callback;
+
+		if (c != nullptr)
+			c->audioDeviceError (errorMessage);
+	}
+
+	// The channel pointers for the aggregate's callback.
+	HeapBlock<const float*> inputs;
+	HeapBlock<float*> outputs;
+	int maxBlockSize;
+
+private:
+	AggregateAudioIODevice& owner;
+
+	JUCE_DECLARE_NON_COPYABLE (MasterCallback);
+};
+
+//==============================================================================
+AggregateAudioIODevice::AggregateAudioIODevice (const String& deviceName, const Array<AudioIODevice*>& devices_)
+	: AudioIODevice (deviceName, "Aggregate"),
+	  callback (nullptr),
+	  deviceIsOpen (false)
+{
+	jassert (devices_.size() > 0);
+
+	int numInputs = 0, numOutputs = 0;
+
+	for (int i = 0; i < devices_.size(); ++i)
+	{
+		AudioIODevice* const d = devices_.getUnchecked (i);
+		jassert (d != nullptr && ! d->isOpen());
+
+		devices.add (d);
+		firstInputChannel.add (numInputs);
+		firstOutputChannel.add (numOutputs);
+		numInputs += d->getInputChannelNames().size();
+		numOutputs += d->getOutputChannelNames().size();
+	}
+
+	firstInputChannel.add (numInputs);
+	firstOutputChannel.add (numOutputs);
+}
+
+AggregateAudioIODevice::~AggregateAudioIODevice()
+{
+	close();
+}
+
+int AggregateAudioIODevice::getNumMemberDevices() const noexcept
+{
+	return devices.size();
+}
+
+AudioIODevice* AggregateAudioIODevice::getMemberDevice (const int index) const noexcept
+{
+	return devices [index];
+}
+
+AggregateAudioIODevice::Slave* AggregateAudioIODevice::getSlaveFor (const int deviceIndex) const noexcept
+{
+	for (int i = slaves.size(); --i >= 0;)
+		if (slaves.getUnchecked (i)->deviceIndex == deviceIndex)
+			return slaves.getUnchecked (i);
+
+	return nullptr;
+}
+
+double AggregateAudioIODevice::getClockRatio (const int deviceIndex) const noexcept
+{
+	const Slave* const s = getSlaveFor (deviceIndex);
+	return s != nullptr ? s->ratio : 1.0;
+}
+
+int AggregateAudioIODevice::getNumFifoGlitches (const int deviceIndex) const noexcept
+{
+	const Slave* const s = getSlaveFor (deviceIndex);
+	return s != nullptr ? s->numGlitches.get() : 0;
+}
+
+//==============================================================================
+StringArray AggregateAudioIODevice::getOutputChannelNames()
+{
+	StringArray s;
+
+	for (int i = 0; i < devices.size(); ++i)
+	{
+		const StringArray names (devices.getUnchecked (i)->getOutputChannelNames());
+
+		for (int j = 0; j < names.size(); ++j)
+			s.add (devices.getUnchecked (i)->getName() + ": " + names[j]);
+	}
+
+	return s;
+}
+
+StringArray AggregateAudioIODevice::getInputChannelNames()
+{
+	StringArray s;
+
+	for (int i = 0; i < devices.size(); ++i)
+	{
+		const StringArray names (devices.getUnchecked (i)->getInputChannelNames());
+
+		for (int j = 0; j < names.size(); ++j)
+			s.add (devices.getUnchecked (i)->getName() + ": " + names[j]);
+	}
+
+	return s;
+}
+
+int AggregateAudioIODevice::getNumSampleRates()
+{
+	return devices.getUnchecked (0)->getNumSampleRates();
+}
+
+double AggregateAudioIODevice::getSampleRate (int index)
+{
+	return devices.getUnchecked (0)->getSampleRate (index);
+}
+
+int AggregateAudioIODevice::getNumBufferSizesAvailable()        { return devices.getUnchecked (0)->getNumBufferSizesAvailable(); }
+int AggregateAudioIODevice::getBufferSizeSamples (int index)    { return devices.getUnchecked (0)->getBufferSizeSamples (index); }
+int AggregateAudioIODevice::getDefaultBufferSize()              { return devices.getUnchecked (0)->getDefaultBufferSize(); }
+
+String AggregateAudioIODevice::open (const BigInteger& inputChannels, const BigInteger& outputChannels,
+									 double sampleRate, int bufferSizeSamples)
+{
+	close();
+
+	const int numDeviceInputs = firstInputChannel.getLast();
+	const int numDeviceOutputs = firstOutputChannel.getLast();
+
+	activeInputs = inputChannels.getBitRange (0, numDeviceInputs);
+	activeOutputs = outputChannels.getBitRange (0, numDeviceOutputs);
+
+	// The master is always opened, because it's the clock for the whole aggregate,
+	// but the other devices are only used if some of their channels are needed.
+	for (int i = 0; i < devices.size(); ++i)
+	{
+		AudioIODevice& d = *devices.getUnchecked (i);
+
+		const BigInteger ins (activeInputs.getBitRange (firstInputChannel[i], firstInputChannel[i + 1] - firstInputChannel[i]));
+		const BigInteger outs (activeOutputs.getBitRange (firstOutputChannel[i], firstOutputChannel[i + 1] - firstOutputChannel[i]));
+
+		if (i > 0 && ins.isZero() && outs.isZero())
+			continue;
+
+		lastError = d.open (ins, outs,
+							i == 0 ? sampleRate : devices.getUnchecked (0)->getCurrentSampleRate(),
+							i == 0 ? bufferSizeSamples : devices.getUnchecked (0)->getCurrentBufferSizeSamples());
+
+		if (lastError.isNotEmpty())
+		{
+			lastError = d.getName() + ": " + lastError;
+			const String error (lastError);
+			close();
+			lastError = error;
+			return lastError;
+		}
+
+		if (i > 0)
+			slaves.add (new Slave (d, i, ins.countNumberOfSetBits(), outs.countNumberOfSetBits(),
+								   devices.getUnchecked (0)->getCurrentSampleRate(),
+								   devices.getUnchecked (0)->getCurrentBufferSizeSamples()));
+	}
+
+	masterCallback = new MasterCallback (*this);
+	masterCallback->inputs.calloc ((size_t) activeInputs.countNumberOfSetBits() + 1);
+	masterCallback->outputs.calloc ((size_t) activeOutputs.countNumberOfSetBits() + 1);
+	masterCallback->maxBlockSize = devices.getUnchecked (0)->getCurrentBufferSizeSamples() * 2;
+
+	deviceIsOpen = true;
+	return String::empty;
+}
+
+void AggregateAudioIODevice::close()
+{
+	stop();
+
+	for (int i = 0; i < devices.size(); ++i)
+		devices.getUnchecked (i)->close();
+
+	slaves.clear();
+	masterCallback = nullptr;
+	deviceIsOpen = false;
+}
+
+bool AggregateAudioIODevice::isOpen()                                   { return deviceIsOpen; }
+bool AggregateAudioIODevice::isPlaying()                                { return callback != nullptr; }
+String AggregateAudioIODevice::getLastError()                           { return lastError; }
+int AggregateAudioIODevice::getCurrentBufferSizeSamples()               { return devices.getUnchecked (0)->getCurrentBufferSizeSamples(); }
+double AggregateAudioIODevice::getCurrentSampleRate()                   { return devices.getUnchecked (0)->getCurrentSampleRate(); }
+int AggregateAudioIODevice::getCurrentBitDepth()                        { return devices.getUnchecked (0)->getCurrentBitDepth(); }
+BigInteger AggregateAudioIODevice::getActiveOutputChannels() const      { return activeOutputs; }
+BigInteger AggregateAudioIODevice::getActiveInputChannels() const       { return activeInputs; }
+
+int AggregateAudioIODevice::getOutputLatencyInSamples()
+{
+	int latency = devices.getUnchecked (0)->getOutputLatencyInSamples();
+
+	for (int i = 0; i < slaves.size(); ++i)
+	{
+		const Slave& s = *slaves.getUnchecked (i);
+		latency = jmax (latency, roundToInt ((s.device.getOutputLatencyInSamples() + s.targetLevel) / s.nominalRatio));
+	}
+
+	return latency;
+}
+
+int AggregateAudioIODevice::getInputLatencyInSamples()
+{
+	int latency = devices.getUnchecked (0)->getInputLatencyInSamples();
+
+	for (int i = 0; i < slaves.size(); ++i)
+	{
+		const Slave& s = *slaves.getUnchecked (i);
+		latency = jmax (latency, roundToInt ((s.device.getInputLatencyInSamples() + s.targetLevel) / s.nominalRatio));
+	}
+
+	return latency;
+}
+
+int AggregateAudioIODevice::getXRunCount() const noexcept
+{
+	int total = 0;
+
+	for (int i = 0; i < devices.size(); ++i)
+		total += devices.getUnchecked (i)->getXRunCount() + getNumFifoGlitches (i);
+
+	return total;
+}
+
+void AggregateAudioIODevice::start (AudioIODeviceCallback* newCallback)
+{
+	if (! deviceIsOpen)
+		newCallback = nullptr;
+
+	if (newCallback != callback)
+	{
+		stop();
+
+		if (newCallback != nullptr)
+		{
+			newCallback->audioDeviceAboutToStart (this);
+			callback = newCallback;
+
+			for (int i = 0; i < slaves.size(); ++i)
+			{
+				Slave& s = *slaves.getUnchecked (i);
+				s.reset();
+				s.device.start (&s);
+			}
+
+			devices.getUnchecked (0)->start (masterCallback);
+		}
+	}
+}
+
+void AggregateAudioIODevice::stop()
+{
+	devices.getUnchecked (0)->stop();
+
+	for (int i = 0; i < slaves.size(); ++i)
+		slaves.getUnchecked (i)->device.stop();
+
+	AudioIODeviceCallback* const oldCallback = callback;
+	callback = nullptr;
+
+	if (oldCallback != nullptr)
+		oldCallback->audioDeviceStopped();
+}
+
+void AggregateAudioIODevice::processMasterBlock (const float** inputs, const int numInputs,
+												 float** outputs, const int numOutputs, const int numSamples)
+{
+	MasterCallback& m = *masterCallback;
+	AudioIODeviceCallback* const c = callback;
+
+	if (c == nullptr || numSamples > m.maxBlockSize)
+	{
+		jassert (numSamples <= m.maxBlockSize); // the master's block size has changed unexpectedly
+
+		for (int i = 0; i < numOutputs; ++i)
+			zeromem (outputs[i], sizeof (float) * (size_t) numSamples);
+
+		return;
+	}
+
+	int totalIns = 0, totalOuts = 0;
+
+	for (int i = 0; i < numInputs; ++i)
+		m.inputs [totalIns++] = inputs[i];
+
+	for (int i = 0; i < numOutputs; ++i)
+		m.outputs [totalOuts++] = outputs[i];
+
+	const double now = Time::getMillisecondCounterHiRes();
+
+	for (int i = 0; i < slaves.size(); ++i)
+	{
+		Slave& s = *slaves.getUnchecked (i);
+
+		s.updateClock (now, numSamples);
+		s.pullInputs (numSamples);
+		s.outputBlock.clear();
+
+		for (int ch = 0; ch < s.numInputs; ++ch)
+			m.inputs [totalIns++] = s.inputBlock.getSampleData (ch);
+
+		for (int ch = 0; ch < s.numOutputs; ++ch)
+			m.outputs [totalOuts++] = s.outputBlock.getSampleData (ch);
+	}
+
+	c->audioDeviceIOCallback (m.inputs, totalIns, m.outputs, totalOuts, numSamples);
+
+	for (int i = 0; i < slaves.size(); ++i)
+		slaves.getUnchecked (i)->pushOutputs (numSamples);
+}
+
+//==============================================================================
+AggregateAudioIODeviceType::AggregateAudioIODeviceType (AudioIODeviceType* const memberDeviceType)
+	: AudioIODeviceType ("Aggregate"),
+	  memberType (memberDeviceType)
+{
+	jassert (memberType != nullptr);
+}
+
+AggregateAudioIODeviceType::~AggregateAudioIODeviceType()
+{
+}
+
+void AggregateAudioIODeviceType::addAggregate (const String& aggregateName, const StringArray& memberDeviceNames)
+{
+	jassert (memberDeviceNames.size() > 0);
+
+	aggregateNames.add (aggregateName);
+	memberNames.add (new StringArray (memberDeviceNames));
+}
+
+void AggregateAudioIODeviceType::clearAggregates()
+{
+	aggregateNames.clear();
+	memberNames.clear();
+}
+
+void AggregateAudioIODeviceType::scanForDevices()
+{
+	memberType->scanForDevices();
+}
+
+StringArray AggregateAudioIODeviceType::getDeviceNames (bool) const
+{
+	return aggregateNames;
+}
+
+int AggregateAudioIODeviceType::getDefaultDeviceIndex (bool) const
+{
+	return 0;
+}
+
+int AggregateAudioIODeviceType::getIndexOfDevice (AudioIODevice* device, bool) const
+{
+	return dynamic_cast <AggregateAudioIODevice*> (device) != nullptr ? aggregateNames.indexOf (device->getName())
+																	  : -1;
+}
+
+bool AggregateAudioIODeviceType::hasSeparateInputsAndOutputs() const
+{
+	return false;
+}
+
+AudioIODevice* AggregateAudioIODeviceType::createDevice (const String& outputDeviceName, const String& inputDeviceName)
+{
+	const String name (outputDeviceName.isNotEmpty() ? outputDeviceName : inputDeviceName);
+	const int index = aggregateNames.indexOf (name);
+
+	if (index < 0)
+		return nullptr;
+
+	const StringArray& names = *memberNames.getUnchecked (index);
+	const StringArray outputNames (memberType->getDeviceNames (false));
+	const StringArray inputNames (memberType->getDeviceNames (true));
+	OwnedArray<AudioIODevice> members;
+
+	for (int i = 0; i < names.size(); ++i)
+	{
+		AudioIODevice* const d = memberType->createDevice (outputNames.contains (names[i]) ? names[i] : String::empty,
+														   inputNames.contains (names[i]) ? names[i] : String::empty);
+
+		if (d == nullptr)
+			return nullptr;
+
+		members.add (d);
+	}
+
+	Array<AudioIODevice*> devices;
+
+	for (int i = 0; i < members.size(); ++i)
+		devices.add (members.getUnchecked (i));
+
+	members.clear (false);
+	return new AggregateAudioIODevice (name, devices);
+}
+
+#if JUCE_UNIT_TESTS
+
+class AggregateAudioIODeviceTests  : public UnitTest
+{
+public:
+	AggregateAudioIODeviceTests() : UnitTest ("AggregateAudioIODevice") {}
+
+	void runTest()
+	{
+		beginTest ("Resampler accuracy");
+		{
+			const double frequency = 1000.0 / 44100.0, ratio = 1.0013;
+			const int blockSize = 256;
+
+			AggregateDeviceHelpers::Resampler resampler (1, blockSize * 2);
+			HeapBlock<float> output ((size_t) blockSize);
+			float* dest[] = { output };
+			int64 numWritten = 0, numRead = 0;
+			float maxError = 0;
+
+			for (int block = 0; block < 100; ++block)
+			{
+				const int numNeeded = resampler.getNumInputSamplesNeeded (blockSize, ratio);
+				float* const input = resampler.getWritePointer (0);
+
+				for (int i = 0; i < numNeeded; ++i)
+					input[i] = (float) std::sin (2.0 * double_Pi * frequency * (double) numWritten++);
+
+				resampler.advanceWritePosition (numNeeded);
+				expectEquals (resampler.read (dest, blockSize, ratio), blockSize);
+
+				for (int i = 0; i < blockSize; ++i)
+				{
+					const double expected = std::sin (2.0 * double_Pi * frequency * ratio * (double) numRead++);
+
+					// (ignores the start, where the filter is still filling up)
+					if (block > 0)
+						maxError = jmax (maxError, std::abs (output[i] - (float) expected));
+				}
+			}
+
+			expect (maxError < 0.001f, "error: " + String (maxError));
+		}
+
+		beginTest ("Resampling to a lower rate");
+		{
+			// 96kHz to 48kHz: a tone above the output's nyquist must be filtered out rather
+			// than aliasing, and one well below it must come through at the same level
+			expect (getLevelAfterDownsampling (43000.0 / 96000.0) < 0.05f);
+			expect (std::abs (getLevelAfterDownsampling (2000.0 / 96000.0) - 1.0f) < 0.01f);
+		}
+
+		beginTest ("Drift between virtual clocks");
+		{
+			// The second device's clock runs 2000 parts-per-million fast, which is much
+			// worse than any real device would be.
+			VirtualAudioIODevice* const master = new VirtualAudioIODevice ("Master", true, 2, 2);
+			VirtualAudioIODevice* const slave = new VirtualAudioIODevice ("Slave", true, 2, 2);
+			slave->setClockSpeed (1.002);
+
+			Array<AudioIODevice*> devices;
+			devices.add (master);
+			devices.add (slave);
+
+			AggregateAudioIODevice aggregate ("Aggregate", devices);
+			expectEquals (aggregate.getInputChannelNames().size(), 4);
+			expectEquals (aggregate.getOutputChannelNames()[2], String ("Slave: Output 1"));
+
+			BigInteger channels;
+			channels.setRange (0, 4, true);
+			expect (aggregate.open (channels, channels, 44100.0, 256).isEmpty());
+
+			ChannelCounter counter;
+			aggregate.start (&counter);
+			Thread::sleep (4000);
+			aggregate.stop();
+
+			expect (counter.numCalls.get() > 0);
+			expectEquals (counter.numInputs, 4);
+			expectEquals (counter.numOutputs, 4);
+			expect (std::abs (aggregate.getClockRatio (1) - 1.002) < 0.0005, "ratio: " + String (aggregate.getClockRatio (1), 6));
+			expectEquals (aggregate.getNumFifoGlitches (1), 0);
+		}
+	}
+
+private:
+	static float getLevelAfterDownsampling (const double frequency)
+	{
+		const double ratio = 2.0;
+		const int blockSize = 256;
+
+		AggregateDeviceHelpers::Resampler resampler (1, blockSize * 4, ratio);
+		HeapBlock<float> output ((size_t) blockSize);
+		float* dest[] = { output };
+		int64 numWritten = 0;
+		float level = 0;
+
+		for (int block = 0; block < 20; ++block)
+		{
+			const int numNeeded = resampler.getNumInputSamplesNeeded (blockSize, ratio);
+			float* const input = resampler.getWritePointer (0);
+
+			for (int i = 0; i < numNeeded; ++i)
+				input[i] = (float) std::sin (2.0 * double_Pi * frequency * (double) numWritten++);
+
+			resampler.advanceWritePosition (numNeeded);
+			resampler.read (dest, blockSize, ratio);
+
+			if (block > 0)
+				for (int i = 0; i < blockSize; ++i)
+					level = jmax (level, std::abs (output[i]));
+		}
+
+		return level;
+	}
+
+	struct ChannelCounter  : public AudioIODeviceCallback
+	{
+		ChannelCounter() : numInputs (0), numOutputs (0) {}
+
+		void audioDeviceIOCallback (const float**, int numInputs_, float** outputs, int numOutputs_, int numSamples)
+		{
+			numInputs = numInputs_;
+			numOutputs = numOutputs_;
+			++numCalls;
+
+			for (int i = 0; i < numOutputs; ++i)
+				zeromem (outputs[i], sizeof (float) * (size_t) numSamples);
+		}
+
+		void audioDeviceAboutToStart (AudioIODevice*) {}
+		void audioDeviceStopped() {}
+
+		Atomic<int> numCalls;
+		int numInputs, numOutputs;
+	};
+};
+
+static AggregateAudioIODeviceTests aggregateAudioIODeviceTests;
+
+#endif
+
+/*** End of inlined file: juce_AggregateAudioIODevice.cpp ***/
+
+
+
+/*** Start of inlined file: juce_MidiMessageCollector.cpp ***/
+/*  A bounded multi-producer, single-consumer queue of timestamped MIDI messages.
+
+	Each slot has a sequence number. A producer claims a slot by advancing the write
+	position with a compare-and-swap, fills it in, and then publishes it by bumping the
+	slot's sequence number, so the consumer never sees a half-written message.
+
+	Messages that are too long to fit in a slot (i.e. large sysexes) are written as
+	records into a preallocated byte FIFO instead. The producers take turns at this with
+	a SpinLock, but the consumer reads it without locking. Every message is stamped with
+	an arrival number, so that the consumer can merge the two in the right order.
+*/
+class MidiMessageCollector::EventQueue
+{
+public:
+	EventQueue()
+		: slots ((size_t) capacity), readPosition (0),
+		  longMessageFifo (longMessageBufferSize),
+		  longMessageData ((size_t) longMessageBufferSize),
+		  longMessageScratch ((size_t) longMessageBufferSize)
+	{
+		for (uint32 i = 0; i < (uint32) capacity; ++i)
+			slots[i].sequence = i;
+	}
+
+	enum { capacity = 4096, maxInlineBytes = 15, longMessageBufferSize = 65536 };
+
+	struct Slot
+	{
+		Atomic<uint32> sequence;
+		uint32 order;
+		int64 timeNs;
+		uint8 numBytes;
+		uint8 data [maxInlineBytes];
+	};
+
+	struct LongMessageHeader
+	{
+		int64 timeNs;
+		uint32 order;
+		int numBytes;
+	};
+
+	bool push (const MidiMessage& message, const int64 timeNs) noexcept
+	{
+		const int numBytes = message.getRawDataSize();
+		const uint32 order = (uint32) ++nextOrder;
+
+		if (numBytes > maxInlineBytes)
+			return pushLongMessage (message.getRawData(), numBytes, timeNs, order);
+
+		uint32 pos = writePosition.get();
+
+		for (;;)
+		{
+			Slot& slot = slots [pos & (capacity - 1)];
+			const int32 diff = (int32) (slot.sequence.get() - pos);
+
+			if (diff == 0)
+			{
+				if (writePosition.compareAndSetBool (pos + 1, pos))
+				{
+					slot.order = order;
+					slot.timeNs = timeNs;
+					slot.numBytes = (uint8) numBytes;
+					memcpy (slot.data, message.getRawData(), (size_t) numBytes);
+					slot.sequence = pos + 1;
+					return true;
+				}
+			}
+			else if (diff < 0)
 			{
-				samplePosition = ((samplePosition - startSample) * scale) >> 10;
+				++numDropped;   // the queue is full
+				return false;
+			}
+
+			pos = writePosition.get();
+		}
+	}
+
+	// These are only called by the consumer:
+	const Slot* getNextEvent() const noexcept
+	{
+		const Slot& slot = slots [readPosition & (capacity - 1)];
+		return slot.sequence.get() == readPosition + 1 ? &slot : nullptr;
+	}
+
+	void removeNextEvent() noexcept
+	{
+		slots [readPosition & (capacity - 1)].sequence = readPosition + (uint32) capacity;
+		++readPosition;
+	}
+
+	bool getNextLongMessage (LongMessageHeader& header) const noexcept
+	{
+		if (longMessageFifo.getNumReady() < (int) sizeof (header))
+			return false;
+
+		int start1, size1, start2, size2;
+		longMessageFifo.prepareToRead ((int) sizeof (header), start1, size1, start2, size2);
+		copyFromRing (start1, &header, (int) sizeof (header));
+		return true;
+	}
+
+	// Takes the message that getNextLongMessage() returned out of the FIFO, and returns
+	// its data, which stays valid until the next call.
+	const uint8* removeNextLongMessage (const LongMessageHeader& header) noexcept
+	{
+		const int recordSize = (int) sizeof (header) + header.numBytes;
+		int start1, size1, start2, size2;
+		longMessageFifo.prepareToRead (recordSize, start1, size1, start2, size2);
+		copyFromRing ((start1 + (int) sizeof (header)) % longMessageBufferSize, longMessageScratch, header.numBytes);
+		longMessageFifo.finishedRead (recordSize);
+		return longMessageScratch;
+	}
+
+	// Returns true if the first message arrived before the second one.
+	static bool isEarlier (const int64 time1, const uint32 order1, const int64 time2, const uint32 order2) noexcept
+	{
+		return time1 < time2 || (time1 == time2 && (int32) (order1 - order2) < 0);
+	}
+
+	void clear()
+	{
+		while (getNextEvent() != nullptr)
+			removeNextEvent();
+
+		const SpinLock::ScopedLockType sl (longMessageLock);
+		longMessageFifo.reset();
+	}
+
+	HeapBlock<Slot> slots;
+	Atomic<uint32> writePosition, nextOrder;
+	uint32 readPosition;
+	Atomic<int> numDropped;
+
+private:
+	SpinLock longMessageLock;   // (this is only used to keep the producers out of each other's way)
+	AbstractFifo longMessageFifo;
+	HeapBlock<uint8> longMessageData, longMessageScratch;
+
+	bool pushLongMessage (const uint8* const data, const int numBytes, const int64 timeNs, const uint32 order) noexcept
+	{
+		const SpinLock::ScopedLockType sl (longMessageLock);
+		const LongMessageHeader header = { timeNs, order, numBytes };
+		const int recordSize = (int) sizeof (header) + numBytes;
+
+		// (the FIFO can only ever hold one byte less than its size)
+		if (recordSize >= longMessageFifo.getFreeSpace())
+		{
+			++numDropped;
+			return false;
+		}
 
-				destBuffer.addEvent (midiData, numBytes,
-									 jlimit (0, numSamples - 1, samplePosition));
-			}
+		int start1, size1, start2, size2;
+		longMessageFifo.prepareToWrite (recordSize, start1, size1, start2, size2);
+		copyToRing (start1, &header, (int) sizeof (header));
+		copyToRing ((start1 + (int) sizeof (header)) % longMessageBufferSize, data, numBytes);
+		longMessageFifo.finishedWrite (recordSize);
+		return true;
+	}
+
+	void copyToRing (const int pos, const void* const source, const int numBytes) noexcept
+	{
+		const int numBeforeWrap = jmin (numBytes, longMessageBufferSize - pos);
+		memcpy (longMessageData + pos, source, (size_t) numBeforeWrap);
+		memcpy (longMessageData, addBytesToPointer (source, numBeforeWrap), (size_t) (numBytes - numBeforeWrap));
+	}
+
+	void copyFromRing (const int pos, void* const dest, const int numBytes) const noexcept
+	{
+		const int numBeforeWrap = jmin (numBytes, longMessageBufferSize - pos);
+		memcpy (dest, longMessageData + pos, (size_t) numBeforeWrap);
+		memcpy (addBytesToPointer (dest, numBeforeWrap), longMessageData, (size_t) (numBytes - numBeforeWrap));
+	}
+
+	JUCE_DECLARE_NON_COPYABLE (EventQueue);
+};
+
+MidiMessageCollector::MidiMessageCollector()
+	: queue (new EventQueue()),
+	  sampleRate (44100.0001),
+	  blockStartTime (0),
+	  blockEndTime (0),
+	  nextCallbackTime (0),
+	  filteredPeriod (0),
+	  loopGainB (0),
+	  loopGainC (0),
+	  jitterMargin (0),
+	  lastNumSamples (0)
+{
+}
+
+MidiMessageCollector::~MidiMessageCollector()
+{
+}
+
+void MidiMessageCollector::reset (const double sampleRate_)
+{
+	jassert (sampleRate_ > 0);
+
+	sampleRate = sampleRate_;
+	queue->clear();
+	lastNumSamples = 0; // restarts the clock at the next callback
+}
+
+void MidiMessageCollector::addMessageToQueue (const MidiMessage& message)
+{
+	// you need to call reset() to set the correct sample rate before using this object
+	jassert (sampleRate != 44100.0001);
+
+	// the messages that come in here need to be time-stamped correctly - see MidiInput
+	// for details of what the number should be.
+	jassert (message.getTimeStamp() != 0);
+
+	queue->push (message, (int64) (message.getTimeStamp() * 1.0e9));
+}
+
+int MidiMessageCollector::getNumDroppedMessages() const noexcept
+{
+	return queue->numDropped.get();
+}
+
+void MidiMessageCollector::updateCallbackClock (const double callbackTime, const int numSamples) noexcept
+{
+	const double period = numSamples / sampleRate;
+
+	if (numSamples != lastNumSamples
+		 || std::abs (callbackTime - nextCallbackTime) > jmax (0.05, 4.0 * period))
+	{
+		// (Re)start the loop after a reset, a change of block size or a long gap. Its
+		// bandwidth is low enough to smooth out the scheduling jitter of the callbacks,
+		// while still following any drift between the audio and system clocks.
+		const double bandwidthHz = 0.5;
+		const double omega = 2.0 * double_Pi * bandwidthHz * period;
+
+		loopGainB = std::sqrt (2.0) * omega;
+		loopGainC = omega * omega;
+		filteredPeriod = period;
+		jitterMargin = 0;
+		lastNumSamples = numSamples;
+
+		blockStartTime = callbackTime - period;
+		blockEndTime = callbackTime;
+		nextCallbackTime = callbackTime + period;
+	}
+	else
+	{
+		const double error = callbackTime - nextCallbackTime;
+
+		// A callback that arrives before its predicted time can't have seen the messages
+		// that came in between the two, so the blocks are shifted back by the largest
+		// recent early arrival. This slowly decays, with a time constant of 10 seconds.
+		jitterMargin = jmax (-error, jitterMargin * (1.0 - period / 10.0));
+
+		blockStartTime = blockEndTime;
+		blockEndTime = nextCallbackTime;
+		nextCallbackTime += loopGainB * error + filteredPeriod;
+		filteredPeriod += loopGainC * error;
+	}
+}
+
+void MidiMessageCollector::removeNextBlockOfMessages (MidiBuffer& destBuffer, const int numSamples)
+{
+	removeNextBlockOfMessages (destBuffer, numSamples, Time::getMillisecondCounterHiRes() * 0.001);
+}
+
+void MidiMessageCollector::removeNextBlockOfMessages (MidiBuffer& destBuffer,
+													  const int numSamples,
+													  const double callbackTime)
+{
+	// you need to call reset() to set the correct sample rate before using this object
+	jassert (sampleRate != 44100.0001);
+
+	if (numSamples <= 0)
+		return;
+
+	updateCallbackClock (callbackTime, numSamples);
+
+	// Each block covers the time between the previous callback and this one, so every
+	// message ends up one block (plus the jitter margin) later than it arrived.
+	const int64 blockStartNs = (int64) ((blockStartTime - jitterMargin) * 1.0e9);
+	const int64 blockEndNs = (int64) ((blockEndTime - jitterMargin) * 1.0e9);
+	const int64 staleTimeNs = blockStartNs - (int64) 1000000000;
+	const double samplesPerNs = numSamples / (double) jmax ((int64) 1, blockEndNs - blockStartNs);
+
+	EventQueue::LongMessageHeader longMessage;
+	bool hasLongMessage = queue->getNextLongMessage (longMessage);
+
+	// The short and long messages are merged, taking whichever arrived first each time
+	for (;;)
+	{
+		const EventQueue::Slot* const event = queue->getNextEvent();
+		const bool useLongMessage = hasLongMessage
+									 && (event == nullptr || EventQueue::isEarlier (longMessage.timeNs, longMessage.order,
+																					event->timeNs, event->order));
+
+		if (event == nullptr && ! useLongMessage)
+			break;
+
+		const int64 timeNs = useLongMessage ? longMessage.timeNs : event->timeNs;
+
+		if (timeNs >= blockEndNs)
+			break;
+
+		// (anything that's been waiting for over a second is dropped)
+		const bool isStale = timeNs <= staleTimeNs;
+		const int samplePosition = jlimit (0, numSamples - 1, (int) ((timeNs - blockStartNs) * samplesPerNs));
+
+		if (useLongMessage)
+		{
+			const uint8* const data = queue->removeNextLongMessage (longMessage);
+
+			if (! isStale)
+				destBuffer.addEvent (data, longMessage.numBytes, samplePosition);
+
+			hasLongMessage = queue->getNextLongMessage (longMessage);
 		}
 		else
 		{
-			// if our event list is shorter than the number we need, put them
-			// towards the end of the buffer
-			startSample = numSamples - numSourceSamples;
+			if (! isStale)
+				destBuffer.addEvent (event->data, event->numBytes, samplePosition);
 
-			while (iter.getNextEvent (midiData, numBytes, samplePosition))
-			{
-				destBuffer.addEvent (midiData, numBytes,
-									 jlimit (0, numSamples - 1, samplePosition + startSample));
-			}
+			queue->removeNextEvent();
 		}
-
-		incomingMessages.clear();
 	}
 }
 
@@ -1619,6 +3920,234 @@ void MidiMessageCollector::handleIncomingMidiMessage (MidiInput*, const MidiMess
 	addMessageToQueue (message);
 }
 
+#if JUCE_UNIT_TESTS
+
+class MidiMessageCollectorTests  : public UnitTest
+{
+public:
+	MidiMessageCollectorTests() : UnitTest ("MidiMessageCollector") {}
+
+	void runTest()
+	{
+		beginTest ("Placement with jittery callbacks");
+		{
+			const double sampleRate = 48000.0;
+			const int blockSize = 480, numBlocks = 1000, numWarmUpBlocks = 500;
+
+			MidiMessageCollector collector;
+			collector.reset (sampleRate);
+
+			Random r (0x4567);
+			double nextMessageTime = 1.0, minLatency = 1.0e9, maxLatency = -1.0e9;
+			Array<double> pendingTimes;
+
+			for (int block = 0; block < numBlocks; ++block)
+			{
+				// Callbacks arrive every 10ms, give or take 2ms of scheduling jitter. Placing the
+				// messages relative to the raw callback times would make their latency vary by
+				// the full 4ms.
+				const double callbackTime = 1.0 + (block + 1) * blockSize / sampleRate + (r.nextDouble() - 0.5) * 0.004;
+
+				while (nextMessageTime < callbackTime)
+				{
+					MidiMessage m (MidiMessage::noteOn (1, 60, (uint8) 100));
+					m.setTimeStamp (nextMessageTime);
+					collector.addMessageToQueue (m);
+					pendingTimes.add (nextMessageTime);
+					nextMessageTime += 0.0037;
+				}
+
+				MidiBuffer buffer;
+				collector.removeNextBlockOfMessages (buffer, blockSize, callbackTime);
+
+				MidiBuffer::Iterator i (buffer);
+				MidiMessage message (0xf4);
+				int samplePosition;
+
+				while (i.getNextEvent (message, samplePosition))
+				{
+					expect (pendingTimes.size() > 0);
+					const double latency = 1.0 + ((block + 1) * blockSize + samplePosition) / sampleRate - pendingTimes.getFirst();
+					pendingTimes.remove (0);
+
+					if (block >= numWarmUpBlocks)
+					{
+						minLatency = jmin (minLatency, latency);
+						maxLatency = jmax (maxLatency, latency);
+					}
+				}
+			}
+
+			expect (pendingTimes.size() < 4);
+			expect (minLatency > 0 && maxLatency < 0.03);
+			expect (maxLatency - minLatency < 0.002, "latency varies by " + String ((maxLatency - minLatency) * 1000.0) + "ms");
+		}
+
+		beginTest ("Long messages and overflow");
+		{
+			MidiMessageCollector collector;
+			collector.reset (44100.0);
+
+			const double now = Time::getMillisecondCounterHiRes() * 0.001;
+			const uint8 sysexData[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 };
+			MidiMessage sysex (MidiMessage::createSysExMessage (sysexData, numElementsInArray (sysexData)));
+			sysex.setTimeStamp (now - 0.001);
+			collector.addMessageToQueue (sysex);
+
+			MidiBuffer buffer;
+			collector.removeNextBlockOfMessages (buffer, 512, now);
+			expectEquals (buffer.getNumEvents(), 1);
+
+			for (int i = 0; i < 5000; ++i)
+			{
+				MidiMessage m (MidiMessage::noteOff (1, 60));
+				m.setTimeStamp (now);
+				collector.addMessageToQueue (m);
+			}
+
+			expectEquals (collector.getNumDroppedMessages(), 5000 - 4096);
+		}
+
+		beginTest ("Long and short messages stay in order");
+		{
+			const double sampleRate = 44100.0;
+			const int blockSize = 441;
+
+			MidiMessageCollector collector;
+			collector.reset (sampleRate);
+
+			// Enough large sysexes go through to wrap around the long-message buffer many
+			// times, and each has short messages on either side with the same timestamps.
+			for (int block = 0; block < 400; ++block)
+			{
+				const double callbackTime = 1.0 + (block + 1) * blockSize / sampleRate;
+				const double messageTime = callbackTime - 0.5 * blockSize / sampleRate;
+
+				MemoryBlock sysexData ((size_t) (500 + block * 3));
+
+				for (size_t i = 0; i < sysexData.getSize(); ++i)
+					sysexData[i] = (char) ((i + (size_t) block) & 0x7f);
+
+				MidiMessage before (MidiMessage::noteOn (1, block & 127, (uint8) 100));
+				MidiMessage sysex (MidiMessage::createSysExMessage (static_cast <const uint8*> (sysexData.getData()), (int) sysexData.getSize()));
+				MidiMessage after (MidiMessage::noteOff (1, block & 127));
+				before.setTimeStamp (messageTime);
+				sysex.setTimeStamp (messageTime);
+				after.setTimeStamp (messageTime);
+
+				collector.addMessageToQueue (before);
+				collector.addMessageToQueue (sysex);
+				collector.addMessageToQueue (after);
+
+				MidiBuffer buffer;
+				collector.removeNextBlockOfMessages (buffer, blockSize, callbackTime);
+				expectEquals (buffer.getNumEvents(), 3);
+
+				MidiBuffer::Iterator i (buffer);
+				MidiMessage message (0xf4);
+				int samplePosition;
+
+				expect (i.getNextEvent (message, samplePosition) && message.isNoteOn());
+				expect (i.getNextEvent (message, samplePosition) && message.isSysEx()
+						 && message.getSysExDataSize() == (int) sysexData.getSize()
+						 && memcmp (message.getSysExData(), sysexData.getData(), sysexData.getSize()) == 0);
+				expect (i.getNextEvent (message, samplePosition) && message.isNoteOff());
+			}
+
+			expectEquals (collector.getNumDroppedMessages(), 0);
+		}
+
+		beginTest ("Long message overflow");
+		{
+			MidiMessageCollector collector;
+			collector.reset (44100.0);
+
+			// each of these takes up just over 1000 bytes of the 64K buffer
+			const MemoryBlock sysexData (1000, true);
+			MidiMessage sysex (MidiMessage::createSysExMessage (static_cast <const uint8*> (sysexData.getData()), (int) sysexData.getSize()));
+			sysex.setTimeStamp (Time::getMillisecondCounterHiRes() * 0.001);
+
+			for (int i = 0; i < 100; ++i)
+				collector.addMessageToQueue (sysex);
+
+			expect (collector.getNumDroppedMessages() > 30 && collector.getNumDroppedMessages() < 40);
+		}
+
+	   #if JUCE_LINUX && JUCE_ALSA
+		beginTest ("ALSA sequencer jitter");
+		{
+			// Sends messages from one virtual sequencer port to another, and measures how
+			// long they take to arrive.
+			const String name ("JUCE jitter test");
+			ScopedPointer<MidiOutput> output (MidiOutput::createNewDevice (name));
+			const int inputIndex = MidiInput::getDevices().indexOf (name + " Output");
+
+			if (output == nullptr || inputIndex < 0)
+			{
+				logMessage ("Couldn't open the ALSA sequencer - skipping");
+			}
+			else
+			{
+				ArrivalRecorder recorder;
+				ScopedPointer<MidiInput> input (MidiInput::openDevice (inputIndex, &recorder));
+				expect (input != nullptr);
+
+				input->start();
+				Thread::sleep (100);
+
+				const int numMessages = 200;
+				Array<double> sendTimes;
+
+				for (int i = 0; i < numMessages; ++i)
+				{
+					sendTimes.add (Time::getMillisecondCounterHiRes() * 0.001);
+					output->sendMessageNow (MidiMessage::controllerEvent (1, 1, i & 127));
+					Thread::sleep (2);
+				}
+
+				Thread::sleep (200);
+				input->stop();
+
+				const ScopedLock sl (recorder.lock);
+				expectEquals (recorder.arrivalTimes.size(), numMessages);
+
+				double total = 0, minLatency = 1.0e9, maxLatency = 0;
+
+				for (int i = 0; i < jmin (numMessages, recorder.arrivalTimes.size()); ++i)
+				{
+					const double latency = recorder.arrivalTimes.getUnchecked (i) - sendTimes.getUnchecked (i);
+					total += latency;
+					minLatency = jmin (minLatency, latency);
+					maxLatency = jmax (maxLatency, latency);
+				}
+
+				if (recorder.arrivalTimes.size() > 0)
+					logMessage ("Mean latency: " + String (1000.0 * total / recorder.arrivalTimes.size(), 3)
+								 + "ms, max: " + String (1000.0 * maxLatency, 3)
+								 + "ms, jitter: " + String (1000.0 * (maxLatency - minLatency), 3) + "ms");
+			}
+		}
+	   #endif
+	}
+
+private:
+	struct ArrivalRecorder  : public MidiInputCallback
+	{
+		void handleIncomingMidiMessage (MidiInput*, const MidiMessage& message)
+		{
+			const ScopedLock sl (lock);
+			arrivalTimes.add (message.getTimeStamp());
+		}
+
+		CriticalSection lock;
+		Array<double> arrivalTimes;
+	};
+};
+
+static MidiMessageCollectorTests midiMessageCollectorTests;
+
+#endif
+
 /*** End of inlined file: juce_MidiMessageCollector.cpp ***/
 
 
@@ -1821,17 +4350,12 @@ AudioSourcePlayer::~AudioSourcePlayer()
 
 void AudioSourcePlayer::setSource (AudioSource* newSource)
 {
-	if (source != newSource)
+	if (source.get() != newSource)
 	{
-		AudioSource* const oldSource = source;
-
 		if (newSource != nullptr && bufferSize > 0 && sampleRate > 0)
 			newSource->prepareToPlay (bufferSize, sampleRate);
 
-		{
-			const ScopedLock sl (readLock);
-			source = newSource;
-		}
+		AudioSource* const oldSource = source.exchange (newSource);
 
 		if (oldSource != nullptr)
 			oldSource->releaseResources();
@@ -1852,9 +4376,9 @@ void AudioSourcePlayer::audioDeviceIOCallback (const float** inputChannelData,
 	// these should have been prepared by audioDeviceAboutToStart()...
 	jassert (sampleRate > 0 && bufferSize > 0);
 
-	const ScopedLock sl (readLock);
+	const AudioThreadPointer <AudioSource>::ScopedReader currentSource (source);
 
-	if (source != nullptr)
+	if (currentSource.get() != nullptr)
 	{
 		int i, numActiveChans = 0, numInputs = 0, numOutputs = 0;
 
@@ -1922,7 +4446,7 @@ void AudioSourcePlayer::audioDeviceIOCallback (const float** inputChannelData,
 		AudioSampleBuffer buffer (channels, numActiveChans, numSamples);
 
 		AudioSourceChannelInfo info (&buffer, 0, numSamples);
-		source->getNextAudioBlock (info);
+		currentSource->getNextAudioBlock (info);
 
 		for (i = info.buffer->getNumChannels(); --i >= 0;)
 			buffer.applyGainRamp (i, info.startSample, info.numSamples, lastGain, gain);
@@ -1943,14 +4467,14 @@ void AudioSourcePlayer::audioDeviceAboutToStart (AudioIODevice* device)
 	bufferSize = device->getCurrentBufferSizeSamples();
 	zeromem (channels, sizeof (channels));
 
-	if (source != nullptr)
-		source->prepareToPlay (bufferSize, sampleRate);
+	if (source.get() != nullptr)
+		source.get()->prepareToPlay (bufferSize, sampleRate);
 }
 
 void AudioSourcePlayer::audioDeviceStopped()
 {
-	if (source != nullptr)
-		source->releaseResources();
+	if (source.get() != nullptr)
+		source.get()->releaseResources();
 
 	sampleRate = 0.0;
 	bufferSize = 0;
@@ -1962,22 +4486,106 @@ void AudioSourcePlayer::audioDeviceStopped()
 
 
 /*** Start of inlined file: juce_AudioTransportSource.cpp ***/
+/*  The chain of sources that's used to play one input source: the source itself, plus
+	an optional read-ahead buffer and resampler.
+*/
+class AudioTransportSource::SourceChain
+{
+public:
+	SourceChain (PositionableAudioSource* const source_,
+				 const int readAheadBufferSize,
+				 TimeSliceThread* const readAheadThread,
+				 const double sourceSampleRate_,
+				 const int maxNumChannels)
+		: source (source_),
+		  positionableSource (source_),
+		  masterSource (nullptr),
+		  sourceSampleRate (sourceSampleRate_),
+		  numChannels (maxNumChannels)
+	{
+		if (readAheadBufferSize > 0)
+		{
+			// If you want to use a read-ahead buffer, you must also provide a TimeSliceThread
+			// for it to use!
+			jassert (readAheadThread != nullptr);
+
+			positionableSource = bufferingSource
+				= new BufferingAudioSource (positionableSource, *readAheadThread,
+											false, readAheadBufferSize, maxNumChannels);
+		}
+
+		positionableSource->setNextReadPosition (0);
+
+		if (sourceSampleRate > 0)
+			masterSource = resamplerSource
+				= new ResamplingAudioSource (positionableSource, false, maxNumChannels);
+		else
+			masterSource = positionableSource;
+	}
+
+	~SourceChain()
+	{
+		masterSource->releaseResources();
+	}
+
+	void prepareToPlay (const int blockSize, const double sampleRate)
+	{
+		if (resamplerSource != nullptr && sourceSampleRate > 0 && sampleRate > 0)
+			resamplerSource->setResamplingRatio (sourceSampleRate / sampleRate);
+
+		masterSource->prepareToPlay (blockSize, sampleRate);
+	}
+
+	double getRatio (const double sampleRate) const noexcept
+	{
+		return (sampleRate > 0 && sourceSampleRate > 0) ? sampleRate / sourceSampleRate : 1.0;
+	}
+
+	int64 getNextReadPosition (const double sampleRate) const
+	{
+		return (int64) (positionableSource->getNextReadPosition() * getRatio (sampleRate));
+	}
+
+	int64 getTotalLength (const double sampleRate) const
+	{
+		return (int64) (positionableSource->getTotalLength() * getRatio (sampleRate));
+	}
+
+	bool isNextBlockReady (const int numSamples) const
+	{
+		return bufferingSource == nullptr || bufferingSource->isNextBlockReady (numSamples);
+	}
+
+	PositionableAudioSource* const source;
+	ScopedPointer<BufferingAudioSource> bufferingSource;
+	ScopedPointer<ResamplingAudioSource> resamplerSource;
+	PositionableAudioSource* positionableSource;
+	AudioSource* masterSource;
+	const double sourceSampleRate;
+	const int numChannels;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (SourceChain);
+};
+
+//==============================================================================
 AudioTransportSource::AudioTransportSource()
-	: source (nullptr),
-	  resamplerSource (nullptr),
-	  bufferingSource (nullptr),
-	  positionableSource (nullptr),
-	  masterSource (nullptr),
-	  gain (1.0f),
+	: gain (1.0f),
 	  lastGain (1.0f),
 	  playing (false),
 	  stopped (true),
 	  sampleRate (44100.0),
-	  sourceSampleRate (0.0),
 	  blockSize (128),
-	  readAheadBufferSize (0),
 	  isPrepared (false),
-	  inputStreamEOF (false)
+	  inputStreamEOF (false),
+	  crossfadeBuffer (2, 128),
+	  crossfadeSeconds (0),
+	  crossfadeLength (0),
+	  crossfadePosition (-1),
+	  crossfadeRequested (false),
+	  seekTime (0),
+	  lastSeekLatencyMs (-1.0),
+	  seekPending (false)
 {
 }
 
@@ -1989,82 +4597,121 @@ AudioTransportSource::~AudioTransportSource()
 }
 
 void AudioTransportSource::setSource (PositionableAudioSource* const newSource,
-									  int readAheadBufferSize_,
+									  int readAheadBufferSize,
 									  TimeSliceThread* readAheadThread,
 									  double sourceSampleRateToCorrectFor,
 									  int maxNumChannels)
 {
-	if (source == newSource)
+	if ((current != nullptr ? current->source : nullptr) == newSource)
 	{
-		if (source == nullptr)
+		if (newSource == nullptr)
 			return;
 
 		setSource (nullptr, 0, nullptr); // deselect and reselect to avoid releasing resources wrongly
 	}
 
-	readAheadBufferSize = readAheadBufferSize_;
-	sourceSampleRate = sourceSampleRateToCorrectFor;
+	ScopedPointer<SourceChain> newChain;
+
+	if (newSource != nullptr)
+	{
+		newChain = new SourceChain (newSource, readAheadBufferSize, readAheadThread,
+									sourceSampleRateToCorrectFor, maxNumChannels);
 
-	ResamplingAudioSource* newResamplerSource = nullptr;
-	BufferingAudioSource* newBufferingSource = nullptr;
-	PositionableAudioSource* newPositionableSource = nullptr;
-	AudioSource* newMasterSource = nullptr;
+		if (isPrepared)
+			newChain->prepareToPlay (blockSize, sampleRate);
+	}
 
-	ScopedPointer <ResamplingAudioSource> oldResamplerSource (resamplerSource);
-	ScopedPointer <BufferingAudioSource> oldBufferingSource (bufferingSource);
-	AudioSource* oldMasterSource = masterSource;
+	ScopedPointer<SourceChain> oldChain, oldNext, oldRetired;
 
-	if (newSource != nullptr)
 	{
-		newPositionableSource = newSource;
+		const ScopedLock sl (callbackLock);
 
-		if (readAheadBufferSize_ > 0)
-		{
-			// If you want to use a read-ahead buffer, you must also provide a TimeSliceThread
-			// for it to use!
-			jassert (readAheadThread != nullptr);
+		oldChain = current.release();
+		oldNext = next.release();
+		oldRetired = retired.release();
+		current = newChain.release();
 
-			newPositionableSource = newBufferingSource
-				= new BufferingAudioSource (newPositionableSource, *readAheadThread,
-											false, readAheadBufferSize_, maxNumChannels);
-		}
+		crossfadePosition = -1;
+		crossfadeRequested = false;
+		seekPending = false;
+		playing = false;
+	}
+
+	// (the old chains get deleted here, outside the lock)
+}
 
-		newPositionableSource->setNextReadPosition (0);
+void AudioTransportSource::queueNextSource (PositionableAudioSource* const nextSource,
+											const double crossfadeLengthSeconds,
+											const int readAheadBufferSize,
+											TimeSliceThread* const readAheadThread,
+											const double sourceSampleRateToCorrectFor,
+											const int maxNumChannels,
+											const int64 startPosition)
+{
+	ScopedPointer<SourceChain> newChain;
 
-		if (sourceSampleRateToCorrectFor > 0)
-			newMasterSource = newResamplerSource
-				= new ResamplingAudioSource (newPositionableSource, false, maxNumChannels);
-		else
-			newMasterSource = newPositionableSource;
+	if (nextSource != nullptr)
+	{
+		newChain = new SourceChain (nextSource, readAheadBufferSize, readAheadThread,
+									sourceSampleRateToCorrectFor, maxNumChannels);
+
+		// (the position is set first, so that the read-ahead buffer fills up from there)
+		newChain->positionableSource->setNextReadPosition (startPosition);
 
 		if (isPrepared)
-		{
-			if (newResamplerSource != nullptr && sourceSampleRate > 0 && sampleRate > 0)
-				newResamplerSource->setResamplingRatio (sourceSampleRate / sampleRate);
+			newChain->prepareToPlay (blockSize, sampleRate);
+	}
+
+	ScopedPointer<SourceChain> oldNext, oldRetired;
+
+	{
+		const ScopedLock sl (callbackLock);
+
+		if (newChain != nullptr && newChain->numChannels > crossfadeBuffer.getNumChannels())
+			crossfadeBuffer.setSize (newChain->numChannels, crossfadeBuffer.getNumSamples());
+
+		oldNext = next.release();
+		oldRetired = retired.release();
+		next = newChain.release();
+
+		crossfadeSeconds = jmax (0.0, crossfadeLengthSeconds);
+		crossfadeLength = roundToInt (crossfadeSeconds * sampleRate);
+		crossfadePosition = -1;
+		crossfadeRequested = false;
+	}
+}
+
+bool AudioTransportSource::crossfadeToNextSource()
+{
+	const ScopedLock sl (callbackLock);
+
+	if (next == nullptr)
+		return false;
+
+	crossfadeRequested = true;
+	return true;
+}
+
+PositionableAudioSource* AudioTransportSource::getNextSource() const
+{
+	const ScopedLock sl (callbackLock);
+
+	return next != nullptr ? next->source : nullptr;
+}
 
-			newMasterSource->prepareToPlay (blockSize, sampleRate);
-		}
-	}
+void AudioTransportSource::handleAsyncUpdate()
+{
+	ScopedPointer<SourceChain> oldRetired;
 
 	{
 		const ScopedLock sl (callbackLock);
-
-		source = newSource;
-		resamplerSource = newResamplerSource;
-		bufferingSource = newBufferingSource;
-		masterSource = newMasterSource;
-		positionableSource = newPositionableSource;
-
-		playing = false;
+		oldRetired = retired.release();
 	}
-
-	if (oldMasterSource != nullptr)
-		oldMasterSource->releaseResources();
 }
 
 void AudioTransportSource::start()
 {
-	if ((! playing) && masterSource != nullptr)
+	if ((! playing) && current != nullptr)
 	{
 		{
 			const ScopedLock sl (callbackLock);
@@ -2113,49 +4760,46 @@ double AudioTransportSource::getLengthInSeconds() const
 	return getTotalLength() / sampleRate;
 }
 
+double AudioTransportSource::getLastSeekLatencyMs() const noexcept
+{
+	return seekPending ? -1.0 : lastSeekLatencyMs;
+}
+
 void AudioTransportSource::setNextReadPosition (int64 newPosition)
 {
-	if (positionableSource != nullptr)
+	const ScopedLock sl (callbackLock);
+
+	if (current != nullptr)
 	{
-		if (sampleRate > 0 && sourceSampleRate > 0)
-			newPosition = (int64) (newPosition * sourceSampleRate / sampleRate);
+		newPosition = (int64) (newPosition / current->getRatio (sampleRate));
+
+		seekTime = Time::getMillisecondCounterHiRes();
+		seekPending = true;
 
-		positionableSource->setNextReadPosition (newPosition);
+		current->positionableSource->setNextReadPosition (newPosition);
 	}
 }
 
 int64 AudioTransportSource::getNextReadPosition() const
 {
-	if (positionableSource != nullptr)
-	{
-		const double ratio = (sampleRate > 0 && sourceSampleRate > 0) ? sampleRate / sourceSampleRate : 1.0;
-
-		return (int64) (positionableSource->getNextReadPosition() * ratio);
-	}
+	const ScopedLock sl (callbackLock);
 
-	return 0;
+	return current != nullptr ? current->getNextReadPosition (sampleRate) : 0;
 }
 
 int64 AudioTransportSource::getTotalLength() const
 {
 	const ScopedLock sl (callbackLock);
 
-	if (positionableSource != nullptr)
-	{
-		const double ratio = (sampleRate > 0 && sourceSampleRate > 0) ? sampleRate / sourceSampleRate : 1.0;
-
-		return (int64) (positionableSource->getTotalLength() * ratio);
-	}
-
-	return 0;
+	return current != nullptr ? current->getTotalLength (sampleRate) : 0;
 }
 
 bool AudioTransportSource::isLooping() const
 {
 	const ScopedLock sl (callbackLock);
 
-	return positionableSource != nullptr
-			&& positionableSource->isLooping();
+	return current != nullptr
+			&& current->positionableSource->isLooping();
 }
 
 void AudioTransportSource::setGain (const float newGain) noexcept
@@ -2171,11 +4815,14 @@ void AudioTransportSource::prepareToPlay (int samplesPerBlockExpected,
 	sampleRate = sampleRate_;
 	blockSize = samplesPerBlockExpected;
 
-	if (masterSource != nullptr)
-		masterSource->prepareToPlay (samplesPerBlockExpected, sampleRate);
+	if (current != nullptr)
+		current->prepareToPlay (samplesPerBlockExpected, sampleRate);
 
-	if (resamplerSource != nullptr && sourceSampleRate > 0)
-		resamplerSource->setResamplingRatio (sourceSampleRate / sampleRate);
+	if (next != nullptr)
+		next->prepareToPlay (samplesPerBlockExpected, sampleRate);
+
+	crossfadeBuffer.setSize (crossfadeBuffer.getNumChannels(), jmax (128, samplesPerBlockExpected));
+	crossfadeLength = roundToInt (crossfadeSeconds * sampleRate);
 
 	isPrepared = true;
 }
@@ -2184,8 +4831,11 @@ void AudioTransportSource::releaseMasterResources()
 {
 	const ScopedLock sl (callbackLock);
 
-	if (masterSource != nullptr)
-		masterSource->releaseResources();
+	if (current != nullptr)
+		current->masterSource->releaseResources();
+
+	if (next != nullptr)
+		next->masterSource->releaseResources();
 
 	isPrepared = false;
 }
@@ -2195,15 +4845,109 @@ void AudioTransportSource::releaseResources()
 	releaseMasterResources();
 }
 
+void AudioTransportSource::finishCrossfade()
+{
+	// The old chain can't be deleted on the audio thread, so it's parked until the
+	// message thread gets round to it. Queueing another source also deletes it, so by
+	// the time the next switch is due, the slot is always free again.
+	jassert (retired == nullptr);
+
+	retired = current.release();
+	current = next.release();
+	crossfadePosition = -1;
+
+	triggerAsyncUpdate();
+	sendChangeMessage();
+}
+
+void AudioTransportSource::readCurrentSource (const AudioSourceChannelInfo& info)
+{
+	int startSample = info.startSample;
+	int numLeft = info.numSamples;
+
+	while (numLeft > 0)
+	{
+		if (crossfadePosition < 0)
+		{
+			int numBeforeCrossfade = numLeft;
+
+			if (next != nullptr && retired == nullptr)
+			{
+				if (crossfadeRequested)
+					numBeforeCrossfade = 0;
+				else if (! current->positionableSource->isLooping())
+					numBeforeCrossfade = (int) jlimit ((int64) 0, (int64) numLeft,
+													   current->getTotalLength (sampleRate)
+														 - current->getNextReadPosition (sampleRate)
+														 - crossfadeLength);
+			}
+
+			if (numBeforeCrossfade > 0)
+			{
+				AudioSourceChannelInfo section (info.buffer, startSample, numBeforeCrossfade);
+				current->masterSource->getNextAudioBlock (section);
+
+				startSample += numBeforeCrossfade;
+				numLeft -= numBeforeCrossfade;
+			}
+
+			if (numLeft > 0)
+			{
+				crossfadePosition = 0;
+				crossfadeRequested = false;
+			}
+		}
+		else if (crossfadePosition >= crossfadeLength)
+		{
+			finishCrossfade();
+		}
+		else
+		{
+			const int numThisTime = jmin (numLeft, crossfadeLength - crossfadePosition, crossfadeBuffer.getNumSamples());
+
+			AudioSourceChannelInfo section (info.buffer, startSample, numThisTime);
+			current->masterSource->getNextAudioBlock (section);
+
+			AudioSourceChannelInfo nextSection (&crossfadeBuffer, 0, numThisTime);
+			next->masterSource->getNextAudioBlock (nextSection);
+
+			const float startGain = crossfadePosition / (float) crossfadeLength;
+			const float endGain = (crossfadePosition + numThisTime) / (float) crossfadeLength;
+
+			for (int i = info.buffer->getNumChannels(); --i >= 0;)
+			{
+				info.buffer->applyGainRamp (i, startSample, numThisTime, 1.0f - startGain, 1.0f - endGain);
+
+				if (i < crossfadeBuffer.getNumChannels())
+					info.buffer->addFromWithRamp (i, startSample, crossfadeBuffer.getSampleData (i),
+												  numThisTime, startGain, endGain);
+			}
+
+			crossfadePosition += numThisTime;
+			startSample += numThisTime;
+			numLeft -= numThisTime;
+		}
+	}
+
+	if (crossfadePosition >= 0 && crossfadePosition >= crossfadeLength)
+		finishCrossfade();
+}
+
 void AudioTransportSource::getNextAudioBlock (const AudioSourceChannelInfo& info)
 {
 	const ScopedLock sl (callbackLock);
 
 	inputStreamEOF = false;
 
-	if (masterSource != nullptr && ! stopped)
+	if (current != nullptr && ! stopped)
 	{
-		masterSource->getNextAudioBlock (info);
+		if (seekPending && current->isNextBlockReady (info.numSamples))
+		{
+			lastSeekLatencyMs = Time::getMillisecondCounterHiRes() - seekTime;
+			seekPending = false;
+		}
+
+		readCurrentSource (info);
 
 		if (! playing)
 		{
@@ -2215,6 +4959,8 @@ void AudioTransportSource::getNextAudioBlock (const AudioSourceChannelInfo& info
 				info.buffer->clear (info.startSample + 256, info.numSamples - 256);
 		}
 
+		PositionableAudioSource* const positionableSource = current->positionableSource;
+
 		if (positionableSource->getNextReadPosition() > positionableSource->getTotalLength() + 1
 			 && ! positionableSource->isLooping())
 		{
@@ -2240,6 +4986,174 @@ void AudioTransportSource::getNextAudioBlock (const AudioSourceChannelInfo& info
 	lastGain = gain;
 }
 
+#if JUCE_UNIT_TESTS
+
+class AudioTransportSourceTests  : public UnitTest
+{
+public:
+	AudioTransportSourceTests() : UnitTest ("AudioTransportSource") {}
+
+	void runTest()
+	{
+		beginTest ("Crossfade");
+		{
+			ConstantSource a (1.0f, 1000), b (0.5f, 1000);
+			AudioTransportSource transport;
+			transport.prepareToPlay (64, 1000.0);
+			transport.setSource (&a);
+			transport.queueNextSource (&b, 0.1);
+			transport.start();
+
+			AudioSampleBuffer output (1, 1200);
+			render (transport, output, 64);
+
+			expect (transport.getNextSource() == nullptr);
+			expectNear (*output.getSampleData (0, 899), 1.0f);
+			expectNear (*output.getSampleData (0, 950), 0.75f);
+			expectNear (*output.getSampleData (0, 1000), 0.5f);
+			expectNear (*output.getSampleData (0, 1100), 0.5f);
+			expect (b.getNextReadPosition() == 300);
+
+			transport.setSource (nullptr);
+		}
+
+		beginTest ("Gapless");
+		{
+			ConstantSource a (1.0f, 1000), b (0.5f, 1000);
+			AudioTransportSource transport;
+			transport.prepareToPlay (64, 1000.0);
+			transport.setSource (&a);
+			transport.queueNextSource (&b, 0.0);
+			transport.start();
+
+			AudioSampleBuffer output (1, 1200);
+			render (transport, output, 64);
+
+			expectEquals (*output.getSampleData (0, 999), 1.0f);
+			expectEquals (*output.getSampleData (0, 1000), 0.5f);
+			expect (b.getNextReadPosition() == 200);
+			expect (transport.isPlaying());
+
+			transport.setSource (nullptr);
+		}
+
+		beginTest ("Back-to-back switches");
+		{
+			// The second source is shorter than a block, and the third is queued straight
+			// after the first switch, before the message thread has deleted the first chain.
+			ConstantSource a (1.0f, 100), b (0.5f, 50), c (0.25f, 1000);
+			AudioTransportSource transport;
+			transport.prepareToPlay (64, 1000.0);
+			transport.setSource (&a);
+			transport.queueNextSource (&b, 0.0);
+			transport.start();
+
+			AudioSampleBuffer output (1, 320);
+			bool hasQueuedC = false;
+
+			for (int pos = 0; pos < output.getNumSamples(); pos += 64)
+			{
+				transport.getNextAudioBlock (AudioSourceChannelInfo (&output, pos, 64));
+
+				if (! hasQueuedC && transport.getNextSource() == nullptr)
+				{
+					transport.queueNextSource (&c, 0.0);
+					hasQueuedC = true;
+				}
+			}
+
+			expectEquals (*output.getSampleData (0, 99), 1.0f);
+			expectEquals (*output.getSampleData (0, 100), 0.5f);
+			expectEquals (*output.getSampleData (0, 149), 0.5f);
+			expectEquals (*output.getSampleData (0, 150), 0.25f);
+			expectEquals (*output.getSampleData (0, 319), 0.25f);
+			expect (c.getNextReadPosition() == 170);
+			expect (transport.isPlaying());
+
+			transport.setSource (nullptr);
+		}
+
+		beginTest ("Seek latency");
+		{
+			TimeSliceThread thread ("read-ahead");
+			thread.startThread();
+
+			ConstantSource a (1.0f, 100000);
+			AudioTransportSource transport;
+			transport.prepareToPlay (64, 1000.0);
+			transport.setSource (&a, 8192, &thread);
+			transport.start();
+
+			Thread::sleep (200);
+			transport.setNextReadPosition (10);
+
+			AudioSampleBuffer output (1, 64);
+
+			for (int i = 0; i < 100 && transport.getLastSeekLatencyMs() < 0; ++i)
+			{
+				render (transport, output, 64);
+				Thread::sleep (5);
+			}
+
+			expect (transport.getLastSeekLatencyMs() >= 0);
+
+			transport.setSource (nullptr);
+			thread.stopThread (1000);
+		}
+	}
+
+private:
+	class ConstantSource  : public PositionableAudioSource
+	{
+	public:
+		ConstantSource (float value_, int64 length_) : value (value_), length (length_), position (0) {}
+
+		void prepareToPlay (int, double) {}
+		void releaseResources() {}
+
+		void getNextAudioBlock (const AudioSourceChannelInfo& info)
+		{
+			const int num = (int) jlimit ((int64) 0, (int64) info.numSamples, length - position);
+
+			for (int i = info.buffer->getNumChannels(); --i >= 0;)
+			{
+				float* const d = info.buffer->getSampleData (i, info.startSample);
+
+				for (int j = 0; j < info.numSamples; ++j)
+					d[j] = j < num ? value : 0.0f;
+			}
+
+			position += info.numSamples;
+		}
+
+		void setNextReadPosition (int64 newPosition)    { position = newPosition; }
+		int64 getNextReadPosition() const               { return position; }
+		int64 getTotalLength() const                    { return length; }
+		bool isLooping() const                          { return false; }
+
+	private:
+		const float value;
+		const int64 length;
+		int64 position;
+	};
+
+	static void render (AudioSource& source, AudioSampleBuffer& output, const int blockSize)
+	{
+		for (int pos = 0; pos < output.getNumSamples(); pos += blockSize)
+			source.getNextAudioBlock (AudioSourceChannelInfo (&output, pos, jmin (blockSize, output.getNumSamples() - pos)));
+	}
+
+	void expectNear (const float actual, const float expected)
+	{
+		expect (std::abs (actual - expected) < 0.02f,
+				"expected " + String (expected) + " but got " + String (actual));
+	}
+};
+
+static AudioTransportSourceTests audioTransportSourceTests;
+
+#endif
+
 /*** End of inlined file: juce_AudioTransportSource.cpp ***/
 
 // END_AUTOINCLUDE
@@ -12470,74 +15384,307 @@ namespace
 			if (snd_pcm_hw_params_any (handle, hwParams) >= 0
 				 && snd_pcm_hw_params_test_rate (handle, hwParams, ratesToTry[i], 0) == 0)
 			{
-				rates.addIfNotAlreadyThere (ratesToTry[i]);
+				rates.addIfNotAlreadyThere (ratesToTry[i]);
+			}
+		}
+	}
+
+	void getDeviceNumChannels (snd_pcm_t* handle, unsigned int* minChans, unsigned int* maxChans)
+	{
+		snd_pcm_hw_params_t *params;
+		snd_pcm_hw_params_alloca (&params);
+
+		if (snd_pcm_hw_params_any (handle, params) >= 0)
+		{
+			snd_pcm_hw_params_get_channels_min (params, minChans);
+			snd_pcm_hw_params_get_channels_max (params, maxChans);
+		}
+	}
+
+	void getDeviceProperties (const String& deviceID,
+							  unsigned int& minChansOut,
+							  unsigned int& maxChansOut,
+							  unsigned int& minChansIn,
+							  unsigned int& maxChansIn,
+							  Array <int>& rates)
+	{
+		if (deviceID.isEmpty())
+			return;
+
+		snd_ctl_t* handle;
+
+		if (snd_ctl_open (&handle, deviceID.upToLastOccurrenceOf (",", false, false).toUTF8(), SND_CTL_NONBLOCK) >= 0)
+		{
+			snd_pcm_info_t* info;
+			snd_pcm_info_alloca (&info);
+
+			snd_pcm_info_set_stream (info, SND_PCM_STREAM_PLAYBACK);
+			snd_pcm_info_set_device (info, deviceID.fromLastOccurrenceOf (",", false, false).getIntValue());
+			snd_pcm_info_set_subdevice (info, 0);
+
+			if (snd_ctl_pcm_info (handle, info) >= 0)
+			{
+				snd_pcm_t* pcmHandle;
+				if (snd_pcm_open (&pcmHandle, deviceID.toUTF8(), SND_PCM_STREAM_PLAYBACK, SND_PCM_ASYNC | SND_PCM_NONBLOCK) >= 0)
+				{
+					getDeviceNumChannels (pcmHandle, &minChansOut, &maxChansOut);
+					getDeviceSampleRates (pcmHandle, rates);
+
+					snd_pcm_close (pcmHandle);
+				}
+			}
+
+			snd_pcm_info_set_stream (info, SND_PCM_STREAM_CAPTURE);
+
+			if (snd_ctl_pcm_info (handle, info) >= 0)
+			{
+				snd_pcm_t* pcmHandle;
+				if (snd_pcm_open (&pcmHandle, deviceID.toUTF8(), SND_PCM_STREAM_CAPTURE, SND_PCM_ASYNC | SND_PCM_NONBLOCK) >= 0)
+				{
+					getDeviceNumChannels (pcmHandle, &minChansIn, &maxChansIn);
+
+					if (rates.size() == 0)
+						getDeviceSampleRates (pcmHandle, rates);
+
+					snd_pcm_close (pcmHandle);
+				}
+			}
+
+			snd_ctl_close (handle);
+		}
+	}
+
+	//==============================================================================
+	/*  Most hardware uses one of a few little-endian formats, so these have fast
+		conversion routines. Each sample in the device's buffer is 'stride' samples
+		away from the previous one, which allows them to be used on both interleaved and
+		non-interleaved data.
+	*/
+	enum FastSampleType
+	{
+		fastFloat32LE,
+		fastInt32LE,
+		fastInt16LE,
+		noFastConversion
+	};
+
+	/*  The float-to-int conversions give exactly the same results as AudioData::Converter,
+		which is what was used before these existed: each sample is clipped and rounded to a
+		32-bit value in double precision, and a 16-bit sample is the top half of that.
+	*/
+	inline int32 floatToInt32 (const float sample) noexcept
+	{
+		return roundToInt (jlimit (-1.0, 1.0, (double) sample) * 2147483647.0);
+	}
+
+   #if JUCE_USE_SSE_INTRINSICS
+	inline __m128i floatsToInt32 (const float* const src) noexcept
+	{
+		const __m128 clipped = _mm_min_ps (_mm_max_ps (_mm_loadu_ps (src), _mm_set1_ps (-1.0f)), _mm_set1_ps (1.0f));
+		const __m128d scale = _mm_set1_pd (2147483647.0);
+
+		return _mm_unpacklo_epi64 (_mm_cvtpd_epi32 (_mm_mul_pd (_mm_cvtps_pd (clipped), scale)),
+								   _mm_cvtpd_epi32 (_mm_mul_pd (_mm_cvtps_pd (_mm_movehl_ps (clipped, clipped)), scale)));
+	}
+   #endif
+
+	void convertFloatToInt16 (const float* const src, int16* const dest, const int stride, const int numSamples) noexcept
+	{
+		int i = 0;
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		for (; i <= numSamples - 8; i += 8)
+		{
+			const __m128i packed = _mm_packs_epi32 (_mm_srai_epi32 (floatsToInt32 (src + i), 16),
+													_mm_srai_epi32 (floatsToInt32 (src + i + 4), 16));
+
+			if (stride == 1)
+			{
+				_mm_storeu_si128 ((__m128i*) (dest + i), packed);
+			}
+			else
+			{
+				int16 results[8];
+				_mm_storeu_si128 ((__m128i*) results, packed);
+
+				for (int j = 0; j < 8; ++j)
+					dest [(i + j) * stride] = results[j];
+			}
+		}
+	   #endif
+
+		for (; i < numSamples; ++i)
+			dest [i * stride] = (int16) (floatToInt32 (src[i]) >> 16);
+	}
+
+	void convertFloatToInt32 (const float* const src, int32* const dest, const int stride, const int numSamples) noexcept
+	{
+		int i = 0;
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		for (; i <= numSamples - 4; i += 4)
+		{
+			const __m128i ints = floatsToInt32 (src + i);
+
+			if (stride == 1)
+			{
+				_mm_storeu_si128 ((__m128i*) (dest + i), ints);
+			}
+			else
+			{
+				int32 results[4];
+				_mm_storeu_si128 ((__m128i*) results, ints);
+
+				for (int j = 0; j < 4; ++j)
+					dest [(i + j) * stride] = results[j];
+			}
+		}
+	   #endif
+
+		for (; i < numSamples; ++i)
+			dest [i * stride] = floatToInt32 (src[i]);
+	}
+
+	// (this works backwards, so that it can also be used to expand a buffer in-place)
+	void convertInt16ToFloat (const int16* const src, const int stride, float* const dest, const int numSamples) noexcept
+	{
+		const float scale = 1.0f / 32768.0f;
+		int i = numSamples;
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		if (stride == 1)
+		{
+			const __m128 scaleVector = _mm_set1_ps (scale);
+
+			while (i > (numSamples & ~7))
+			{
+				--i;
+				dest[i] = src[i] * scale;
+			}
+
+			while (i > 0)
+			{
+				i -= 8;
+				const __m128i s = _mm_loadu_si128 ((const __m128i*) (src + i));
+
+				// (shifting the samples into the top of each 32-bit slot sign-extends them)
+				const __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 16);
+				const __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (s, s), 16);
+
+				_mm_storeu_ps (dest + i,     _mm_mul_ps (_mm_cvtepi32_ps (lo), scaleVector));
+				_mm_storeu_ps (dest + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (hi), scaleVector));
 			}
 		}
+	   #endif
+
+		while (--i >= 0)
+			dest[i] = src [i * stride] * scale;
 	}
 
-	void getDeviceNumChannels (snd_pcm_t* handle, unsigned int* minChans, unsigned int* maxChans)
+	void convertInt32ToFloat (const int32* const src, const int stride, float* const dest, const int numSamples) noexcept
 	{
-		snd_pcm_hw_params_t *params;
-		snd_pcm_hw_params_alloca (&params);
+		const float scale = 1.0f / 2147483648.0f;
+		int i = 0;
 
-		if (snd_pcm_hw_params_any (handle, params) >= 0)
+	   #if JUCE_USE_SSE_INTRINSICS
+		const __m128 scaleVector = _mm_set1_ps (scale);
+
+		for (; i <= numSamples - 4; i += 4)
 		{
-			snd_pcm_hw_params_get_channels_min (params, minChans);
-			snd_pcm_hw_params_get_channels_max (params, maxChans);
+			const __m128i ints = stride == 1 ? _mm_loadu_si128 ((const __m128i*) (src + i))
+											 : _mm_set_epi32 (src [(i + 3) * stride], src [(i + 2) * stride],
+															  src [(i + 1) * stride], src [i * stride]);
+
+			_mm_storeu_ps (dest + i, _mm_mul_ps (_mm_cvtepi32_ps (ints), scaleVector));
 		}
+	   #endif
+
+		for (; i < numSamples; ++i)
+			dest[i] = src [i * stride] * scale;
 	}
 
-	void getDeviceProperties (const String& deviceID,
-							  unsigned int& minChansOut,
-							  unsigned int& maxChansOut,
-							  unsigned int& minChansIn,
-							  unsigned int& maxChansIn,
-							  Array <int>& rates)
+	bool convertFloatToDevice (const FastSampleType type, const float* const src,
+							   void* const dest, const int stride, const int numSamples) noexcept
 	{
-		if (deviceID.isEmpty())
-			return;
+		switch (type)
+		{
+			case fastInt16LE:   convertFloatToInt16 (src, static_cast <int16*> (dest), stride, numSamples); return true;
+			case fastInt32LE:   convertFloatToInt32 (src, static_cast <int32*> (dest), stride, numSamples); return true;
 
-		snd_ctl_t* handle;
+			case fastFloat32LE:
+				if (stride == 1)
+				{
+					memmove (dest, src, sizeof (float) * (size_t) numSamples);
+				}
+				else
+				{
+					float* const d = static_cast <float*> (dest);
 
-		if (snd_ctl_open (&handle, deviceID.upToLastOccurrenceOf (",", false, false).toUTF8(), SND_CTL_NONBLOCK) >= 0)
-		{
-			snd_pcm_info_t* info;
-			snd_pcm_info_alloca (&info);
+					for (int i = 0; i < numSamples; ++i)
+						d [i * stride] = src[i];
+				}
 
-			snd_pcm_info_set_stream (info, SND_PCM_STREAM_PLAYBACK);
-			snd_pcm_info_set_device (info, deviceID.fromLastOccurrenceOf (",", false, false).getIntValue());
-			snd_pcm_info_set_subdevice (info, 0);
+				return true;
 
-			if (snd_ctl_pcm_info (handle, info) >= 0)
-			{
-				snd_pcm_t* pcmHandle;
-				if (snd_pcm_open (&pcmHandle, deviceID.toUTF8(), SND_PCM_STREAM_PLAYBACK, SND_PCM_ASYNC | SND_PCM_NONBLOCK) >= 0)
+			default:
+				return false;
+		}
+	}
+
+	bool convertDeviceToFloat (const FastSampleType type, const void* const src,
+							   const int stride, float* const dest, const int numSamples) noexcept
+	{
+		switch (type)
+		{
+			case fastInt16LE:   convertInt16ToFloat (static_cast <const int16*> (src), stride, dest, numSamples); return true;
+			case fastInt32LE:   convertInt32ToFloat (static_cast <const int32*> (src), stride, dest, numSamples); return true;
+
+			case fastFloat32LE:
+				if (stride == 1)
 				{
-					getDeviceNumChannels (pcmHandle, &minChansOut, &maxChansOut);
-					getDeviceSampleRates (pcmHandle, rates);
+					memmove (dest, src, sizeof (float) * (size_t) numSamples);
+				}
+				else
+				{
+					const float* const s = static_cast <const float*> (src);
 
-					snd_pcm_close (pcmHandle);
+					for (int i = 0; i < numSamples; ++i)
+						dest[i] = s [i * stride];
 				}
-			}
 
-			snd_pcm_info_set_stream (info, SND_PCM_STREAM_CAPTURE);
+				return true;
 
-			if (snd_ctl_pcm_info (handle, info) >= 0)
-			{
-				snd_pcm_t* pcmHandle;
-				if (snd_pcm_open (&pcmHandle, deviceID.toUTF8(), SND_PCM_STREAM_CAPTURE, SND_PCM_ASYNC | SND_PCM_NONBLOCK) >= 0)
-				{
-					getDeviceNumChannels (pcmHandle, &minChansIn, &maxChansIn);
+			default:
+				return false;
+		}
+	}
 
-					if (rates.size() == 0)
-						getDeviceSampleRates (pcmHandle, rates);
+	//==============================================================================
+	// Tries to give the calling thread SCHED_FIFO priority, staying within the limit
+	// that the user is allowed if that's lower than the priority we'd like.
+	bool setCurrentThreadToRealtimePriority()
+	{
+		const int minPriority = sched_get_priority_min (SCHED_FIFO);
+		const int maxPriority = sched_get_priority_max (SCHED_FIFO);
 
-					snd_pcm_close (pcmHandle);
-				}
-			}
+		struct sched_param param;
+		param.sched_priority = minPriority + (maxPriority - minPriority) * 7 / 10;
 
-			snd_ctl_close (handle);
+		if (pthread_setschedparam (pthread_self(), SCHED_FIFO, &param) == 0)
+			return true;
+
+		struct rlimit limit;
+
+		if (getrlimit (RLIMIT_RTPRIO, &limit) == 0
+			 && limit.rlim_cur != RLIM_INFINITY
+			 && (int) limit.rlim_cur >= minPriority
+			 && (int) limit.rlim_cur < param.sched_priority)
+		{
+			param.sched_priority = (int) limit.rlim_cur;
+			return pthread_setschedparam (pthread_self(), SCHED_FIFO, &param) == 0;
 		}
+
+		return false;
 	}
 }
 
@@ -12549,8 +15696,14 @@ public:
 		  bitDepth (16),
 		  numChannelsRunning (0),
 		  latency (0),
+		  numXRuns (0),
 		  isInput (forInput),
-		  isInterleaved (true)
+		  isInterleaved (true),
+		  isMapped (false),
+		  hasStarted (false),
+		  bytesPerSample (2),
+		  fastSampleType (noFastConversion),
+		  ringBufferSize (0)
 	{
 		failed (snd_pcm_open (&handle, deviceID.toUTF8(),
 							  forInput ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK,
@@ -12574,16 +15727,23 @@ public:
 		if (failed (snd_pcm_hw_params_any (handle, hwParams)))
 			return false;
 
-		if (snd_pcm_hw_params_set_access (handle, hwParams, SND_PCM_ACCESS_RW_NONINTERLEAVED) >= 0)
-			isInterleaved = false;
-		else if (snd_pcm_hw_params_set_access (handle, hwParams, SND_PCM_ACCESS_RW_INTERLEAVED) >= 0)
-			isInterleaved = true;
-		else
+		// (the mmap modes let the data be converted straight into the device's ring buffer)
+		const snd_pcm_access_t accessTypesToTry[] = { SND_PCM_ACCESS_MMAP_NONINTERLEAVED, SND_PCM_ACCESS_MMAP_INTERLEAVED,
+													  SND_PCM_ACCESS_RW_NONINTERLEAVED, SND_PCM_ACCESS_RW_INTERLEAVED };
+		int accessIndex = JUCE_ALSA_USE_MMAP ? 0 : 2;
+
+		while (snd_pcm_hw_params_set_access (handle, hwParams, accessTypesToTry [accessIndex]) < 0)
 		{
-			jassertfalse;
-			return false;
+			if (++accessIndex >= numElementsInArray (accessTypesToTry))
+			{
+				jassertfalse;
+				return false;
+			}
 		}
 
+		isMapped = accessIndex < 2;
+		isInterleaved = (accessIndex & 1) != 0;
+
 		enum { isFloatBit = 1 << 16, isLittleEndianBit = 1 << 17 };
 
 		const int formatsToTry[] = { SND_PCM_FORMAT_FLOAT_LE,   32 | isFloatBit | isLittleEndianBit,
@@ -12601,9 +15761,19 @@ public:
 			if (snd_pcm_hw_params_set_format (handle, hwParams, (_snd_pcm_format) formatsToTry [i]) >= 0)
 			{
 				bitDepth = formatsToTry [i + 1] & 255;
+				bytesPerSample = bitDepth / 8;
 				const bool isFloat = (formatsToTry [i + 1] & isFloatBit) != 0;
 				const bool isLittleEndian = (formatsToTry [i + 1] & isLittleEndianBit) != 0;
-				converter = createConverter (isInput, bitDepth, isFloat, isLittleEndian, numChannels);
+				converter = createConverter (isInput, bitDepth, isFloat, isLittleEndian, isInterleaved ? numChannels : 1);
+
+				fastSampleType = noFastConversion;
+
+			   #if JUCE_LITTLE_ENDIAN
+				if (isLittleEndian)
+					fastSampleType = isFloat ? fastFloat32LE : (bitDepth == 32 ? fastInt32LE
+																		: (bitDepth == 16 ? fastInt16LE : noFastConversion));
+			   #endif
+
 				break;
 			}
 		}
@@ -12615,142 +15785,367 @@ public:
 			return false;
 		}
 
-		int dir = 0;
-		unsigned int periods = 4;
-		snd_pcm_uframes_t samplesPerPeriod = bufferSize;
+		int dir = 0;
+		unsigned int periods = 4;
+		snd_pcm_uframes_t samplesPerPeriod = bufferSize;
+
+		if (failed (snd_pcm_hw_params_set_rate_near (handle, hwParams, &sampleRate, 0))
+			|| failed (snd_pcm_hw_params_set_channels (handle, hwParams, numChannels))
+			|| failed (snd_pcm_hw_params_set_periods_near (handle, hwParams, &periods, &dir))
+			|| failed (snd_pcm_hw_params_set_period_size_near (handle, hwParams, &samplesPerPeriod, &dir))
+			|| failed (snd_pcm_hw_params (handle, hwParams)))
+		{
+			return false;
+		}
+
+		snd_pcm_uframes_t frames = 0;
+
+		if (failed (snd_pcm_hw_params_get_period_size (hwParams, &frames, &dir))
+			 || failed (snd_pcm_hw_params_get_periods (hwParams, &periods, &dir)))
+			latency = 0;
+		else
+			latency = frames * (periods - 1); // (this is the method JACK uses to guess the latency..)
+
+		if (failed (snd_pcm_hw_params_get_buffer_size (hwParams, &ringBufferSize)))
+			ringBufferSize = frames * periods;
+
+		snd_pcm_sw_params_t* swParams;
+		snd_pcm_sw_params_alloca (&swParams);
+		snd_pcm_uframes_t boundary;
+
+		if (failed (snd_pcm_sw_params_current (handle, swParams))
+			|| failed (snd_pcm_sw_params_get_boundary (swParams, &boundary))
+			|| failed (snd_pcm_sw_params_set_silence_threshold (handle, swParams, 0))
+			|| failed (snd_pcm_sw_params_set_silence_size (handle, swParams, boundary))
+			|| failed (snd_pcm_sw_params_set_start_threshold (handle, swParams, samplesPerPeriod))
+			|| failed (snd_pcm_sw_params_set_stop_threshold (handle, swParams, boundary))
+			|| failed (snd_pcm_sw_params (handle, swParams)))
+		{
+			return false;
+		}
+
+	  #if 0
+		// enable this to dump the config of the devices that get opened
+		snd_output_t* out;
+		snd_output_stdio_attach (&out, stderr, 0);
+		snd_pcm_hw_params_dump (hwParams, out);
+		snd_pcm_sw_params_dump (swParams, out);
+	  #endif
+
+		numChannelsRunning = numChannels;
+
+		return true;
+	}
+
+	bool writeToOutputDevice (AudioSampleBuffer& outputChannelBuffer, const int numSamples)
+	{
+		jassert (numChannelsRunning <= outputChannelBuffer.getNumChannels());
+		float** const data = outputChannelBuffer.getArrayOfChannels();
+
+		if (isMapped)
+			return writeMapped (data, numSamples);
+
+		checkForXRun (snd_pcm_avail_update (handle));
+
+		snd_pcm_sframes_t numDone = 0;
+
+		if (isInterleaved)
+		{
+			scratch.ensureSize (sizeof (float) * numSamples * numChannelsRunning, false);
+
+			for (int i = 0; i < numChannelsRunning; ++i)
+				convertToDevice (data[i], addBytesToPointer (scratch.getData(), i * bytesPerSample), numChannelsRunning, numSamples);
+
+			numDone = snd_pcm_writei (handle, scratch.getData(), numSamples);
+		}
+		else
+		{
+			for (int i = 0; i < numChannelsRunning; ++i)
+				convertToDevice (data[i], data[i], 1, numSamples);
+
+			numDone = snd_pcm_writen (handle, (void**) data, numSamples);
+		}
+
+		hasStarted = true;
+		return numDone >= 0 || recover ((int) numDone);
+	}
+
+	bool readFromInputDevice (AudioSampleBuffer& inputChannelBuffer, const int numSamples)
+	{
+		jassert (numChannelsRunning <= inputChannelBuffer.getNumChannels());
+		float** const data = inputChannelBuffer.getArrayOfChannels();
+
+		if (isMapped)
+			return readMapped (data, numSamples);
+
+		checkForXRun (snd_pcm_avail_update (handle));
+
+		if (isInterleaved)
+		{
+			scratch.ensureSize (sizeof (float) * numSamples * numChannelsRunning, false);
+			scratch.fillWith (0); // (not clearing this data causes warnings in valgrind)
+
+			if (! readFrames (scratch.getData(), numSamples, true))
+				return false;
+
+			for (int i = 0; i < numChannelsRunning; ++i)
+				convertFromDevice (addBytesToPointer (scratch.getData(), i * bytesPerSample), numChannelsRunning, data[i], numSamples);
+		}
+		else
+		{
+			if (! readFrames (data, numSamples, false))
+				return false;
+
+			for (int i = 0; i < numChannelsRunning; ++i)
+				convertFromDevice (data[i], 1, data[i], numSamples);
+		}
+
+		hasStarted = true;
+		return true;
+	}
+
+	snd_pcm_t* handle;
+	String error;
+	int bitDepth, numChannelsRunning, latency;
+	int volatile numXRuns;
+
+	bool isMemoryMapped() const noexcept    { return isMapped; }
+
+private:
+	const bool isInput;
+	bool isInterleaved, isMapped, hasStarted;
+	int bytesPerSample;
+	FastSampleType fastSampleType;
+	snd_pcm_uframes_t ringBufferSize;
+	MemoryBlock scratch;
+	ScopedPointer<AudioData::Converter> converter;
+
+	void convertToDevice (const float* const source, void* const dest, const int stride, const int numSamples)
+	{
+		if (! convertFloatToDevice (fastSampleType, source, dest, stride, numSamples))
+		{
+			jassert (stride == (isInterleaved ? numChannelsRunning : 1));
+			converter->convertSamples (dest, 0, source, 0, numSamples);
+		}
+	}
+
+	void convertFromDevice (const void* const source, const int stride, float* const dest, const int numSamples)
+	{
+		if (! convertDeviceToFloat (fastSampleType, source, stride, dest, numSamples))
+		{
+			jassert (stride == (isInterleaved ? numChannelsRunning : 1));
+			converter->convertSamples (dest, 0, source, 0, numSamples);
+		}
+	}
+
+	static void* getAreaAddress (const snd_pcm_channel_area_t& area, const snd_pcm_uframes_t offset) noexcept
+	{
+		return addBytesToPointer (area.addr, (area.first + offset * area.step) / 8);
+	}
+
+	int getAreaStride (const snd_pcm_channel_area_t& area) const noexcept
+	{
+		return (int) (area.step / (8 * (unsigned int) bytesPerSample));
+	}
+
+	bool readFrames (void* const dest, const int numSamples, const bool interleaved)
+	{
+		for (int attempt = 0;; ++attempt)
+		{
+			const snd_pcm_sframes_t num = interleaved ? snd_pcm_readi (handle, dest, (snd_pcm_uframes_t) numSamples)
+													  : snd_pcm_readn (handle, (void**) dest, (snd_pcm_uframes_t) numSamples);
+
+			if (num >= 0)
+				return true;
+
+			if (! recover ((int) num))
+				return false;
+
+			// after an overrun, the stream has been re-prepared, so try once more to fill this block
+			if (attempt > 0)
+				return true;
+		}
+	}
+
+	// Because the stop threshold is set to the boundary, an under- or overrun doesn't
+	// stop the stream, so it has to be spotted by the amount of space in the buffer
+	// having grown beyond the buffer size.
+	snd_pcm_sframes_t checkForXRun (snd_pcm_sframes_t avail)
+	{
+		if (avail > (snd_pcm_sframes_t) ringBufferSize)
+		{
+			if (hasStarted)
+				++numXRuns;
+
+			// skip over the frames that were lost, so that we're back in step with the hardware
+			snd_pcm_forward (handle, (snd_pcm_uframes_t) (avail - (snd_pcm_sframes_t) ringBufferSize));
+			avail = (snd_pcm_sframes_t) ringBufferSize;
+		}
+
+		return avail;
+	}
+
+	bool recover (const int errorNum)
+	{
+		if (errorNum == -EPIPE)
+		{
+			++numXRuns;
+			return ! failed (snd_pcm_prepare (handle));
+		}
+
+		if (errorNum == -ESTRPIPE)
+		{
+			int result;
+
+			while ((result = snd_pcm_resume (handle)) == -EAGAIN)
+				Thread::sleep (1);
+
+			return result >= 0 || ! failed (snd_pcm_prepare (handle));
+		}
+
+		failed (errorNum);
+		return false;
+	}
 
-		if (failed (snd_pcm_hw_params_set_rate_near (handle, hwParams, &sampleRate, 0))
-			|| failed (snd_pcm_hw_params_set_channels (handle, hwParams, numChannels))
-			|| failed (snd_pcm_hw_params_set_periods_near (handle, hwParams, &periods, &dir))
-			|| failed (snd_pcm_hw_params_set_period_size_near (handle, hwParams, &samplesPerPeriod, &dir))
-			|| failed (snd_pcm_hw_params (handle, hwParams)))
+	bool waitForDevice()
+	{
+		const int result = snd_pcm_wait (handle, 2000);
+
+		if (result == 0)
 		{
+			error = "device timed out";
 			return false;
 		}
 
-		snd_pcm_uframes_t frames = 0;
+		return result > 0 || recover (result);
+	}
 
-		if (failed (snd_pcm_hw_params_get_period_size (hwParams, &frames, &dir))
-			 || failed (snd_pcm_hw_params_get_periods (hwParams, &periods, &dir)))
-			latency = 0;
-		else
-			latency = frames * (periods - 1); // (this is the method JACK uses to guess the latency..)
+	bool writeMapped (float** const data, const int numSamples)
+	{
+		for (int numDone = 0; numDone < numSamples;)
+		{
+			const snd_pcm_sframes_t avail = checkForXRun (snd_pcm_avail_update (handle));
 
-		snd_pcm_sw_params_t* swParams;
-		snd_pcm_sw_params_alloca (&swParams);
-		snd_pcm_uframes_t boundary;
+			if (avail < 0)
+			{
+				if (! recover ((int) avail))
+					return false;
 
-		if (failed (snd_pcm_sw_params_current (handle, swParams))
-			|| failed (snd_pcm_sw_params_get_boundary (swParams, &boundary))
-			|| failed (snd_pcm_sw_params_set_silence_threshold (handle, swParams, 0))
-			|| failed (snd_pcm_sw_params_set_silence_size (handle, swParams, boundary))
-			|| failed (snd_pcm_sw_params_set_start_threshold (handle, swParams, samplesPerPeriod))
-			|| failed (snd_pcm_sw_params_set_stop_threshold (handle, swParams, boundary))
-			|| failed (snd_pcm_sw_params (handle, swParams)))
-		{
-			return false;
-		}
+				continue;
+			}
 
-	  #if 0
-		// enable this to dump the config of the devices that get opened
-		snd_output_t* out;
-		snd_output_stdio_attach (&out, stderr, 0);
-		snd_pcm_hw_params_dump (hwParams, out);
-		snd_pcm_sw_params_dump (swParams, out);
-	  #endif
+			if (avail == 0)
+			{
+				if (snd_pcm_state (handle) == SND_PCM_STATE_PREPARED)
+				{
+					if (failed (snd_pcm_start (handle)))
+						return false;
+				}
+				else if (! waitForDevice())
+				{
+					return false;
+				}
 
-		numChannelsRunning = numChannels;
+				continue;
+			}
 
-		return true;
-	}
+			const snd_pcm_channel_area_t* areas = nullptr;
+			snd_pcm_uframes_t offset = 0;
+			snd_pcm_uframes_t frames = (snd_pcm_uframes_t) jmin ((snd_pcm_sframes_t) (numSamples - numDone), avail);
 
-	bool writeToOutputDevice (AudioSampleBuffer& outputChannelBuffer, const int numSamples)
-	{
-		jassert (numChannelsRunning <= outputChannelBuffer.getNumChannels());
-		float** const data = outputChannelBuffer.getArrayOfChannels();
-		snd_pcm_sframes_t numDone = 0;
+			const int result = snd_pcm_mmap_begin (handle, &areas, &offset, &frames);
 
-		if (isInterleaved)
-		{
-			scratch.ensureSize (sizeof (float) * numSamples * numChannelsRunning, false);
+			if (result < 0)
+			{
+				if (! recover (result))
+					return false;
 
-			for (int i = 0; i < numChannelsRunning; ++i)
-				converter->convertSamples (scratch.getData(), i, data[i], 0, numSamples);
+				continue;
+			}
 
-			numDone = snd_pcm_writei (handle, scratch.getData(), numSamples);
-		}
-		else
-		{
 			for (int i = 0; i < numChannelsRunning; ++i)
-				converter->convertSamples (data[i], data[i], numSamples);
+				convertToDevice (data[i] + numDone, getAreaAddress (areas[i], offset), getAreaStride (areas[i]), (int) frames);
 
-			numDone = snd_pcm_writen (handle, (void**) data, numSamples);
-		}
+			const snd_pcm_sframes_t numCommitted = snd_pcm_mmap_commit (handle, offset, frames);
 
-		if (failed (numDone))
-		{
-			if (numDone == -EPIPE)
+			if (numCommitted < 0 || (snd_pcm_uframes_t) numCommitted != frames)
 			{
-				if (failed (snd_pcm_prepare (handle)))
+				if (! recover (numCommitted < 0 ? (int) numCommitted : -EPIPE))
 					return false;
+
+				continue;
 			}
-			else if (numDone != -ESTRPIPE)
-				return false;
+
+			numDone += (int) frames;
 		}
 
+		hasStarted = true;
+
+		if (snd_pcm_state (handle) == SND_PCM_STATE_PREPARED)
+			return ! failed (snd_pcm_start (handle));
+
 		return true;
 	}
 
-	bool readFromInputDevice (AudioSampleBuffer& inputChannelBuffer, const int numSamples)
+	bool readMapped (float** const data, const int numSamples)
 	{
-		jassert (numChannelsRunning <= inputChannelBuffer.getNumChannels());
-		float** const data = inputChannelBuffer.getArrayOfChannels();
-
-		if (isInterleaved)
+		for (int numDone = 0; numDone < numSamples;)
 		{
-			scratch.ensureSize (sizeof (float) * numSamples * numChannelsRunning, false);
-			scratch.fillWith (0); // (not clearing this data causes warnings in valgrind)
+			if (snd_pcm_state (handle) == SND_PCM_STATE_PREPARED && failed (snd_pcm_start (handle)))
+				return false;
 
-			snd_pcm_sframes_t num = snd_pcm_readi (handle, scratch.getData(), numSamples);
+			const snd_pcm_sframes_t avail = checkForXRun (snd_pcm_avail_update (handle));
 
-			if (failed (num))
+			if (avail < 0)
 			{
-				if (num == -EPIPE)
-				{
-					if (failed (snd_pcm_prepare (handle)))
-						return false;
-				}
-				else if (num != -ESTRPIPE)
+				if (! recover ((int) avail))
+					return false;
+
+				continue;
+			}
+
+			if (avail == 0)
+			{
+				if (! waitForDevice())
 					return false;
+
+				continue;
 			}
 
-			for (int i = 0; i < numChannelsRunning; ++i)
-				converter->convertSamples (data[i], 0, scratch.getData(), i, numSamples);
-		}
-		else
-		{
-			snd_pcm_sframes_t num = snd_pcm_readn (handle, (void**) data, numSamples);
+			const snd_pcm_channel_area_t* areas = nullptr;
+			snd_pcm_uframes_t offset = 0;
+			snd_pcm_uframes_t frames = (snd_pcm_uframes_t) jmin ((snd_pcm_sframes_t) (numSamples - numDone), avail);
 
-			if (failed (num) && num != -EPIPE && num != -ESTRPIPE)
-				return false;
+			const int result = snd_pcm_mmap_begin (handle, &areas, &offset, &frames);
+
+			if (result < 0)
+			{
+				if (! recover (result))
+					return false;
+
+				continue;
+			}
 
 			for (int i = 0; i < numChannelsRunning; ++i)
-				converter->convertSamples (data[i], data[i], numSamples);
+				convertFromDevice (getAreaAddress (areas[i], offset), getAreaStride (areas[i]), data[i] + numDone, (int) frames);
+
+			const snd_pcm_sframes_t numCommitted = snd_pcm_mmap_commit (handle, offset, frames);
+
+			if (numCommitted < 0 || (snd_pcm_uframes_t) numCommitted != frames)
+			{
+				if (! recover (numCommitted < 0 ? (int) numCommitted : -EPIPE))
+					return false;
+
+				continue;
+			}
+
+			numDone += (int) frames;
 		}
 
+		hasStarted = true;
 		return true;
 	}
 
-	snd_pcm_t* handle;
-	String error;
-	int bitDepth, numChannelsRunning, latency;
-
-private:
-	const bool isInput;
-	bool isInterleaved;
-	MemoryBlock scratch;
-	ScopedPointer<AudioData::Converter> converter;
-
 	template <class SampleType>
 	struct ConverterHelper
 	{
@@ -12814,10 +16209,11 @@ public:
 		  bufferSize (0),
 		  outputLatency (0),
 		  inputLatency (0),
-		  callback (0),
+		  callback (nullptr),
 		  inputId (inputId_),
 		  outputId (outputId_),
 		  numCallbacks (0),
+		  lastCallbackTime (0),
 		  inputChannelBuffer (1, 1),
 		  outputChannelBuffer (1, 1)
 	{
@@ -12968,16 +16364,23 @@ public:
 		outputChannelBuffer.setSize (1, 1);
 
 		numCallbacks = 0;
+		lastCallbackTime = 0;
+
+		const SpinLock::ScopedLockType sl (statsLock);
+		timingStats = AudioIODevice::CallbackTimingStatistics();
 	}
 
-	void setCallback (AudioIODeviceCallback* const newCallback) noexcept
+	void setCallback (AudioIODeviceCallback* const newCallback)
 	{
-		const ScopedLock sl (callbackLock);
-		callback = newCallback;
+		// this waits for the current block to finish if the old callback is in use
+		callback.exchange (newCallback);
 	}
 
 	void run()
 	{
+		if (! setCurrentThreadToRealtimePriority())
+			DBG ("ALSA: couldn't get SCHED_FIFO priority for the audio thread, so running at normal priority");
+
 		while (! threadShouldExit())
 		{
 			if (inputDevice != nullptr)
@@ -12993,16 +16396,31 @@ public:
 				break;
 
 			{
-				const ScopedLock sl (callbackLock);
+				const double now = Time::getMillisecondCounterHiRes();
+
+				if (lastCallbackTime > 0)
+				{
+					// (never wait here for a reader - if it's busy, this one interval just gets dropped)
+					const GenericScopedTryLock<SpinLock> sl (statsLock);
+
+					if (sl.isLocked())
+						timingStats.addInterval (now - lastCallbackTime);
+				}
+
+				lastCallbackTime = now;
+			}
+
+			{
+				const AudioThreadPointer<AudioIODeviceCallback>::ScopedReader currentCallback (callback);
 				++numCallbacks;
 
-				if (callback != nullptr)
+				if (currentCallback.get() != nullptr)
 				{
-					callback->audioDeviceIOCallback ((const float**) inputChannelDataForCallback.getRawDataPointer(),
-													 inputChannelDataForCallback.size(),
-													 outputChannelDataForCallback.getRawDataPointer(),
-													 outputChannelDataForCallback.size(),
-													 bufferSize);
+					currentCallback->audioDeviceIOCallback ((const float**) inputChannelDataForCallback.getRawDataPointer(),
+															inputChannelDataForCallback.size(),
+															outputChannelDataForCallback.getRawDataPointer(),
+															outputChannelDataForCallback.size(),
+															bufferSize);
 				}
 				else
 				{
@@ -13013,13 +16431,13 @@ public:
 
 			if (outputDevice != nullptr)
 			{
-				failed (snd_pcm_wait (outputDevice->handle, 2000));
+				// (in mmap mode, the device waits for space by itself)
+				if (! outputDevice->isMemoryMapped())
+					failed (snd_pcm_wait (outputDevice->handle, 2000));
 
 				if (threadShouldExit())
 					break;
 
-				failed (snd_pcm_avail_update (outputDevice->handle));
-
 				if (! outputDevice->writeToOutputDevice (outputChannelBuffer, bufferSize))
 				{
 					DBG ("ALSA: write failure");
@@ -13040,6 +16458,25 @@ public:
 		return 16;
 	}
 
+	int getXRunCount() const noexcept
+	{
+		int total = 0;
+
+		if (outputDevice != nullptr)
+			total += outputDevice->numXRuns;
+
+		if (inputDevice != nullptr)
+			total += inputDevice->numXRuns;
+
+		return total;
+	}
+
+	AudioIODevice::CallbackTimingStatistics getCallbackTimingStatistics() const
+	{
+		const SpinLock::ScopedLockType sl (statsLock);
+		return timingStats;
+	}
+
 	String error;
 	double sampleRate;
 	int bufferSize, outputLatency, inputLatency;
@@ -13047,15 +16484,17 @@ public:
 
 	Array <int> sampleRates;
 	StringArray channelNamesOut, channelNamesIn;
-	AudioIODeviceCallback* callback;
+	AudioThreadPointer<AudioIODeviceCallback> callback;
 
 private:
 
 	const String inputId, outputId;
 	ScopedPointer<ALSADevice> outputDevice, inputDevice;
 	int numCallbacks;
+	double lastCallbackTime;
 
-	CriticalSection callbackLock;
+	SpinLock statsLock;
+	AudioIODevice::CallbackTimingStatistics timingStats;
 
 	AudioSampleBuffer inputChannelBuffer, outputChannelBuffer;
 	Array<float*> inputChannelDataForCallback, outputChannelDataForCallback;
@@ -13189,6 +16628,9 @@ public:
 	int getOutputLatencyInSamples()         { return internal.outputLatency; }
 	int getInputLatencyInSamples()          { return internal.inputLatency; }
 
+	int getXRunCount() const noexcept                               { return internal.getXRunCount(); }
+	CallbackTimingStatistics getCallbackTimingStatistics() const    { return internal.getCallbackTimingStatistics(); }
+
 	void start (AudioIODeviceCallback* callback)
 	{
 		if (! isOpen_)
@@ -13204,7 +16646,7 @@ public:
 
 	void stop()
 	{
-		AudioIODeviceCallback* const oldCallback = internal.callback;
+		AudioIODeviceCallback* const oldCallback = internal.callback.get();
 
 		start (0);
 
@@ -13429,6 +16871,139 @@ AudioIODeviceType* AudioIODeviceType::createAudioIODeviceType_ALSA()
 	return new ALSAAudioIODeviceType();
 }
 
+#if JUCE_UNIT_TESTS
+
+class ALSASampleConversionTests  : public UnitTest
+{
+public:
+	ALSASampleConversionTests() : UnitTest ("ALSA sample conversion") {}
+
+	enum { maxSamples = 37, maxStride = 3, maxOffset = 4 };
+
+	void runTest()
+	{
+		Random r (0x5a5a);
+
+		beginTest ("Float to integer");
+
+		for (int stride = 1; stride <= maxStride; stride += 2)
+			for (int offset = 0; offset < maxOffset; ++offset)
+				for (int num = 0; num <= maxSamples; ++num)
+					testFloatToInt (r, stride, offset, num);
+
+		beginTest ("Integer to float");
+
+		for (int stride = 1; stride <= maxStride; stride += 2)
+			for (int offset = 0; offset < maxOffset; ++offset)
+				for (int num = 0; num <= maxSamples; ++num)
+					testIntToFloat (r, stride, offset, num);
+
+		beginTest ("Expanding 16-bit samples in-place");
+
+		for (int num = 0; num <= maxSamples; ++num)
+		{
+			HeapBlock<float> buffer ((size_t) maxSamples), expected ((size_t) maxSamples);
+			int16* const ints = reinterpret_cast<int16*> (buffer.getData());
+
+			for (int i = 0; i < num; ++i)
+			{
+				ints[i] = (int16) r.nextInt();
+				expected[i] = ints[i] / 32768.0f;
+			}
+
+			convertInt16ToFloat (ints, 1, buffer, num);
+
+			for (int i = 0; i < num; ++i)
+				expectEquals (buffer[i], expected[i]);
+		}
+	}
+
+private:
+	typedef AudioData::Pointer <AudioData::Float32, AudioData::NativeEndian, AudioData::NonInterleaved, AudioData::Const>     FloatSource;
+	typedef AudioData::Pointer <AudioData::Float32, AudioData::NativeEndian, AudioData::NonInterleaved, AudioData::NonConst>  FloatDest;
+
+	// Includes a few values that are out of range, or exactly on the limits
+	static float getTestValue (Random& r, const int index)
+	{
+		switch (index % 11)
+		{
+			case 0:     return 1.0f;
+			case 1:     return -1.0f;
+			case 2:     return r.nextBool() ? 3.5f : -3.5f;
+			case 3:     return (r.nextInt (65536) - 32768 + 0.5f) / 32768.0f;
+			default:    return r.nextFloat() * 2.2f - 1.1f;
+		}
+	}
+
+	void testFloatToInt (Random& r, const int stride, const int offset, const int num)
+	{
+		HeapBlock<float> source ((size_t) (maxSamples + maxOffset));
+		HeapBlock<int16> dest16 ((size_t) ((maxSamples + maxOffset) * stride)), expected16 ((size_t) ((maxSamples + maxOffset) * stride));
+		HeapBlock<int32> dest32 ((size_t) ((maxSamples + maxOffset) * stride)), expected32 ((size_t) ((maxSamples + maxOffset) * stride));
+
+		float* const src = source + offset;
+
+		for (int i = 0; i < num; ++i)
+			src[i] = getTestValue (r, i + offset);
+
+		for (int i = (maxSamples + maxOffset) * stride; --i >= 0;)
+		{
+			dest16[i] = expected16[i] = 0x1234;
+			dest32[i] = expected32[i] = 0x12345678;
+		}
+
+		convertFloatToInt16 (src, dest16 + offset, stride, num);
+		convertFloatToInt32 (src, dest32 + offset, stride, num);
+
+		AudioData::Pointer <AudioData::Int16, AudioData::LittleEndian, AudioData::Interleaved, AudioData::NonConst> (expected16 + offset, stride)
+			.convertSamples (FloatSource (src), num);
+
+		AudioData::Pointer <AudioData::Int32, AudioData::LittleEndian, AudioData::Interleaved, AudioData::NonConst> (expected32 + offset, stride)
+			.convertSamples (FloatSource (src), num);
+
+		for (int i = 0; i < (maxSamples + maxOffset) * stride; ++i)
+		{
+			expectEquals ((int) dest16[i], (int) expected16[i]);
+			expectEquals ((int) dest32[i], (int) expected32[i]);
+		}
+	}
+
+	void testIntToFloat (Random& r, const int stride, const int offset, const int num)
+	{
+		HeapBlock<int16> source16 ((size_t) ((maxSamples + maxOffset) * stride));
+		HeapBlock<int32> source32 ((size_t) ((maxSamples + maxOffset) * stride));
+		HeapBlock<float> dest ((size_t) (maxSamples + maxOffset)), expected ((size_t) (maxSamples + maxOffset));
+
+		for (int i = (maxSamples + maxOffset) * stride; --i >= 0;)
+		{
+			const int32 n = (i % 7 == 0) ? (r.nextBool() ? std::numeric_limits<int32>::min() : std::numeric_limits<int32>::max())
+										 : r.nextInt();
+			source32[i] = n;
+			source16[i] = (int16) (n >> 16);
+		}
+
+		convertInt16ToFloat (source16 + offset, stride, dest + offset, num);
+
+		AudioData::Pointer <AudioData::Int16, AudioData::LittleEndian, AudioData::Interleaved, AudioData::Const> expectedSource16 (source16 + offset, stride);
+		FloatDest (expected + offset).convertSamples (expectedSource16, num);
+
+		for (int i = 0; i < num; ++i)
+			expectEquals (dest [offset + i], expected [offset + i]);
+
+		convertInt32ToFloat (source32 + offset, stride, dest + offset, num);
+
+		AudioData::Pointer <AudioData::Int32, AudioData::LittleEndian, AudioData::Interleaved, AudioData::Const> expectedSource32 (source32 + offset, stride);
+		FloatDest (expected + offset).convertSamples (expectedSource32, num);
+
+		for (int i = 0; i < num; ++i)
+			expectEquals (dest [offset + i], expected [offset + i]);
+	}
+};
+
+static ALSASampleConversionTests alsaSampleConversionTests;
+
+#endif
+
 /*** End of inlined file: juce_linux_ALSA.cpp ***/
 
 
@@ -13704,73 +17279,159 @@ public:
 		: Thread ("Juce MIDI Input"),
 		  midiInput (midiInput_),
 		  seqHandle (seqHandle_),
-		  callback (callback_)
+		  callback (callback_),
+		  sysex ((size_t) maxSysexSize),
+		  sysexSize (0),
+		  blockSize (0),
+		  blockStartTime (0)
+	{
+		jassert (seqHandle != 0 && callback != 0 && midiInput != 0);
+
+		block.ensureSize (blockCapacity);
+	}
+
+	~MidiInputThread()
+	{
+		snd_seq_close (seqHandle);
+	}
+
+	void run()
+	{
+		snd_midi_event_t* midiParser;
+
+		if (snd_midi_event_new (maxShortEventSize, &midiParser) >= 0)
+		{
+			const int numPfds = snd_seq_poll_descriptors_count (seqHandle, POLLIN);
+			HeapBlock<struct pollfd> pfd ((size_t) numPfds);
+
+			snd_seq_poll_descriptors (seqHandle, pfd, numPfds, POLLIN);
+			snd_seq_nonblock (seqHandle, 1);
+
+			while (! threadShouldExit())
+				if (poll (pfd, numPfds, 500) > 0)
+					readPendingEvents (midiParser);
+
+			snd_midi_event_free (midiParser);
+		}
+	}
+
+private:
+	MidiInput* const midiInput;
+	snd_seq_t* const seqHandle;
+	MidiInputCallback* const callback;
+
+	// These are allocated up-front and re-used for each batch, so that reading the
+	// events doesn't allocate anything.
+	MidiBuffer block;
+	MemoryBlock sysex;
+	int sysexSize, blockSize;
+
+	// A MidiBuffer stores each event's size as a uint16, so that's the limit on the size
+	// of a sysex. The block has room for a full-sized sysex plus a full batch of short
+	// events, allowing for the headroom that MidiBuffer::addEvent() asks for.
+	enum { maxShortEventSize = 32, maxEventsPerBlock = 1024, maxSysexSize = 65535,
+		   eventHeaderSize = sizeof (int) + sizeof (uint16),
+		   blockCapacity = 3 * (maxSysexSize + maxEventsPerBlock * (eventHeaderSize + 3)) / 2 + 64 };
+
+	void addToBlock (const void* const data, const int numBytes, const int microseconds)
 	{
-		jassert (seqHandle != 0 && callback != 0 && midiInput != 0);
+		// (if this event would make the buffer grow, the batch so far is sent on first)
+		const int spaceNeeded = blockSize + numBytes + eventHeaderSize;
+
+		if (spaceNeeded + spaceNeeded / 2 + 8 > blockCapacity)
+			flushBlock();
+
+		block.addEvent (data, numBytes, microseconds);
+		blockSize += numBytes + eventHeaderSize;
 	}
 
-	~MidiInputThread()
+	void flushBlock()
 	{
-		snd_seq_close (seqHandle);
+		if (block.getNumEvents() > 0)
+			callback->handleIncomingMidiBlock (midiInput, block, blockStartTime);
+
+		block.clear();
+		blockSize = 0;
 	}
 
-	void run()
-	{
-		const int maxEventSize = 16 * 1024;
-		snd_midi_event_t* midiParser;
+	double blockStartTime;
 
-		if (snd_midi_event_new (maxEventSize, &midiParser) >= 0)
+	void readPendingEvents (snd_midi_event_t* midiParser)
+	{
+		for (;;)
 		{
-			HeapBlock <uint8> buffer (maxEventSize);
-
-			const int numPfds = snd_seq_poll_descriptors_count (seqHandle, POLLIN);
-			struct pollfd* const pfd = (struct pollfd*) alloca (numPfds * sizeof (struct pollfd));
+			blockStartTime = Time::getMillisecondCounterHiRes() * 0.001;
+			snd_seq_event_t* inputEvent = nullptr;
+			int numEvents = 0;
 
-			snd_seq_poll_descriptors (seqHandle, pfd, numPfds, POLLIN);
+			block.clear();
+			blockSize = 0;
 
-			while (! threadShouldExit())
+			while (numEvents < maxEventsPerBlock
+					&& snd_seq_event_input (seqHandle, &inputEvent) >= 0)
 			{
-				if (poll (pfd, numPfds, 500) > 0)
-				{
-					snd_seq_event_t* inputEvent = nullptr;
+				++numEvents;
+				const int microseconds = (int) ((Time::getMillisecondCounterHiRes() * 0.001 - blockStartTime) * 1.0e6);
 
-					snd_seq_nonblock (seqHandle, 1);
+				if (inputEvent->type == SND_SEQ_EVENT_SYSEX)
+				{
+					// (sysexes are copied straight out of the event, as they can be any length)
+					addSysexChunk (static_cast <const uint8*> (inputEvent->data.ext.ptr),
+								   (int) inputEvent->data.ext.len,
+								   blockStartTime + microseconds * 1.0e-6, microseconds);
+				}
+				else
+				{
+					uint8 data [maxShortEventSize];
+					const long numBytes = snd_midi_event_decode (midiParser, data, maxShortEventSize, inputEvent);
+					snd_midi_event_reset_decode (midiParser);
 
-					do
-					{
-						if (snd_seq_event_input (seqHandle, &inputEvent) >= 0)
-						{
-							// xxx what about SYSEXes that are too big for the buffer?
-							const int numBytes = snd_midi_event_decode (midiParser, buffer, maxEventSize, inputEvent);
+					if (numBytes > 0)
+						addToBlock (data, (int) numBytes, microseconds);
+				}
 
-							snd_midi_event_reset_decode (midiParser);
+				snd_seq_free_event (inputEvent);
+			}
 
-							if (numBytes > 0)
-							{
-								const MidiMessage message ((const uint8*) buffer,
-														   numBytes,
-														   Time::getMillisecondCounter() * 0.001);
+			flushBlock();
 
-								callback->handleIncomingMidiMessage (midiInput, message);
-							}
+			if (numEvents < maxEventsPerBlock)
+				break;
+		}
+	}
 
-							snd_seq_free_event (inputEvent);
-						}
-					}
-					while (snd_seq_event_input_pending (seqHandle, 0) > 0);
+	// ALSA splits long sysexes into several events, so this glues them back together.
+	// Anything longer than maxSysexSize is thrown away.
+	void addSysexChunk (const uint8* data, const int numBytes, const double time, const int microseconds)
+	{
+		if (numBytes <= 0)
+			return;
 
-					snd_seq_free_event (inputEvent);
-				}
-			}
+		if (data[0] == 0xf0)
+			sysexSize = 0;
+		else if (sysexSize == 0)
+			return; // (the start of this one must have been lost, or it was too long)
 
-			snd_midi_event_free (midiParser);
+		if (sysexSize + numBytes > maxSysexSize)
+		{
+			DBG ("ALSA MIDI: discarding a sysex that's too long");
+			sysexSize = 0;
+			return;
 		}
-	};
 
-private:
-	MidiInput* const midiInput;
-	snd_seq_t* const seqHandle;
-	MidiInputCallback* const callback;
+		memcpy (static_cast <uint8*> (sysex.getData()) + sysexSize, data, (size_t) numBytes);
+		sysexSize += numBytes;
+
+		if (data [numBytes - 1] == 0xf7)
+		{
+			addToBlock (sysex.getData(), sysexSize, microseconds);
+			sysexSize = 0;
+		}
+		else
+		{
+			callback->handlePartialSysexMessage (midiInput, static_cast <const uint8*> (sysex.getData()), sysexSize, time);
+		}
+	}
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiInputThread);
 };
@@ -13840,6 +17501,101 @@ MidiInput* MidiInput::createNewDevice (const String& deviceName, MidiInputCallba
 	return newDevice;
 }
 
+#if JUCE_UNIT_TESTS
+
+class AlsaMidiInputTests  : public UnitTest
+{
+public:
+	AlsaMidiInputTests() : UnitTest ("ALSA MIDI input") {}
+
+	void runTest()
+	{
+		beginTest ("Batched input throughput");
+
+		// Sends a stream of controllers with the odd sysex mixed in, from one virtual
+		// sequencer port to another, and measures how fast they come through.
+		const String name ("JUCE throughput test");
+		ScopedPointer<MidiOutput> output (MidiOutput::createNewDevice (name));
+		const int inputIndex = MidiInput::getDevices().indexOf (name + " Output");
+
+		if (output == nullptr || inputIndex < 0)
+		{
+			logMessage ("Couldn't open the ALSA sequencer - skipping");
+			return;
+		}
+
+		Counter counter;
+		ScopedPointer<MidiInput> input (MidiInput::openDevice (inputIndex, &counter));
+		expect (input != nullptr);
+
+		input->start();
+		Thread::sleep (100);
+
+		const int numMessages = 20000, sysexInterval = 1000, sysexSize = 1000;
+
+		HeapBlock<uint8> sysexData ((size_t) sysexSize);
+		for (int i = 0; i < sysexSize; ++i)
+			sysexData[i] = (uint8) (i & 0x7f);
+
+		const MidiMessage sysex (MidiMessage::createSysExMessage (sysexData, sysexSize));
+		const double startTime = Time::getMillisecondCounterHiRes();
+
+		for (int i = 0; i < numMessages; ++i)
+		{
+			output->sendMessageNow ((i % sysexInterval) == 0 ? sysex
+															 : MidiMessage::controllerEvent (1 + (i & 15), 74, i & 0x7f));
+
+			// (gives the reader a chance to keep up, so that the sequencer doesn't drop anything)
+			if ((i % 200) == 199)
+				Thread::sleep (1);
+		}
+
+		for (int i = 0; i < 500 && counter.numEvents.get() < numMessages; ++i)
+			Thread::sleep (1);
+
+		const double elapsedSeconds = (Time::getMillisecondCounterHiRes() - startTime) * 0.001;
+		input->stop();
+
+		expectEquals (counter.numEvents.get(), numMessages);
+		expectEquals (counter.numSysexes.get(), numMessages / sysexInterval);
+
+		logMessage (String (counter.numEvents.get() / elapsedSeconds, 0) + " events per second, in "
+					 + String (counter.numBlocks.get()) + " blocks");
+	}
+
+private:
+	struct Counter  : public MidiInputCallback
+	{
+		void handleIncomingMidiMessage (MidiInput*, const MidiMessage&)
+		{
+			jassertfalse; // all the messages should arrive in blocks
+		}
+
+		void handleIncomingMidiBlock (MidiInput*, const MidiBuffer& messages, double)
+		{
+			MidiBuffer::Iterator i (messages);
+			const uint8* data;
+			int numBytes, position;
+
+			while (i.getNextEvent (data, numBytes, position))
+			{
+				++numEvents;
+
+				if (*data == 0xf0)
+					++numSysexes;
+			}
+
+			++numBlocks;
+		}
+
+		Atomic<int> numEvents, numSysexes, numBlocks;
+	};
+};
+
+static AlsaMidiInputTests alsaMidiInputTests;
+
+#endif
+
 #else
 
 // (These are just stub functions if ALSA is unavailable...)
@@ -13879,11 +17635,12 @@ static void* juce_loadJackFunction (const char* const name)
 
 #define JUCE_DECL_JACK_FUNCTION(return_type, fn_name, argument_types, arguments)  \
   typedef return_type (*fn_name##_ptr_t)argument_types;                           \
+  typedef return_type fn_name##_return_t;                                         \
   return_type fn_name argument_types {                                            \
 	static fn_name##_ptr_t fn = nullptr;                                          \
 	if (fn == nullptr) { fn = (fn_name##_ptr_t)juce_loadJackFunction(#fn_name); } \
 	if (fn) return (*fn)arguments;                                                \
-	else return nullptr;                                                          \
+	else return fn_name##_return_t();                                             \
   }
 
 #define JUCE_DECL_VOID_JACK_FUNCTION(fn_name, argument_types, arguments)          \
@@ -13913,6 +17670,12 @@ JUCE_DECL_JACK_FUNCTION (int, jack_set_port_connect_callback, (jack_client_t* cl
 JUCE_DECL_JACK_FUNCTION (jack_port_t* , jack_port_by_id, (jack_client_t* client, jack_port_id_t port_id), (client, port_id));
 JUCE_DECL_JACK_FUNCTION (int, jack_port_connected, (const jack_port_t* port), (port));
 JUCE_DECL_JACK_FUNCTION (int, jack_port_connected_to, (const jack_port_t* port, const char* port_name), (port, port_name));
+JUCE_DECL_JACK_FUNCTION (int, jack_port_unregister, (jack_client_t* client, jack_port_t* port), (client, port));
+JUCE_DECL_JACK_FUNCTION (int, jack_set_buffer_size_callback, (jack_client_t* client, JackBufferSizeCallback bufsize_callback, void* arg), (client, bufsize_callback, arg));
+JUCE_DECL_JACK_FUNCTION (int, jack_set_sample_rate_callback, (jack_client_t* client, JackSampleRateCallback srate_callback, void* arg), (client, srate_callback, arg));
+JUCE_DECL_JACK_FUNCTION (int, jack_set_xrun_callback, (jack_client_t* client, JackXRunCallback xrun_callback, void* arg), (client, xrun_callback, arg));
+JUCE_DECL_VOID_JACK_FUNCTION (jack_port_get_latency_range, (jack_port_t* port, jack_latency_callback_mode_t mode, jack_latency_range_t* range), (port, mode, range));
+JUCE_DECL_JACK_FUNCTION (jack_transport_state_t, jack_transport_query, (const jack_client_t* client, jack_position_t* pos), (client, pos));
 
 #if JUCE_DEBUG
   #define JACK_LOGGING_ENABLED 1
@@ -13945,7 +17708,9 @@ namespace
   #define JUCE_JACK_CLIENT_NAME "JuceJack"
 #endif
 
-class JackAudioIODevice   : public AudioIODevice
+class JackAudioIODevice   : public AudioIODevice,
+							private AudioPlayHead,
+							private AsyncUpdater
 {
 public:
 	JackAudioIODevice (const String& deviceName,
@@ -13954,17 +17719,20 @@ public:
 		: AudioIODevice (deviceName, "JACK"),
 		  inputId (inputId_),
 		  outputId (outputId_),
+		  inputClientName (inputId_.upToFirstOccurrenceOf (":", false, false)),
+		  outputClientName (outputId_.upToFirstOccurrenceOf (":", false, false)),
 		  isOpen_ (false),
+		  client (nullptr),
 		  callback (nullptr),
-		  totalNumberOfInputChannels (0),
-		  totalNumberOfOutputChannels (0)
+		  bufferSize (0),
+		  sampleRate (0)
 	{
 		jassert (deviceName.isNotEmpty());
 
 		jack_status_t status;
 		client = juce::jack_client_open (JUCE_JACK_CLIENT_NAME, JackNoStartServer, &status);
 
-		if (client == 0)
+		if (client == nullptr)
 		{
 			dumpJackErrorMessage (status);
 		}
@@ -13972,78 +17740,46 @@ public:
 		{
 			juce::jack_set_error_function (errorCallback);
 
-			// open input ports
-			const StringArray inputChannels (getInputChannelNames());
-			for (int i = 0; i < inputChannels.size(); i++)
-			{
-				String inputName;
-				inputName << "in_" << ++totalNumberOfInputChannels;
-
-				inputPorts.add (juce::jack_port_register (client, inputName.toUTF8(),
-														  JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0));
-			}
-
-			// open output ports
-			const StringArray outputChannels (getOutputChannelNames());
-			for (int i = 0; i < outputChannels.size (); i++)
-			{
-				String outputName;
-				outputName << "out_" << ++totalNumberOfOutputChannels;
-
-				outputPorts.add (juce::jack_port_register (client, outputName.toUTF8(),
-														   JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0));
-			}
-
-			inChans.calloc (totalNumberOfInputChannels + 2);
-			outChans.calloc (totalNumberOfOutputChannels + 2);
+			bufferSize = (int) juce::jack_get_buffer_size (client);
+			sampleRate = (int) juce::jack_get_sample_rate (client);
 		}
+
+		transportPosition.resetToDefault();
 	}
 
 	~JackAudioIODevice()
 	{
 		close();
-		if (client != 0)
+
+		if (client != nullptr)
 		{
 			juce::jack_client_close (client);
-			client = 0;
+			client = nullptr;
 		}
 	}
 
 	StringArray getChannelNames (bool forInput) const
 	{
-		StringArray names;
-		const char** const ports = juce::jack_get_ports (client, 0, 0, /* JackPortIsPhysical | */
-														 forInput ? JackPortIsInput : JackPortIsOutput);
-
-		if (ports != 0)
-		{
-			int j = 0;
-			while (ports[j] != 0)
-			{
-				const String portName (ports [j++]);
-
-				if (portName.upToFirstOccurrenceOf (":", false, false) == getName())
-					names.add (portName.fromFirstOccurrenceOf (":", false, false));
-			}
+		StringArray names (getRemotePortIds (forInput));
 
-			free (ports);
-		}
+		for (int i = names.size(); --i >= 0;)
+			names.set (i, names[i].fromFirstOccurrenceOf (":", false, false));
 
 		return names;
 	}
 
 	StringArray getOutputChannelNames()         { return getChannelNames (false); }
 	StringArray getInputChannelNames()          { return getChannelNames (true); }
-	int getNumSampleRates()                     { return client != 0 ? 1 : 0; }
-	double getSampleRate (int index)            { return client != 0 ? juce::jack_get_sample_rate (client) : 0; }
-	int getNumBufferSizesAvailable()            { return client != 0 ? 1 : 0; }
+	int getNumSampleRates()                     { return client != nullptr ? 1 : 0; }
+	double getSampleRate (int index)            { return client != nullptr ? sampleRate.get() : 0; }
+	int getNumBufferSizesAvailable()            { return client != nullptr ? 1 : 0; }
 	int getBufferSizeSamples (int index)        { return getDefaultBufferSize(); }
-	int getDefaultBufferSize()                  { return client != 0 ? juce::jack_get_buffer_size (client) : 0; }
+	int getDefaultBufferSize()                  { return client != nullptr ? bufferSize.get() : 0; }
 
 	String open (const BigInteger& inputChannels, const BigInteger& outputChannels,
-				 double sampleRate, int bufferSizeSamples)
+				 double /*sampleRate*/, int /*bufferSizeSamples*/)
 	{
-		if (client == 0)
+		if (client == nullptr)
 		{
 			lastError = "No JACK client running";
 			return lastError;
@@ -14052,59 +17788,74 @@ public:
 		lastError = String::empty;
 		close();
 
-		juce::jack_set_process_callback (client, processCallback, this);
-		juce::jack_on_shutdown (client, shutdownCallback, this);
-		juce::jack_activate (client);
-		isOpen_ = true;
+		// Only the channels that are wanted get a port, and the ports go again when the
+		// device is closed, so other clients don't see a pile of unused ones.
+		const StringArray remoteInputs (getRemotePortIds (true));
+		const StringArray remoteOutputs (getRemotePortIds (false));
+		StringArray inputsToConnect, outputsToConnect;
 
-		if (! inputChannels.isZero())
+		for (int i = 0; i < remoteInputs.size(); ++i)
 		{
-			const char** const ports = juce::jack_get_ports (client, 0, 0, /* JackPortIsPhysical | */ JackPortIsOutput);
-
-			if (ports != 0)
+			if (inputChannels[i])
 			{
-				const int numInputChannels = inputChannels.getHighestBit() + 1;
-
-				for (int i = 0; i < numInputChannels; ++i)
+				jack_port_t* const port = juce::jack_port_register (client, ("in_" + String (i + 1)).toUTF8(),
+																	JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+				if (port != nullptr)
 				{
-					const String portName (ports[i]);
-
-					if (inputChannels[i] && portName.upToFirstOccurrenceOf (":", false, false) == getName())
-					{
-						int error = juce::jack_connect (client, ports[i], juce::jack_port_name ((jack_port_t*) inputPorts[i]));
-						if (error != 0)
-							jack_Log ("Cannot connect input port " + String (i) + " (" + String (ports[i]) + "), error " + String (error));
-					}
+					inputPorts.add (port);
+					inputsToConnect.add (remoteInputs[i]);
+					activeInputChannels.setBit (i);
 				}
-
-				free (ports);
 			}
 		}
 
-		if (! outputChannels.isZero())
+		for (int i = 0; i < remoteOutputs.size(); ++i)
 		{
-			const char** const ports = juce::jack_get_ports (client, 0, 0, /* JackPortIsPhysical | */ JackPortIsInput);
-
-			if (ports != 0)
+			if (outputChannels[i])
 			{
-				const int numOutputChannels = outputChannels.getHighestBit() + 1;
-
-				for (int i = 0; i < numOutputChannels; ++i)
+				jack_port_t* const port = juce::jack_port_register (client, ("out_" + String (i + 1)).toUTF8(),
+																	JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+				if (port != nullptr)
 				{
-					const String portName (ports[i]);
-
-					if (outputChannels[i] && portName.upToFirstOccurrenceOf (":", false, false) == getName())
-					{
-						int error = juce::jack_connect (client, juce::jack_port_name ((jack_port_t*) outputPorts[i]), ports[i]);
-						if (error != 0)
-							jack_Log ("Cannot connect output port " + String (i) + " (" + String (ports[i]) + "), error " + String (error));
-					}
+					outputPorts.add (port);
+					outputsToConnect.add (remoteOutputs[i]);
+					activeOutputChannels.setBit (i);
 				}
-
-				free (ports);
 			}
 		}
 
+		inChans.calloc ((size_t) inputPorts.size() + 1);
+		outChans.calloc ((size_t) outputPorts.size() + 1);
+
+		bufferSize = (int) juce::jack_get_buffer_size (client);
+		sampleRate = (int) juce::jack_get_sample_rate (client);
+		numXRuns = 0;
+
+		juce::jack_set_process_callback (client, processCallback, this);
+		juce::jack_set_buffer_size_callback (client, bufferSizeCallback, this);
+		juce::jack_set_sample_rate_callback (client, sampleRateCallback, this);
+		juce::jack_set_xrun_callback (client, xrunCallback, this);
+		juce::jack_on_shutdown (client, shutdownCallback, this);
+		formatChangePending = 0;
+		juce::jack_activate (client);
+		isOpen_ = true;
+
+		for (int i = 0; i < inputPorts.size(); ++i)
+		{
+			const int error = juce::jack_connect (client, inputsToConnect[i].toUTF8(),
+												  juce::jack_port_name (inputPorts.getUnchecked (i)));
+			if (error != 0)
+				jack_Log ("Cannot connect input port " + String (i) + " (" + inputsToConnect[i] + "), error " + String (error));
+		}
+
+		for (int i = 0; i < outputPorts.size(); ++i)
+		{
+			const int error = juce::jack_connect (client, juce::jack_port_name (outputPorts.getUnchecked (i)),
+												  outputsToConnect[i].toUTF8());
+			if (error != 0)
+				jack_Log ("Cannot connect output port " + String (i) + " (" + outputsToConnect[i] + "), error " + String (error));
+		}
+
 		return lastError;
 	}
 
@@ -14112,29 +17863,40 @@ public:
 	{
 		stop();
 
-		if (client != 0)
+		if (client != nullptr)
 		{
 			juce::jack_deactivate (client);
-			juce::jack_set_process_callback (client, processCallback, 0);
-			juce::jack_on_shutdown (client, shutdownCallback, 0);
+			juce::jack_set_process_callback (client, processCallback, nullptr);
+			juce::jack_set_buffer_size_callback (client, bufferSizeCallback, nullptr);
+			juce::jack_set_sample_rate_callback (client, sampleRateCallback, nullptr);
+			juce::jack_set_xrun_callback (client, xrunCallback, nullptr);
+			juce::jack_on_shutdown (client, shutdownCallback, nullptr);
+
+			for (int i = inputPorts.size(); --i >= 0;)
+				juce::jack_port_unregister (client, inputPorts.getUnchecked (i));
+
+			for (int i = outputPorts.size(); --i >= 0;)
+				juce::jack_port_unregister (client, outputPorts.getUnchecked (i));
 		}
 
+		inputPorts.clear();
+		outputPorts.clear();
+		activeInputChannels.clear();
+		activeOutputChannels.clear();
+		cancelPendingUpdate();
 		isOpen_ = false;
 	}
 
 	void start (AudioIODeviceCallback* newCallback)
 	{
-		if (isOpen_ && newCallback != callback)
+		if (isOpen_ && newCallback != callback.get())
 		{
+			const ScopedLock sl (callbackChangeLock);
+
 			if (newCallback != nullptr)
 				newCallback->audioDeviceAboutToStart (this);
 
-			AudioIODeviceCallback* const oldCallback = callback;
-
-			{
-				const ScopedLock sl (callbackLock);
-				callback = newCallback;
-			}
+			AudioIODeviceCallback* const oldCallback = callback.exchange (newCallback);
 
 			if (oldCallback != nullptr)
 				oldCallback->audioDeviceStopped();
@@ -14143,101 +17905,240 @@ public:
 
 	void stop()
 	{
-		start (0);
+		start (nullptr);
 	}
 
 	bool isOpen()                           { return isOpen_; }
-	bool isPlaying()                        { return callback != nullptr; }
+	bool isPlaying()                        { return callback.get() != nullptr; }
 	int getCurrentBufferSizeSamples()       { return getBufferSizeSamples (0); }
 	double getCurrentSampleRate()           { return getSampleRate (0); }
 	int getCurrentBitDepth()                { return 32; }
 	String getLastError()                   { return lastError; }
 
-	BigInteger getActiveOutputChannels() const
-	{
-		BigInteger outputBits;
+	BigInteger getActiveOutputChannels() const      { return activeOutputChannels; }
+	BigInteger getActiveInputChannels() const       { return activeInputChannels; }
 
-		for (int i = 0; i < outputPorts.size(); i++)
-			if (juce::jack_port_connected ((jack_port_t*) outputPorts [i]))
-				outputBits.setBit (i);
+	int getOutputLatencyInSamples()         { return getLatency (outputPorts, false); }
+	int getInputLatencyInSamples()          { return getLatency (inputPorts, true); }
 
-		return outputBits;
-	}
+	int getXRunCount() const noexcept       { return numXRuns.get(); }
+	AudioPlayHead* getPlayHead()            { return this; }
 
-	BigInteger getActiveInputChannels() const
+	String inputId, outputId;
+
+private:
+	const String inputClientName, outputClientName;
+	bool isOpen_;
+	jack_client_t* client;
+	String lastError;
+	AudioThreadPointer<AudioIODeviceCallback> callback;
+	CriticalSection callbackChangeLock;
+	Atomic<int> bufferSize, sampleRate, numXRuns, formatChangePending;
+
+	HeapBlock <float*> inChans, outChans;
+	Array<jack_port_t*> inputPorts, outputPorts;
+	BigInteger activeInputChannels, activeOutputChannels;
+
+	// The process thread writes the position between two increments of the sequence
+	// counter, and a reader copies it again if it saw the counter odd or changing.
+	CurrentPositionInfo transportPosition;
+	Atomic<int> transportSequence;
+
+	// Returns the full names of the other client's ports that our inputs or outputs can
+	// be connected to - i.e. its outputs for our inputs, and vice-versa.
+	StringArray getRemotePortIds (const bool forInput) const
 	{
-		BigInteger inputBits;
+		StringArray ids;
+		const String& clientName = forInput ? inputClientName : outputClientName;
+
+		if (client != nullptr && clientName.isNotEmpty())
+		{
+			const char** const ports = juce::jack_get_ports (client, nullptr, JACK_DEFAULT_AUDIO_TYPE,
+															 forInput ? JackPortIsOutput : JackPortIsInput);
+
+			if (ports != nullptr)
+			{
+				for (int j = 0; ports[j] != nullptr; ++j)
+				{
+					const String portId (ports[j]);
 
-		for (int i = 0; i < inputPorts.size(); i++)
-			if (juce::jack_port_connected ((jack_port_t*) inputPorts [i]))
-				inputBits.setBit (i);
+					if (portId.upToFirstOccurrenceOf (":", false, false) == clientName)
+						ids.add (portId);
+				}
+
+				free (ports);
+			}
+		}
 
-		return inputBits;
+		return ids;
 	}
 
-	int getOutputLatencyInSamples()
+	int getLatency (const Array<jack_port_t*>& ports, const bool forInput) const
 	{
+		// jack_port_get_latency_range() replaced jack_port_get_total_latency() in JACK 0.120,
+		// so older servers need the old call
+		static const bool canGetLatencyRanges = juce_loadJackFunction ("jack_port_get_latency_range") != nullptr;
 		int latency = 0;
 
-		for (int i = 0; i < outputPorts.size(); i++)
-			latency = jmax (latency, (int) juce::jack_port_get_total_latency (client, (jack_port_t*) outputPorts [i]));
+		for (int i = 0; i < ports.size(); ++i)
+		{
+			if (canGetLatencyRanges)
+			{
+				jack_latency_range_t range = { 0, 0 };
+				juce::jack_port_get_latency_range (ports.getUnchecked (i), forInput ? JackCaptureLatency
+																				   : JackPlaybackLatency, &range);
+				latency = jmax (latency, (int) range.max);
+			}
+			else
+			{
+				latency = jmax (latency, (int) juce::jack_port_get_total_latency (client, ports.getUnchecked (i)));
+			}
+		}
 
 		return latency;
 	}
 
-	int getInputLatencyInSamples()
+	void process (const int numSamples)
 	{
-		int latency = 0;
+		// The callback gets the port buffers themselves, so nothing needs copying
+		for (int i = 0; i < inputPorts.size(); ++i)
+			inChans[i] = (float*) juce::jack_port_get_buffer (inputPorts.getUnchecked (i), (jack_nframes_t) numSamples);
 
-		for (int i = 0; i < inputPorts.size(); i++)
-			latency = jmax (latency, (int) juce::jack_port_get_total_latency (client, (jack_port_t*) inputPorts [i]));
+		for (int i = 0; i < outputPorts.size(); ++i)
+			outChans[i] = (float*) juce::jack_port_get_buffer (outputPorts.getUnchecked (i), (jack_nframes_t) numSamples);
 
-		return latency;
-	}
+		updateTransportPosition();
 
-	String inputId, outputId;
+		const AudioThreadPointer<AudioIODeviceCallback>::ScopedReader currentCallback (callback);
 
-private:
-	void process (const int numSamples)
+		// (until the callback has been re-prepared for a new format, it just gets silence)
+		if (currentCallback.get() != nullptr && formatChangePending.get() == 0)
+		{
+			currentCallback->audioDeviceIOCallback (const_cast <const float**> (inChans.getData()), inputPorts.size(),
+													outChans, outputPorts.size(), numSamples);
+		}
+		else
+		{
+			for (int i = 0; i < outputPorts.size(); ++i)
+				zeromem (outChans[i], sizeof (float) * (size_t) numSamples);
+		}
+	}
+
+	void updateTransportPosition()
 	{
-		int i, numActiveInChans = 0, numActiveOutChans = 0;
+		jack_position_t pos;
+		const jack_transport_state_t state = juce::jack_transport_query (client, &pos);
 
-		for (i = 0; i < totalNumberOfInputChannels; ++i)
+		CurrentPositionInfo info;
+		info.resetToDefault();
+		info.frameRate = fpsUnknown;
+		info.isPlaying = (state == JackTransportRolling || state == JackTransportLooping);
+		info.isLooping = (state == JackTransportLooping);
+
+		if (pos.frame_rate > 0)
+			info.timeInSeconds = pos.frame / (double) pos.frame_rate;
+
+		if ((pos.valid & JackPositionBBT) != 0 && pos.beat_type > 0 && pos.ticks_per_beat > 0)
 		{
-			jack_default_audio_sample_t* in
-				= (jack_default_audio_sample_t*) juce::jack_port_get_buffer ((jack_port_t*) inputPorts.getUnchecked(i), numSamples);
+			// JACK counts bars and beats from 1, in beats of the time-signature's denominator
+			const double quarterNotesPerBeat = 4.0 / pos.beat_type;
+			const double beatsBeforeBar = (pos.bar - 1) * (double) pos.beats_per_bar;
 
-			if (in != nullptr)
-				inChans [numActiveInChans++] = (float*) in;
+			info.bpm = pos.beats_per_minute;
+			info.timeSigNumerator = (int) pos.beats_per_bar;
+			info.timeSigDenominator = (int) pos.beat_type;
+			info.ppqPositionOfLastBarStart = beatsBeforeBar * quarterNotesPerBeat;
+			info.ppqPosition = (beatsBeforeBar + (pos.beat - 1) + pos.tick / pos.ticks_per_beat) * quarterNotesPerBeat;
 		}
 
-		for (i = 0; i < totalNumberOfOutputChannels; ++i)
+		++transportSequence;
+		transportPosition = info;
+		++transportSequence;
+	}
+
+	bool getCurrentPosition (CurrentPositionInfo& result)
+	{
+		for (;;)
 		{
-			jack_default_audio_sample_t* out
-				= (jack_default_audio_sample_t*) juce::jack_port_get_buffer ((jack_port_t*) outputPorts.getUnchecked(i), numSamples);
+			const int startSequence = transportSequence.get();
+
+			if ((startSequence & 1) == 0)
+			{
+				result = transportPosition;
+
+				if (transportSequence.get() == startSequence)
+					return true;
+			}
 
-			if (out != nullptr)
-				outChans [numActiveOutChans++] = (float*) out;
+			Thread::yield();
 		}
+	}
 
-		const ScopedLock sl (callbackLock);
+	// Called on JACK's thread when the buffer size or sample rate changes. Re-preparing the
+	// callback can allocate and block, so that's left to the message thread, and until it's
+	// done, process() keeps the callback out of the way.
+	void formatChanged()
+	{
+		formatChangePending = 1;
+		triggerAsyncUpdate();
+	}
 
-		if (callback != nullptr)
+	// Rather than restarting the device, the callback is taken out of the processing chain
+	// and re-prepared for the new format.
+	void handleAsyncUpdate()
+	{
+		const ScopedLock sl (callbackChangeLock);
+		AudioIODeviceCallback* const currentCallback = callback.exchange (nullptr);
+
+		// (if the format changes again while this is happening, there'll be another update)
+		formatChangePending = 0;
+
+		if (currentCallback != nullptr)
 		{
-			callback->audioDeviceIOCallback (const_cast <const float**> (inChans.getData()), numActiveInChans,
-											 outChans, numActiveOutChans, numSamples);
+			currentCallback->audioDeviceStopped();
+			currentCallback->audioDeviceAboutToStart (this);
+			callback.exchange (currentCallback);
 		}
-		else
+	}
+
+	static int processCallback (jack_nframes_t nframes, void* callbackArgument)
+	{
+		if (callbackArgument != nullptr)
+			((JackAudioIODevice*) callbackArgument)->process ((int) nframes);
+
+		return 0;
+	}
+
+	static int bufferSizeCallback (jack_nframes_t nframes, void* callbackArgument)
+	{
+		JackAudioIODevice* const device = (JackAudioIODevice*) callbackArgument;
+
+		if (device != nullptr && device->bufferSize.exchange ((int) nframes) != (int) nframes)
+		{
+			jack_Log ("JackAudioIODevice::bufferSizeCallback " + String ((int) nframes));
+			device->formatChanged();
+		}
+
+		return 0;
+	}
+
+	static int sampleRateCallback (jack_nframes_t nframes, void* callbackArgument)
+	{
+		JackAudioIODevice* const device = (JackAudioIODevice*) callbackArgument;
+
+		if (device != nullptr && device->sampleRate.exchange ((int) nframes) != (int) nframes)
 		{
-			for (i = 0; i < numActiveOutChans; ++i)
-				zeromem (outChans[i], sizeof (float) * numSamples);
+			jack_Log ("JackAudioIODevice::sampleRateCallback " + String ((int) nframes));
+			device->formatChanged();
 		}
+
+		return 0;
 	}
 
-	static int processCallback (jack_nframes_t nframes, void* callbackArgument)
+	static int xrunCallback (void* callbackArgument)
 	{
-		if (callbackArgument != 0)
-			((JackAudioIODevice*) callbackArgument)->process (nframes);
+		if (callbackArgument != nullptr)
+			++(((JackAudioIODevice*) callbackArgument)->numXRuns);
 
 		return 0;
 	}
@@ -14255,7 +18156,7 @@ private:
 
 		if (device != nullptr)
 		{
-			device->client = 0;
+			device->client = nullptr;
 			device->close();
 		}
 	}
@@ -14265,16 +18166,7 @@ private:
 		jack_Log ("JackAudioIODevice::errorCallback " + String (msg));
 	}
 
-	bool isOpen_;
-	jack_client_t* client;
-	String lastError;
-	AudioIODeviceCallback* callback;
-	CriticalSection callbackLock;
-
-	HeapBlock <float*> inChans, outChans;
-	int totalNumberOfInputChannels;
-	int totalNumberOfOutputChannels;
-	Array<void*> inputPorts, outputPorts;
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (JackAudioIODevice);
 };
 
 class JackAudioIODeviceType  : public AudioIODeviceType
@@ -14314,7 +18206,7 @@ public:
 		else
 		{
 			// scan for output devices
-			const char** ports = juce::jack_get_ports (client, 0, 0, /* JackPortIsPhysical | */ JackPortIsOutput);
+			const char** ports = juce::jack_get_ports (client, 0, JACK_DEFAULT_AUDIO_TYPE, /* JackPortIsPhysical | */ JackPortIsOutput);
 
 			if (ports != 0)
 			{
@@ -14324,7 +18216,8 @@ public:
 					String clientName (ports[j]);
 					clientName = clientName.upToFirstOccurrenceOf (":", false, false);
 
-					if (clientName != String (JUCE_JACK_CLIENT_NAME)
+					// (skips our own clients, which JACK may have renamed to e.g. "JuceJack-01")
+					if (! clientName.startsWith (JUCE_JACK_CLIENT_NAME)
 						 && ! inputNames.contains (clientName))
 					{
 						inputNames.add (clientName);
@@ -14338,7 +18231,7 @@ public:
 			}
 
 			// scan for input devices
-			ports = juce::jack_get_ports (client, 0, 0, /* JackPortIsPhysical | */ JackPortIsInput);
+			ports = juce::jack_get_ports (client, 0, JACK_DEFAULT_AUDIO_TYPE, /* JackPortIsPhysical | */ JackPortIsInput);
 
 			if (ports != 0)
 			{
@@ -14348,7 +18241,8 @@ public:
 					String clientName (ports[j]);
 					clientName = clientName.upToFirstOccurrenceOf (":", false, false);
 
-					if (clientName != String (JUCE_JACK_CLIENT_NAME)
+					// (skips our own clients, which JACK may have renamed to e.g. "JuceJack-01")
+					if (! clientName.startsWith (JUCE_JACK_CLIENT_NAME)
 						 && ! outputNames.contains (clientName))
 					{
 						outputNames.add (clientName);
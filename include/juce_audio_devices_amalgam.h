@@ -65,6 +65,18 @@
  #define JUCE_ALSA 1
 #endif
 
+/** Config: JUCE_ALSA_USE_MMAP
+	If enabled, ALSA devices will be opened in memory-mapped mode when the hardware
+	allows it, so that the audio is converted directly into the device's buffer. Devices
+	which don't support this will fall back to the normal read/write mode.
+
+	This is experimental, and is off by default because the memory-mapped transfers
+	haven't yet been tried on real hardware.
+*/
+#ifndef JUCE_ALSA_USE_MMAP
+ #define JUCE_ALSA_USE_MMAP 0
+#endif
+
 /** Config: JUCE_JACK
 	Enables JACK audio devices (Linux only).
 */
@@ -72,6 +84,15 @@
  #define JUCE_JACK 0
 #endif
 
+/** Config: JUCE_USE_VIRTUAL_AUDIO_DEVICE
+	Adds the hardware-free VirtualAudioIODeviceType to the list of device types that
+	an AudioDeviceManager creates by default. This is handy for running an app on a
+	build or test machine which has no sound card.
+*/
+#ifndef JUCE_USE_VIRTUAL_AUDIO_DEVICE
+ #define JUCE_USE_VIRTUAL_AUDIO_DEVICE 0
+#endif
+
 /** Config: JUCE_USE_ANDROID_OPENSLES
 	Enables OpenSLES devices (Android only).
 */
@@ -117,6 +138,125 @@ namespace juce
 #ifndef __JUCE_AUDIOIODEVICE_JUCEHEADER__
 #define __JUCE_AUDIOIODEVICE_JUCEHEADER__
 
+
+/*** Start of inlined file: juce_AudioThreadPointer.h ***/
+#ifndef __JUCE_AUDIOTHREADPOINTER_JUCEHEADER__
+#define __JUCE_AUDIOTHREADPOINTER_JUCEHEADER__
+
+/**
+	Holds a pointer that an audio thread can use without locking, while other threads
+	replace it.
+
+	The audio thread uses a ScopedReader to get hold of the current object, which never
+	blocks or waits for any other thread. Other threads publish a new object with
+	exchange(), which only returns the old object once the audio thread has finished
+	with it, so that the caller can then safely delete it or release its resources.
+
+	This means that it's the thread making the change that may have to wait (for the
+	length of one audio callback at most), rather than the audio thread.
+
+	Only one thread may use a ScopedReader at a time, but any number of threads may
+	call exchange(). The object doesn't take ownership of the objects it points to.
+*/
+template <class ObjectType>
+class AudioThreadPointer
+{
+public:
+	/** Creates a pointer with an initial value. */
+	explicit AudioThreadPointer (ObjectType* const initialObject = nullptr) noexcept
+		: current (initialObject)
+	{
+	}
+
+	/** Destructor. */
+	~AudioThreadPointer()
+	{
+		// a reader mustn't still be using this object!
+		jassert (inUse.get() == nullptr);
+	}
+
+	/** Returns the current object.
+		This is only safe to use on the thread(s) that change the pointer - the audio
+		thread must use a ScopedReader.
+	*/
+	ObjectType* get() const noexcept                 { return current.get(); }
+
+	/** Publishes a new object, and returns the previous one.
+
+		If the audio thread is using the previous object, this will wait until it has
+		finished, so when it returns, the old object is no longer in use and can be
+		deleted by the caller.
+	*/
+	ObjectType* exchange (ObjectType* const newObject)
+	{
+		const ScopedLock sl (writeLock);
+		ObjectType* const oldObject = current.exchange (newObject);
+
+		if (oldObject != nullptr && oldObject != newObject)
+		{
+			for (int spins = 0; inUse.get() == oldObject; ++spins)
+			{
+				if (spins < 20)
+					Thread::yield();
+				else
+					Thread::sleep (1);
+			}
+		}
+
+		return oldObject;
+	}
+
+	//==============================================================================
+	/** Gives the audio thread access to the current object for the lifetime of this
+		ScopedReader.
+	*/
+	class ScopedReader
+	{
+	public:
+		/** Takes hold of the pointer's current object. This never blocks. */
+		explicit ScopedReader (AudioThreadPointer& p) noexcept
+			: owner (p)
+		{
+			// Once inUse is set, the object can't be retired without the writer seeing it,
+			// but it may have been retired before that, so it has to be checked again.
+			do
+			{
+				object = owner.current.get();
+				owner.inUse = object;
+			}
+			while (owner.current.get() != object);
+		}
+
+		/** Releases the object, allowing a waiting exchange() call to return. */
+		~ScopedReader() noexcept
+		{
+			owner.inUse = nullptr;
+		}
+
+		/** Returns the object, which may be null. */
+		ObjectType* get() const noexcept             { return object; }
+
+		/** Returns the object, which may be null. */
+		ObjectType* operator->() const noexcept      { return object; }
+
+	private:
+		AudioThreadPointer& owner;
+		ObjectType* object;
+
+		JUCE_DECLARE_NON_COPYABLE (ScopedReader);
+	};
+
+private:
+	Atomic<ObjectType*> current, inUse;
+	CriticalSection writeLock;
+
+	JUCE_DECLARE_NON_COPYABLE (AudioThreadPointer);
+};
+
+#endif   // __JUCE_AUDIOTHREADPOINTER_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioThreadPointer.h ***/
+
 class AudioIODevice;
 
 /**
@@ -398,6 +538,52 @@ public:
 	*/
 	virtual bool showControlPanel();
 
+	//==============================================================================
+	/** Returns the number of under- or overruns that the device has had since it was
+		opened, or -1 if the device can't report this.
+	*/
+	virtual int getXRunCount() const noexcept;
+
+	/** A set of figures describing the intervals between a device's callbacks. */
+	struct JUCE_API  CallbackTimingStatistics
+	{
+		CallbackTimingStatistics() noexcept;
+
+		/** Adds a measured interval to the figures. */
+		void addInterval (double intervalMs) noexcept;
+
+		/** Returns the mean interval between callbacks, in milliseconds. */
+		double getMeanIntervalMs() const noexcept;
+
+		/** Returns the jitter, i.e. the standard deviation of the intervals, in milliseconds. */
+		double getJitterMs() const noexcept;
+
+		/** The number of intervals that have been measured. */
+		int64 numIntervals;
+
+		/** The shortest and longest intervals that have been measured, in milliseconds. */
+		double minimumIntervalMs, maximumIntervalMs;
+
+		/** The sum of the intervals, and of their squares. */
+		double totalMs, totalSquaredMs;
+	};
+
+	/** Returns figures for the timing of the callbacks made since the device was opened.
+
+		Devices which don't measure this will return a set of figures in which
+		numIntervals is 0.
+	*/
+	virtual CallbackTimingStatistics getCallbackTimingStatistics() const;
+
+	//==============================================================================
+	/** If the device follows an external transport (e.g. JACK's), this returns a play
+		head that describes the transport's position at the start of the current block.
+
+		The play head belongs to the device, and should only be queried from within the
+		audio callback. Devices without a transport return nullptr.
+	*/
+	virtual AudioPlayHead* getPlayHead();
+
 protected:
 	/** Creates a device, setting its name and type member variables. */
 	AudioIODevice (const String& deviceName,
@@ -546,6 +732,8 @@ public:
 	static AudioIODeviceType* createAudioIODeviceType_Android();
 	/** Creates an Android OpenSLES device type if it's available on this platform, or returns null. */
 	static AudioIODeviceType* createAudioIODeviceType_OpenSLES();
+	/** Creates a VirtualAudioIODeviceType, which is available on all platforms. */
+	static AudioIODeviceType* createAudioIODeviceType_Virtual();
 
 protected:
 	explicit AudioIODeviceType (const String& typeName);
@@ -618,6 +806,38 @@ public:
 		// (this bit is just to avoid compiler warnings about unused variables)
 		(void) source; (void) messageData; (void) numBytesSoFar; (void) timestamp;
 	}
+
+	/** Receives a batch of incoming messages.
+
+		Some platforms (currently Linux/ALSA) read whatever messages are waiting in one go,
+		and pass them all to this method, which is much cheaper than one call per message
+		when a lot of data is arriving, e.g. big sysex dumps or MPE controller streams.
+
+		Each event's position in the buffer is the number of microseconds between
+		blockStartTime (in seconds, using the same clock as MidiMessage timestamps) and the
+		time at which that event arrived. The buffer is re-used for the next batch, so don't
+		keep a reference to it.
+
+		Because MidiBuffer stores each event's size in 16 bits, a complete sysex can only
+		be delivered here if it's no more than 65535 bytes long. Longer ones are discarded,
+		although handlePartialSysexMessage() will already have seen their first chunks.
+
+		The default implementation just calls handleIncomingMidiMessage() for each event,
+		so you only need to override this if you can do something more efficient with
+		the whole block.
+	*/
+	virtual void handleIncomingMidiBlock (MidiInput* source,
+										  const MidiBuffer& messages,
+										  double blockStartTime)
+	{
+		MidiBuffer::Iterator i (messages);
+		const uint8* data;
+		int numBytes, microseconds;
+
+		while (i.getNextEvent (data, numBytes, microseconds))
+			handleIncomingMidiMessage (source, MidiMessage (data, numBytes, blockStartTime + microseconds * 1.0e-6));
+	}
+
 };
 
 /**
@@ -1108,6 +1328,73 @@ public:
 	*/
 	double getCpuUsage() const;
 
+	//==============================================================================
+	/** A set of figures describing how long the audio callbacks have been taking.
+
+		@see getCallbackTimingReport
+	*/
+	struct JUCE_API  CallbackTimingReport
+	{
+		/** Creates an empty report. */
+		CallbackTimingReport() noexcept;
+
+		/** The length of audio that each callback produces, i.e. the time that is
+			available for processing each block.
+		*/
+		double blockDurationMs;
+
+		/** The number of device callbacks that have been measured. */
+		int64 numCallbacks;
+
+		/** The number of device callbacks that took longer than blockDurationMs. */
+		int64 numMissedDeadlines;
+
+		/** The mean and the longest time that a device callback has taken. */
+		double meanMs, worstMs;
+
+		/** The longest time that a device callback has taken within the last second,
+			the last ten seconds and the last minute.
+		*/
+		double worstMsInLastSecond, worstMsInLast10Seconds, worstMsInLastMinute;
+
+		enum { numHistogramBins = 20 };
+
+		/** A histogram of the callback durations.
+
+			Each bin covers 10% of blockDurationMs, so e.g. histogram[3] is the number of
+			callbacks that used between 30% and 40% of the available time. The last bin
+			also counts all the callbacks that took longer than that.
+		*/
+		int64 histogram [numHistogramBins];
+
+		/** The time spent inside one of the registered AudioIODeviceCallback objects. */
+		struct JUCE_API  CallbackTime
+		{
+			AudioIODeviceCallback* callback;
+			int64 numCalls;
+			double meanMs, worstMs;
+		};
+
+		/** The figures for each of the registered callbacks, in the order that they were added. */
+		Array<CallbackTime> callbackTimes;
+	};
+
+	/** Returns the timing figures that have been gathered for the audio callback.
+
+		The figures are recorded by the audio thread without any locking, and this method
+		can safely be called from any other thread without blocking it.
+
+		@see resetCallbackTimingReport, getCpuUsage
+	*/
+	CallbackTimingReport getCallbackTimingReport() const;
+
+	/** Clears the figures returned by getCallbackTimingReport().
+
+		The audio thread performs the reset at the start of its next callback, so if the
+		device isn't running, the old figures will remain until it starts again.
+	*/
+	void resetCallbackTimingReport();
+
 	/** Enables or disables a midi input device.
 
 		The list of devices can be obtained with the MidiInput::getDevices() method.
@@ -1185,6 +1472,14 @@ public:
 	*/
 	const OwnedArray <AudioIODeviceType>& getAvailableDeviceTypes();
 
+	/** Adds a new device type to the list of types.
+
+		The manager will take ownership of the object that is passed-in. This can be used
+		to add types which aren't created by createAudioDeviceTypes(), e.g. a
+		VirtualAudioIODeviceType.
+	*/
+	void addAudioDeviceType (AudioIODeviceType* newDeviceType);
+
 	/** Creates a list of available types.
 
 		This will add a set of new AudioIODeviceType objects to the specified list, to
@@ -1226,8 +1521,11 @@ public:
 	double getCurrentInputLevel() const;
 
 	/** Returns the a lock that can be used to synchronise access to the audio callback.
-		Obviously while this is locked, you're blocking the audio thread from running, so
-		it must only be used for very brief periods when absolutely necessary.
+
+		While this is locked, none of the registered callbacks will be called. The audio
+		thread never waits for this lock though: any blocks that arrive while it's held are
+		filled with silence instead, so it must only be used for very brief periods when
+		absolutely necessary.
 	*/
 	CriticalSection& getAudioCallbackLock() noexcept        { return audioCallbackLock; }
 
@@ -1245,15 +1543,16 @@ private:
 	AudioDeviceSetup currentSetup;
 	ScopedPointer <AudioIODevice> currentAudioDevice;
 	Array <AudioIODeviceCallback*> callbacks;
+	AudioThreadPointer <const Array <AudioIODeviceCallback*> > activeCallbacks;
 	int numInputChansNeeded, numOutputChansNeeded;
 	String currentDeviceType;
 	BigInteger inputChannels, outputChannels;
 	ScopedPointer <XmlElement> lastExplicitSettings;
 	mutable bool listNeedsScanning;
 	bool useInputNames;
-	int inputLevelMeasurementEnabledCount;
+	Atomic<int> inputLevelMeasurementEnabledCount;
 	double inputLevel;
-	ScopedPointer <AudioSampleBuffer> testSound;
+	AudioThreadPointer <AudioSampleBuffer> testSound;
 	int testSoundPosition;
 	AudioSampleBuffer tempBuffer;
 
@@ -1263,10 +1562,13 @@ private:
 	StringArray midiCallbackDevices;
 	String defaultMidiOutputName;
 	ScopedPointer <MidiOutput> defaultMidiOutput;
-	CriticalSection audioCallbackLock, midiCallbackLock;
+	CriticalSection audioCallbackLock, callbackListLock, midiCallbackLock;
 
 	double cpuUsageMs, timeToCpuScale;
 
+	class CallbackTimer;
+	ScopedPointer<CallbackTimer> callbackTimer;
+
 	class CallbackHandler  : public AudioIODeviceCallback,
 							 public MidiInputCallback,
 							 public AudioIODeviceType::Listener
@@ -1290,6 +1592,8 @@ private:
 	void audioDeviceStoppedInt();
 	void handleIncomingMidiMessageInt (MidiInput*, const MidiMessage&);
 	void audioDeviceListChanged();
+	void publishCallbackList();
+	void setTestSound (AudioSampleBuffer*);
 
 	String restartDevice (int blockSizeToUse, double sampleRateToUse,
 						  const BigInteger& ins, const BigInteger& outs);
@@ -1321,6 +1625,459 @@ private:
 #endif
 #ifndef __JUCE_AUDIOIODEVICETYPE_JUCEHEADER__
 
+#endif
+#ifndef __JUCE_VIRTUALAUDIOIODEVICE_JUCEHEADER__
+
+/*** Start of inlined file: juce_VirtualAudioIODevice.h ***/
+#ifndef __JUCE_VIRTUALAUDIOIODEVICE_JUCEHEADER__
+#define __JUCE_VIRTUALAUDIOIODEVICE_JUCEHEADER__
+
+/**
+	An audio device which isn't connected to any hardware, and whose callbacks are
+	driven by a clock.
+
+	This lets an app's audio code be run on machines that have no sound card, e.g.
+	for automated tests or for measuring how much processing can be done before a
+	real device would start to glitch.
+
+	The device can either run in real-time, in which case it calls its callback at
+	the rate that a real device would, or it can run as fast as possible. Its input
+	can be supplied by an AudioFormatReader, and its output can be recorded with an
+	AudioFormatWriter.
+
+	For every callback, the device measures the "slack", i.e. how much time was left
+	before the deadline by which a real device would have needed the block of data. A
+	negative slack means that a real device would have glitched. The most recent values
+	are kept in a log which can be retrieved with getSlackLog().
+
+	The devices are created by a VirtualAudioIODeviceType.
+
+	@see VirtualAudioIODeviceType
+*/
+class JUCE_API  VirtualAudioIODevice  : public AudioIODevice,
+										private Thread
+{
+public:
+
+	/** Creates a device.
+		If runInRealTime is false, the callbacks are made as fast as possible.
+	*/
+	VirtualAudioIODevice (const String& deviceName, bool runInRealTime,
+						  int numInputChannels = 2, int numOutputChannels = 2);
+
+	/** Destructor. */
+	~VirtualAudioIODevice();
+
+	//==============================================================================
+	/** Sets a reader which provides the device's input.
+
+		The reader's channels are fed to the corresponding input channels. When the end
+		of the reader is reached, it will start again from the beginning.
+		Pass nullptr to return to giving silent input.
+	*/
+	void setInputReader (AudioFormatReader* reader, bool deleteReaderWhenRemoved);
+
+	/** Sets a writer to which the device's output will be written.
+
+		The writer is called on the audio thread, after the slack for each block has been
+		measured, so it doesn't affect the timing figures. If it may block for a long time,
+		use an AudioFormatWriter::ThreadedWriter.
+		Pass nullptr to stop recording.
+	*/
+	void setOutputWriter (AudioFormatWriter* writer, bool deleteWriterWhenRemoved);
+
+	/** Returns true if the callbacks are paced to match a real device. */
+	bool isRunningInRealTime() const noexcept                   { return realTime; }
+
+	/** Makes the device's clock run slightly fast or slow, like a real device whose
+		crystal isn't quite in step with anything else.
+
+		A value of 1.0001 makes it run 100 parts-per-million fast. This only affects a
+		device that's running in real-time, and must be called before it's started.
+	*/
+	void setClockSpeed (double speedRatio) noexcept;
+
+	/** Returns the number of samples that the device has processed since it was opened. */
+	int64 getSamplePosition() const noexcept                    { return samplePosition; }
+
+	//==============================================================================
+	/** A summary of the timing of the callbacks. */
+	struct JUCE_API  TimingStatistics
+	{
+		TimingStatistics() noexcept;
+
+		/** The number of callbacks that have been made. */
+		int64 numCallbacks;
+
+		/** The number of callbacks that finished after their deadline. */
+		int64 numLateCallbacks;
+
+		/** The smallest slack that has been measured, in milliseconds. */
+		double minimumSlackMs;
+
+		/** The average slack, in milliseconds. */
+		double averageSlackMs;
+
+		/** The longest time that a callback took, in milliseconds. */
+		double maximumCallbackMs;
+	};
+
+	/** Returns the timing figures gathered since the device was opened, or since the
+		last call to resetTimingStatistics().
+	*/
+	TimingStatistics getTimingStatistics() const;
+
+	/** Clears the timing figures and the slack log. */
+	void resetTimingStatistics();
+
+	/** Copies the slack measured for the most recent callbacks (in milliseconds) into an
+		array, oldest first.
+		Up to slackLogSize values are kept.
+	*/
+	void getSlackLog (Array<float>& slackValuesMs) const;
+
+	/** The number of callbacks for which the slack is kept. */
+	enum { slackLogSize = 8192 };
+
+	//==============================================================================
+	/** @internal */
+	StringArray getOutputChannelNames();
+	/** @internal */
+	StringArray getInputChannelNames();
+	/** @internal */
+	int getNumSampleRates();
+	/** @internal */
+	double getSampleRate (int index);
+	/** @internal */
+	int getNumBufferSizesAvailable();
+	/** @internal */
+	int getBufferSizeSamples (int index);
+	/** @internal */
+	int getDefaultBufferSize();
+	/** @internal */
+	String open (const BigInteger& inputChannels, const BigInteger& outputChannels,
+				 double sampleRate, int bufferSizeSamples);
+	/** @internal */
+	void close();
+	/** @internal */
+	bool isOpen();
+	/** @internal */
+	void start (AudioIODeviceCallback* callback);
+	/** @internal */
+	void stop();
+	/** @internal */
+	bool isPlaying();
+	/** @internal */
+	String getLastError();
+	/** @internal */
+	int getCurrentBufferSizeSamples();
+	/** @internal */
+	double getCurrentSampleRate();
+	/** @internal */
+	int getCurrentBitDepth();
+	/** @internal */
+	BigInteger getActiveOutputChannels() const;
+	/** @internal */
+	BigInteger getActiveInputChannels() const;
+	/** @internal */
+	int getOutputLatencyInSamples();
+	/** @internal */
+	int getInputLatencyInSamples();
+	/** @internal */
+	int getXRunCount() const noexcept;
+	/** @internal */
+	CallbackTimingStatistics getCallbackTimingStatistics() const;
+
+private:
+	//==============================================================================
+	const bool realTime;
+	const int numInputs, numOutputs;
+	bool deviceIsOpen;
+	double sampleRate, clockSpeed;
+	int bufferSize;
+	BigInteger activeInputs, activeOutputs;
+	AudioSampleBuffer inputBuffer, outputBuffer;
+	Array<const float*> inputPointers;
+	Array<float*> outputPointers;
+	int64 volatile samplePosition;
+
+	SpinLock sourceLock, statsLock;
+	AudioIODeviceCallback* callback;
+
+	OptionalScopedPointer<AudioFormatReader> inputReader;
+	OptionalScopedPointer<AudioFormatWriter> outputWriter;
+	HeapBlock<int*> readerChannels;
+	HeapBlock<float*> writerChannels;
+	int64 inputReaderPosition;
+
+	struct Measurement
+	{
+		double callbackStartTime, slackMs, callbackMs;
+	};
+
+	enum { measurementFifoSize = 256 };
+
+	AbstractFifo measurementFifo;
+	HeapBlock<Measurement> measurements;
+
+	TimingStatistics stats;
+	CallbackTimingStatistics intervals;
+	double totalSlackMs, lastCallbackTime;
+	HeapBlock<float> slackLog;
+	int slackLogPosition;
+
+	void run();
+	void processBlock();
+	void readInput();
+	void writeOutput();
+	void addTimingMeasurement (double callbackStartTime, double slackMs, double callbackMs);
+	void collectTimingMeasurements();
+
+	JUCE_DECLARE_NON_COPYABLE (VirtualAudioIODevice);
+};
+
+//==============================================================================
+/**
+	An AudioIODeviceType which creates VirtualAudioIODevice objects.
+
+	It provides two devices: one which runs in real-time, and one which runs as fast
+	as possible. It isn't one of the types created by default in
+	AudioDeviceManager::createAudioDeviceTypes() unless the JUCE_USE_VIRTUAL_AUDIO_DEVICE
+	flag is enabled, but it can be added to a manager with
+	AudioDeviceManager::addAudioDeviceType().
+
+	@see VirtualAudioIODevice
+*/
+class JUCE_API  VirtualAudioIODeviceType  : public AudioIODeviceType
+{
+public:
+	/** Creates the type, specifying the number of channels that its devices will have. */
+	VirtualAudioIODeviceType (int numInputChannels = 2, int numOutputChannels = 2);
+
+	/** Destructor. */
+	~VirtualAudioIODeviceType();
+
+	/** The name of the device that runs in real-time. */
+	static const char* const realTimeDeviceName;
+
+	/** The name of the device that runs as fast as possible. */
+	static const char* const freeRunningDeviceName;
+
+	//==============================================================================
+	/** @internal */
+	void scanForDevices();
+	/** @internal */
+	StringArray getDeviceNames (bool wantInputNames) const;
+	/** @internal */
+	int getDefaultDeviceIndex (bool forInput) const;
+	/** @internal */
+	int getIndexOfDevice (AudioIODevice* device, bool asInput) const;
+	/** @internal */
+	bool hasSeparateInputsAndOutputs() const;
+	/** @internal */
+	AudioIODevice* createDevice (const String& outputDeviceName, const String& inputDeviceName);
+
+private:
+	const int numInputs, numOutputs;
+
+	JUCE_DECLARE_NON_COPYABLE (VirtualAudioIODeviceType);
+};
+
+#endif   // __JUCE_VIRTUALAUDIOIODEVICE_JUCEHEADER__
+
+/*** End of inlined file: juce_VirtualAudioIODevice.h ***/
+
+#endif
+#ifndef __JUCE_AGGREGATEAUDIOIODEVICE_JUCEHEADER__
+
+/*** Start of inlined file: juce_AggregateAudioIODevice.h ***/
+#ifndef __JUCE_AGGREGATEAUDIOIODEVICE_JUCEHEADER__
+#define __JUCE_AGGREGATEAUDIOIODEVICE_JUCEHEADER__
+
+/**
+	An AudioIODevice which combines several other devices into one, so that their
+	channels can all be used from a single callback.
+
+	The first of the devices acts as the clock master, and its callback drives the
+	aggregate's callback. Each of the other devices runs from its own callback thread,
+	and swaps its audio with the master through a pair of lock-free FIFOs.
+
+	Because the devices' crystals are never exactly in step, the other devices' audio
+	is passed through a windowed-sinc resampler whose ratio is continuously adjusted to
+	keep the amount of data in the FIFOs constant, so that the drift between the clocks
+	never causes a glitch. The devices don't even need to be running at the same sample
+	rate.
+
+	To add aggregates to an AudioDeviceManager, use an AggregateAudioIODeviceType.
+
+	@see AggregateAudioIODeviceType
+*/
+class JUCE_API  AggregateAudioIODevice  : public AudioIODevice
+{
+public:
+
+	/** Creates an aggregate from a set of devices.
+
+		The first device in the array is used as the clock master. The aggregate takes
+		ownership of the devices, which must not have been opened yet.
+	*/
+	AggregateAudioIODevice (const String& deviceName, const Array<AudioIODevice*>& devices);
+
+	/** Destructor. */
+	~AggregateAudioIODevice();
+
+	//==============================================================================
+	/** Returns the number of devices that make up the aggregate. */
+	int getNumMemberDevices() const noexcept;
+
+	/** Returns one of the devices that make up the aggregate. */
+	AudioIODevice* getMemberDevice (int index) const noexcept;
+
+	/** Returns the current ratio between a device's sample clock and the master's, i.e.
+		the number of that device's samples that are played for each of the master's.
+
+		For the master itself, this is always 1.0.
+	*/
+	double getClockRatio (int deviceIndex) const noexcept;
+
+	/** Returns the number of times that a device's FIFOs have run dry or overflowed
+		since the aggregate was opened.
+	*/
+	int getNumFifoGlitches (int deviceIndex) const noexcept;
+
+	//==============================================================================
+	/** @internal */
+	StringArray getOutputChannelNames();
+	/** @internal */
+	StringArray getInputChannelNames();
+	/** @internal */
+	int getNumSampleRates();
+	/** @internal */
+	double getSampleRate (int index);
+	/** @internal */
+	int getNumBufferSizesAvailable();
+	/** @internal */
+	int getBufferSizeSamples (int index);
+	/** @internal */
+	int getDefaultBufferSize();
+	/** @internal */
+	String open (const BigInteger& inputChannels, const BigInteger& outputChannels,
+				 double sampleRate, int bufferSizeSamples);
+	/** @internal */
+	void close();
+	/** @internal */
+	bool isOpen();
+	/** @internal */
+	void start (AudioIODeviceCallback* callback);
+	/** @internal */
+	void stop();
+	/** @internal */
+	bool isPlaying();
+	/** @internal */
+	String getLastError();
+	/** @internal */
+	int getCurrentBufferSizeSamples();
+	/** @internal */
+	double getCurrentSampleRate();
+	/** @internal */
+	int getCurrentBitDepth();
+	/** @internal */
+	BigInteger getActiveOutputChannels() const;
+	/** @internal */
+	BigInteger getActiveInputChannels() const;
+	/** @internal */
+	int getOutputLatencyInSamples();
+	/** @internal */
+	int getInputLatencyInSamples();
+	/** @internal */
+	int getXRunCount() const noexcept;
+
+private:
+	//==============================================================================
+	class MasterCallback;
+	class Slave;
+	friend class MasterCallback;
+
+	OwnedArray<AudioIODevice> devices;
+	OwnedArray<Slave> slaves;
+	ScopedPointer<MasterCallback> masterCallback;
+	AudioIODeviceCallback* callback;
+	BigInteger activeInputs, activeOutputs;
+	Array<int> firstInputChannel, firstOutputChannel;
+	String lastError;
+	bool deviceIsOpen;
+
+	void processMasterBlock (const float** inputs, int numInputs, float** outputs, int numOutputs, int numSamples);
+	Slave* getSlaveFor (int deviceIndex) const noexcept;
+
+	JUCE_DECLARE_NON_COPYABLE (AggregateAudioIODevice);
+};
+
+//==============================================================================
+/**
+	An AudioIODeviceType whose devices are aggregates of the devices of another type.
+
+	E.g. to treat two USB interfaces as one device:
+	@code
+	StringArray interfaces;
+	interfaces.add ("USB Audio CODEC");
+	interfaces.add ("USB Audio CODEC (2)");
+
+	AggregateAudioIODeviceType* type = new AggregateAudioIODeviceType (AudioIODeviceType::createAudioIODeviceType_ALSA());
+	type->addAggregate ("Both interfaces", interfaces);
+	deviceManager.addAudioDeviceType (type);
+	@endcode
+
+	@see AggregateAudioIODevice
+*/
+class JUCE_API  AggregateAudioIODeviceType  : public AudioIODeviceType
+{
+public:
+	/** Creates a type which will build its aggregates from the devices of another type.
+		The type that's passed in will be deleted by this object.
+	*/
+	explicit AggregateAudioIODeviceType (AudioIODeviceType* memberDeviceType);
+
+	/** Destructor. */
+	~AggregateAudioIODeviceType();
+
+	/** Defines an aggregate device.
+
+		The member names are device names from the member type, and the first of them
+		will be the aggregate's clock master. Each member is opened as both an input and
+		an output, if it has both.
+	*/
+	void addAggregate (const String& aggregateName, const StringArray& memberDeviceNames);
+
+	/** Removes all the aggregates that have been added. */
+	void clearAggregates();
+
+	//==============================================================================
+	/** @internal */
+	void scanForDevices();
+	/** @internal */
+	StringArray getDeviceNames (bool wantInputNames) const;
+	/** @internal */
+	int getDefaultDeviceIndex (bool forInput) const;
+	/** @internal */
+	int getIndexOfDevice (AudioIODevice* device, bool asInput) const;
+	/** @internal */
+	bool hasSeparateInputsAndOutputs() const;
+	/** @internal */
+	AudioIODevice* createDevice (const String& outputDeviceName, const String& inputDeviceName);
+
+private:
+	ScopedPointer<AudioIODeviceType> memberType;
+	StringArray aggregateNames;
+	OwnedArray<StringArray> memberNames;
+
+	JUCE_DECLARE_NON_COPYABLE (AggregateAudioIODeviceType);
+};
+
+#endif   // __JUCE_AGGREGATEAUDIOIODEVICE_JUCEHEADER__
+
+/*** End of inlined file: juce_AggregateAudioIODevice.h ***/
+
 #endif
 #ifndef __JUCE_MIDIINPUT_JUCEHEADER__
 
@@ -1338,6 +2095,13 @@ private:
 	The class can also be used as either a MidiKeyboardStateListener or a MidiInputCallback
 	so it can easily use a midi input or keyboard component as its source.
 
+	Messages are passed from the MIDI threads to the audio thread through a lock-free
+	queue, so neither side ever has to wait for the other. Each message is then placed
+	in the audio block according to its timestamp, measured against a smoothed estimate
+	of the audio callback's clock. This means that every message gets delayed by the
+	same amount (one block), rather than being squeezed into whichever block happens
+	to come next, which would add up to a block's worth of jitter.
+
 	@see MidiMessage, MidiInput
 */
 class JUCE_API  MidiMessageCollector    : public MidiKeyboardStateListener,
@@ -1354,34 +2118,58 @@ public:
 	/** Clears any messages from the queue.
 
 		You need to call this method before starting to use the collector, so that
-		it knows the correct sample rate to use.
+		it knows the correct sample rate to use. It mustn't be called while another
+		thread might be inside removeNextBlockOfMessages().
 	*/
 	void reset (double sampleRate);
 
 	/** Takes an incoming real-time message and adds it to the queue.
 
 		The message's timestamp is taken, and it will be ready for retrieval as part
-		of the block returned by the next call to removeNextBlockOfMessages().
+		of the block returned by the next call to removeNextBlockOfMessages() that
+		covers that time.
+
+		Any number of threads can call this at the same time as each other and as
+		removeNextBlockOfMessages(), and it never waits for the audio thread. If nothing
+		has been collecting the messages and the queue is full, the message is discarded.
 
-		This method is fully thread-safe when overlapping calls are made with
-		removeNextBlockOfMessages().
+		Messages longer than 15 bytes (i.e. sysexes) share a separate 64K buffer, so the
+		largest one that can be queued is a little under 64K. Threads adding these can
+		briefly wait for each other, but not for the audio thread.
 	*/
 	void addMessageToQueue (const MidiMessage& message);
 
 	/** Removes all the pending messages from the queue as a buffer.
 
-		This will also correct the messages' timestamps to make sure they're in
-		the range 0 to numSamples - 1.
+		The messages' timestamps are converted into positions in the range 0 to
+		numSamples - 1. Any message that's timestamped later than the end of the block
+		is left in the queue for the next one.
+
+		On top of the one block of delay, the messages get delayed by the largest amount
+		by which the callbacks have recently arrived early, so that a message can't
+		miss the block that it belongs to just because the callback came too soon.
 
 		This call should be made regularly by something like an audio processing
 		callback, because the time that it happens is used in calculating the
 		midi event positions.
 
-		This method is fully thread-safe when overlapping calls are made with
-		addMessageToQueue().
+		This method never blocks, but only one thread may call it at a time.
 	*/
 	void removeNextBlockOfMessages (MidiBuffer& destBuffer, int numSamples);
 
+	/** Removes the pending messages, using a time supplied by the caller as the time
+		of the audio callback rather than reading the clock.
+
+		If the device can provide an accurate time for the block, this avoids any
+		scheduling delay between the callback starting and this method being called.
+		The time is in seconds, using the same clock as MidiMessage timestamps, i.e.
+		Time::getMillisecondCounterHiRes() * 0.001.
+	*/
+	void removeNextBlockOfMessages (MidiBuffer& destBuffer, int numSamples, double callbackTime);
+
+	/** Returns the number of messages that have been discarded because the queue was full. */
+	int getNumDroppedMessages() const noexcept;
+
 	/** @internal */
 	void handleNoteOn (MidiKeyboardState* source, int midiChannel, int midiNoteNumber, float velocity);
 	/** @internal */
@@ -1391,11 +2179,16 @@ public:
 
 private:
 
-	double lastCallbackTime;
-	CriticalSection midiCallbackLock;
-	MidiBuffer incomingMessages;
+	class EventQueue;
+	ScopedPointer<EventQueue> queue;
 	double sampleRate;
 
+	// The callback clock, filtered by a delay-locked loop
+	double blockStartTime, blockEndTime, nextCallbackTime, filteredPeriod, loopGainB, loopGainC, jitterMargin;
+	int lastNumSamples;
+
+	void updateCallbackClock (double callbackTime, int numSamples) noexcept;
+
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiMessageCollector);
 };
 
@@ -1442,7 +2235,9 @@ public:
 		before it starts being used for playback.
 
 		If there's another source currently playing, its releaseResources() method
-		will be called after it has been swapped for the new one.
+		will be called after it has been swapped for the new one. The swap doesn't
+		block the audio thread - instead, this method waits until the audio thread
+		has finished with the old source before returning.
 
 		@param newSource                the new source to use - this will NOT be deleted
 										by this object when no longer needed, so it's the
@@ -1454,7 +2249,7 @@ public:
 
 		May return 0 if there's no source.
 	*/
-	AudioSource* getCurrentSource() const noexcept      { return source; }
+	AudioSource* getCurrentSource() const noexcept      { return source.get(); }
 
 	/** Sets a gain to apply to the audio data.
 		@see getGain
@@ -1481,8 +2276,7 @@ public:
 
 private:
 
-	CriticalSection readLock;
-	AudioSource* source;
+	AudioThreadPointer <AudioSource> source;
 	double sampleRate;
 	int bufferSize;
 	float* channels [128];
@@ -1513,13 +2307,19 @@ private:
 	This can also be told use a buffer and background thread to read ahead, and
 	if can correct for different sample-rates.
 
+	For gapless playback, the next source can be queued with queueNextSource(), which
+	fills its read-ahead buffer in advance. The audio thread then switches to it at
+	exactly the right sample, with an optional crossfade, without having to allocate
+	or wait for anything.
+
 	You may want to use one of these along with an AudioSourcePlayer and AudioIODevice
 	to control playback of an audio file.
 
 	@see AudioSource, AudioSourcePlayer
 */
 class JUCE_API  AudioTransportSource  : public PositionableAudioSource,
-										public ChangeBroadcaster
+										public ChangeBroadcaster,
+										private AsyncUpdater
 {
 public:
 
@@ -1561,6 +2361,59 @@ public:
 					double sourceSampleRateToCorrectFor = 0.0,
 					int maxNumChannels = 2);
 
+	/** Queues a source to be played when the current one finishes.
+
+		The new source is positioned and its read-ahead buffer is filled straight away,
+		on the calling thread. Then, when the current source gets to within
+		crossfadeLengthSeconds of its end, the audio thread starts crossfading to the new
+		source, at exactly the right sample. With a crossfade length of zero, the new
+		source starts on the sample after the last one of the current source. To make
+		the switch sooner, call crossfadeToNextSource().
+
+		Once the switch has happened, a change message is sent, and the previous source
+		will no longer be used by the time that message arrives. If a source was already
+		queued, it's replaced by the new one, and any crossfade that has already started
+		is abandoned. Calling setSource() removes the queued source.
+
+		Only one source can be queued at a time. To play a sequence of sources without
+		gaps, queue each one after the previous switch has happened, e.g. when the change
+		message arrives or getNextSource() returns nullptr. This can be done as soon as
+		the switch has happened, without waiting for the message thread to tidy up the
+		old source, as long as it's done before the new current source reaches its end.
+
+		The source passed in will not be deleted by this object, so must be managed by
+		the caller.
+
+		@param nextSource                       the source to play next, or nullptr to clear the queue
+		@param crossfadeLengthSeconds           the length of the crossfade between the two sources
+		@param readAheadBufferSize              as for setSource()
+		@param readAheadThread                  as for setSource()
+		@param sourceSampleRateToCorrectFor     as for setSource()
+		@param maxNumChannels                   as for setSource()
+		@param startPosition                    the position (in the new source's samples) from
+												which the new source should start
+	*/
+	void queueNextSource (PositionableAudioSource* nextSource,
+						  double crossfadeLengthSeconds,
+						  int readAheadBufferSize = 0,
+						  TimeSliceThread* readAheadThread = nullptr,
+						  double sourceSampleRateToCorrectFor = 0.0,
+						  int maxNumChannels = 2,
+						  int64 startPosition = 0);
+
+	/** Makes the crossfade to the source that was queued with queueNextSource() start at
+		the beginning of the next audio block, rather than waiting for the current source
+		to reach its end.
+
+		Returns false if no source is queued.
+	*/
+	bool crossfadeToNextSource();
+
+	/** Returns the source that was queued with queueNextSource(), or nullptr if there
+		isn't one, or if it has already become the current source.
+	*/
+	PositionableAudioSource* getNextSource() const;
+
 	/** Changes the current playback position in the source stream.
 
 		The next time the getNextAudioBlock() method is called, this
@@ -1576,6 +2429,15 @@ public:
 	*/
 	double getCurrentPosition() const;
 
+	/** Returns the time it took for audio from the new position to start being played,
+		after the most recent call to setPosition() or setNextReadPosition().
+
+		If the new position was already in the read-ahead buffer, this is just the
+		time until the next audio callback. Returns a negative value if the audio hasn't
+		arrived yet, or if the position has never been changed.
+	*/
+	double getLastSeekLatencyMs() const noexcept;
+
 	/** Returns the stream's length in seconds. */
 	double getLengthInSeconds() const;
 
@@ -1636,20 +2498,28 @@ public:
 
 private:
 
-	PositionableAudioSource* source;
-	ResamplingAudioSource* resamplerSource;
-	BufferingAudioSource* bufferingSource;
-	PositionableAudioSource* positionableSource;
-	AudioSource* masterSource;
+	class SourceChain;
+	ScopedPointer<SourceChain> current, next, retired;
 
 	CriticalSection callbackLock;
 	float volatile gain, lastGain;
 	bool volatile playing, stopped;
-	double sampleRate, sourceSampleRate;
-	int blockSize, readAheadBufferSize;
+	double sampleRate;
+	int blockSize;
 	bool isPrepared, inputStreamEOF;
 
+	AudioSampleBuffer crossfadeBuffer;
+	double crossfadeSeconds;
+	int crossfadeLength, crossfadePosition;
+	bool volatile crossfadeRequested;
+
+	double volatile seekTime, lastSeekLatencyMs;
+	bool volatile seekPending;
+
 	void releaseMasterResources();
+	void readCurrentSource (const AudioSourceChannelInfo&);
+	void finishCrossfade();
+	void handleAsyncUpdate();
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioTransportSource);
 };
@@ -393,6 +393,18 @@
 
 #include "juce_audio_formats_amalgam.h"
 
+#ifndef JUCE_USE_SSE_INTRINSICS
+ #define JUCE_USE_SSE_INTRINSICS 1
+#endif
+
+#if ! (JUCE_INTEL && (JUCE_64BIT || JUCE_MSVC || defined (__SSE2__)))
+ #undef JUCE_USE_SSE_INTRINSICS
+#endif
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#endif
+
 #if JUCE_MAC
  #define Point CarbonDummyPointName
  #define Component CarbonDummyCompName
@@ -1291,7 +1303,7 @@ void AudioFormatReader::readMaxLevels (int64 startSampleInFile,
 		return;
 	}
 
-	const int bufferSize = (int) jmin (numSamples, (int64) 4096);
+	const int bufferSize = (int) jmin (numSamples, (int64) 32768);
 	HeapBlock<int> tempSpace ((size_t) bufferSize * 2 + 64);
 
 	int* tempBuffer[3];
@@ -1315,13 +1327,13 @@ void AudioFormatReader::readMaxLevels (int64 startSampleInFile,
 			startSampleInFile += numToDo;
 
 			float bufMin, bufMax;
-			findMinAndMax (reinterpret_cast<float*> (tempBuffer[0]), numToDo, bufMin, bufMax);
+			FloatVectorOperations::findMinAndMax (reinterpret_cast<float*> (tempBuffer[0]), numToDo, bufMin, bufMax);
 			lmin = jmin (lmin, bufMin);
 			lmax = jmax (lmax, bufMax);
 
 			if (numChannels > 1)
 			{
-				findMinAndMax (reinterpret_cast<float*> (tempBuffer[1]), numToDo, bufMin, bufMax);
+				FloatVectorOperations::findMinAndMax (reinterpret_cast<float*> (tempBuffer[1]), numToDo, bufMin, bufMax);
 				rmin = jmin (rmin, bufMin);
 				rmax = jmax (rmax, bufMax);
 			}
@@ -1354,7 +1366,7 @@ void AudioFormatReader::readMaxLevels (int64 startSampleInFile,
 			numSamples -= numToDo;
 			startSampleInFile += numToDo;
 
-			for (int j = (int) numChannels; --j >= 0;)
+			for (int j = jmin (2, (int) numChannels); --j >= 0;)
 			{
 				int bufMin, bufMax;
 				findMinAndMax (tempBuffer[j], numToDo, bufMin, bufMax);
@@ -1378,469 +1390,3525 @@ void AudioFormatReader::readMaxLevels (int64 startSampleInFile,
 			rmin = lmin;
 		}
 
-		lowestLeft   = lmin / (float) std::numeric_limits<int>::max();
-		highestLeft  = lmax / (float) std::numeric_limits<int>::max();
-		lowestRight  = rmin / (float) std::numeric_limits<int>::max();
-		highestRight = rmax / (float) std::numeric_limits<int>::max();
-	}
-}
+		lowestLeft   = lmin / (float) std::numeric_limits<int>::max();
+		highestLeft  = lmax / (float) std::numeric_limits<int>::max();
+		lowestRight  = rmin / (float) std::numeric_limits<int>::max();
+		highestRight = rmax / (float) std::numeric_limits<int>::max();
+	}
+}
+
+int64 AudioFormatReader::searchForLevel (int64 startSample,
+										 int64 numSamplesToSearch,
+										 const double magnitudeRangeMinimum,
+										 const double magnitudeRangeMaximum,
+										 const int minimumConsecutiveSamples)
+{
+	if (numSamplesToSearch == 0)
+		return -1;
+
+	const int bufferSize = 32768;
+	HeapBlock<int> tempSpace (bufferSize * 2 + 64);
+
+	int* tempBuffer[3];
+	tempBuffer[0] = tempSpace.getData();
+	tempBuffer[1] = tempSpace.getData() + bufferSize;
+	tempBuffer[2] = 0;
+
+	int consecutive = 0;
+	int64 firstMatchPos = -1;
+
+	jassert (magnitudeRangeMaximum > magnitudeRangeMinimum);
+
+	const double doubleMin = jlimit (0.0, (double) std::numeric_limits<int>::max(), magnitudeRangeMinimum * std::numeric_limits<int>::max());
+	const double doubleMax = jlimit (doubleMin, (double) std::numeric_limits<int>::max(), magnitudeRangeMaximum * std::numeric_limits<int>::max());
+	const int intMagnitudeRangeMinimum = roundToInt (doubleMin);
+	const int intMagnitudeRangeMaximum = roundToInt (doubleMax);
+
+	while (numSamplesToSearch != 0)
+	{
+		const int numThisTime = (int) jmin (abs64 (numSamplesToSearch), (int64) bufferSize);
+		int64 bufferStart = startSample;
+
+		if (numSamplesToSearch < 0)
+			bufferStart -= numThisTime;
+
+		if (bufferStart >= (int) lengthInSamples)
+			break;
+
+		read (tempBuffer, 2, bufferStart, numThisTime, false);
+
+		if (! blockMightContainLevel (tempBuffer, numThisTime, magnitudeRangeMinimum, intMagnitudeRangeMinimum))
+		{
+			// nothing in this block can match, so skip straight over it..
+			consecutive = 0;
+			firstMatchPos = -1;
+
+			if (numSamplesToSearch > 0)
+			{
+				startSample += numThisTime;
+				numSamplesToSearch -= numThisTime;
+			}
+			else
+			{
+				startSample -= numThisTime;
+				numSamplesToSearch += numThisTime;
+			}
+
+			continue;
+		}
+
+		int num = numThisTime;
+		while (--num >= 0)
+		{
+			if (numSamplesToSearch < 0)
+				--startSample;
+
+			bool matches = false;
+			const int index = (int) (startSample - bufferStart);
+
+			if (usesFloatingPointData)
+			{
+				const float sample1 = std::abs (((float*) tempBuffer[0]) [index]);
+
+				if (sample1 >= magnitudeRangeMinimum
+					 && sample1 <= magnitudeRangeMaximum)
+				{
+					matches = true;
+				}
+				else if (numChannels > 1)
+				{
+					const float sample2 = std::abs (((float*) tempBuffer[1]) [index]);
+
+					matches = (sample2 >= magnitudeRangeMinimum
+								 && sample2 <= magnitudeRangeMaximum);
+				}
+			}
+			else
+			{
+				const int sample1 = abs (tempBuffer[0] [index]);
+
+				if (sample1 >= intMagnitudeRangeMinimum
+					 && sample1 <= intMagnitudeRangeMaximum)
+				{
+					matches = true;
+				}
+				else if (numChannels > 1)
+				{
+					const int sample2 = abs (tempBuffer[1][index]);
+
+					matches = (sample2 >= intMagnitudeRangeMinimum
+								 && sample2 <= intMagnitudeRangeMaximum);
+				}
+			}
+
+			if (matches)
+			{
+				if (firstMatchPos < 0)
+					firstMatchPos = startSample;
+
+				if (++consecutive >= minimumConsecutiveSamples)
+				{
+					if (firstMatchPos < 0 || firstMatchPos >= lengthInSamples)
+						return -1;
+
+					return firstMatchPos;
+				}
+			}
+			else
+			{
+				consecutive = 0;
+				firstMatchPos = -1;
+			}
+
+			if (numSamplesToSearch > 0)
+				++startSample;
+		}
+
+		if (numSamplesToSearch > 0)
+			numSamplesToSearch -= numThisTime;
+		else
+			numSamplesToSearch += numThisTime;
+	}
+
+	return -1;
+}
+
+bool AudioFormatReader::blockMightContainLevel (int* const* channels, const int numSamples,
+												const double floatMinimum, const int intMinimum) const noexcept
+{
+	for (int i = jmin (2, (int) numChannels); --i >= 0;)
+	{
+		if (usesFloatingPointData)
+		{
+			float mn, mx;
+			FloatVectorOperations::findMinAndMax (reinterpret_cast<const float*> (channels[i]), numSamples, mn, mx);
+
+			if (jmax (-mn, mx) >= floatMinimum)
+				return true;
+		}
+		else
+		{
+			int mn, mx;
+			findMinAndMax (channels[i], numSamples, mn, mx);
+
+			if (jmax (-(int64) mn, (int64) mx) >= intMinimum)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+namespace DeinterleaveHelpers
+{
+	template <int bytesPerSample> struct LittleEndianSample;
+
+	template <> struct LittleEndianSample<2>
+	{
+		static inline int read (const char* p) noexcept     { return (int) (((uint32) ByteOrder::littleEndianShort (p)) << 16); }
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		static inline __m128i readFour (const char* p) noexcept
+		{
+			return _mm_unpacklo_epi16 (_mm_setzero_si128(), _mm_loadl_epi64 ((const __m128i*) p));
+		}
+	   #endif
+	};
+
+	template <> struct LittleEndianSample<3>
+	{
+		static inline int read (const char* p) noexcept     { return (int) (((uint32) ByteOrder::littleEndian24Bit (p)) << 8); }
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		// NB: this reads 4 bytes beyond the end of the last sample
+		static inline __m128i readFour (const char* p) noexcept
+		{
+			const __m128i v = _mm_loadu_si128 ((const __m128i*) p);
+
+			return _mm_slli_epi32 (_mm_unpacklo_epi64 (_mm_unpacklo_epi32 (v, _mm_srli_si128 (v, 3)),
+													   _mm_unpacklo_epi32 (_mm_srli_si128 (v, 6), _mm_srli_si128 (v, 9))), 8);
+		}
+	   #endif
+	};
+
+	template <> struct LittleEndianSample<4>
+	{
+		static inline int read (const char* p) noexcept     { return (int) ByteOrder::littleEndianInt (p); }
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		static inline __m128i readFour (const char* p) noexcept
+		{
+			return _mm_loadu_si128 ((const __m128i*) p);
+		}
+	   #endif
+	};
+
+	template <int bytesPerSample>
+	static void readChannel (int* dest, const char* source, const int frameSize, int numSamples) noexcept
+	{
+		while (--numSamples >= 0)
+		{
+			*dest++ = LittleEndianSample<bytesPerSample>::read (source);
+			source += frameSize;
+		}
+	}
+
+	// Unpacks as many groups of 4 channels as possible, and returns the number of channels done.
+	template <int bytesPerSample>
+	static int deinterleave (int** destData, const int destOffset, const int numChannels,
+							 const char* source, const int frameSize, const int numSamples) noexcept
+	{
+		int ch = 0;
+
+	   #if JUCE_USE_SSE_INTRINSICS
+		// The source block is small enough to stay in the cache, so this takes the channels
+		// four at a time, transposing 4x4 blocks of samples so that each store writes 4
+		// consecutive samples. Only having 4 destination streams on the go at once is also
+		// much kinder to the cache than scattering into all the channels together.
+		const int numFastFrames = (bytesPerSample == 3 ? numSamples - 1 : numSamples) & ~3;
+
+		for (; ch + 4 <= numChannels; ch += 4)
+		{
+			int* const d0 = destData[ch];
+			int* const d1 = destData[ch + 1];
+			int* const d2 = destData[ch + 2];
+			int* const d3 = destData[ch + 3];
+
+			if (d0 == nullptr || d1 == nullptr || d2 == nullptr || d3 == nullptr)
+			{
+				for (int j = 0; j < 4; ++j)
+					if (destData[ch + j] != nullptr)
+						readChannel<bytesPerSample> (destData[ch + j] + destOffset, source + (ch + j) * bytesPerSample, frameSize, numSamples);
+
+				continue;
+			}
+
+			const char* s = source + ch * bytesPerSample;
+			int i = 0;
+
+			for (; i < numFastFrames; i += 4)
+			{
+				const __m128i f0 = LittleEndianSample<bytesPerSample>::readFour (s);
+				const __m128i f1 = LittleEndianSample<bytesPerSample>::readFour (s + frameSize);
+				const __m128i f2 = LittleEndianSample<bytesPerSample>::readFour (s + frameSize * 2);
+				const __m128i f3 = LittleEndianSample<bytesPerSample>::readFour (s + frameSize * 3);
+				s += frameSize * 4;
+
+				const __m128i t0 = _mm_unpacklo_epi32 (f0, f1);
+				const __m128i t1 = _mm_unpacklo_epi32 (f2, f3);
+				const __m128i t2 = _mm_unpackhi_epi32 (f0, f1);
+				const __m128i t3 = _mm_unpackhi_epi32 (f2, f3);
+
+				_mm_storeu_si128 ((__m128i*) (d0 + destOffset + i), _mm_unpacklo_epi64 (t0, t1));
+				_mm_storeu_si128 ((__m128i*) (d1 + destOffset + i), _mm_unpackhi_epi64 (t0, t1));
+				_mm_storeu_si128 ((__m128i*) (d2 + destOffset + i), _mm_unpacklo_epi64 (t2, t3));
+				_mm_storeu_si128 ((__m128i*) (d3 + destOffset + i), _mm_unpackhi_epi64 (t2, t3));
+			}
+
+			for (int j = 0; j < 4; ++j)
+				readChannel<bytesPerSample> (destData[ch + j] + destOffset + i, s + j * bytesPerSample, frameSize, numSamples - i);
+		}
+	   #else
+		(void) destData; (void) destOffset; (void) numChannels; (void) source; (void) frameSize; (void) numSamples;
+	   #endif
+
+		return ch;
+	}
+}
+
+void AudioFormatReader::deinterleaveLittleEndianSamples (int** destData, const int destOffset, const int numDestChannels,
+														 const void* sourceData, const int numSourceChannels,
+														 const int bytesPerSample, const int numSamples) noexcept
+{
+	using namespace DeinterleaveHelpers;
+
+	const char* const source = static_cast<const char*> (sourceData);
+	const int frameSize = numSourceChannels * bytesPerSample;
+	const int numChannels = jmin (numDestChannels, numSourceChannels);
+
+	int numDone = 0;
+
+	switch (bytesPerSample)
+	{
+		case 2:     numDone = deinterleave<2> (destData, destOffset, numChannels, source, frameSize, numSamples); break;
+		case 3:     numDone = deinterleave<3> (destData, destOffset, numChannels, source, frameSize, numSamples); break;
+		case 4:     numDone = deinterleave<4> (destData, destOffset, numChannels, source, frameSize, numSamples); break;
+		default:    jassertfalse; return;
+	}
+
+	// Any channels left over after the groups of 4 are converted individually, as the
+	// scalar version of the deinterleaver is no quicker than that.
+	if (numDone < numChannels)
+	{
+		int** const dest = destData + numDone;
+		const char* const src = source + numDone * bytesPerSample;
+		const int num = numChannels - numDone;
+
+		switch (bytesPerSample)
+		{
+			case 2:     ReadHelper<AudioData::Int32, AudioData::Int16, AudioData::LittleEndian>::read (dest, destOffset, num, src, numSourceChannels, numSamples); break;
+			case 3:     ReadHelper<AudioData::Int32, AudioData::Int24, AudioData::LittleEndian>::read (dest, destOffset, num, src, numSourceChannels, numSamples); break;
+			default:    ReadHelper<AudioData::Int32, AudioData::Int32, AudioData::LittleEndian>::read (dest, destOffset, num, src, numSourceChannels, numSamples); break;
+		}
+	}
+
+	for (int i = numChannels; i < numDestChannels; ++i)
+		if (destData[i] != nullptr)
+			zeromem (destData[i] + destOffset, sizeof (int) * (size_t) numSamples);
+}
+
+/*** End of inlined file: juce_AudioFormatReader.cpp ***/
+
+
+/*** Start of inlined file: juce_AudioFormatReaderSource.cpp ***/
+AudioFormatReaderSource::AudioFormatReaderSource (AudioFormatReader* const reader_,
+												  const bool deleteReaderWhenThisIsDeleted)
+	: reader (reader_, deleteReaderWhenThisIsDeleted),
+	  nextPlayPos (0),
+	  looping (false)
+{
+	jassert (reader != nullptr);
+}
+
+AudioFormatReaderSource::~AudioFormatReaderSource() {}
+
+int64 AudioFormatReaderSource::getTotalLength() const                   { return reader->lengthInSamples; }
+void AudioFormatReaderSource::setNextReadPosition (int64 newPosition)   { nextPlayPos = newPosition; }
+void AudioFormatReaderSource::setLooping (bool shouldLoop)              { looping = shouldLoop; }
+
+int64 AudioFormatReaderSource::getNextReadPosition() const
+{
+	return looping ? nextPlayPos % reader->lengthInSamples
+				   : nextPlayPos;
+}
+
+void AudioFormatReaderSource::prepareToPlay (int /*samplesPerBlockExpected*/, double /*sampleRate*/) {}
+void AudioFormatReaderSource::releaseResources() {}
+
+void AudioFormatReaderSource::getNextAudioBlock (const AudioSourceChannelInfo& info)
+{
+	if (info.numSamples > 0)
+	{
+		const int64 start = nextPlayPos;
+
+		if (looping)
+		{
+			const int newStart = (int) (start % (int) reader->lengthInSamples);
+			const int newEnd = (int) ((start + info.numSamples) % (int) reader->lengthInSamples);
+
+			if (newEnd > newStart)
+			{
+				reader->read (info.buffer, info.startSample,
+							  newEnd - newStart, newStart, true, true);
+			}
+			else
+			{
+				const int endSamps = (int) reader->lengthInSamples - newStart;
+
+				reader->read (info.buffer, info.startSample,
+							  endSamps, newStart, true, true);
+
+				reader->read (info.buffer, info.startSample + endSamps,
+							  newEnd, 0, true, true);
+			}
+
+			nextPlayPos = newEnd;
+		}
+		else
+		{
+			reader->read (info.buffer, info.startSample,
+						  info.numSamples, start, true, true);
+			nextPlayPos += info.numSamples;
+		}
+	}
+}
+
+/*** End of inlined file: juce_AudioFormatReaderSource.cpp ***/
+
+/*** Start of inlined file: juce_AudioFormatPrefetcher.cpp ***/
+class AudioFormatPrefetcher::PrefetchedReader  : public AudioFormatReader
+{
+public:
+	PrefetchedReader (AudioFormatReader* const source_, HeapBlock<int>& data,
+					  const int64 prefetchStart_, const int numPrefetched_, const int samplesPerChannel_)
+		: AudioFormatReader (nullptr, source_->getFormatName()),
+		  source (source_),
+		  prefetchStart (prefetchStart_),
+		  numPrefetched (numPrefetched_),
+		  samplesPerChannel (samplesPerChannel_)
+	{
+		prefetched.swapWith (data);
+
+		sampleRate = source->sampleRate;
+		bitsPerSample = source->bitsPerSample;
+		lengthInSamples = source->lengthInSamples;
+		numChannels = source->numChannels;
+		usesFloatingPointData = source->usesFloatingPointData;
+		metadataValues = source->metadataValues;
+	}
+
+	bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+					  int64 startSampleInFile, int numSamples)
+	{
+		bool ok = true;
+		const int64 prefetchEnd = prefetchStart + numPrefetched;
+
+		while (numSamples > 0)
+		{
+			int numThisTime;
+
+			if (startSampleInFile >= prefetchStart && startSampleInFile < prefetchEnd)
+			{
+				const int offset = (int) (startSampleInFile - prefetchStart);
+				numThisTime = jmin (numSamples, numPrefetched - offset);
+
+				for (int i = numDestChannels; --i >= 0;)
+				{
+					if (destSamples[i] != nullptr)
+					{
+						if (i < (int) numChannels)
+							memcpy (destSamples[i] + startOffsetInDestBuffer,
+									prefetched + i * samplesPerChannel + offset,
+									sizeof (int) * (size_t) numThisTime);
+						else
+							zeromem (destSamples[i] + startOffsetInDestBuffer, sizeof (int) * (size_t) numThisTime);
+					}
+				}
+			}
+			else
+			{
+				numThisTime = numSamples;
+
+				if (startSampleInFile < prefetchStart)
+					numThisTime = (int) jmin ((int64) numSamples, prefetchStart - startSampleInFile);
+
+				ok = source->readSamples (destSamples, numDestChannels, startOffsetInDestBuffer,
+										  startSampleInFile, numThisTime) && ok;
+			}
+
+			startOffsetInDestBuffer += numThisTime;
+			startSampleInFile += numThisTime;
+			numSamples -= numThisTime;
+		}
+
+		return ok;
+	}
+
+private:
+	ScopedPointer<AudioFormatReader> source;
+	HeapBlock<int> prefetched;
+	const int64 prefetchStart;
+	const int numPrefetched, samplesPerChannel;
+
+	JUCE_DECLARE_NON_COPYABLE (PrefetchedReader);
+};
+
+//==============================================================================
+class AudioFormatPrefetcher::Item  : public ReferenceCountedObject
+{
+public:
+	Item (const File& file_, const int64 startSample_)
+		: file (file_), startSample (jmax ((int64) 0, startSample_)),
+		  finished (false), numToPrefetch (0),
+		  numPrefetched (0), failed (false)
+	{
+	}
+
+	typedef ReferenceCountedObjectPtr<Item> Ptr;
+
+	// Does the next bit of work, i.e. either opening the file or decoding a block
+	void process (AudioFormatManager& formatManager, const double secondsToPrefetch)
+	{
+		const ScopedLock sl (lock);
+
+		if (finished)
+			return;
+
+		if (reader == nullptr)
+		{
+			reader = formatManager.createReaderFor (file);
+
+			if (reader == nullptr)
+			{
+				failed = true;
+				finished = true;
+				return;
+			}
+
+			numToPrefetch = (int) jlimit ((int64) 0, reader->lengthInSamples - startSample,
+										  (int64) (secondsToPrefetch * reader->sampleRate));
+			data.malloc ((size_t) (jmax (1, (int) reader->numChannels) * jmax (1, numToPrefetch)));
+		}
+		else
+		{
+			const int numThisTime = jmin ((int) blockSize, numToPrefetch - numPrefetched);
+			const int numChannels = (int) reader->numChannels;
+			HeapBlock<int*> channels ((size_t) numChannels + 1);
+
+			for (int i = 0; i < numChannels; ++i)
+				channels[i] = data + i * numToPrefetch + numPrefetched;
+
+			channels[numChannels] = nullptr;
+
+			reader->read (channels, numChannels, startSample + numPrefetched, numThisTime, false);
+			numPrefetched += numThisTime;
+		}
+
+		finished = (numPrefetched >= numToPrefetch);
+	}
+
+	// Hands over whatever has been done so far, as a reader
+	AudioFormatReader* createReader (AudioFormatManager& formatManager)
+	{
+		const ScopedLock sl (lock);
+		finished = true;
+
+		if (reader == nullptr)
+			return failed ? nullptr : formatManager.createReaderFor (file);
+
+		return new PrefetchedReader (reader.release(), data, startSample, numPrefetched, numToPrefetch);
+	}
+
+	const File file;
+	const int64 startSample;
+	bool volatile finished;
+
+private:
+	CriticalSection lock;
+	ScopedPointer<AudioFormatReader> reader;
+	HeapBlock<int> data;
+	int numToPrefetch, numPrefetched;
+	bool failed;
+
+	enum { blockSize = 16384 };
+
+	JUCE_DECLARE_NON_COPYABLE (Item);
+};
+
+//==============================================================================
+AudioFormatPrefetcher::AudioFormatPrefetcher (AudioFormatManager& formatManager_,
+											  TimeSliceThread& thread_,
+											  const double secondsToPrefetch_)
+	: formatManager (formatManager_),
+	  thread (thread_),
+	  secondsToPrefetch (jmax (0.0, secondsToPrefetch_))
+{
+	thread.addTimeSliceClient (this);
+}
+
+AudioFormatPrefetcher::~AudioFormatPrefetcher()
+{
+	thread.removeTimeSliceClient (this);
+}
+
+void AudioFormatPrefetcher::prefetch (const File& file, const int64 startSample)
+{
+	{
+		const ScopedLock sl (lock);
+
+		if (indexOf (file, startSample) >= 0)
+			return;
+
+		items.add (new Item (file, startSample));
+	}
+
+	thread.moveToFrontOfQueue (this);
+}
+
+void AudioFormatPrefetcher::cancel (const File& file, const int64 startSample)
+{
+	const ScopedLock sl (lock);
+	items.remove (indexOf (file, startSample));
+}
+
+void AudioFormatPrefetcher::cancelAll()
+{
+	const ScopedLock sl (lock);
+	items.clear();
+}
+
+bool AudioFormatPrefetcher::isReady (const File& file, const int64 startSample) const
+{
+	const ScopedLock sl (lock);
+	const int index = indexOf (file, startSample);
+	return index >= 0 && items.getUnchecked (index)->finished;
+}
+
+int AudioFormatPrefetcher::getNumPendingFiles() const
+{
+	const ScopedLock sl (lock);
+	return items.size();
+}
+
+AudioFormatReaderSource* AudioFormatPrefetcher::createSourceFor (const File& file, const int64 startSample)
+{
+	Item::Ptr item;
+
+	{
+		const ScopedLock sl (lock);
+		const int index = indexOf (file, startSample);
+
+		if (index >= 0)
+		{
+			item = items.getUnchecked (index);
+			items.remove (index);
+		}
+	}
+
+	AudioFormatReader* const reader = item != nullptr ? item->createReader (formatManager)
+													  : formatManager.createReaderFor (file);
+
+	if (reader == nullptr)
+		return nullptr;
+
+	AudioFormatReaderSource* const source = new AudioFormatReaderSource (reader, true);
+	source->setNextReadPosition (startSample);
+	return source;
+}
+
+int AudioFormatPrefetcher::indexOf (const File& file, int64 startSample) const
+{
+	startSample = jmax ((int64) 0, startSample);
+
+	for (int i = 0; i < items.size(); ++i)
+	{
+		const Item* const item = items.getUnchecked (i);
+
+		if (item->startSample == startSample && item->file == file)
+			return i;
+	}
+
+	return -1;
+}
+
+int AudioFormatPrefetcher::useTimeSlice()
+{
+	Item::Ptr item;
+
+	{
+		// (the items are dealt with in the order they were added, as that's the
+		// order in which a playlist will need them)
+		const ScopedLock sl (lock);
+
+		for (int i = 0; i < items.size(); ++i)
+		{
+			if (! items.getUnchecked (i)->finished)
+			{
+				item = items.getUnchecked (i);
+				break;
+			}
+		}
+	}
+
+	if (item == nullptr)
+		return 500;
+
+	item->process (formatManager, secondsToPrefetch);
+	return 0;
+}
+
+#if JUCE_UNIT_TESTS
+
+class AudioFormatPrefetcherTests  : public UnitTest
+{
+public:
+	AudioFormatPrefetcherTests() : UnitTest ("Audio format prefetcher") {}
+
+	void runTest()
+	{
+		beginTest ("Prefetching");
+
+		const File file (File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("juce_prefetch_test", ".wav", false));
+		const int numSamples = 20000, startSample = 3000;
+
+		{
+			AudioSampleBuffer buffer (2, numSamples);
+
+			for (int i = 0; i < numSamples; ++i)
+			{
+				*buffer.getSampleData (0, i) = (i % 1000) / 1000.0f;
+				*buffer.getSampleData (1, i) = -(i % 700) / 700.0f;
+			}
+
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (file.createOutputStream(), 10000, 2, 24, StringPairArray(), 0));
+			expect (writer != nullptr);
+			writer->writeFromAudioSampleBuffer (buffer, 0, numSamples);
+		}
+
+		AudioFormatManager formatManager;
+		formatManager.registerBasicFormats();
+
+		TimeSliceThread thread ("prefetch test");
+		thread.startThread();
+
+		{
+			AudioFormatPrefetcher prefetcher (formatManager, thread, 1.0);
+			prefetcher.prefetch (file, startSample);
+			prefetcher.prefetch (File::nonexistent);
+			expectEquals (prefetcher.getNumPendingFiles(), 2);
+
+			for (int i = 0; i < 500 && ! prefetcher.isReady (file, startSample); ++i)
+				Thread::sleep (10);
+
+			expect (prefetcher.isReady (file, startSample));
+
+			ScopedPointer<AudioFormatReaderSource> source (prefetcher.createSourceFor (file, startSample));
+			expect (source != nullptr);
+			expectEquals (prefetcher.getNumPendingFiles(), 1);
+			expect (source->getNextReadPosition() == startSample);
+
+			// read across the end of the prefetched region and compare with the file
+			const int numToRead = 15000;
+			AudioSampleBuffer result (2, numToRead);
+			source->prepareToPlay (numToRead, 10000.0);
+			source->getNextAudioBlock (AudioSourceChannelInfo (result));
+
+			ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (file));
+			AudioSampleBuffer expected (2, numToRead);
+			reader->read (&expected, 0, numToRead, startSample, true, true);
+
+			for (int ch = 0; ch < 2; ++ch)
+				expect (memcmp (result.getSampleData (ch), expected.getSampleData (ch), sizeof (float) * numToRead) == 0);
+
+			expect (prefetcher.createSourceFor (File::nonexistent) == nullptr);
+			expectEquals (prefetcher.getNumPendingFiles(), 0);
+		}
+
+		thread.stopThread (1000);
+		file.deleteFile();
+	}
+};
+
+static AudioFormatPrefetcherTests audioFormatPrefetcherTests;
+
+#endif
+
+/*** End of inlined file: juce_AudioFormatPrefetcher.cpp ***/
+
+
+/*** Start of inlined file: juce_AudioFormatTranscoder.cpp ***/
+AudioFormatTranscoder::Job::Job (const File& source, const File& destination)
+	: sourceFile (source),
+	  destinationFile (destination),
+	  destinationFormat (nullptr),
+	  destinationSampleRate (0),
+	  bitsPerSample (0),
+	  qualityOptionIndex (0)
+{
+}
+
+AudioFormatTranscoder::JobProgress::JobProgress() noexcept
+	: state (jobPending),
+	  totalSamples (0),
+	  samplesDecoded (0),
+	  samplesWritten (0),
+	  elapsedSeconds (0),
+	  sampleRate (0)
+{
+}
+
+double AudioFormatTranscoder::JobProgress::getSamplesPerSecond() const noexcept
+{
+	return elapsedSeconds > 0 ? samplesWritten / elapsedSeconds : 0.0;
+}
+
+double AudioFormatTranscoder::JobProgress::getSpeedRelativeToRealtime() const noexcept
+{
+	return sampleRate > 0 ? getSamplesPerSecond() / sampleRate : 0.0;
+}
+
+class AudioFormatTranscoder::FileTask
+{
+public:
+	FileTask (AudioFormatTranscoder& owner_, const Job& job_, const int numBlocks)
+		: owner (owner_),
+		  job (job_),
+		  fifo (numBlocks),
+		  blockLengths ((size_t) numBlocks),
+		  samplesDecoded (0),
+		  samplesWritten (0),
+		  decodingFinished (false),
+		  aborted (false),
+		  needsReleasing (false),
+		  decoderActive (false),
+		  encoderActive (false),
+		  startTime (0),
+		  endTime (0)
+	{
+	}
+
+	bool open (String& error)
+	{
+		reader = owner.formatManager.createReaderFor (job.sourceFile);
+
+		if (reader == nullptr)
+		{
+			error = "Couldn't open " + job.sourceFile.getFullPathName();
+			return false;
+		}
+
+		AudioFormat* format = job.destinationFormat;
+
+		if (format == nullptr)
+			format = owner.formatManager.findFormatForFileExtension (job.destinationFile.getFileExtension());
+
+		if (format == nullptr)
+		{
+			error = "No format available for " + job.destinationFile.getFileName();
+			return false;
+		}
+
+		const int numChannels = (int) reader->numChannels;
+		const double rate = job.destinationSampleRate > 0 ? job.destinationSampleRate : reader->sampleRate;
+
+		int bits = job.bitsPerSample;
+
+		if (bits <= 0)
+		{
+			const Array<int> depths (format->getPossibleBitDepths());
+			bits = depths.contains ((int) reader->bitsPerSample) ? (int) reader->bitsPerSample
+																  : jmax (16, depths.getLast());
+		}
+
+		job.destinationFile.deleteFile();
+		ScopedPointer<FileOutputStream> out (job.destinationFile.createOutputStream());
+
+		if (out == nullptr)
+		{
+			error = "Couldn't create " + job.destinationFile.getFullPathName();
+			return false;
+		}
+
+		writer = format->createWriterFor (out, rate, (unsigned int) numChannels, bits,
+										  job.metadataValues, job.qualityOptionIndex);
+
+		if (writer == nullptr)
+		{
+			error = "Couldn't create a " + format->getFormatName() + " writer for "
+					  + job.destinationFile.getFileName();
+			return false;
+		}
+
+		out.release();
+
+		for (int i = fifo.getTotalSize(); --i >= 0;)
+			blocks.add (new AudioSampleBuffer (numChannels, owner.samplesPerBlock));
+
+		readerSource = new ReaderSource (*reader);
+		totalSamples = reader->lengthInSamples;
+
+		if (rate != reader->sampleRate)
+		{
+			resampler = new ResamplingAudioSource (readerSource, false, numChannels);
+			resampler->setResamplingRatio (reader->sampleRate / rate);
+			resampler->prepareToPlay (owner.samplesPerBlock, rate);
+			totalSamples = (int64) (reader->lengthInSamples * rate / reader->sampleRate);
+		}
+
+		outputSampleRate = rate;
+		return true;
+	}
+
+	void decodeNextBlock (AudioSampleBuffer& buffer, const int numSamples)
+	{
+		if (resampler != nullptr)
+			resampler->getNextAudioBlock (AudioSourceChannelInfo (&buffer, 0, numSamples));
+		else
+			readerSource->getNextAudioBlock (AudioSourceChannelInfo (&buffer, 0, numSamples));
+	}
+
+	void releaseDecoder()
+	{
+		resampler = nullptr;
+		readerSource = nullptr;
+		reader = nullptr;
+	}
+
+	void releaseEncoder (const bool deleteOutput)
+	{
+		writer = nullptr;
+		blocks.clear();
+
+		if (deleteOutput)
+			job.destinationFile.deleteFile();
+	}
+
+	/** Called by each stage when it's about to leave the pool for good. The two stages
+		share the blocks, so whichever one goes last is the one that releases them.
+	*/
+	void stageFinished (bool& stageActiveFlag)
+	{
+		const ScopedLock sl (owner.lock);
+		stageActiveFlag = false;
+		releaseIfUnused();
+	}
+
+	// (the owner's lock must be held when calling this)
+	void releaseIfUnused()
+	{
+		if (needsReleasing && ! (decoderActive || encoderActive))
+		{
+			needsReleasing = false;
+			releaseDecoder();
+			releaseEncoder (state != jobFinished);
+		}
+	}
+
+	JobProgress getProgress (const JobState state, const String& errorMessage) const
+	{
+		JobProgress p;
+		p.state = state;
+		p.errorMessage = errorMessage;
+		p.totalSamples = totalSamples;
+		p.samplesDecoded = samplesDecoded;
+		p.samplesWritten = samplesWritten;
+		p.sampleRate = outputSampleRate;
+
+		if (startTime > 0)
+			p.elapsedSeconds = ((endTime > 0 ? endTime : Time::getMillisecondCounterHiRes()) - startTime) / 1000.0;
+
+		return p;
+	}
+
+	//==============================================================================
+	/** Reads all of the reader's channels as floats, regardless of the sample format. */
+	struct ReaderSource  : public AudioSource
+	{
+		ReaderSource (AudioFormatReader& reader_)
+			: reader (reader_), position (0), channels ((size_t) reader_.numChannels + 1)
+		{}
+
+		void prepareToPlay (int, double) {}
+		void releaseResources() {}
+
+		void getNextAudioBlock (const AudioSourceChannelInfo& info)
+		{
+			const int numChans = jmin ((int) reader.numChannels, info.buffer->getNumChannels());
+
+			for (int i = 0; i < numChans; ++i)
+				channels[i] = reinterpret_cast<int*> (info.buffer->getSampleData (i, info.startSample));
+
+			if (! reader.read (channels, numChans, position, info.numSamples, false))
+				info.clearActiveBufferRegion();
+			else if (! reader.usesFloatingPointData)
+				for (int i = 0; i < numChans; ++i)
+					convertToFloat (channels[i], info.numSamples);
+
+			position += info.numSamples;
+		}
+
+		static void convertToFloat (int* data, int num) noexcept
+		{
+			const float multiplier = 1.0f / 0x7fffffff;
+
+			for (int i = 0; i < num; ++i)
+				reinterpret_cast<float*> (data)[i] = data[i] * multiplier;
+		}
+
+		AudioFormatReader& reader;
+		int64 position;
+		HeapBlock<int*> channels;
+
+		JUCE_DECLARE_NON_COPYABLE (ReaderSource);
+	};
+
+	AudioFormatTranscoder& owner;
+	Job job;
+
+	ScopedPointer<AudioFormatReader> reader;
+	ScopedPointer<ReaderSource> readerSource;
+	ScopedPointer<ResamplingAudioSource> resampler;
+	ScopedPointer<AudioFormatWriter> writer;
+
+	AbstractFifo fifo;
+	OwnedArray<AudioSampleBuffer> blocks;
+	HeapBlock<int> blockLengths;
+	WaitableEvent dataReady, spaceReady;
+
+	ScopedPointer<DecodeStage> decoder;
+	ScopedPointer<EncodeStage> encoder;
+
+	JobState state;
+	String errorMessage;
+	int64 totalSamples;
+	volatile int64 samplesDecoded, samplesWritten;
+	volatile bool decodingFinished, aborted;
+	bool needsReleasing, decoderActive, encoderActive; // (guarded by the owner's lock)
+	double outputSampleRate, startTime, endTime;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (FileTask);
+};
+
+//==============================================================================
+class AudioFormatTranscoder::EncodeStage  : public ThreadPoolJob
+{
+public:
+	EncodeStage (FileTask& task_)
+		: ThreadPoolJob ("Encode " + task_.job.destinationFile.getFileName()),
+		  task (task_)
+	{
+	}
+
+	JobStatus runJob()
+	{
+		for (int i = 4; --i >= 0;)
+		{
+			if (shouldExit() || task.aborted)
+				break;
+
+			// (this flag must be checked before looking at the fifo)
+			const bool noMoreData = task.decodingFinished;
+
+			int start1, size1, start2, size2;
+			task.fifo.prepareToRead (1, start1, size1, start2, size2);
+
+			if (size1 <= 0)
+			{
+				if (noMoreData)
+				{
+					task.writer = nullptr; // (flushes the file before anyone's told it's finished)
+					task.owner.taskFinished (task, jobFinished, String::empty);
+					task.stageFinished (task.encoderActive);
+					return jobHasFinished;
+				}
+
+				task.dataReady.wait (20);
+				break;
+			}
+
+			if (! task.writer->writeFromAudioSampleBuffer (*task.blocks.getUnchecked (start1),
+														   0, task.blockLengths[start1]))
+			{
+				// The decoder may still be filling the blocks, so they're left for
+				// whichever stage finishes last to release.
+				task.aborted = true;
+				task.spaceReady.signal();
+				task.owner.taskFinished (task, jobFailed, "Couldn't write to " + task.job.destinationFile.getFullPathName());
+				task.stageFinished (task.encoderActive);
+				return jobHasFinished;
+			}
+
+			task.samplesWritten += task.blockLengths[start1];
+			task.fifo.finishedRead (1);
+			task.spaceReady.signal();
+		}
+
+		if (shouldExit() || task.aborted)
+		{
+			task.stageFinished (task.encoderActive);
+			return jobHasFinished;
+		}
+
+		return jobNeedsRunningAgain;
+	}
+
+private:
+	FileTask& task;
+
+	JUCE_DECLARE_NON_COPYABLE (EncodeStage);
+};
+
+//==============================================================================
+class AudioFormatTranscoder::DecodeStage  : public ThreadPoolJob
+{
+public:
+	DecodeStage (FileTask& task_)
+		: ThreadPoolJob ("Decode " + task_.job.sourceFile.getFileName()),
+		  task (task_), isOpen (false)
+	{
+	}
+
+	JobStatus runJob()
+	{
+		if (! isOpen)
+		{
+			String error;
+
+			{
+				const ScopedLock sl (task.owner.lock);
+				task.startTime = Time::getMillisecondCounterHiRes();
+			}
+
+			if (! task.open (error))
+			{
+				task.owner.taskFinished (task, jobFailed, error);
+				task.stageFinished (task.decoderActive);
+				return jobHasFinished;
+			}
+
+			isOpen = true;
+
+			const ScopedLock sl (task.owner.lock);
+
+			if (! task.aborted)
+			{
+				task.encoderActive = true;
+				task.owner.pool.addJob (task.encoder, false);
+			}
+		}
+
+		// Do a few blocks at a time, then give the other jobs a turn..
+		for (int i = 4; --i >= 0;)
+		{
+			if (shouldExit() || task.aborted)
+				break;
+
+			if (task.samplesDecoded >= task.totalSamples)
+			{
+				task.releaseDecoder();
+				task.decodingFinished = true;
+				task.dataReady.signal();
+				task.stageFinished (task.decoderActive);
+				return jobHasFinished;
+			}
+
+			int start1, size1, start2, size2;
+			task.fifo.prepareToWrite (1, start1, size1, start2, size2);
+
+			if (size1 <= 0)
+			{
+				task.spaceReady.wait (20);
+				break;
+			}
+
+			const int numSamples = (int) jmin ((int64) task.owner.samplesPerBlock,
+											   task.totalSamples - task.samplesDecoded);
+
+			task.decodeNextBlock (*task.blocks.getUnchecked (start1), numSamples);
+			task.blockLengths[start1] = numSamples;
+			task.fifo.finishedWrite (1);
+			task.samplesDecoded += numSamples;
+			task.dataReady.signal();
+		}
+
+		if (shouldExit() || task.aborted)
+		{
+			task.stageFinished (task.decoderActive);
+			return jobHasFinished;
+		}
+
+		return jobNeedsRunningAgain;
+	}
+
+private:
+	FileTask& task;
+	bool isOpen;
+
+	JUCE_DECLARE_NON_COPYABLE (DecodeStage);
+};
+
+//==============================================================================
+AudioFormatTranscoder::AudioFormatTranscoder (AudioFormatManager& formatManager_,
+											  const int numThreads,
+											  const int samplesPerBlock_,
+											  const int numBlocksPerFile_)
+	: formatManager (formatManager_),
+	  pool (numThreads > 0 ? numThreads : SystemStats::getNumCpus()),
+	  samplesPerBlock (jmax (256, samplesPerBlock_)),
+	  numBlocksPerFile (jmax (2, numBlocksPerFile_)),
+	  maxActiveTasks (numThreads > 0 ? numThreads : SystemStats::getNumCpus()),
+	  numActiveTasks (0),
+	  started (false),
+	  startTime (0),
+	  endTime (0)
+{
+}
+
+AudioFormatTranscoder::~AudioFormatTranscoder()
+{
+	cancel();
+
+	// The tasks can't be deleted while any of their jobs might still be using them..
+	pool.removeAllJobs (true, -1);
+
+	const ScopedLock sl (lock);
+
+	for (int i = tasks.size(); --i >= 0;)
+	{
+		FileTask& task = *tasks.getUnchecked (i);
+		task.decoderActive = task.encoderActive = false;
+		task.releaseIfUnused();
+	}
+}
+
+int AudioFormatTranscoder::addJob (const Job& newJob)
+{
+	FileTask* const task = new FileTask (*this, newJob, numBlocksPerFile);
+	task->decoder = new DecodeStage (*task);
+	task->encoder = new EncodeStage (*task);
+	task->state = jobPending;
+	task->totalSamples = 0;
+	task->outputSampleRate = newJob.destinationSampleRate;
+
+	int index;
+
+	{
+		const ScopedLock sl (lock);
+		index = tasks.size();
+		tasks.add (task);
+	}
+
+	if (started)
+		startMoreTasks();
+
+	return index;
+}
+
+int AudioFormatTranscoder::getNumJobs() const
+{
+	const ScopedLock sl (lock);
+	return tasks.size();
+}
+
+void AudioFormatTranscoder::start()
+{
+	{
+		const ScopedLock sl (lock);
+
+		if (started)
+			return;
+
+		started = true;
+		startTime = Time::getMillisecondCounterHiRes();
+		endTime = 0;
+	}
+
+	startMoreTasks();
+}
+
+void AudioFormatTranscoder::startMoreTasks()
+{
+	const ScopedLock sl (lock);
+
+	for (int i = 0; i < tasks.size() && numActiveTasks < maxActiveTasks; ++i)
+	{
+		FileTask* const task = tasks.getUnchecked (i);
+
+		if (task->state == jobPending && ! task->aborted)
+		{
+			task->state = jobRunning;
+			task->needsReleasing = true;
+			task->decoderActive = true;
+			++numActiveTasks;
+			pool.addJob (task->decoder, false);
+		}
+	}
+}
+
+void AudioFormatTranscoder::taskFinished (FileTask& task, const JobState newState, const String& error)
+{
+	JobProgress progress;
+	int index;
+
+	{
+		const ScopedLock sl (lock);
+
+		// (if cancel() gave up waiting for this task, it's already been reported)
+		if (task.state == jobCancelled)
+			return;
+
+		task.state = newState;
+		task.errorMessage = error;
+		task.endTime = Time::getMillisecondCounterHiRes();
+		progress = task.getProgress (task.state, task.errorMessage);
+		index = tasks.indexOf (&task);
+		--numActiveTasks;
+	}
+
+	{
+		const ScopedLock sl (listenerLock);
+
+		for (int i = listeners.size(); --i >= 0;)
+			listeners.getUnchecked (i)->transcoderJobFinished (*this, index, progress);
+	}
+
+	startMoreTasks();
+
+	if (! isBusy())
+	{
+		{
+			const ScopedLock sl (lock);
+			endTime = Time::getMillisecondCounterHiRes();
+		}
+
+		finishedEvent.signal();
+	}
+}
+
+void AudioFormatTranscoder::cancel()
+{
+	{
+		const ScopedLock sl (lock);
+
+		for (int i = tasks.size(); --i >= 0;)
+			tasks.getUnchecked (i)->aborted = true;
+	}
+
+	pool.removeAllJobs (true, 10000);
+
+	Array<int> cancelledTasks;
+
+	{
+		const ScopedLock sl (lock);
+
+		for (int i = 0; i < tasks.size(); ++i)
+		{
+			FileTask& task = *tasks.getUnchecked (i);
+
+			if (task.state == jobRunning || task.state == jobPending)
+			{
+				if (task.state == jobRunning)
+					task.endTime = Time::getMillisecondCounterHiRes();
+
+				task.state = jobCancelled;
+				cancelledTasks.add (i);
+			}
+
+			// A stage that was taken out of the queue between its runs won't get the chance
+			// to say it's gone. One that's still running (because it's stuck) will release
+			// the task itself when it stops, or else the destructor will.
+			if (task.decoderActive && ! pool.contains (task.decoder))
+				task.decoderActive = false;
+
+			if (task.encoderActive && ! pool.contains (task.encoder))
+				task.encoderActive = false;
+
+			task.releaseIfUnused();
+		}
+
+		numActiveTasks = 0;
+	}
+
+	if (cancelledTasks.size() > 0)
+	{
+		const ScopedLock sl (listenerLock);
+
+		for (int i = 0; i < cancelledTasks.size(); ++i)
+		{
+			const JobProgress progress (getJobProgress (cancelledTasks.getUnchecked (i)));
+
+			for (int j = listeners.size(); --j >= 0;)
+				listeners.getUnchecked (j)->transcoderJobFinished (*this, cancelledTasks.getUnchecked (i), progress);
+		}
+	}
+
+	{
+		const ScopedLock sl (lock);
+		endTime = Time::getMillisecondCounterHiRes();
+	}
+
+	finishedEvent.signal();
+}
+
+bool AudioFormatTranscoder::isBusy() const
+{
+	const ScopedLock sl (lock);
+
+	if (started)
+		for (int i = tasks.size(); --i >= 0;)
+			if (tasks.getUnchecked (i)->state <= jobRunning)
+				return true;
+
+	return false;
+}
+
+bool AudioFormatTranscoder::waitForCompletion (const int timeOutMilliseconds)
+{
+	const uint32 startMs = Time::getMillisecondCounter();
+
+	while (isBusy())
+	{
+		if (timeOutMilliseconds >= 0
+			 && Time::getMillisecondCounter() > startMs + (uint32) timeOutMilliseconds)
+			return false;
+
+		finishedEvent.wait (50);
+	}
+
+	return true;
+}
+
+AudioFormatTranscoder::JobProgress AudioFormatTranscoder::getJobProgress (const int jobIndex) const
+{
+	const ScopedLock sl (lock);
+	const FileTask* const task = tasks [jobIndex];
+
+	return task != nullptr ? task->getProgress (task->state, task->errorMessage)
+						   : JobProgress();
+}
+
+int64 AudioFormatTranscoder::getTotalSamplesWritten() const
+{
+	const ScopedLock sl (lock);
+	int64 total = 0;
+
+	for (int i = tasks.size(); --i >= 0;)
+		total += tasks.getUnchecked (i)->samplesWritten;
+
+	return total;
+}
+
+double AudioFormatTranscoder::getOverallProgress() const
+{
+	const ScopedLock sl (lock);
+	double total = 0;
+
+	for (int i = tasks.size(); --i >= 0;)
+	{
+		const FileTask& task = *tasks.getUnchecked (i);
+
+		if (task.state > jobRunning)
+			total += 1.0;
+		else if (task.totalSamples > 0)
+			total += task.samplesWritten / (double) task.totalSamples;
+	}
+
+	return tasks.size() > 0 ? total / tasks.size() : 0.0;
+}
+
+double AudioFormatTranscoder::getAggregateSamplesPerSecond() const
+{
+	const ScopedLock sl (lock);
+
+	if (startTime <= 0)
+		return 0.0;
+
+	const double seconds = ((endTime > 0 ? endTime : Time::getMillisecondCounterHiRes()) - startTime) / 1000.0;
+	return seconds > 0 ? getTotalSamplesWritten() / seconds : 0.0;
+}
+
+void AudioFormatTranscoder::addListener (Listener* const newListener)
+{
+	const ScopedLock sl (listenerLock);
+	listeners.addIfNotAlreadyThere (newListener);
+}
+
+void AudioFormatTranscoder::removeListener (Listener* const listenerToRemove)
+{
+	const ScopedLock sl (listenerLock);
+	listeners.removeValue (listenerToRemove);
+}
+
+#if JUCE_UNIT_TESTS
+
+class AudioFormatTranscoderTests  : public UnitTest
+{
+public:
+	AudioFormatTranscoderTests() : UnitTest ("Audio format transcoder") {}
+
+	enum { numSources = 4, numSamples = 30000 };
+
+	void runTest()
+	{
+		beginTest ("Transcoding");
+
+		const File dir (File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("juce_transcoder_test", String::empty, false));
+		dir.createDirectory();
+
+		for (int i = 0; i < numSources; ++i)
+			writeSource (getSourceFile (dir, i), i);
+
+		AudioFormatManager formatManager;
+		formatManager.registerBasicFormats();
+
+		{
+			AudioFormatTranscoder transcoder (formatManager, 2, 1024, 3);
+
+			for (int i = 0; i < numSources; ++i)
+			{
+				AudioFormatTranscoder::Job job (getSourceFile (dir, i), getDestFile (dir, i));
+				job.bitsPerSample = 24;
+				transcoder.addJob (job);
+			}
+
+			AudioFormatTranscoder::Job resampled (getSourceFile (dir, 0), dir.getChildFile ("resampled.wav"));
+			resampled.destinationSampleRate = 2 * sourceRate;
+			transcoder.addJob (resampled);
+
+			transcoder.addJob (AudioFormatTranscoder::Job (dir.getChildFile ("missing.wav"), dir.getChildFile ("missing_out.wav")));
+
+			transcoder.start();
+			expect (transcoder.waitForCompletion (20000));
+
+			for (int i = 0; i < numSources; ++i)
+			{
+				expect (transcoder.getJobProgress (i).state == AudioFormatTranscoder::jobFinished);
+				expect (transcoder.getJobProgress (i).samplesWritten == numSamples);
+
+				ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (getDestFile (dir, i)));
+				expect (reader != nullptr);
+				expectEquals ((int) reader->bitsPerSample, 24);
+				expect (reader->lengthInSamples == numSamples);
+
+				AudioSampleBuffer result (2, numSamples);
+				reader->read (&result, 0, numSamples, 0, true, true);
+				expect (std::abs (*result.getSampleData (1, 1234) - getSample (i, 1, 1234)) < 0.001f);
+			}
+
+			ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (dir.getChildFile ("resampled.wav")));
+			expect (reader != nullptr && reader->sampleRate == 2 * sourceRate);
+			expect (reader != nullptr && std::abs ((int) reader->lengthInSamples - 2 * numSamples) < 10);
+
+			const AudioFormatTranscoder::JobProgress failed (transcoder.getJobProgress (numSources + 1));
+			expect (failed.state == AudioFormatTranscoder::jobFailed);
+			expect (failed.errorMessage.isNotEmpty());
+			expect (! dir.getChildFile ("missing_out.wav").exists());
+			expect (transcoder.getOverallProgress() == 1.0);
+		}
+
+		beginTest ("Cancelling");
+		{
+			ScopedPointer<AudioFormatTranscoder> transcoder (new AudioFormatTranscoder (formatManager, 1, 256, 2));
+
+			for (int i = 0; i < numSources; ++i)
+				transcoder->addJob (AudioFormatTranscoder::Job (getSourceFile (dir, i), getCancelledFile (dir, i)));
+
+			transcoder->start();
+			transcoder->cancel();
+			expect (! transcoder->isBusy());
+
+			for (int i = 0; i < numSources; ++i)
+			{
+				const AudioFormatTranscoder::JobState state = transcoder->getJobProgress (i).state;
+				expect (state == AudioFormatTranscoder::jobCancelled || state == AudioFormatTranscoder::jobFinished);
+
+				if (state == AudioFormatTranscoder::jobCancelled)
+					expect (! getCancelledFile (dir, i).exists());
+			}
+
+			// deleting a transcoder while it's running must wait for its jobs to stop
+			transcoder = new AudioFormatTranscoder (formatManager, 2, 256, 2);
+
+			for (int i = 0; i < numSources; ++i)
+				transcoder->addJob (AudioFormatTranscoder::Job (getSourceFile (dir, i), getCancelledFile (dir, i)));
+
+			transcoder->start();
+			transcoder = nullptr;
+		}
+
+		dir.deleteRecursively();
+	}
+
+private:
+	enum { sourceRate = 22050 };
+
+	static File getSourceFile (const File& dir, int index)    { return dir.getChildFile ("source" + String (index) + ".wav"); }
+	static File getDestFile (const File& dir, int index)      { return dir.getChildFile ("dest" + String (index) + ".wav"); }
+	static File getCancelledFile (const File& dir, int index) { return dir.getChildFile ("cancelled" + String (index) + ".wav"); }
+
+	static float getSample (int file, int channel, int index) noexcept
+	{
+		return ((index * (file + 1) + channel * 100) % 500) / 1000.0f - 0.25f;
+	}
+
+	void writeSource (const File& file, const int index)
+	{
+		AudioSampleBuffer buffer (2, numSamples);
+
+		for (int ch = 0; ch < 2; ++ch)
+			for (int i = 0; i < numSamples; ++i)
+				*buffer.getSampleData (ch, i) = getSample (index, ch, i);
+
+		WavAudioFormat wav;
+		ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (file.createOutputStream(), sourceRate, 2, 16, StringPairArray(), 0));
+		expect (writer != nullptr);
+		writer->writeFromAudioSampleBuffer (buffer, 0, numSamples);
+	}
+};
+
+static AudioFormatTranscoderTests audioFormatTranscoderTests;
+
+#endif
+
+/*** End of inlined file: juce_AudioFormatTranscoder.cpp ***/
+
+
+
+/*** Start of inlined file: juce_AudioFormatWriter.cpp ***/
+AudioFormatWriter::AudioFormatWriter (OutputStream* const out,
+									  const String& formatName_,
+									  const double rate,
+									  const unsigned int numChannels_,
+									  const unsigned int bitsPerSample_)
+  : sampleRate (rate),
+	numChannels (numChannels_),
+	bitsPerSample (bitsPerSample_),
+	usesFloatingPointData (false),
+	output (out),
+	formatName (formatName_)
+{
+}
+
+AudioFormatWriter::~AudioFormatWriter()
+{
+	delete output;
+}
+
+bool AudioFormatWriter::writeFromAudioReader (AudioFormatReader& reader,
+											  int64 startSample,
+											  int64 numSamplesToRead)
+{
+	const int bufferSize = 16384;
+	AudioSampleBuffer tempBuffer ((int) numChannels, bufferSize);
+
+	int* buffers [128] = { 0 };
+
+	for (int i = tempBuffer.getNumChannels(); --i >= 0;)
+		buffers[i] = reinterpret_cast<int*> (tempBuffer.getSampleData (i, 0));
+
+	if (numSamplesToRead < 0)
+		numSamplesToRead = reader.lengthInSamples;
+
+	while (numSamplesToRead > 0)
+	{
+		const int numToDo = (int) jmin (numSamplesToRead, (int64) bufferSize);
+
+		if (! reader.read (buffers, (int) numChannels, startSample, numToDo, false))
+			return false;
+
+		if (reader.usesFloatingPointData != isFloatingPoint())
+		{
+			int** bufferChan = buffers;
+
+			while (*bufferChan != nullptr)
+			{
+				int* b = *bufferChan++;
+
+				if (isFloatingPoint())
+				{
+					// int -> float
+					const double factor = 1.0 / std::numeric_limits<int>::max();
+
+					for (int i = 0; i < numToDo; ++i)
+						reinterpret_cast<float*> (b)[i] = (float) (factor * b[i]);
+				}
+				else
+				{
+					// float -> int
+					for (int i = 0; i < numToDo; ++i)
+					{
+						const double samp = *(const float*) b;
+
+						if (samp <= -1.0)
+							*b++ = std::numeric_limits<int>::min();
+						else if (samp >= 1.0)
+							*b++ = std::numeric_limits<int>::max();
+						else
+							*b++ = roundToInt (std::numeric_limits<int>::max() * samp);
+					}
+				}
+			}
+		}
+
+		if (! write (const_cast <const int**> (buffers), numToDo))
+			return false;
+
+		numSamplesToRead -= numToDo;
+		startSample += numToDo;
+	}
+
+	return true;
+}
+
+bool AudioFormatWriter::writeFromAudioSource (AudioSource& source, int numSamplesToRead, const int samplesPerBlock)
+{
+	AudioSampleBuffer tempBuffer (getNumChannels(), samplesPerBlock);
+
+	while (numSamplesToRead > 0)
+	{
+		const int numToDo = jmin (numSamplesToRead, samplesPerBlock);
+
+		AudioSourceChannelInfo info (&tempBuffer, 0, numToDo);
+		info.clearActiveBufferRegion();
+
+		source.getNextAudioBlock (info);
+
+		if (! writeFromAudioSampleBuffer (tempBuffer, 0, numToDo))
+			return false;
+
+		numSamplesToRead -= numToDo;
+	}
+
+	return true;
+}
+
+bool AudioFormatWriter::writeFromAudioSampleBuffer (const AudioSampleBuffer& source, int startSample, int numSamples)
+{
+	jassert (startSample >= 0 && startSample + numSamples <= source.getNumSamples() && source.getNumChannels() > 0);
+
+	if (numSamples <= 0)
+		return true;
+
+	HeapBlock<int> tempBuffer;
+	HeapBlock<int*> chans (numChannels + 1);
+	chans [numChannels] = 0;
+
+	if (isFloatingPoint())
+	{
+		for (int i = (int) numChannels; --i >= 0;)
+			chans[i] = reinterpret_cast<int*> (source.getSampleData (i, startSample));
+	}
+	else
+	{
+		tempBuffer.malloc (((size_t) numSamples) * (size_t) numChannels);
+
+		for (unsigned int i = 0; i < numChannels; ++i)
+		{
+			typedef AudioData::Pointer <AudioData::Int32, AudioData::NativeEndian, AudioData::NonInterleaved, AudioData::NonConst> DestSampleType;
+			typedef AudioData::Pointer <AudioData::Float32, AudioData::NativeEndian, AudioData::NonInterleaved, AudioData::Const> SourceSampleType;
+
+			chans[i] = tempBuffer + (int) i * numSamples;
+			DestSampleType destData (chans[i]);
+			SourceSampleType sourceData (source.getSampleData ((int) i, startSample));
+			destData.convertSamples (sourceData, numSamples);
+		}
+	}
+
+	return write ((const int**) chans.getData(), numSamples);
+}
+
+class AudioFormatWriter::ThreadedWriter::Buffer   : public TimeSliceClient,
+													public AbstractFifo
+{
+public:
+	Buffer (TimeSliceThread& timeSliceThread_, AudioFormatWriter* writer_, int numChannels, int bufferSize_)
+		: AbstractFifo (bufferSize_),
+		  buffer (numChannels, bufferSize_),
+		  timeSliceThread (timeSliceThread_),
+		  writer (writer_),
+		  receiver (nullptr),
+		  samplesWritten (0),
+		  batchSize (0),
+		  isRunning (true),
+		  blockWhenFull (false)
+	{
+		timeSliceThread.addTimeSliceClient (this);
+	}
+
+	~Buffer()
+	{
+		isRunning = false;
+		spaceAvailable.signal();
+		timeSliceThread.removeTimeSliceClient (this);
+
+		while (writePendingData (true) == 0)
+		{}
+	}
+
+	bool write (const float** data, int numSamples)
+	{
+		if (numSamples <= 0 || ! isRunning)
+			return true;
+
+		jassert (timeSliceThread.isThreadRunning());  // you need to get your thread running before pumping data into this!
+
+		if (blockWhenFull)
+		{
+			// push the data through in chunks that are small enough to fit in the fifo
+			const int maxChunk = jmax (1, getTotalSize() / 2);
+			int offset = 0;
+
+			while (offset < numSamples)
+			{
+				const int numThisTime = jmin (maxChunk, numSamples - offset);
+
+				while (! hasSpaceFor (numThisTime))
+				{
+					if (! isRunning)
+					{
+						numSamplesDropped += (int64) (numSamples - offset);
+						return false;
+					}
+
+					timeSliceThread.notify();
+					spaceAvailable.wait (100);
+				}
+
+				addToFifo (data, offset, numThisTime);
+				offset += numThisTime;
+			}
+
+			return true;
+		}
+
+		if (! hasSpaceFor (numSamples))
+		{
+			numSamplesDropped += (int64) numSamples;
+			return false;
+		}
+
+		addToFifo (data, 0, numSamples);
+		return true;
+	}
+
+	int useTimeSlice()
+	{
+		return writePendingData (false);
+	}
+
+	int writePendingData (const bool flushEverything)
+	{
+		const int numReady = getNumReady();
+		int numToDo;
+
+		if (batchSize > 0)
+		{
+			if (numReady < batchSize && ! (flushEverything && numReady > 0))
+				return 10;
+
+			numToDo = jmin (numReady, batchSize);
+		}
+		else
+		{
+			numToDo = getTotalSize() / 4;
+		}
+
+		int start1, size1, start2, size2;
+		prepareToRead (numToDo, start1, size1, start2, size2);
+
+		if (size1 <= 0)
+			return 10;
+
+		writer->writeFromAudioSampleBuffer (buffer, start1, size1);
+
+		const ScopedLock sl (thumbnailLock);
+		if (receiver != nullptr)
+			receiver->addBlock (samplesWritten, buffer, start1, size1);
+
+		samplesWritten += size1;
+
+		if (size2 > 0)
+		{
+			writer->writeFromAudioSampleBuffer (buffer, start2, size2);
+
+			if (receiver != nullptr)
+				receiver->addBlock (samplesWritten, buffer, start2, size2);
+
+			samplesWritten += size2;
+		}
+
+		finishedRead (size1 + size2);
+		spaceAvailable.signal();
+		return 0;
+	}
+
+	void setDataReceiver (IncomingDataReceiver* newReceiver)
+	{
+		if (newReceiver != nullptr)
+			newReceiver->reset (buffer.getNumChannels(), writer->getSampleRate(), 0);
+
+		const ScopedLock sl (thumbnailLock);
+		receiver = newReceiver;
+		samplesWritten = 0;
+	}
+
+	void setWriteBatchSize (const int numSamples) noexcept
+	{
+		// a batch can't be bigger than half the fifo, or the writer would never get a chance to catch up
+		batchSize = jlimit (0, jmax (1, getTotalSize() / 2), numSamples);
+	}
+
+	void setBlockingMode (const bool shouldBlock) noexcept
+	{
+		blockWhenFull = shouldBlock;
+	}
+
+	int getHighWaterMark() const noexcept           { return highWaterMark.get(); }
+	int64 getNumSamplesDropped() const noexcept     { return numSamplesDropped.get(); }
+
+	void resetStatistics() noexcept
+	{
+		highWaterMark = getNumReady();
+		numSamplesDropped = 0;
+	}
+
+private:
+	AudioSampleBuffer buffer;
+	TimeSliceThread& timeSliceThread;
+	ScopedPointer<AudioFormatWriter> writer;
+	CriticalSection thumbnailLock;
+	IncomingDataReceiver* receiver;
+	int64 samplesWritten;
+	int batchSize;
+	volatile bool isRunning, blockWhenFull;
+	WaitableEvent spaceAvailable;
+	Atomic<int> highWaterMark;
+	Atomic<int64> numSamplesDropped;
+
+	// (the fifo can only hold one sample less than its total size)
+	bool hasSpaceFor (const int numSamples) const noexcept
+	{
+		return getFreeSpace() > numSamples;
+	}
+
+	void addToFifo (const float** data, const int offset, const int numSamples)
+	{
+		int start1, size1, start2, size2;
+		prepareToWrite (numSamples, start1, size1, start2, size2);
+		jassert (size1 + size2 == numSamples);
+
+		for (int i = buffer.getNumChannels(); --i >= 0;)
+		{
+			buffer.copyFrom (i, start1, data[i] + offset, size1);
+			buffer.copyFrom (i, start2, data[i] + offset + size1, size2);
+		}
+
+		finishedWrite (size1 + size2);
+
+		const int numReady = getNumReady();
+
+		if (numReady > highWaterMark.get())
+			highWaterMark = numReady;
+
+		// (this is called on the audio thread, so mustn't touch the TimeSliceThread's client
+		// list - once there's data ready, writePendingData() keeps asking to be called again
+		// straight away until it has caught up)
+		if (numReady >= batchSize)
+			timeSliceThread.notify();
+	}
+
+	JUCE_DECLARE_NON_COPYABLE (Buffer);
+};
+
+AudioFormatWriter::ThreadedWriter::ThreadedWriter (AudioFormatWriter* writer, TimeSliceThread& backgroundThread, int numSamplesToBuffer)
+	: buffer (new AudioFormatWriter::ThreadedWriter::Buffer (backgroundThread, writer, (int) writer->numChannels, numSamplesToBuffer))
+{
+}
+
+AudioFormatWriter::ThreadedWriter::~ThreadedWriter()
+{
+}
+
+bool AudioFormatWriter::ThreadedWriter::write (const float** data, int numSamples)
+{
+	return buffer->write (data, numSamples);
+}
+
+void AudioFormatWriter::ThreadedWriter::setDataReceiver (AudioFormatWriter::ThreadedWriter::IncomingDataReceiver* receiver)
+{
+	buffer->setDataReceiver (receiver);
+}
+
+void AudioFormatWriter::ThreadedWriter::setWriteBatchSize (int numSamples)  { buffer->setWriteBatchSize (numSamples); }
+void AudioFormatWriter::ThreadedWriter::setBlockingMode (bool shouldBlock)  { buffer->setBlockingMode (shouldBlock); }
+int AudioFormatWriter::ThreadedWriter::getBufferSize() const                { return buffer->getTotalSize(); }
+int AudioFormatWriter::ThreadedWriter::getNumSamplesBuffered() const        { return buffer->getNumReady(); }
+int AudioFormatWriter::ThreadedWriter::getHighWaterMark() const             { return buffer->getHighWaterMark(); }
+int64 AudioFormatWriter::ThreadedWriter::getNumSamplesDropped() const       { return buffer->getNumSamplesDropped(); }
+void AudioFormatWriter::ThreadedWriter::resetStatistics()                   { buffer->resetStatistics(); }
+
+#if JUCE_UNIT_TESTS
+
+class ThreadedWriterTests  : public UnitTest
+{
+public:
+	ThreadedWriterTests() : UnitTest ("Threaded audio writer") {}
+
+	enum { numChannels = 2, fifoSize = 4096 };
+
+	void runTest()
+	{
+		beginTest ("Batched writing");
+		{
+			const File file (createTempFile());
+			TimeSliceThread thread ("writer test");
+			thread.startThread();
+
+			const int numSamples = 50000, blockSize = 300;
+			Receiver receiver;
+
+			{
+				AudioFormatWriter::ThreadedWriter writer (createWriter (file), thread, fifoSize);
+				writer.setWriteBatchSize (1024);
+				writer.setDataReceiver (&receiver);
+				expectEquals (writer.getBufferSize(), (int) fifoSize);
+
+				for (int pos = 0; pos < numSamples; pos += blockSize)
+				{
+					writeBlock (writer, pos, jmin (blockSize, numSamples - pos));
+
+					while (writer.getNumSamplesBuffered() > fifoSize / 2)
+						Thread::sleep (1);
+				}
+
+				expect (writer.getHighWaterMark() < fifoSize);
+				expect (writer.getNumSamplesDropped() == 0);
+			}
+
+			expectEquals (receiver.numSamples, numSamples);
+			expectEquals (receiver.largestBlock, 1024);
+			checkFile (file, numSamples);
+			thread.stopThread (1000);
+		}
+
+		beginTest ("Dropping data when full");
+		{
+			const File file (createTempFile());
+			TimeSliceThread thread ("writer test");
+			thread.startThread();
+
+			{
+				AudioFormatWriter::ThreadedWriter writer (createWriter (file), thread, fifoSize);
+				expect (! writeBlock (writer, 0, fifoSize * 2));
+				expect (writer.getNumSamplesDropped() == fifoSize * 2);
+				expect (writeBlock (writer, 0, 100));
+
+				writer.resetStatistics();
+				expect (writer.getNumSamplesDropped() == 0);
+			}
+
+			thread.stopThread (1000);
+			file.deleteFile();
+		}
+
+		beginTest ("Blocking mode");
+		{
+			const File file (createTempFile());
+			TimeSliceThread thread ("writer test");
+			thread.startThread();
+
+			const int numSamples = fifoSize * 10 + 123;
+
+			{
+				AudioFormatWriter::ThreadedWriter writer (createWriter (file), thread, fifoSize);
+				writer.setBlockingMode (true);
+				expect (writeBlock (writer, 0, numSamples));
+				expect (writer.getNumSamplesDropped() == 0);
+			}
+
+			checkFile (file, numSamples);
+			thread.stopThread (1000);
+		}
+	}
+
+private:
+	struct Receiver  : public AudioFormatWriter::ThreadedWriter::IncomingDataReceiver
+	{
+		Receiver() : numSamples (0), largestBlock (0) {}
+
+		void reset (int, double, int64)     {}
+
+		void addBlock (int64 sampleNumberInSource, const AudioSampleBuffer&, int, int num)
+		{
+			jassert (sampleNumberInSource == numSamples);
+			(void) sampleNumberInSource;
+			numSamples += num;
+			largestBlock = jmax (largestBlock, num);
+		}
+
+		int numSamples, largestBlock;
+	};
+
+	static float getSample (int channel, int index) noexcept
+	{
+		return ((index + channel * 1000) % 2000) / 4000.0f;
+	}
+
+	static File createTempFile()
+	{
+		return File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("juce_writer_test", ".wav", false);
+	}
+
+	AudioFormatWriter* createWriter (const File& file)
+	{
+		WavAudioFormat wav;
+		AudioFormatWriter* const writer = wav.createWriterFor (file.createOutputStream(), 44100, numChannels, 24, StringPairArray(), 0);
+		expect (writer != nullptr);
+		return writer;
+	}
+
+	static bool writeBlock (AudioFormatWriter::ThreadedWriter& writer, const int startSample, const int numSamples)
+	{
+		AudioSampleBuffer buffer (numChannels, numSamples);
+
+		for (int ch = 0; ch < numChannels; ++ch)
+			for (int i = 0; i < numSamples; ++i)
+				*buffer.getSampleData (ch, i) = getSample (ch, startSample + i);
+
+		return writer.write ((const float**) buffer.getArrayOfChannels(), numSamples);
+	}
+
+	void checkFile (const File& file, const int numSamples)
+	{
+		{
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (file.createInputStream(), true));
+			expect (reader != nullptr);
+			expect (reader->lengthInSamples == numSamples);
+
+			AudioSampleBuffer result (numChannels, numSamples);
+			reader->read (&result, 0, numSamples, 0, true, true);
+
+			int numWrong = 0;
+
+			for (int ch = 0; ch < numChannels; ++ch)
+				for (int i = 0; i < numSamples; ++i)
+					if (std::abs (*result.getSampleData (ch, i) - getSample (ch, i)) > 0.0001f)
+						++numWrong;
+
+			expectEquals (numWrong, 0);
+		}
+
+		file.deleteFile();
+	}
+};
+
+static ThreadedWriterTests threadedWriterTests;
+
+#endif
+
+/*** End of inlined file: juce_AudioFormatWriter.cpp ***/
+
+/*** Start of inlined file: juce_AudioLevelAnalyser.cpp ***/
+const double AudioLevelAnalyser::minusInfinityLoudness = -100.0;
+
+AudioLevelAnalyser::Options::Options()
+	: startSample (0),
+	  numSamples (-1),
+	  samplesPerBlock (65536),
+	  numThreads (1),
+	  measureLoudness (false)
+{
+}
+
+AudioLevelAnalyser::Results::Results()
+	: numSamples (0),
+	  integratedLoudness (minusInfinityLoudness)
+{
+}
+
+AudioLevelAnalyser::LevelSummary::LevelSummary (const int samplesPerPoint_, const int numPoints_, const int numChannels_)
+	: samplesPerPoint (samplesPerPoint_),
+	  numPoints (numPoints_),
+	  numChannels (numChannels_),
+	  mins ((size_t) (numPoints_ * numChannels_)),
+	  maxs ((size_t) (numPoints_ * numChannels_)),
+	  rms ((size_t) (numPoints_ * numChannels_))
+{
+}
+
+//==============================================================================
+class AudioLevelAnalyser::RegionAnalyser
+{
+public:
+	RegionAnalyser (const int numChannels_, const int64 origin_, const int64 regionStart_, const int64 regionEnd_,
+					const int pointSize_, const int segmentSize_, const double sampleRate)
+		: numChannels (numChannels_),
+		  origin (origin_), regionStart (regionStart_), regionEnd (regionEnd_),
+		  pointSize (pointSize_), segmentSize (segmentSize_),
+		  firstPoint ((regionStart_ - origin_) / pointSize_),
+		  numPoints ((int) ((regionEnd_ - 1 - origin_) / pointSize_ - firstPoint + 1)),
+		  firstSegment (0), numSegments (0)
+	{
+		mins.malloc ((size_t) (numPoints * numChannels));
+		maxs.malloc ((size_t) (numPoints * numChannels));
+		sumSquares.calloc ((size_t) (numPoints * numChannels));
+
+		for (int i = numPoints * numChannels; --i >= 0;)
+		{
+			mins[i] = std::numeric_limits<float>::max();
+			maxs[i] = -std::numeric_limits<float>::max();
+		}
+
+		if (segmentSize > 0)
+		{
+			firstSegment = (regionStart - origin) / segmentSize;
+			numSegments = (int) ((regionEnd - 1 - origin) / segmentSize - firstSegment + 1);
+			energies.calloc ((size_t) numSegments);
+
+			for (int i = 0; i < numChannels; ++i)
+				filters.add (new KWeightingFilter (sampleRate, getChannelWeight (i, numChannels)));
+		}
+	}
+
+	bool process (AudioFormatReader& reader, const int blockSize)
+	{
+		HeapBlock<int> space ((size_t) (numChannels * blockSize));
+		HeapBlock<int*> chans ((size_t) numChannels + 1);
+
+		for (int i = 0; i < numChannels; ++i)
+			chans[i] = space + i * blockSize;
+
+		chans[numChannels] = nullptr;
+
+		if (segmentSize > 0 && regionStart > origin)
+		{
+			// run the filters over some of the preceding audio to get them into the right state..
+			const int64 preRollStart = jmax (origin, regionStart - 4 * segmentSize);
+
+			if (! readAndProcess (reader, chans, blockSize, preRollStart, regionStart, false))
+				return false;
+		}
+
+		return readAndProcess (reader, chans, blockSize, regionStart, regionEnd, true);
+	}
+
+	static float getChannelWeight (const int channel, const int numChannels) noexcept
+	{
+		// BS.1770 weights the surround channels of a 5.1 layout by +1.5dB, and ignores the LFE
+		if (numChannels == 6)
+			return channel == 3 ? 0.0f : (channel >= 4 ? 1.41f : 1.0f);
+
+		return 1.0f;
+	}
+
+	const int numChannels;
+	const int64 origin, regionStart, regionEnd;
+	const int pointSize, segmentSize;
+	const int64 firstPoint;
+	const int numPoints;
+	int64 firstSegment;
+	int numSegments;
+
+	HeapBlock<float> mins, maxs;
+	HeapBlock<double> sumSquares, energies;
+
+private:
+	//==============================================================================
+	struct KWeightingFilter
+	{
+		KWeightingFilter (const double sampleRate, const float weight_)
+			: weight (weight_)
+		{
+			// The BS.1770 pre-filter (a high shelf) and RLB filter (a high-pass), with
+			// their coefficients recalculated for the actual sample rate
+			{
+				const double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+				const double k = std::tan (double_Pi * f0 / sampleRate);
+				const double vh = std::pow (10.0, gain / 20.0);
+				const double vb = std::pow (vh, 0.4996667741545416);
+				const double a0 = 1.0 + k / q + k * k;
+
+				shelf.b0 = (vh + vb * k / q + k * k) / a0;
+				shelf.b1 = 2.0 * (k * k - vh) / a0;
+				shelf.b2 = (vh - vb * k / q + k * k) / a0;
+				shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+				shelf.a2 = (1.0 - k / q + k * k) / a0;
+			}
+
+			{
+				const double f0 = 38.13547087602444, q = 0.5003270373238773;
+				const double k = std::tan (double_Pi * f0 / sampleRate);
+				const double a0 = 1.0 + k / q + k * k;
+
+				highPass.b0 = 1.0;
+				highPass.b1 = -2.0;
+				highPass.b2 = 1.0;
+				highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+				highPass.a2 = (1.0 - k / q + k * k) / a0;
+			}
+		}
+
+		struct Biquad
+		{
+			Biquad() noexcept : z1 (0), z2 (0) {}
+
+			forcedinline double process (const double in) noexcept
+			{
+				const double out = b0 * in + z1;
+				z1 = b1 * in - a1 * out + z2;
+				z2 = b2 * in - a2 * out;
+				return out;
+			}
+
+			double b0, b1, b2, a1, a2, z1, z2;
+		};
+
+		forcedinline double process (const float in) noexcept
+		{
+			return highPass.process (shelf.process (in));
+		}
+
+		Biquad shelf, highPass;
+		const float weight;
+	};
+
+	OwnedArray<KWeightingFilter> filters;
+
+	bool readAndProcess (AudioFormatReader& reader, int** chans, const int blockSize,
+						 int64 pos, const int64 end, const bool accumulate)
+	{
+		while (pos < end)
+		{
+			const int num = (int) jmin ((int64) blockSize, end - pos);
+
+			if (! reader.read (chans, numChannels, pos, num, false))
+				return false;
+
+			if (! reader.usesFloatingPointData)
+				for (int i = 0; i < numChannels; ++i)
+					FloatVectorOperations::convertFixedToFloat (reinterpret_cast<float*> (chans[i]), chans[i],
+																1.0f / 0x7fffffff, num);
+
+			if (accumulate)
+				addLevels (reinterpret_cast<float**> (chans), pos, num);
+
+			if (segmentSize > 0)
+				addLoudness (reinterpret_cast<float**> (chans), pos, num, accumulate);
+
+			pos += num;
+		}
+
+		return true;
+	}
+
+	void addLevels (float** data, int64 pos, const int num) noexcept
+	{
+		for (int offset = 0; offset < num;)
+		{
+			const int64 point = (pos - origin) / pointSize;
+			const int numThisTime = (int) jmin ((int64) (num - offset), origin + (point + 1) * pointSize - pos);
+			const int index = (int) (point - firstPoint);
+
+			for (int i = 0; i < numChannels; ++i)
+			{
+				const int n = i * numPoints + index;
+				float mn, mx;
+				FloatVectorOperations::findMinAndMax (data[i] + offset, numThisTime, mn, mx);
+				mins[n] = jmin (mins[n], mn);
+				maxs[n] = jmax (maxs[n], mx);
+				sumSquares[n] += FloatVectorOperations::findSumOfSquares (data[i] + offset, numThisTime);
+			}
+
+			offset += numThisTime;
+			pos += numThisTime;
+		}
+	}
+
+	void addLoudness (float** data, const int64 startPos, const int num, const bool accumulate) noexcept
+	{
+		for (int i = 0; i < numChannels; ++i)
+		{
+			KWeightingFilter& filter = *filters.getUnchecked (i);
+
+			if (filter.weight == 0)
+				continue;
+
+			const float* const samples = data[i];
+			int64 pos = startPos;
+
+			for (int offset = 0; offset < num;)
+			{
+				const int64 segment = (pos - origin) / segmentSize;
+				const int numThisTime = (int) jmin ((int64) (num - offset), origin + (segment + 1) * segmentSize - pos);
+				double sum = 0;
+
+				for (int j = 0; j < numThisTime; ++j)
+				{
+					const double y = filter.process (samples [offset + j]);
+					sum += y * y;
+				}
+
+				if (accumulate)
+					energies [(int) (segment - firstSegment)] += filter.weight * sum;
+
+				offset += numThisTime;
+				pos += numThisTime;
+			}
+		}
+	}
+
+	JUCE_DECLARE_NON_COPYABLE (RegionAnalyser);
+};
+
+//==============================================================================
+class AudioLevelAnalyser::RegionJob  : public ThreadPoolJob
+{
+public:
+	RegionJob (AudioFormatReader* reader_, AudioFormatManager* formatManager_, const File* file_,
+			   RegionAnalyser* analyser_, const int blockSize_)
+		: ThreadPoolJob ("Level analysis"),
+		  reader (reader_), formatManager (formatManager_), file (file_),
+		  analyser (analyser_), blockSize (blockSize_), succeeded (false)
+	{
+	}
+
+	JobStatus runJob()
+	{
+		if (reader == nullptr)
+		{
+			ownedReader = formatManager->createReaderFor (*file);
+			reader = ownedReader;
+		}
+
+		succeeded = reader != nullptr && analyser->process (*reader, blockSize);
+		ownedReader = nullptr;
+		return jobHasFinished;
+	}
+
+	AudioFormatReader* reader;
+	ScopedPointer<AudioFormatReader> ownedReader;
+	AudioFormatManager* const formatManager;
+	const File* const file;
+	ScopedPointer<RegionAnalyser> analyser;
+	const int blockSize;
+	bool succeeded;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (RegionJob);
+};
+
+//==============================================================================
+bool AudioLevelAnalyser::analyse (AudioFormatReader& reader, const Options& options, Results& results)
+{
+	return analyseRegions (reader, nullptr, nullptr, options, results);
+}
+
+bool AudioLevelAnalyser::analyse (AudioFormatManager& formatManager, const File& file,
+								  const Options& options, Results& results)
+{
+	ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+	return reader != nullptr
+			&& analyseRegions (*reader, &formatManager, &file, options, results);
+}
+
+bool AudioLevelAnalyser::analyseRegions (AudioFormatReader& reader, AudioFormatManager* formatManager,
+										 const File* file, const Options& options, Results& results)
+{
+	const int numChannels = (int) reader.numChannels;
+	const int64 start = jmax ((int64) 0, options.startSample);
+	const int64 numSamples = jmax ((int64) 0, options.numSamples >= 0 ? options.numSamples
+																	   : reader.lengthInSamples - start);
+	const int blockSize = jmax (1024, options.samplesPerBlock);
+
+	results.numSamples = numSamples;
+	results.minimum.clear();
+	results.maximum.clear();
+	results.rmsLevel.clear();
+	results.summaries.clear();
+	results.integratedLoudness = minusInfinityLoudness;
+
+	if (numChannels <= 0)
+		return false;
+
+	// The finest summary is measured directly, and all the others are built from it
+	int pointSize = 65536;
+
+	if (options.summaryResolutions.size() > 0)
+	{
+		pointSize = options.summaryResolutions.getFirst();
+
+		for (int i = options.summaryResolutions.size(); --i > 0;)
+			pointSize = jmin (pointSize, options.summaryResolutions.getUnchecked (i));
+
+		pointSize = jmax (1, pointSize);
+	}
+
+	const int segmentSize = (options.measureLoudness && reader.sampleRate > 0)
+								? roundToInt (reader.sampleRate * 0.1) : 0;
+
+	if (numSamples == 0)
+	{
+		for (int i = 0; i < numChannels; ++i)
+		{
+			results.minimum.add (0.0f);
+			results.maximum.add (0.0f);
+			results.rmsLevel.add (0.0f);
+		}
+
+		return true;
+	}
+
+	// Split the job into regions, each of which must be at least a few blocks long
+	int numRegions = 1;
+
+	if (formatManager != nullptr)
+		numRegions = (int) jmax ((int64) 1, jmin ((int64) jlimit (1, 64, options.numThreads),
+												  numSamples / (blockSize * 4)));
+
+	OwnedArray<RegionJob> jobs;
+
+	for (int i = 0; i < numRegions; ++i)
+	{
+		const int64 regionStart = start + (numSamples * i) / numRegions;
+		const int64 regionEnd   = start + (numSamples * (i + 1)) / numRegions;
+
+		jobs.add (new RegionJob (i == 0 ? &reader : nullptr, formatManager, file,
+								 new RegionAnalyser (numChannels, start, regionStart, regionEnd,
+													 pointSize, segmentSize, reader.sampleRate),
+								 blockSize));
+	}
+
+	if (numRegions == 1)
+	{
+		jobs.getUnchecked (0)->runJob();
+	}
+	else
+	{
+		ThreadPool pool (numRegions);
+
+		for (int i = 0; i < numRegions; ++i)
+			pool.addJob (jobs.getUnchecked (i), false);
+
+		for (int i = 0; i < numRegions; ++i)
+			pool.waitForJobToFinish (jobs.getUnchecked (i), -1);
+	}
+
+	for (int i = 0; i < numRegions; ++i)
+		if (! jobs.getUnchecked (i)->succeeded)
+			return false;
+
+	// Merge the regions. Where a point or segment straddles two regions, both have
+	// a partial value for it, which can simply be combined.
+	const int totalPoints = (int) ((numSamples + pointSize - 1) / pointSize);
+	HeapBlock<float> mins ((size_t) (totalPoints * numChannels)), maxs ((size_t) (totalPoints * numChannels));
+	HeapBlock<double> sumSquares;
+	sumSquares.calloc ((size_t) (totalPoints * numChannels));
+
+	for (int i = totalPoints * numChannels; --i >= 0;)
+	{
+		mins[i] = std::numeric_limits<float>::max();
+		maxs[i] = -std::numeric_limits<float>::max();
+	}
+
+	const int totalSegments = segmentSize > 0 ? (int) (numSamples / segmentSize) : 0;
+	HeapBlock<double> energies;
+	energies.calloc ((size_t) totalSegments + 1);
+
+	for (int r = 0; r < numRegions; ++r)
+	{
+		const RegionAnalyser& region = *jobs.getUnchecked (r)->analyser;
+
+		for (int ch = 0; ch < numChannels; ++ch)
+		{
+			for (int p = 0; p < region.numPoints; ++p)
+			{
+				const int dest = ch * totalPoints + (int) region.firstPoint + p;
+				const int src  = ch * region.numPoints + p;
+
+				mins[dest] = jmin (mins[dest], region.mins[src]);
+				maxs[dest] = jmax (maxs[dest], region.maxs[src]);
+				sumSquares[dest] += region.sumSquares[src];
+			}
+		}
+
+		for (int s = 0; s < region.numSegments; ++s)
+		{
+			const int64 segment = region.firstSegment + s;
+
+			if (segment < totalSegments)
+				energies [(int) segment] += region.energies[s];
+		}
+	}
+
+	for (int ch = 0; ch < numChannels; ++ch)
+	{
+		float mn = std::numeric_limits<float>::max(), mx = -mn;
+		double sum = 0;
+
+		for (int p = 0; p < totalPoints; ++p)
+		{
+			mn = jmin (mn, mins [ch * totalPoints + p]);
+			mx = jmax (mx, maxs [ch * totalPoints + p]);
+			sum += sumSquares [ch * totalPoints + p];
+		}
+
+		results.minimum.add (mn);
+		results.maximum.add (mx);
+		results.rmsLevel.add ((float) std::sqrt (sum / numSamples));
+	}
+
+	for (int i = 0; i < options.summaryResolutions.size(); ++i)
+	{
+		const int resolution = options.summaryResolutions.getUnchecked (i);
+
+		// all the summary resolutions must be multiples of the smallest one!
+		jassert (resolution % pointSize == 0);
+
+		const int pointsPerPoint = jmax (1, resolution / pointSize);
+		const int samplesPerPoint = pointsPerPoint * pointSize;
+		const int numPoints = (totalPoints + pointsPerPoint - 1) / pointsPerPoint;
+
+		LevelSummary* const summary = new LevelSummary (samplesPerPoint, numPoints, numChannels);
+		results.summaries.add (summary);
+
+		for (int ch = 0; ch < numChannels; ++ch)
+		{
+			for (int p = 0; p < numPoints; ++p)
+			{
+				const int first = p * pointsPerPoint;
+				const int last = jmin (totalPoints, first + pointsPerPoint);
+				float mn = std::numeric_limits<float>::max(), mx = -mn;
+				double sum = 0;
+
+				for (int j = first; j < last; ++j)
+				{
+					mn = jmin (mn, mins [ch * totalPoints + j]);
+					mx = jmax (mx, maxs [ch * totalPoints + j]);
+					sum += sumSquares [ch * totalPoints + j];
+				}
+
+				const int64 samplesInPoint = jmin ((int64) samplesPerPoint, numSamples - p * (int64) samplesPerPoint);
+
+				summary->mins [ch * numPoints + p] = mn;
+				summary->maxs [ch * numPoints + p] = mx;
+				summary->rms  [ch * numPoints + p] = (float) std::sqrt (sum / (double) samplesInPoint);
+			}
+		}
+	}
+
+	// BS.1770 gating: 400ms blocks with 75% overlap (i.e. four 100ms segments), an absolute
+	// gate at -70 LUFS, then a relative gate 10 LU below the loudness of the remaining blocks
+	if (totalSegments >= 4)
+	{
+		const int numBlocks = totalSegments - 3;
+		HeapBlock<double> blockPower ((size_t) numBlocks);
+
+		for (int i = 0; i < numBlocks; ++i)
+			blockPower[i] = (energies[i] + energies[i + 1] + energies[i + 2] + energies[i + 3]) / (4.0 * segmentSize);
+
+		const double absoluteGate = std::pow (10.0, (-70.0 + 0.691) / 10.0);
+		double sum = 0;
+		int num = 0;
+
+		for (int i = 0; i < numBlocks; ++i)
+		{
+			if (blockPower[i] > absoluteGate)
+			{
+				sum += blockPower[i];
+				++num;
+			}
+		}
+
+		if (num > 0)
+		{
+			const double relativeGate = (sum / num) * std::pow (10.0, -10.0 / 10.0);
+			sum = 0;
+			num = 0;
+
+			for (int i = 0; i < numBlocks; ++i)
+			{
+				if (blockPower[i] > absoluteGate && blockPower[i] > relativeGate)
+				{
+					sum += blockPower[i];
+					++num;
+				}
+			}
+
+			if (num > 0)
+				results.integratedLoudness = jmax (minusInfinityLoudness, -0.691 + 10.0 * std::log10 (sum / num));
+		}
+	}
+
+	return true;
+}
+
+#if JUCE_UNIT_TESTS
+
+class AudioLevelAnalyserTests  : public UnitTest
+{
+public:
+	AudioLevelAnalyserTests() : UnitTest ("Audio level analysis") {}
+
+	enum { length = 100003 };
+
+	void runTest()
+	{
+		for (int numChannels = 1; numChannels <= 3; ++numChannels)
+		{
+			for (int useFloats = 0; useFloats < 2; ++useFloats)
+			{
+				beginTest (String (numChannels) + (useFloats ? " float" : " integer") + " channels");
+
+				TestReader reader (numChannels, length, useFloats != 0);
+				testMaxLevels (reader);
+				testSearching (reader);
+				testAnalysis (reader);
+			}
+		}
+
+		beginTest ("Multi-threaded analysis");
+		testMultiThreadedAnalysis();
+
+		beginTest ("Loudness");
+		{
+			TestReader reader (1, 5 * 44100, true, true);
+
+			AudioLevelAnalyser::Options options;
+			options.measureLoudness = true;
+
+			AudioLevelAnalyser::Results results;
+			expect (AudioLevelAnalyser::analyse (reader, options, results));
+
+			// BS.1770 defines a full-scale 1kHz sine in one channel as -3.01 LUFS
+			expect (std::abs (results.integratedLoudness + 3.01) < 0.1);
+		}
+	}
+
+private:
+	//==============================================================================
+	/** Generates quiet noise with a few loud bursts in each channel, as either
+		integers or floats.
+	*/
+	class TestReader  : public AudioFormatReader
+	{
+	public:
+		TestReader (const int numChannels_, const int64 length_, const bool useFloats, const bool sine_ = false)
+			: AudioFormatReader (nullptr, "Test"), sine (sine_)
+		{
+			sampleRate = 44100.0;
+			bitsPerSample = 32;
+			numChannels = (unsigned int) numChannels_;
+			lengthInSamples = length_;
+			usesFloatingPointData = useFloats;
+		}
+
+		bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+						  int64 startSampleInFile, int numSamples)
+		{
+			for (int ch = 0; ch < numDestChannels; ++ch)
+			{
+				if (destSamples[ch] == nullptr)
+					continue;
+
+				int* const dest = destSamples[ch] + startOffsetInDestBuffer;
+
+				for (int i = 0; i < numSamples; ++i)
+				{
+					const int64 pos = startSampleInFile + i;
+
+					if (pos < 0 || pos >= lengthInSamples || ch >= (int) numChannels)
+						dest[i] = 0;
+					else if (usesFloatingPointData)
+						reinterpret_cast<float*> (dest)[i] = getFloatSample (ch, pos);
+					else
+						dest[i] = getIntSample (ch, pos);
+				}
+			}
+
+			return true;
+		}
+
+		float getFloatSample (const int channel, const int64 pos) const noexcept
+		{
+			if (sine)
+				return (float) std::sin (2.0 * double_Pi * 1000.0 * pos / sampleRate);
 
-int64 AudioFormatReader::searchForLevel (int64 startSample,
-										 int64 numSamplesToSearch,
-										 const double magnitudeRangeMinimum,
-										 const double magnitudeRangeMaximum,
-										 const int minimumConsecutiveSamples)
-{
-	if (numSamplesToSearch == 0)
-		return -1;
+			const int64 burstStart = 35000 + channel * 1000;
 
-	const int bufferSize = 4096;
-	HeapBlock<int> tempSpace (bufferSize * 2 + 64);
+			if (pos % 40000 >= burstStart && pos % 40000 < burstStart + 20 + channel)
+				return (pos & 1) != 0 ? 0.8f : -0.75f;
 
-	int* tempBuffer[3];
-	tempBuffer[0] = tempSpace.getData();
-	tempBuffer[1] = tempSpace.getData() + bufferSize;
-	tempBuffer[2] = 0;
+			return (int) ((pos * 7919 + channel * 104729) % 2001 - 1000) / 10000.0f;
+		}
 
-	int consecutive = 0;
-	int64 firstMatchPos = -1;
+		int getIntSample (const int channel, const int64 pos) const noexcept
+		{
+			return (int) (getFloatSample (channel, pos) * (double) 0x7fffffff);
+		}
 
-	jassert (magnitudeRangeMaximum > magnitudeRangeMinimum);
+		float getSampleAsFloat (const int channel, const int64 pos) const noexcept
+		{
+			return usesFloatingPointData ? getFloatSample (channel, pos)
+										 : getIntSample (channel, pos) * (1.0f / 0x7fffffff);
+		}
 
-	const double doubleMin = jlimit (0.0, (double) std::numeric_limits<int>::max(), magnitudeRangeMinimum * std::numeric_limits<int>::max());
-	const double doubleMax = jlimit (doubleMin, (double) std::numeric_limits<int>::max(), magnitudeRangeMaximum * std::numeric_limits<int>::max());
-	const int intMagnitudeRangeMinimum = roundToInt (doubleMin);
-	const int intMagnitudeRangeMaximum = roundToInt (doubleMax);
+	private:
+		const bool sine;
+	};
 
-	while (numSamplesToSearch != 0)
+	//==============================================================================
+	void testMaxLevels (TestReader& reader)
 	{
-		const int numThisTime = (int) jmin (abs64 (numSamplesToSearch), (int64) bufferSize);
-		int64 bufferStart = startSample;
+		Random r (0x2371);
 
-		if (numSamplesToSearch < 0)
-			bufferStart -= numThisTime;
+		for (int i = 0; i < 20; ++i)
+		{
+			const int64 start = r.nextInt (length);
+			const int64 num = i == 0 ? length - start : r.nextInt ((int) (length - start));
 
-		if (bufferStart >= (int) lengthInSamples)
-			break;
+			float lowestLeft, highestLeft, lowestRight, highestRight;
+			reader.readMaxLevels (start, num, lowestLeft, highestLeft, lowestRight, highestRight);
 
-		read (tempBuffer, 2, bufferStart, numThisTime, false);
+			const int rightChannel = reader.numChannels > 1 ? 1 : 0;
 
-		int num = numThisTime;
-		while (--num >= 0)
-		{
-			if (numSamplesToSearch < 0)
-				--startSample;
+			if (reader.usesFloatingPointData)
+			{
+				float mn[2] = { 0 }, mx[2] = { 0 };
 
-			bool matches = false;
-			const int index = (int) (startSample - bufferStart);
+				for (int ch = 0; ch < 2; ++ch)
+				{
+					for (int64 pos = start; pos < start + num; ++pos)
+					{
+						const float v = reader.getFloatSample (ch == 0 ? 0 : rightChannel, pos);
+						mn[ch] = (pos == start || v < mn[ch]) ? v : mn[ch];
+						mx[ch] = (pos == start || v > mx[ch]) ? v : mx[ch];
+					}
+				}
 
-			if (usesFloatingPointData)
+				expectEquals (lowestLeft, mn[0]);
+				expectEquals (highestLeft, mx[0]);
+				expectEquals (lowestRight, mn[1]);
+				expectEquals (highestRight, mx[1]);
+			}
+			else
 			{
-				const float sample1 = std::abs (((float*) tempBuffer[0]) [index]);
+				int mn[2] = { 0 }, mx[2] = { 0 };
 
-				if (sample1 >= magnitudeRangeMinimum
-					 && sample1 <= magnitudeRangeMaximum)
+				for (int ch = 0; ch < 2; ++ch)
 				{
-					matches = true;
+					for (int64 pos = start; pos < start + num; ++pos)
+					{
+						const int v = reader.getIntSample (ch == 0 ? 0 : rightChannel, pos);
+						mn[ch] = (pos == start || v < mn[ch]) ? v : mn[ch];
+						mx[ch] = (pos == start || v > mx[ch]) ? v : mx[ch];
+					}
 				}
-				else if (numChannels > 1)
-				{
-					const float sample2 = std::abs (((float*) tempBuffer[1]) [index]);
 
-					matches = (sample2 >= magnitudeRangeMinimum
-								 && sample2 <= magnitudeRangeMaximum);
-				}
+				const float scale = (float) std::numeric_limits<int>::max();
+				expectEquals (lowestLeft, mn[0] / scale);
+				expectEquals (highestLeft, mx[0] / scale);
+				expectEquals (lowestRight, mn[1] / scale);
+				expectEquals (highestRight, mx[1] / scale);
+			}
+		}
+	}
+
+	//==============================================================================
+	void testSearching (TestReader& reader)
+	{
+		Random r (0x4417);
+
+		for (int i = 0; i < 40; ++i)
+		{
+			const bool loud = (i & 1) == 0;
+			const double minLevel = loud ? 0.7 : 0.095;
+			const double maxLevel = loud ? 1.0 : 0.1;
+			const int minConsecutive = 1 + r.nextInt (12);
+
+			int64 start, num;
+
+			if (i < 4)
+			{
+				start = (i & 2) == 0 ? 0 : length;
+				num = (i & 2) == 0 ? length : -length;
 			}
 			else
 			{
-				const int sample1 = abs (tempBuffer[0] [index]);
+				start = r.nextInt (length);
+				num = r.nextBool() ? r.nextInt ((int) (length - start)) : -r.nextInt ((int) start + 1);
+			}
 
-				if (sample1 >= intMagnitudeRangeMinimum
-					 && sample1 <= intMagnitudeRangeMaximum)
+			expect (reader.searchForLevel (start, num, minLevel, maxLevel, minConsecutive)
+					  == searchWithLoop (reader, start, num, minLevel, maxLevel, minConsecutive));
+		}
+	}
+
+	static int64 searchWithLoop (TestReader& reader, int64 start, const int64 num,
+								 const double minLevel, const double maxLevel, const int minConsecutive)
+	{
+		const int64 end = start + num;
+		const double intMax = (double) std::numeric_limits<int>::max();
+		const int intMin = roundToInt (jlimit (0.0, intMax, minLevel * intMax));
+		const int intMaxLevel = roundToInt (jlimit (minLevel * intMax, intMax, maxLevel * intMax));
+		int consecutive = 0;
+		int64 firstMatch = -1;
+
+		while (start != end)
+		{
+			if (num < 0)
+				--start;
+
+			bool matches = false;
+
+			for (int ch = jmin (2, (int) reader.numChannels); --ch >= 0;)
+			{
+				if (reader.usesFloatingPointData)
 				{
-					matches = true;
+					const float v = std::abs (reader.getFloatSample (ch, start));
+					matches = matches || (v >= minLevel && v <= maxLevel);
 				}
-				else if (numChannels > 1)
+				else
 				{
-					const int sample2 = abs (tempBuffer[1][index]);
-
-					matches = (sample2 >= intMagnitudeRangeMinimum
-								 && sample2 <= intMagnitudeRangeMaximum);
+					const int v = std::abs (reader.getIntSample (ch, start));
+					matches = matches || (v >= intMin && v <= intMaxLevel);
 				}
 			}
 
 			if (matches)
 			{
-				if (firstMatchPos < 0)
-					firstMatchPos = startSample;
+				if (firstMatch < 0)
+					firstMatch = start;
 
-				if (++consecutive >= minimumConsecutiveSamples)
-				{
-					if (firstMatchPos < 0 || firstMatchPos >= lengthInSamples)
-						return -1;
-
-					return firstMatchPos;
-				}
+				if (++consecutive >= minConsecutive)
+					return firstMatch;
 			}
 			else
 			{
 				consecutive = 0;
-				firstMatchPos = -1;
+				firstMatch = -1;
 			}
 
-			if (numSamplesToSearch > 0)
-				++startSample;
+			if (num > 0)
+				++start;
 		}
 
-		if (numSamplesToSearch > 0)
-			numSamplesToSearch -= numThisTime;
-		else
-			numSamplesToSearch += numThisTime;
+		return -1;
 	}
 
-	return -1;
-}
+	//==============================================================================
+	void testAnalysis (TestReader& reader)
+	{
+		AudioLevelAnalyser::Options options;
+		options.startSample = 1001;
+		options.numSamples = length - 2000;
+		options.samplesPerBlock = 1024;
+		options.summaryResolutions.add (333);
+		options.summaryResolutions.add (999);
+
+		AudioLevelAnalyser::Results results;
+		expect (AudioLevelAnalyser::analyse (reader, options, results));
+		expect (results.numSamples == options.numSamples);
+		expectEquals (results.summaries.size(), 2);
+
+		for (int ch = 0; ch < (int) reader.numChannels; ++ch)
+		{
+			float mn, mx, rms;
+			measure (reader, ch, options.startSample, options.numSamples, mn, mx, rms);
 
-/*** End of inlined file: juce_AudioFormatReader.cpp ***/
+			expectEquals (results.minimum[ch], mn);
+			expectEquals (results.maximum[ch], mx);
+			expect (std::abs (results.rmsLevel[ch] - rms) <= rms * 1.0e-4f);
 
+			for (int i = 0; i < results.summaries.size(); ++i)
+			{
+				const AudioLevelAnalyser::LevelSummary& summary = *results.summaries.getUnchecked (i);
+				const int samplesPerPoint = summary.getSamplesPerPoint();
 
-/*** Start of inlined file: juce_AudioFormatReaderSource.cpp ***/
-AudioFormatReaderSource::AudioFormatReaderSource (AudioFormatReader* const reader_,
-												  const bool deleteReaderWhenThisIsDeleted)
-	: reader (reader_, deleteReaderWhenThisIsDeleted),
-	  nextPlayPos (0),
-	  looping (false)
-{
-	jassert (reader != nullptr);
-}
+				expectEquals (samplesPerPoint, options.summaryResolutions[i]);
+				expectEquals (summary.getNumPoints(), (int) ((options.numSamples + samplesPerPoint - 1) / samplesPerPoint));
 
-AudioFormatReaderSource::~AudioFormatReaderSource() {}
+				for (int p = 0; p < summary.getNumPoints(); ++p)
+				{
+					const int64 pointStart = options.startSample + p * (int64) samplesPerPoint;
+					measure (reader, ch, pointStart, jmin ((int64) samplesPerPoint, options.startSample + options.numSamples - pointStart),
+							 mn, mx, rms);
 
-int64 AudioFormatReaderSource::getTotalLength() const                   { return reader->lengthInSamples; }
-void AudioFormatReaderSource::setNextReadPosition (int64 newPosition)   { nextPlayPos = newPosition; }
-void AudioFormatReaderSource::setLooping (bool shouldLoop)              { looping = shouldLoop; }
+					expectEquals (summary.getMinimum (ch, p), mn);
+					expectEquals (summary.getMaximum (ch, p), mx);
+					expect (std::abs (summary.getRMSLevel (ch, p) - rms) <= rms * 1.0e-4f);
+				}
+			}
+		}
+	}
 
-int64 AudioFormatReaderSource::getNextReadPosition() const
-{
-	return looping ? nextPlayPos % reader->lengthInSamples
-				   : nextPlayPos;
-}
+	static void measure (TestReader& reader, const int channel, const int64 start, const int64 num,
+						 float& mn, float& mx, float& rms)
+	{
+		double sum = 0;
 
-void AudioFormatReaderSource::prepareToPlay (int /*samplesPerBlockExpected*/, double /*sampleRate*/) {}
-void AudioFormatReaderSource::releaseResources() {}
+		for (int64 pos = start; pos < start + num; ++pos)
+		{
+			const float v = reader.getSampleAsFloat (channel, pos);
+			mn = (pos == start || v < mn) ? v : mn;
+			mx = (pos == start || v > mx) ? v : mx;
+			sum += v * v;
+		}
 
-void AudioFormatReaderSource::getNextAudioBlock (const AudioSourceChannelInfo& info)
-{
-	if (info.numSamples > 0)
+		rms = (float) std::sqrt (sum / num);
+	}
+
+	//==============================================================================
+	void testMultiThreadedAnalysis()
 	{
-		const int64 start = nextPlayPos;
+		const File file (File::getSpecialLocation (File::tempDirectory)
+						   .getNonexistentChildFile ("juce_level_test", ".wav", false));
 
-		if (looping)
 		{
-			const int newStart = (int) (start % (int) reader->lengthInSamples);
-			const int newEnd = (int) ((start + info.numSamples) % (int) reader->lengthInSamples);
+			TestReader source (2, length, false);
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (file.createOutputStream(), source.sampleRate,
+																		  2, 24, StringPairArray(), 0));
+			expect (writer != nullptr);
+			writer->writeFromAudioReader (source, 0, -1);
+		}
 
-			if (newEnd > newStart)
-			{
-				reader->read (info.buffer, info.startSample,
-							  newEnd - newStart, newStart, true, true);
-			}
-			else
-			{
-				const int endSamps = (int) reader->lengthInSamples - newStart;
+		AudioFormatManager formatManager;
+		formatManager.registerBasicFormats();
 
-				reader->read (info.buffer, info.startSample,
-							  endSamps, newStart, true, true);
+		AudioLevelAnalyser::Options options;
+		options.samplesPerBlock = 1024;
+		options.numThreads = 3;
+		options.summaryResolutions.add (500);
 
-				reader->read (info.buffer, info.startSample + endSamps,
-							  newEnd, 0, true, true);
-			}
+		AudioLevelAnalyser::Results singleThreaded, multiThreaded;
 
-			nextPlayPos = newEnd;
+		{
+			ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (file));
+			expect (reader != nullptr);
+			expect (AudioLevelAnalyser::analyse (*reader, options, singleThreaded));
 		}
-		else
+
+		expect (AudioLevelAnalyser::analyse (formatManager, file, options, multiThreaded));
+		expect (multiThreaded.numSamples == length);
+
+		for (int ch = 0; ch < 2; ++ch)
 		{
-			reader->read (info.buffer, info.startSample,
-						  info.numSamples, start, true, true);
-			nextPlayPos += info.numSamples;
+			expectEquals (multiThreaded.minimum[ch], singleThreaded.minimum[ch]);
+			expectEquals (multiThreaded.maximum[ch], singleThreaded.maximum[ch]);
+			expect (std::abs (multiThreaded.rmsLevel[ch] - singleThreaded.rmsLevel[ch]) <= singleThreaded.rmsLevel[ch] * 1.0e-5f);
+
+			const AudioLevelAnalyser::LevelSummary& s1 = *singleThreaded.summaries.getFirst();
+			const AudioLevelAnalyser::LevelSummary& s2 = *multiThreaded.summaries.getFirst();
+			expectEquals (s2.getNumPoints(), s1.getNumPoints());
+
+			for (int p = 0; p < s1.getNumPoints(); ++p)
+			{
+				expectEquals (s2.getMinimum (ch, p), s1.getMinimum (ch, p));
+				expectEquals (s2.getMaximum (ch, p), s1.getMaximum (ch, p));
+			}
 		}
+
+		file.deleteFile();
 	}
-}
+};
 
-/*** End of inlined file: juce_AudioFormatReaderSource.cpp ***/
+static AudioLevelAnalyserTests audioLevelAnalyserTests;
 
+#endif
 
-/*** Start of inlined file: juce_AudioFormatWriter.cpp ***/
-AudioFormatWriter::AudioFormatWriter (OutputStream* const out,
-									  const String& formatName_,
-									  const double rate,
-									  const unsigned int numChannels_,
-									  const unsigned int bitsPerSample_)
-  : sampleRate (rate),
-	numChannels (numChannels_),
-	bitsPerSample (bitsPerSample_),
-	usesFloatingPointData (false),
-	output (out),
-	formatName (formatName_)
+/*** End of inlined file: juce_AudioLevelAnalyser.cpp ***/
+
+
+
+/*** Start of inlined file: juce_AudioFormatReaderCache.cpp ***/
+class AudioFormatReaderCache::Block  : public ReferenceCountedObject
+{
+public:
+	Block (Source& source_, const int64 index_, const int numChannels_, const int numSamples)
+		: source (source_), index (index_), numChannels (numChannels_),
+		  data ((size_t) (jmax (1, numChannels_) * numSamples)),
+		  channels ((size_t) numChannels_ + 1),
+		  sizeInBytes ((int64) sizeof (int) * jmax (1, numChannels_) * numSamples),
+		  previous (nullptr), next (nullptr)
+	{
+		for (int i = 0; i < numChannels; ++i)
+			channels[i] = data + i * numSamples;
+
+		channels[numChannels] = nullptr;
+	}
+
+	Source& source;
+	const int64 index;
+	const int numChannels;
+	HeapBlock<int> data;
+	HeapBlock<int*> channels;
+	const int64 sizeInBytes;
+	Block* previous;
+	Block* next;
+
+	typedef ReferenceCountedObjectPtr<Block> Ptr;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (Block);
+};
+
+class AudioFormatReaderCache::Source
+{
+public:
+	Source (AudioFormatReader& reader_) : reader (reader_) {}
+
+	struct BlockIndexHash
+	{
+		static int generateHash (const int64 key, const int upperLimit) noexcept
+		{
+			return (int) (((uint64) key) % (uint64) upperLimit);
+		}
+	};
+
+	AudioFormatReader& reader;
+	HashMap<int64, Block*, BlockIndexHash> blocks;
+	CriticalSection readLock;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (Source);
+};
+
+//==============================================================================
+AudioFormatReaderCache::AudioFormatReaderCache (const int samplesPerBlock_, const int64 maximumSizeInBytes)
+	: samplesPerBlock (jmax (16, samplesPerBlock_)),
+	  maximumSize (maximumSizeInBytes), currentSize (0),
+	  numHits (0), numMisses (0), numEvictions (0), numBlocks (0),
+	  mostRecent (nullptr), leastRecent (nullptr)
 {
 }
 
-AudioFormatWriter::~AudioFormatWriter()
+AudioFormatReaderCache::~AudioFormatReaderCache()
 {
-	delete output;
+	clear();
 }
 
-bool AudioFormatWriter::writeFromAudioReader (AudioFormatReader& reader,
-											  int64 startSample,
-											  int64 numSamplesToRead)
+bool AudioFormatReaderCache::read (AudioFormatReader& reader,
+								   int** destSamples, const int numDestChannels, int startOffsetInDestBuffer,
+								   int64 startSampleInSource, int numSamples)
 {
-	const int bufferSize = 16384;
-	AudioSampleBuffer tempBuffer ((int) numChannels, bufferSize);
+	Source& source = getSource (reader);
+	bool ok = true;
 
-	int* buffers [128] = { 0 };
+	if (startSampleInSource < 0)
+	{
+		// (the blocks only cover the positive part of the source, which is all a reader can contain)
+		const int silence = (int) jmin (-startSampleInSource, (int64) numSamples);
 
-	for (int i = tempBuffer.getNumChannels(); --i >= 0;)
-		buffers[i] = reinterpret_cast<int*> (tempBuffer.getSampleData (i, 0));
+		for (int i = numDestChannels; --i >= 0;)
+			if (destSamples[i] != nullptr)
+				zeromem (destSamples[i] + startOffsetInDestBuffer, sizeof (int) * (size_t) silence);
 
-	if (numSamplesToRead < 0)
-		numSamplesToRead = reader.lengthInSamples;
+		startOffsetInDestBuffer += silence;
+		startSampleInSource += silence;
+		numSamples -= silence;
+	}
 
-	while (numSamplesToRead > 0)
+	while (numSamples > 0)
 	{
-		const int numToDo = (int) jmin (numSamplesToRead, (int64) bufferSize);
+		const int64 blockIndex = startSampleInSource / samplesPerBlock;
+		const int offsetInBlock = (int) (startSampleInSource - blockIndex * samplesPerBlock);
+		const int numThisTime = jmin (numSamples, samplesPerBlock - offsetInBlock);
 
-		if (! reader.read (buffers, (int) numChannels, startSample, numToDo, false))
-			return false;
+		const Block::Ptr block (findBlock (source, blockIndex));
 
-		if (reader.usesFloatingPointData != isFloatingPoint())
-		{
-			int** bufferChan = buffers;
+		if (block == nullptr)
+			ok = false;
 
-			while (*bufferChan != nullptr)
+		for (int i = numDestChannels; --i >= 0;)
+		{
+			if (destSamples[i] != nullptr)
 			{
-				int* b = *bufferChan++;
-
-				if (isFloatingPoint())
-				{
-					// int -> float
-					const double factor = 1.0 / std::numeric_limits<int>::max();
-
-					for (int i = 0; i < numToDo; ++i)
-						reinterpret_cast<float*> (b)[i] = (float) (factor * b[i]);
-				}
+				if (block != nullptr && i < block->numChannels)
+					memcpy (destSamples[i] + startOffsetInDestBuffer, block->channels[i] + offsetInBlock,
+							sizeof (int) * (size_t) numThisTime);
 				else
-				{
-					// float -> int
-					for (int i = 0; i < numToDo; ++i)
-					{
-						const double samp = *(const float*) b;
-
-						if (samp <= -1.0)
-							*b++ = std::numeric_limits<int>::min();
-						else if (samp >= 1.0)
-							*b++ = std::numeric_limits<int>::max();
-						else
-							*b++ = roundToInt (std::numeric_limits<int>::max() * samp);
-					}
-				}
+					zeromem (destSamples[i] + startOffsetInDestBuffer, sizeof (int) * (size_t) numThisTime);
 			}
 		}
 
-		if (! write (const_cast <const int**> (buffers), numToDo))
-			return false;
-
-		numSamplesToRead -= numToDo;
-		startSample += numToDo;
+		startOffsetInDestBuffer += numThisTime;
+		startSampleInSource += numThisTime;
+		numSamples -= numThisTime;
 	}
 
-	return true;
+	return ok;
 }
 
-bool AudioFormatWriter::writeFromAudioSource (AudioSource& source, int numSamplesToRead, const int samplesPerBlock)
+AudioFormatReaderCache::Source& AudioFormatReaderCache::getSource (AudioFormatReader& reader)
 {
-	AudioSampleBuffer tempBuffer (getNumChannels(), samplesPerBlock);
+	const ScopedLock sl (lock);
 
-	while (numSamplesToRead > 0)
+	for (int i = sources.size(); --i >= 0;)
+		if (&(sources.getUnchecked (i)->reader) == &reader)
+			return *sources.getUnchecked (i);
+
+	Source* const source = new Source (reader);
+	sources.add (source);
+	return *source;
+}
+
+ReferenceCountedObjectPtr<AudioFormatReaderCache::Block> AudioFormatReaderCache::findBlock (Source& source, const int64 blockIndex)
+{
 	{
-		const int numToDo = jmin (numSamplesToRead, samplesPerBlock);
+		const ScopedLock sl (lock);
+		Block* const b = source.blocks [blockIndex];
 
-		AudioSourceChannelInfo info (&tempBuffer, 0, numToDo);
-		info.clearActiveBufferRegion();
+		if (b != nullptr)
+		{
+			++numHits;
+			moveToFront (b);
+			return b;
+		}
+	}
 
-		source.getNextAudioBlock (info);
+	// Only one block is read from each source at a time, as readers aren't thread-safe
+	const ScopedLock readLock (source.readLock);
 
-		if (! writeFromAudioSampleBuffer (tempBuffer, 0, numToDo))
-			return false;
+	{
+		// ..and while waiting for that lock, another thread may have read this one
+		const ScopedLock sl (lock);
+		Block* const b = source.blocks [blockIndex];
 
-		numSamplesToRead -= numToDo;
+		if (b != nullptr)
+		{
+			++numHits;
+			moveToFront (b);
+			return b;
+		}
+
+		++numMisses;
 	}
 
-	return true;
+	AudioFormatReader& reader = source.reader;
+	const int64 blockStart = blockIndex * samplesPerBlock;
+	const int numToRead = (int) jlimit ((int64) 0, (int64) samplesPerBlock, reader.lengthInSamples - blockStart);
+
+	Block::Ptr block (new Block (source, blockIndex, (int) reader.numChannels, samplesPerBlock));
+
+	if (numToRead < samplesPerBlock)
+		zeromem (block->data, (size_t) block->sizeInBytes);
+
+	if (numToRead > 0 && ! reader.readSamples (block->channels, block->numChannels, 0, blockStart, numToRead))
+		return nullptr;
+
+	const ScopedLock sl (lock);
+	addBlock (block);
+	return block;
 }
 
-bool AudioFormatWriter::writeFromAudioSampleBuffer (const AudioSampleBuffer& source, int startSample, int numSamples)
+void AudioFormatReaderCache::addBlock (Block* const block)
 {
-	jassert (startSample >= 0 && startSample + numSamples <= source.getNumSamples() && source.getNumChannels() > 0);
+	block->incReferenceCount();
+	block->source.blocks.set (block->index, block);
 
-	if (numSamples <= 0)
-		return true;
+	block->next = mostRecent;
 
-	HeapBlock<int> tempBuffer;
-	HeapBlock<int*> chans (numChannels + 1);
-	chans [numChannels] = 0;
+	if (mostRecent != nullptr)
+		mostRecent->previous = block;
 
-	if (isFloatingPoint())
+	mostRecent = block;
+
+	if (leastRecent == nullptr)
+		leastRecent = block;
+
+	currentSize += block->sizeInBytes;
+	++numBlocks;
+	removeExcessBlocks();
+}
+
+void AudioFormatReaderCache::removeBlock (Block* const block)
+{
+	unlink (block);
+	block->source.blocks.remove (block->index);
+	currentSize -= block->sizeInBytes;
+	--numBlocks;
+	block->decReferenceCount();
+}
+
+void AudioFormatReaderCache::moveToFront (Block* const block) noexcept
+{
+	if (block != mostRecent)
 	{
-		for (int i = (int) numChannels; --i >= 0;)
-			chans[i] = reinterpret_cast<int*> (source.getSampleData (i, startSample));
+		unlink (block);
+
+		block->next = mostRecent;
+		mostRecent->previous = block;
+		mostRecent = block;
+
+		if (leastRecent == nullptr)
+			leastRecent = block;
 	}
+}
+
+void AudioFormatReaderCache::unlink (Block* const block) noexcept
+{
+	if (block->previous != nullptr)
+		block->previous->next = block->next;
+	else
+		mostRecent = block->next;
+
+	if (block->next != nullptr)
+		block->next->previous = block->previous;
 	else
+		leastRecent = block->previous;
+
+	block->previous = nullptr;
+	block->next = nullptr;
+}
+
+void AudioFormatReaderCache::removeExcessBlocks()
+{
+	// (the most recent block is always kept, even if it's bigger than the limit on its own)
+	while (currentSize > maximumSize && leastRecent != nullptr && leastRecent != mostRecent)
 	{
-		tempBuffer.malloc (((size_t) numSamples) * (size_t) numChannels);
+		removeBlock (leastRecent);
+		++numEvictions;
+	}
+}
 
-		for (unsigned int i = 0; i < numChannels; ++i)
+void AudioFormatReaderCache::removeSource (AudioFormatReader* const reader)
+{
+	const ScopedLock sl (lock);
+
+	for (int i = sources.size(); --i >= 0;)
+	{
+		Source* const source = sources.getUnchecked (i);
+
+		if (&(source->reader) == reader)
 		{
-			typedef AudioData::Pointer <AudioData::Int32, AudioData::NativeEndian, AudioData::NonInterleaved, AudioData::NonConst> DestSampleType;
-			typedef AudioData::Pointer <AudioData::Float32, AudioData::NativeEndian, AudioData::NonInterleaved, AudioData::Const> SourceSampleType;
+			for (Block* b = mostRecent; b != nullptr;)
+			{
+				Block* const next = b->next;
 
-			chans[i] = tempBuffer + (int) i * numSamples;
-			DestSampleType destData (chans[i]);
-			SourceSampleType sourceData (source.getSampleData ((int) i, startSample));
-			destData.convertSamples (sourceData, numSamples);
+				if (&(b->source) == source)
+					removeBlock (b);
+
+				b = next;
+			}
+
+			sources.remove (i);
 		}
 	}
+}
 
-	return write ((const int**) chans.getData(), numSamples);
+void AudioFormatReaderCache::clear()
+{
+	const ScopedLock sl (lock);
+
+	while (mostRecent != nullptr)
+		removeBlock (mostRecent);
 }
 
-class AudioFormatWriter::ThreadedWriter::Buffer   : public TimeSliceClient,
-													public AbstractFifo
+void AudioFormatReaderCache::setMaximumSize (const int64 maximumSizeInBytes)
+{
+	const ScopedLock sl (lock);
+	maximumSize = maximumSizeInBytes;
+	removeExcessBlocks();
+}
+
+AudioFormatReaderCache::Statistics AudioFormatReaderCache::getStatistics() const
+{
+	const ScopedLock sl (lock);
+
+	Statistics s;
+	s.numHits = numHits;
+	s.numMisses = numMisses;
+	s.numEvictions = numEvictions;
+	s.numBlocks = numBlocks;
+	s.sizeInBytes = currentSize;
+	return s;
+}
+
+void AudioFormatReaderCache::resetStatistics()
+{
+	const ScopedLock sl (lock);
+	numHits = numMisses = numEvictions = 0;
+}
+
+double AudioFormatReaderCache::Statistics::getHitRatio() const noexcept
+{
+	const int64 total = numHits + numMisses;
+	return total > 0 ? numHits / (double) total : 0.0;
+}
+
+#if JUCE_UNIT_TESTS
+
+class AudioFormatReaderCacheTests  : public UnitTest
 {
 public:
-	Buffer (TimeSliceThread& timeSliceThread_, AudioFormatWriter* writer_, int numChannels, int bufferSize_)
-		: AbstractFifo (bufferSize_),
-		  buffer (numChannels, bufferSize_),
-		  timeSliceThread (timeSliceThread_),
-		  writer (writer_),
-		  receiver (nullptr),
-		  samplesWritten (0),
-		  isRunning (true)
-	{
-		timeSliceThread.addTimeSliceClient (this);
-	}
+	AudioFormatReaderCacheTests() : UnitTest ("Audio format reader cache") {}
 
-	~Buffer()
+	void runTest()
 	{
-		isRunning = false;
-		timeSliceThread.removeTimeSliceClient (this);
+		const int numSamples = 100000;
+		MemoryBlock fileData;
 
-		while (writePendingData() == 0)
-		{}
-	}
+		{
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new MemoryOutputStream (fileData, false), 44100, 2, 16, StringPairArray(), 0));
+			AudioSampleBuffer buffer (2, numSamples);
+			Random r (1);
 
-	bool write (const float** data, int numSamples)
-	{
-		if (numSamples <= 0 || ! isRunning)
-			return true;
+			for (int i = 0; i < numSamples; ++i)
+			{
+				*buffer.getSampleData (0, i) = r.nextFloat() - 0.5f;
+				*buffer.getSampleData (1, i) = r.nextFloat() - 0.5f;
+			}
 
-		jassert (timeSliceThread.isThreadRunning());  // you need to get your thread running before pumping data into this!
+			writer->writeFromAudioSampleBuffer (buffer, 0, numSamples);
+		}
 
-		int start1, size1, start2, size2;
-		prepareToWrite (numSamples, start1, size1, start2, size2);
+		WavAudioFormat wav;
+		ScopedPointer<AudioFormatReader> source (wav.createReaderFor (new MemoryInputStream (fileData, false), true));
 
-		if (size1 + size2 < numSamples)
-			return false;
+		// Read the whole thing directly, for comparison
+		HeapBlock<int> reference ((size_t) numSamples * 2);
+		{
+			int* chans[] = { reference, reference + numSamples, nullptr };
+			source->read (chans, 2, 0, numSamples, false);
+		}
 
-		for (int i = buffer.getNumChannels(); --i >= 0;)
+		AudioFormatReaderCache cache (1024, 1024 * 2 * sizeof (int) * 16);
+		OwnedArray<AudioSubsectionReader> regions;
+		Array<int> regionStarts;
+		Random r (2);
+
+		for (int i = 0; i < 50; ++i)
 		{
-			buffer.copyFrom (i, start1, data[i], size1);
-			buffer.copyFrom (i, start2, data[i] + size1, size2);
+			const int start = r.nextInt (numSamples);
+			regionStarts.add (start);
+			regions.add (new AudioSubsectionReader (source, start, 1 + r.nextInt (numSamples - start), false));
+			regions.getLast()->setCache (&cache);
 		}
 
-		finishedWrite (size1 + size2);
-		timeSliceThread.notify();
-		return true;
-	}
+		beginTest ("Reading");
+		{
+			bool allMatched = true;
 
-	int useTimeSlice()
-	{
-		return writePendingData();
-	}
+			for (int i = 0; i < 2000; ++i)
+			{
+				const int index = r.nextInt (regions.size());
+				allMatched = readAndCompare (*regions.getUnchecked (index), regionStarts [index], reference, numSamples, r) && allMatched;
+			}
 
-	int writePendingData()
-	{
-		const int numToDo = getTotalSize() / 4;
+			expect (allMatched);
 
-		int start1, size1, start2, size2;
-		prepareToRead (numToDo, start1, size1, start2, size2);
+			const AudioFormatReaderCache::Statistics stats (cache.getStatistics());
+			expect (stats.numHits > 0 && stats.numMisses > 0 && stats.numEvictions > 0);
+			expect (stats.numBlocks <= 16);
+			expect (stats.sizeInBytes <= (int64) (1024 * 2 * sizeof (int) * 16));
+		}
 
-		if (size1 <= 0)
-			return 10;
+		beginTest ("Threads");
+		{
+			cache.clear();
+			cache.resetStatistics();
 
-		writer->writeFromAudioSampleBuffer (buffer, start1, size1);
+			OwnedArray<ReaderThread> threads;
 
-		const ScopedLock sl (thumbnailLock);
-		if (receiver != nullptr)
-			receiver->addBlock (samplesWritten, buffer, start1, size1);
+			for (int i = 0; i < 4; ++i)
+				threads.add (new ReaderThread (regions, regionStarts, reference, numSamples, i));
 
-		samplesWritten += size1;
+			for (int i = 0; i < threads.size(); ++i)
+				threads.getUnchecked (i)->startThread();
 
-		if (size2 > 0)
-		{
-			writer->writeFromAudioSampleBuffer (buffer, start2, size2);
+			bool allMatched = true;
 
-			if (receiver != nullptr)
-				receiver->addBlock (samplesWritten, buffer, start2, size2);
+			for (int i = 0; i < threads.size(); ++i)
+			{
+				threads.getUnchecked (i)->waitForThreadToExit (-1);
+				allMatched = allMatched && threads.getUnchecked (i)->allMatched;
+			}
 
-			samplesWritten += size2;
+			expect (allMatched);
+			expect (cache.getStatistics().numHits > 0);
 		}
 
-		finishedRead (size1 + size2);
-		return 0;
+		regions.clear();
+		cache.removeSource (source);
+		expect (cache.getStatistics().numBlocks == 0);
 	}
 
-	void setDataReceiver (IncomingDataReceiver* newReceiver)
+private:
+	static bool readAndCompare (AudioSubsectionReader& region, const int regionStart,
+								const int* reference, const int numReferenceSamples, Random& r)
 	{
-		if (newReceiver != nullptr)
-			newReceiver->reset (buffer.getNumChannels(), writer->getSampleRate(), 0);
+		const int length = (int) region.lengthInSamples;
+		const int start = r.nextInt (length + 100) - 50;
+		const int num = 1 + r.nextInt (5000);
 
-		const ScopedLock sl (thumbnailLock);
-		receiver = newReceiver;
-		samplesWritten = 0;
-	}
+		HeapBlock<int> result ((size_t) num * 2);
+		int* chans[] = { result, result + num, nullptr };
+		region.read (chans, 2, start, num, false);
 
-private:
-	AudioSampleBuffer buffer;
-	TimeSliceThread& timeSliceThread;
-	ScopedPointer<AudioFormatWriter> writer;
-	CriticalSection thumbnailLock;
-	IncomingDataReceiver* receiver;
-	int64 samplesWritten;
-	volatile bool isRunning;
+		for (int i = 0; i < num; ++i)
+		{
+			const int pos = start + i;
+			const int sourcePos = regionStart + pos;
+			const bool inside = pos >= 0 && pos < length;
 
-	JUCE_DECLARE_NON_COPYABLE (Buffer);
-};
+			for (int ch = 0; ch < 2; ++ch)
+				if (chans[ch][i] != (inside ? reference [ch * numReferenceSamples + sourcePos] : 0))
+					return false;
+		}
 
-AudioFormatWriter::ThreadedWriter::ThreadedWriter (AudioFormatWriter* writer, TimeSliceThread& backgroundThread, int numSamplesToBuffer)
-	: buffer (new AudioFormatWriter::ThreadedWriter::Buffer (backgroundThread, writer, (int) writer->numChannels, numSamplesToBuffer))
-{
-}
+		return true;
+	}
 
-AudioFormatWriter::ThreadedWriter::~ThreadedWriter()
-{
-}
+	class ReaderThread  : public Thread
+	{
+	public:
+		ReaderThread (OwnedArray<AudioSubsectionReader>& regions_, const Array<int>& regionStarts_,
+					  const int* reference_, int numReferenceSamples_, int seed)
+			: Thread ("cache test"), regions (regions_), regionStarts (regionStarts_),
+			  reference (reference_), numReferenceSamples (numReferenceSamples_),
+			  random (seed), allMatched (true)
+		{
+		}
 
-bool AudioFormatWriter::ThreadedWriter::write (const float** data, int numSamples)
-{
-	return buffer->write (data, numSamples);
-}
+		void run()
+		{
+			for (int i = 0; i < 200; ++i)
+			{
+				const int index = random.nextInt (regions.size());
+				allMatched = readAndCompare (*regions.getUnchecked (index), regionStarts [index],
+											 reference, numReferenceSamples, random) && allMatched;
+			}
+		}
 
-void AudioFormatWriter::ThreadedWriter::setDataReceiver (AudioFormatWriter::ThreadedWriter::IncomingDataReceiver* receiver)
-{
-	buffer->setDataReceiver (receiver);
-}
+		OwnedArray<AudioSubsectionReader>& regions;
+		const Array<int>& regionStarts;
+		const int* const reference;
+		const int numReferenceSamples;
+		Random random;
+		bool allMatched;
+	};
+};
 
-/*** End of inlined file: juce_AudioFormatWriter.cpp ***/
+static AudioFormatReaderCacheTests audioFormatReaderCacheTests;
+
+#endif
+
+/*** End of inlined file: juce_AudioFormatReaderCache.cpp ***/
 
 
 /*** Start of inlined file: juce_AudioSubsectionReader.cpp ***/
@@ -1851,7 +4919,8 @@ AudioSubsectionReader::AudioSubsectionReader (AudioFormatReader* const source_,
    : AudioFormatReader (0, source_->getFormatName()),
 	 source (source_),
 	 startSample (startSample_),
-	 deleteSourceWhenDeleted (deleteSourceWhenDeleted_)
+	 deleteSourceWhenDeleted (deleteSourceWhenDeleted_),
+	 cache (nullptr)
 {
 	length = jmin (jmax ((int64) 0, source->lengthInSamples - startSample), length_);
 
@@ -1865,7 +4934,17 @@ AudioSubsectionReader::AudioSubsectionReader (AudioFormatReader* const source_,
 AudioSubsectionReader::~AudioSubsectionReader()
 {
 	if (deleteSourceWhenDeleted)
+	{
+		if (cache != nullptr)
+			cache->removeSource (source);
+
 		delete source;
+	}
+}
+
+void AudioSubsectionReader::setCache (AudioFormatReaderCache* const cacheToUse) noexcept
+{
+	cache = cacheToUse;
 }
 
 bool AudioSubsectionReader::readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
@@ -1875,7 +4954,7 @@ bool AudioSubsectionReader::readSamples (int** destSamples, int numDestChannels,
 	{
 		for (int i = numDestChannels; --i >= 0;)
 			if (destSamples[i] != nullptr)
-				zeromem (destSamples[i], sizeof (int) * (size_t) numSamples);
+				zeromem (destSamples[i] + startOffsetInDestBuffer, sizeof (int) * (size_t) numSamples);
 
 		numSamples = jmin (numSamples, (int) (length - startSampleInFile));
 
@@ -1883,6 +4962,10 @@ bool AudioSubsectionReader::readSamples (int** destSamples, int numDestChannels,
 			return true;
 	}
 
+	if (cache != nullptr)
+		return cache->read (*source, destSamples, numDestChannels, startOffsetInDestBuffer,
+							startSampleInFile + startSample, numSamples);
+
 	return source->readSamples (destSamples, numDestChannels, startOffsetInDestBuffer,
 								startSampleInFile + startSample, numSamples);
 }
@@ -1894,6 +4977,14 @@ void AudioSubsectionReader::readMaxLevels (int64 startSampleInFile,
 										   float& lowestRight,
 										   float& highestRight)
 {
+	if (cache != nullptr)
+	{
+		// (going through the cache avoids using the source directly, as it may be shared)
+		AudioFormatReader::readMaxLevels (startSampleInFile, numSamples,
+										  lowestLeft, highestLeft, lowestRight, highestRight);
+		return;
+	}
+
 	startSampleInFile = jmax ((int64) 0, startSampleInFile);
 	numSamples = jmax ((int64) 0, jmin (numSamples, length - startSampleInFile));
 
@@ -91655,8 +94746,21 @@ public:
 					break;
 			}
 
-			if (startSampleInFile < reservoirStart
-				|| startSampleInFile + numSamples > reservoirStart + samplesInReservoir)
+			if (numSamples >= reservoir.getNumSamples())
+			{
+				// a long read can be decoded straight into the destination, without going
+				// through the reservoir
+				const int numDecoded = decodeDirectly (destSamples, numDestChannels, startOffsetInDestBuffer,
+													   startSampleInFile, numSamples);
+				startSampleInFile += numDecoded;
+				numSamples -= numDecoded;
+				startOffsetInDestBuffer += numDecoded;
+
+				if (numDecoded == 0)
+					break;
+			}
+			else if (startSampleInFile < reservoirStart
+					  || startSampleInFile + numSamples > reservoirStart + samplesInReservoir)
 			{
 				// buffer miss, so refill the reservoir
 				int bitStream = 0;
@@ -91706,6 +94810,46 @@ public:
 		return true;
 	}
 
+	int decodeDirectly (int** destSamples, const int numDestChannels, const int startOffsetInDestBuffer,
+						const int64 startSampleInFile, const int numSamples)
+	{
+		using namespace OggVorbisNamespace;
+
+		samplesInReservoir = 0;
+
+		if (startSampleInFile != ov_pcm_tell (&ovFile))
+			ov_pcm_seek (&ovFile, startSampleInFile);
+
+		int bitStream = 0;
+		int numDone = 0;
+
+		while (numDone < numSamples)
+		{
+			float** dataIn = nullptr;
+			const int samps = (int) ov_read_float (&ovFile, &dataIn, numSamples - numDone, &bitStream);
+
+			if (samps <= 0)
+				break;
+
+			jassert (samps <= numSamples - numDone);
+
+			for (int i = numDestChannels; --i >= 0;)
+			{
+				if (destSamples[i] != nullptr)
+				{
+					if (i < (int) numChannels)
+						memcpy (destSamples[i] + startOffsetInDestBuffer + numDone, dataIn[i], sizeof (float) * (size_t) samps);
+					else
+						zeromem (destSamples[i] + startOffsetInDestBuffer + numDone, sizeof (float) * (size_t) samps);
+				}
+			}
+
+			numDone += samps;
+		}
+
+		return numDone;
+	}
+
 	static size_t oggReadCallback (void* ptr, size_t size, size_t nmemb, void* datasource)
 	{
 		return (size_t) (static_cast <InputStream*> (datasource)->read (ptr, (int) (size * nmemb)) / size);
@@ -91757,6 +94901,9 @@ public:
 	{
 		using namespace OggVorbisNamespace;
 
+		// Vorbis works in floating point, so this lets the float data go straight to the encoder
+		usesFloatingPointData = true;
+
 		vorbis_info_init (&vi);
 
 		if (vorbis_encode_init_vbr (&vi, (int) numChannels_, (int) sampleRate_,
@@ -91828,18 +94975,19 @@ public:
 
 			if (numSamples > 0)
 			{
-				const double gain = 1.0 / 0x80000000u;
 				float** const vorbisBuffer = vorbis_analysis_buffer (&vd, numSamples);
 
 				for (int i = (int) numChannels; --i >= 0;)
 				{
 					float* const dst = vorbisBuffer[i];
-					const int* const src = samplesToWrite [i];
+					const float* const src = reinterpret_cast<const float*> (samplesToWrite [i]);
 
-					if (src != nullptr && dst != nullptr)
+					if (dst != nullptr)
 					{
-						for (int j = 0; j < numSamples; ++j)
-							dst[j] = (float) (src[j] * gain);
+						if (src != nullptr)
+							memcpy (dst, src, sizeof (float) * (size_t) numSamples);
+						else
+							zeromem (dst, sizeof (float) * (size_t) numSamples);
 					}
 				}
 			}
@@ -91947,6 +95095,118 @@ AudioFormatWriter* OggVorbisAudioFormat::createWriterFor (OutputStream* out,
 	return w->ok ? w.release() : nullptr;
 }
 
+class OggVorbisAudioFormat::SectionEncoder  : public ThreadPoolJob
+{
+public:
+	SectionEncoder (AudioFormatManager& formatManager_, const File& sourceFile_,
+					const int64 startSample_, const int64 numSamples_,
+					const int qualityIndex_, const StringPairArray& metadataValues_)
+		: ThreadPoolJob ("Ogg encoder"),
+		  succeeded (false),
+		  formatManager (formatManager_), sourceFile (sourceFile_),
+		  startSample (startSample_), numSamples (numSamples_),
+		  qualityIndex (qualityIndex_), metadataValues (metadataValues_)
+	{
+	}
+
+	JobStatus runJob()
+	{
+		ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (sourceFile));
+
+		if (reader != nullptr)
+		{
+			OggWriter writer (new MemoryOutputStream (encodedData, false), reader->sampleRate,
+							  reader->numChannels, 32, qualityIndex, metadataValues);
+
+			if (writer.ok)
+			{
+				const int blockSize = 32768;
+				AudioSampleBuffer buffer ((int) reader->numChannels, blockSize);
+				int64 pos = startSample;
+				const int64 end = startSample + numSamples;
+
+				while (pos < end && ! shouldExit())
+				{
+					const int numThisTime = (int) jmin ((int64) blockSize, end - pos);
+
+					reader->read (&buffer, 0, numThisTime, pos, true, true);
+
+					if (! writer.writeFromAudioSampleBuffer (buffer, 0, numThisTime))
+						break;
+
+					pos += numThisTime;
+				}
+
+				succeeded = (pos == end);
+			}
+		}
+
+		return jobHasFinished;
+	}
+
+	MemoryBlock encodedData;
+	bool succeeded;
+
+private:
+	AudioFormatManager& formatManager;
+	const File sourceFile;
+	const int64 startSample, numSamples;
+	const int qualityIndex;
+	const StringPairArray metadataValues;
+
+	JUCE_DECLARE_NON_COPYABLE (SectionEncoder);
+};
+
+bool OggVorbisAudioFormat::writeInParallel (AudioFormatManager& formatManager, const File& sourceFile,
+											OutputStream& destination, const int qualityOptionIndex,
+											const StringPairArray& metadataValues, int numThreads)
+{
+	ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (sourceFile));
+
+	if (reader == nullptr || reader->numChannels == 0 || reader->sampleRate <= 0)
+		return false;
+
+	if (numThreads <= 0)
+		numThreads = SystemStats::getNumCpus();
+
+	// Each section starts a new stream with its own headers, so there's no point
+	// making them very short. Having a couple per thread helps balance the load.
+	const int64 length = reader->lengthInSamples;
+	const int64 minSectionLength = (int64) (reader->sampleRate * 30.0);
+	const int numSections = (int) jlimit ((int64) 1, (int64) numThreads * 2, length / minSectionLength);
+
+	reader = nullptr;
+
+	OwnedArray<SectionEncoder> sections;
+	ThreadPool pool (jmin (numThreads, numSections));
+
+	for (int i = 0; i < numSections; ++i)
+	{
+		const int64 start = length * i / numSections;
+		const int64 end = length * (i + 1) / numSections;
+
+		sections.add (new SectionEncoder (formatManager, sourceFile, start, end - start,
+										  qualityOptionIndex, metadataValues));
+		pool.addJob (sections.getLast(), false);
+	}
+
+	bool ok = true;
+
+	for (int i = 0; i < numSections && ok; ++i)
+	{
+		SectionEncoder& section = *sections.getUnchecked (i);
+		pool.waitForJobToFinish (&section, -1);
+
+		ok = section.succeeded
+			  && destination.write (section.encodedData.getData(), (int) section.encodedData.getSize());
+
+		section.encodedData.setSize (0);
+	}
+
+	pool.removeAllJobs (true, -1);
+	return ok;
+}
+
 StringArray OggVorbisAudioFormat::getQualityOptions()
 {
 	const char* options[] = { "64 kbps", "80 kbps", "96 kbps", "112 kbps", "128 kbps", "160 kbps",
@@ -91982,6 +95242,74 @@ int OggVorbisAudioFormat::estimateOggFileQuality (const File& source)
 	return 1;
 }
 
+#if JUCE_UNIT_TESTS
+
+class OggVorbisAudioFormatTests  : public UnitTest
+{
+public:
+	OggVorbisAudioFormatTests() : UnitTest ("Ogg-Vorbis format") {}
+
+	void runTest()
+	{
+		beginTest ("Parallel encoding");
+
+		const File tempDir (File::getSpecialLocation (File::tempDirectory));
+		const File source (tempDir.getNonexistentChildFile ("juce_ogg_test", ".wav", false));
+		const File dest (tempDir.getNonexistentChildFile ("juce_ogg_test", ".ogg", false));
+
+		// Long enough to be split into several sections
+		const double sampleRate = 22050.0;
+		const int numSamples = (int) (sampleRate * 150);
+		const double frequency = 441.0;
+
+		{
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (source.createOutputStream(), sampleRate, 1, 16, StringPairArray(), 0));
+			expect (writer != nullptr);
+
+			AudioSampleBuffer buffer (1, numSamples);
+
+			for (int i = 0; i < numSamples; ++i)
+				*buffer.getSampleData (0, i) = 0.5f * (float) std::sin (2.0 * double_Pi * frequency * i / sampleRate);
+
+			writer->writeFromAudioSampleBuffer (buffer, 0, numSamples);
+		}
+
+		AudioFormatManager formatManager;
+		formatManager.registerBasicFormats();
+
+		{
+			ScopedPointer<FileOutputStream> out (dest.createOutputStream());
+			OggVorbisAudioFormat ogg;
+			expect (ogg.writeInParallel (formatManager, source, *out, 4, StringPairArray(), 4));
+		}
+
+		ScopedPointer<AudioFormatReader> reader (formatManager.createReaderFor (dest));
+		expect (reader != nullptr);
+		expect (reader->lengthInSamples == numSamples);
+
+		// Check that the joins between the sections are seamless
+		AudioSampleBuffer result (1, numSamples);
+		reader->read (&result, 0, numSamples, 0, true, false);
+
+		float maxError = 0;
+
+		for (int i = 0; i < numSamples; ++i)
+			maxError = jmax (maxError, std::abs (*result.getSampleData (0, i)
+												   - 0.5f * (float) std::sin (2.0 * double_Pi * frequency * i / sampleRate)));
+
+		expect (maxError < 0.05f, "error " + String (maxError));
+
+		reader = nullptr;
+		source.deleteFile();
+		dest.deleteFile();
+	}
+};
+
+static OggVorbisAudioFormatTests oggVorbisAudioFormatTests;
+
+#endif
+
 #endif
 
 /*** End of inlined file: juce_OggVorbisAudioFormat.cpp ***/
@@ -92361,6 +95689,7 @@ const char* const WavAudioFormat::bwavOriginationDate  = "bwav origination date"
 const char* const WavAudioFormat::bwavOriginationTime  = "bwav origination time";
 const char* const WavAudioFormat::bwavTimeReference    = "bwav time reference";
 const char* const WavAudioFormat::bwavCodingHistory    = "bwav coding history";
+const char* const WavAudioFormat::headerUpdateInterval = "header update interval";
 
 StringPairArray WavAudioFormat::createBWAVMetadata (const String& description,
 													const String& originator,
@@ -92861,7 +96190,7 @@ public:
 						}
 						else
 						{
-							input->skipNextBytes (6); // skip over bitsPerSample
+							input->skipNextBytes (4); // skip over size and bitsPerSample
 							metadataValues.set ("ChannelMask", String (input->readInt()));
 
 							ExtensibleWavSubFormat subFormat;
@@ -92873,7 +96202,14 @@ public:
 							const ExtensibleWavSubFormat pcmFormat
 								= { 0x00000001, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
 
-							if (memcmp (&subFormat, &pcmFormat, sizeof (subFormat)) != 0)
+							const ExtensibleWavSubFormat IEEEFloatFormat
+								= { 0x00000003, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+
+							if (memcmp (&subFormat, &IEEEFloatFormat, sizeof (subFormat)) == 0)
+							{
+								usesFloatingPointData = true;
+							}
+							else if (memcmp (&subFormat, &pcmFormat, sizeof (subFormat)) != 0)
 							{
 								const ExtensibleWavSubFormat ambisonicFormat
 									= { 0x00000001, 0x0721, 0x11d3, { 0x86, 0x44, 0xC8, 0xC1, 0xCA, 0x00, 0x00, 0x00 } };
@@ -93023,12 +96359,19 @@ public:
 
 		input->setPosition (dataChunkStart + startSampleInFile * bytesPerFrame);
 
+		const int tempBufSize = 480 * 3 * 4; // (keep this a multiple of 3)
+		const bool useDeinterleaver = shouldUseDeinterleaver ((int) numChannels, (int) bitsPerSample);
+		const int bufferSize = useDeinterleaver ? jmax ((int) multiChannelBufferSize, bytesPerFrame * 4) : tempBufSize;
+
+		if (useDeinterleaver && readBuffer == nullptr)
+			readBuffer.malloc ((size_t) bufferSize);
+
 		while (numSamples > 0)
 		{
-			const int tempBufSize = 480 * 3 * 4; // (keep this a multiple of 3)
-			char tempBuffer [tempBufSize];
+			char localBuffer [tempBufSize];
+			char* const tempBuffer = useDeinterleaver ? readBuffer.getData() : localBuffer;
 
-			const int numThisTime = jmin (tempBufSize / bytesPerFrame, numSamples);
+			const int numThisTime = jmin (bufferSize / bytesPerFrame, numSamples);
 			const int bytesRead = input->read (tempBuffer, numThisTime * bytesPerFrame);
 
 			if (bytesRead < numThisTime * bytesPerFrame)
@@ -93037,7 +96380,13 @@ public:
 				zeromem (tempBuffer + bytesRead, (size_t) (numThisTime * bytesPerFrame - bytesRead));
 			}
 
-			switch (bitsPerSample)
+			if (useDeinterleaver)
+			{
+				// For lots of channels, it's much quicker to unpack all of them in one sweep
+				deinterleaveLittleEndianSamples (destSamples, startOffsetInDestBuffer, numDestChannels,
+												 tempBuffer, (int) numChannels, (int) bitsPerSample / 8, numThisTime);
+			}
+			else switch (bitsPerSample)
 			{
 				case 8:     ReadHelper<AudioData::Int32, AudioData::UInt8, AudioData::LittleEndian>::read (destSamples, startOffsetInDestBuffer, numDestChannels, tempBuffer, (int) numChannels, numThisTime); break;
 				case 16:    ReadHelper<AudioData::Int32, AudioData::Int16, AudioData::LittleEndian>::read (destSamples, startOffsetInDestBuffer, numDestChannels, tempBuffer, (int) numChannels, numThisTime); break;
@@ -93054,6 +96403,20 @@ public:
 		return true;
 	}
 
+	/** Returns true if deinterleaveLittleEndianSamples() beats converting each channel separately.
+		With fewer than 4 channels there's nothing for its SIMD path to do, and without SIMD
+		it's no quicker.
+	*/
+	static bool shouldUseDeinterleaver (const int numChannels, const int bitsPerSample) noexcept
+	{
+	   #if JUCE_USE_SSE_INTRINSICS
+		return numChannels >= 4 && (bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32);
+	   #else
+		(void) numChannels; (void) bitsPerSample;
+		return false;
+	   #endif
+	}
+
 	int64 bwavChunkStart, bwavSize;
 
 private:
@@ -93061,6 +96424,9 @@ private:
 	int bytesPerFrame;
 	int64 dataChunkStart, dataLength;
 	bool isRF64;
+	HeapBlock<char> readBuffer;
+
+	enum { multiChannelBufferSize = 32768 };
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WavAudioFormatReader);
 };
@@ -93074,10 +96440,17 @@ public:
 		: AudioFormatWriter (out, TRANS (wavFormatName), sampleRate_, numChannels_, bits),
 		  lengthInSamples (0),
 		  bytesWritten (0),
+		  headerUpdateIntervalSamples (0),
+		  lengthAtLastHeaderUpdate (0),
 		  writeFailed (false)
 	{
 		using namespace WavFileHelpers;
 
+		const double updateInterval = metadataValues.getValue (WavAudioFormat::headerUpdateInterval, "0").getDoubleValue();
+
+		if (updateInterval > 0)
+			headerUpdateIntervalSamples = jmax ((uint64) 1, (uint64) (updateInterval * sampleRate_));
+
 		if (metadataValues.size() > 0)
 		{
 			// The meta data should have been santised for the WAV format.
@@ -93140,6 +96513,10 @@ public:
 			bytesWritten += bytes;
 			lengthInSamples += numSamples;
 
+			if (headerUpdateIntervalSamples > 0
+				 && lengthInSamples >= lengthAtLastHeaderUpdate + headerUpdateIntervalSamples)
+				updateHeaderWhileRecording();
+
 			return true;
 		}
 	}
@@ -93147,10 +96524,22 @@ public:
 private:
 	ScopedPointer<AudioData::Converter> converter;
 	MemoryBlock tempBlock, bwavChunk, smplChunk, instChunk, cueChunk, listChunk;
-	uint64 lengthInSamples, bytesWritten;
+	uint64 lengthInSamples, bytesWritten, headerUpdateIntervalSamples, lengthAtLastHeaderUpdate;
 	int64 headerPosition;
 	bool writeFailed;
 
+	void updateHeaderWhileRecording()
+	{
+		// The header is always the same size, (the JUNK chunk reserves the space needed
+		// for an RF64 header) so it can be overwritten in-place before carrying on
+		const int64 endOfData = output->getPosition();
+		writeHeader();
+		output->setPosition (endOfData);
+		output->flush();
+
+		lengthAtLastHeaderUpdate = lengthInSamples;
+	}
+
 	static int getChannelMask (const int numChannels) noexcept
 	{
 		switch (numChannels)
@@ -93180,9 +96569,6 @@ private:
 		const size_t bytesPerFrame = numChannels * bitsPerSample / 8;
 		uint64 audioDataSize = bytesPerFrame * lengthInSamples;
 
-		const bool isRF64 = (bytesWritten >= literal64bit (0x100000000));
-		const bool isWaveFmtEx = isRF64 || (numChannels > 2);
-
 		int64 riffChunkSize = 4 /* 'RIFF' */ + 8 + 40 /* WAVEFORMATEX */
 							   + 8 + audioDataSize + (audioDataSize & 1)
 							   + (bwavChunk.getSize() > 0 ? (8  + bwavChunk.getSize()) : 0)
@@ -93194,6 +96580,10 @@ private:
 
 		riffChunkSize += (riffChunkSize & 0x1);
 
+		// (the RIFF size can overflow slightly before the data size does)
+		const bool isRF64 = riffChunkSize >= literal64bit (0x100000000);
+		const bool isWaveFmtEx = isRF64 || (numChannels > 2);
+
 		output->writeInt (chunkName (isRF64 ? "RF64" : "RIFF"));
 		output->writeInt (isRF64 ? -1 : (int) riffChunkSize);
 		output->writeInt (chunkName ("WAVE"));
@@ -93424,6 +96814,288 @@ bool WavAudioFormat::replaceMetadataInFile (const File& wavFile, const StringPai
 	return slowCopyWavFileWithNewMetadata (wavFile, newMetadata);
 }
 
+
+#if JUCE_UNIT_TESTS
+
+class WavAudioFormatTests  : public UnitTest
+{
+public:
+	WavAudioFormatTests() : UnitTest ("WAV format") {}
+
+	void runTest()
+	{
+		beginTest ("Multichannel");
+		{
+			const int numChannels = 6, numSamples = 1000;
+			MemoryBlock fileData;
+
+			{
+				WavAudioFormat wav;
+				ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new MemoryOutputStream (fileData, false), 48000,
+																			 numChannels, 24, StringPairArray(), 0));
+				expect (writer != nullptr);
+
+				AudioSampleBuffer buffer (numChannels, numSamples);
+
+				for (int ch = 0; ch < numChannels; ++ch)
+					for (int i = 0; i < numSamples; ++i)
+						*buffer.getSampleData (ch, i) = (ch + 1) * 0.1f;
+
+				expect (writer->writeFromAudioSampleBuffer (buffer, 0, numSamples));
+			}
+
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (new MemoryInputStream (fileData, false), true));
+			expect (reader != nullptr);
+			expectEquals ((int) reader->numChannels, numChannels);
+			expect (reader->lengthInSamples == numSamples);
+
+			AudioSampleBuffer result (numChannels, numSamples);
+			reader->read (&result, 0, numSamples, 0, true, true);
+			expect (std::abs (*result.getSampleData (1, numSamples / 2) - 0.2f) < 0.001f);
+		}
+
+		beginTest ("Multichannel deinterleaving");
+		{
+			const int channelCounts[] = { 2, 3, 4, 6, 8, 16, 32, 64, 128 };
+			Random r (0x1234);
+
+			for (int bytesPerSample = 2; bytesPerSample <= 4; ++bytesPerSample)
+			{
+				for (int c = 0; c < numElementsInArray (channelCounts); ++c)
+				{
+					const int numChannels = channelCounts[c];
+					const int frameSize = numChannels * bytesPerSample;
+					const int numSamples = jmax (4, 32768 / frameSize); // (the same block size that the reader uses)
+
+					HeapBlock<char> source ((size_t) (frameSize * numSamples));
+
+					for (int i = 0; i < frameSize * numSamples; ++i)
+						source[i] = (char) r.nextInt (256);
+
+					AudioSampleBuffer expected (numChannels + 1, numSamples), actual (numChannels + 1, numSamples);
+					int** const expectedData = reinterpret_cast<int**> (expected.getArrayOfChannels());
+					int** const actualData = reinterpret_cast<int**> (actual.getArrayOfChannels());
+
+					const int numRepeats = 1 + 2000000 / (numChannels * numSamples);
+					ReaderAccess::readPerChannel (expectedData, numChannels + 1, source, numChannels, bytesPerSample, numSamples);
+					ReaderAccess::deinterleave (actualData, numChannels + 1, source, numChannels, bytesPerSample, numSamples);
+
+					const double start = Time::getMillisecondCounterHiRes();
+
+					for (int i = 0; i < numRepeats; ++i)
+						ReaderAccess::readPerChannel (expectedData, numChannels + 1, source, numChannels, bytesPerSample, numSamples);
+
+					const double middle = Time::getMillisecondCounterHiRes();
+
+					for (int i = 0; i < numRepeats; ++i)
+						ReaderAccess::deinterleave (actualData, numChannels + 1, source, numChannels, bytesPerSample, numSamples);
+
+					const double end = Time::getMillisecondCounterHiRes();
+
+					bool matches = true;
+
+					for (int ch = 0; ch <= numChannels; ++ch)
+						matches = matches && memcmp (expectedData[ch], actualData[ch], sizeof (int) * numSamples) == 0;
+
+					expect (matches);
+
+					if (WavAudioFormatReader::shouldUseDeinterleaver (numChannels, bytesPerSample * 8))
+						logMessage (String (numChannels) + " channels, " + String (bytesPerSample * 8) + "-bit: "
+									 + String ((middle - start) / (end - middle), 2) + "x faster");
+				}
+			}
+		}
+
+		beginTest ("RF64 promotion");
+		{
+			// Writes just over 4GB through a stream that only keeps the start and end of the data
+			const int numChannels = 2, blockSize = 1 << 20;
+			const int64 numSamples = literal64bit (0x100000000) / (numChannels * 4) + blockSize;
+			SparseStream stream (numSamples * numChannels * 4 - blockSize * numChannels * 4);
+
+			// (32-bit WAVs hold floating point data, so the writer treats these as floats)
+			HeapBlock<float> silence ((size_t) blockSize), ramp ((size_t) blockSize);
+			silence.clear ((size_t) blockSize);
+
+			for (int i = 0; i < blockSize; ++i)
+				ramp[i] = i / (float) blockSize;
+
+			{
+				WavAudioFormat wav;
+				ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new SparseOutputStream (stream), 48000,
+																			 numChannels, 32, StringPairArray(), 0));
+				const int* chans[] = { (const int*) silence.getData(), (const int*) silence.getData(), nullptr };
+
+				for (int64 pos = 0; pos < numSamples - blockSize; pos += blockSize)
+					writer->write (chans, (int) jmin ((int64) blockSize, numSamples - blockSize - pos));
+
+				chans[1] = (const int*) ramp.getData();
+				writer->write (chans, blockSize);
+			}
+
+			expect (stream.head.getSize() > 0 && memcmp (stream.head.getData(), "RF64", 4) == 0);
+
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (new SparseInputStream (stream), true));
+			expect (reader != nullptr);
+			expect (reader->lengthInSamples == numSamples);
+
+			float results[16] = { 0 };
+			int* dest[] = { (int*) results, (int*) (results + 8) };
+			reader->read (dest, 2, numSamples - 8, 8, false);
+			expect (results[0] == 0);
+			expect (results[15] == ramp[blockSize - 1]);
+		}
+
+		beginTest ("Header updates while recording");
+		{
+			const File file (File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("juce_wav_test", ".wav", false));
+			const int blockSize = 4410;
+			AudioSampleBuffer buffer (2, blockSize);
+			buffer.clear();
+
+			StringPairArray metadata;
+			metadata.set (WavAudioFormat::headerUpdateInterval, "0.5");
+
+			WavAudioFormat wav;
+			ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (file.createOutputStream(), 44100, 2, 16, metadata, 0));
+			expect (writer != nullptr);
+
+			for (int i = 0; i < 12; ++i)
+				writer->writeFromAudioSampleBuffer (buffer, 0, blockSize);
+
+			{
+				ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (file.createInputStream(), true));
+				expect (reader != nullptr);
+				expect (reader->lengthInSamples == 44100);
+			}
+
+			writer = nullptr;
+
+			{
+				ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (file.createInputStream(), true));
+				expect (reader != nullptr);
+				expect (reader->lengthInSamples == 12 * blockSize);
+			}
+
+			file.deleteFile();
+		}
+	}
+
+private:
+	struct ReaderAccess  : public AudioFormatReader
+	{
+		static void deinterleave (int** dest, int numDestChannels, const void* source, int numSourceChannels,
+								  int bytesPerSample, int numSamples)
+		{
+			deinterleaveLittleEndianSamples (dest, 0, numDestChannels, source, numSourceChannels, bytesPerSample, numSamples);
+		}
+
+		static void readPerChannel (int** dest, int numDestChannels, const void* source, int numSourceChannels,
+									int bytesPerSample, int numSamples)
+		{
+			switch (bytesPerSample)
+			{
+				case 2:  ReadHelper<AudioData::Int32, AudioData::Int16, AudioData::LittleEndian>::read (dest, 0, numDestChannels, source, numSourceChannels, numSamples); break;
+				case 3:  ReadHelper<AudioData::Int32, AudioData::Int24, AudioData::LittleEndian>::read (dest, 0, numDestChannels, source, numSourceChannels, numSamples); break;
+				default: ReadHelper<AudioData::Int32, AudioData::Int32, AudioData::LittleEndian>::read (dest, 0, numDestChannels, source, numSourceChannels, numSamples); break;
+			}
+		}
+	};
+
+	struct SparseStream
+	{
+		SparseStream (int64 tailStart_) : tailStart (tailStart_), size (0) {}
+
+		MemoryBlock head, tail;
+		const int64 tailStart;
+		int64 size;
+
+		enum { headSize = 4096 };
+	};
+
+	class SparseOutputStream  : public OutputStream
+	{
+	public:
+		SparseOutputStream (SparseStream& s) : stream (s), position (0) {}
+
+		void flush() {}
+		int64 getPosition()                     { return position; }
+		bool setPosition (int64 newPosition)    { position = newPosition; return true; }
+
+		bool write (const void* data, int numBytes)
+		{
+			for (int i = 0; i < numBytes; ++i)
+			{
+				const int64 pos = position + i;
+
+				if (pos < SparseStream::headSize)
+				{
+					stream.head.ensureSize ((size_t) pos + 1, true);
+					stream.head[(int) pos] = static_cast<const char*> (data)[i];
+				}
+				else if (pos >= stream.tailStart)
+				{
+					stream.tail.ensureSize ((size_t) (pos - stream.tailStart) + 1, true);
+					stream.tail[(int) (pos - stream.tailStart)] = static_cast<const char*> (data)[i];
+				}
+				else
+				{
+					i = (int) jmin ((int64) numBytes, stream.tailStart - position) - 1;
+				}
+			}
+
+			position += numBytes;
+			stream.size = jmax (stream.size, position);
+			return true;
+		}
+
+	private:
+		SparseStream& stream;
+		int64 position;
+	};
+
+	class SparseInputStream  : public InputStream
+	{
+	public:
+		SparseInputStream (SparseStream& s) : stream (s), position (0) {}
+
+		int64 getTotalLength()                  { return stream.size; }
+		bool isExhausted()                      { return position >= stream.size; }
+		int64 getPosition()                     { return position; }
+		bool setPosition (int64 newPosition)    { position = newPosition; return true; }
+
+		int read (void* dest, int numBytes)
+		{
+			numBytes = (int) jmin ((int64) numBytes, stream.size - position);
+
+			for (int i = 0; i < numBytes; ++i)
+			{
+				const int64 pos = position + i;
+				char c = 0;
+
+				if (pos < (int64) stream.head.getSize())
+					c = stream.head[(int) pos];
+				else if (pos >= stream.tailStart && pos < stream.tailStart + (int64) stream.tail.getSize())
+					c = stream.tail[(int) (pos - stream.tailStart)];
+
+				static_cast<char*> (dest)[i] = c;
+			}
+
+			position += numBytes;
+			return numBytes;
+		}
+
+	private:
+		SparseStream& stream;
+		int64 position;
+	};
+};
+
+static WavAudioFormatTests wavAudioFormatTests;
+
+#endif
 /*** End of inlined file: juce_WavAudioFormat.cpp ***/
 
 #if JUCE_WINDOWS && JUCE_USE_WINDOWS_MEDIA_FORMAT
@@ -201,7 +201,7 @@ public:
 									channel (if there is one)
 		@param highestRight         on return, this is the highest absolute sample from the right
 									channel (if there is one)
-		@see read
+		@see read, AudioLevelAnalyser
 	*/
 	virtual void readMaxLevels (int64 startSample,
 								int64 numSamples,
@@ -311,10 +311,29 @@ protected:
 			}
 		}
 	};
+	/** Used by AudioFormatReader subclasses to unpack interleaved little-endian PCM data.
+
+		This splits a block of 16, 24 or 32-bit interleaved frames into separate channels,
+		unpacking several channels at a time with SIMD instructions where possible, which
+		is much faster than converting each channel separately when there are lots of
+		channels. The source block should be small enough to stay in the cache (e.g. 32K
+		or so), as each group of channels is read from it in turn. Each sample is converted to a
+		left-justified 32-bit integer, and 32-bit samples are copied unchanged, so this
+		also works for 32-bit floating point data.
+
+		Any null destination channels are skipped, and any destination channels beyond
+		the number of source channels are cleared.
+	*/
+	static void deinterleaveLittleEndianSamples (int** destData, int destOffset, int numDestChannels,
+												 const void* sourceData, int numSourceChannels,
+												 int bytesPerSample, int numSamples) noexcept;
+
 
 private:
 	String formatName;
 
+	bool blockMightContainLevel (int* const*, int numSamples, double floatMinimum, int intMinimum) const noexcept;
+
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioFormatReader);
 };
 
@@ -463,13 +482,52 @@ public:
 			If the FIFO is too full to accept this many samples, the method will return
 			false - then you could either wait until the background thread has had time to
 			consume some of the buffered data and try again, or you can give up
-			and lost this block.
+			and lost this block. Any samples that are lost like this are added to the
+			count returned by getNumSamplesDropped().
+
+			If blocking mode has been turned on with setBlockingMode(), this will instead
+			wait until the background thread has made enough space for the data.
 
 			The data must be an array containing the same number of channels as the
 			AudioFormatWriter object is using. None of these channels can be null.
 		*/
 		bool write (const float** data, int numSamples);
 
+		/** Sets the number of samples that the background thread should collect before
+			writing them to disk.
+
+			When this is non-zero, data will be held in the FIFO until at least this many
+			samples are ready, and will then be written in blocks of this size, which is
+			much more efficient for high channel counts. Each writer only writes one block
+			per time-slice, so several writers can share a thread fairly. The value can't be
+			more than half of the FIFO size. If it's 0 (the default), data is written as
+			soon as it arrives.
+		*/
+		void setWriteBatchSize (int numSamples);
+
+		/** If enabled, write() will wait for free space rather than dropping data when
+			the FIFO is full. This is intended for offline rendering, and mustn't be used
+			from a realtime audio thread!
+		*/
+		void setBlockingMode (bool shouldBlockWhenFull);
+
+		/** Returns the size of the FIFO, in samples. */
+		int getBufferSize() const;
+
+		/** Returns the number of samples that are currently waiting to be written. */
+		int getNumSamplesBuffered() const;
+
+		/** Returns the largest number of samples that have been waiting in the FIFO
+			since the writer was created or resetStatistics() was called.
+		*/
+		int getHighWaterMark() const;
+
+		/** Returns the number of samples that have been lost because the FIFO was full. */
+		int64 getNumSamplesDropped() const;
+
+		/** Resets the high-water mark and dropped-sample count. */
+		void resetStatistics();
+
 		class JUCE_API  IncomingDataReceiver
 		{
 		public:
@@ -889,9 +947,605 @@ private:
 /*** End of inlined file: juce_AudioFormatReaderSource.h ***/
 
 
+#endif
+#ifndef __JUCE_AUDIOFORMATPREFETCHER_JUCEHEADER__
+
+/*** Start of inlined file: juce_AudioFormatPrefetcher.h ***/
+#ifndef __JUCE_AUDIOFORMATPREFETCHER_JUCEHEADER__
+#define __JUCE_AUDIOFORMATPREFETCHER_JUCEHEADER__
+
+/**
+	Opens and partly decodes audio files in the background, ready for them to be played.
+
+	When a playlist moves on to its next file, opening the file, parsing its header and
+	decoding its first few blocks can take long enough to cause a glitch. To avoid
+	that, you can tell one of these objects about the files that will be played soon
+	(and the positions they'll start from), and it'll use a TimeSliceThread to open
+	them and decode the first few seconds of each one into memory.
+
+	When it's time to play one, createSourceFor() returns an AudioFormatReaderSource
+	which plays the prefetched audio straight from memory, and then carries on
+	reading from the file once that has been used up. (If you wrap that in a
+	BufferingAudioSource, the buffering will have plenty of time to catch up).
+
+	The thread can be shared with other clients, e.g. BufferingAudioSources or an
+	AudioThumbnail.
+
+	@see AudioFormatReaderSource, TimeSliceThread
+*/
+class JUCE_API  AudioFormatPrefetcher  : private TimeSliceClient
+{
+public:
+
+	/** Creates a prefetcher.
+
+		@param formatManager        used to open the files - this must stay alive for as
+									long as the prefetcher
+		@param backgroundThread     the thread that does the work - it must be started by the
+									caller, and must also outlive this object
+		@param secondsToPrefetch    how much audio to decode from each start position
+	*/
+	AudioFormatPrefetcher (AudioFormatManager& formatManager,
+						   TimeSliceThread& backgroundThread,
+						   double secondsToPrefetch = 5.0);
+
+	/** Destructor. */
+	~AudioFormatPrefetcher();
+
+	/** Declares that a file will be played soon, from a given position.
+
+		The file will be opened and its audio decoded from that position in the background.
+		Calling this again with the same file and position has no effect.
+	*/
+	void prefetch (const File& file, int64 startSample = 0);
+
+	/** Forgets about a file that had been given to prefetch(), releasing its memory. */
+	void cancel (const File& file, int64 startSample = 0);
+
+	/** Forgets about all the files that are waiting to be played. */
+	void cancelAll();
+
+	/** Returns true if a file has been opened and all the requested audio has been decoded.
+		Also returns true if the file couldn't be opened, as there's nothing more to do for it.
+	*/
+	bool isReady (const File& file, int64 startSample = 0) const;
+
+	/** Returns the number of files that are waiting to be played. */
+	int getNumPendingFiles() const;
+
+	/** Creates a source that will play a file from the given position.
+
+		If the file was given to prefetch(), the source will use whatever has been prefetched
+		so far, and the file is removed from the list of pending files. If not, the file is
+		just opened directly.
+
+		@returns a new source (which the caller must delete), or nullptr if the file
+				 couldn't be opened
+	*/
+	AudioFormatReaderSource* createSourceFor (const File& file, int64 startSample = 0);
+
+private:
+	class Item;
+	class PrefetchedReader;
+
+	AudioFormatManager& formatManager;
+	TimeSliceThread& thread;
+	const double secondsToPrefetch;
+	ReferenceCountedArray<Item> items;
+	CriticalSection lock;
+
+	int useTimeSlice();
+	int indexOf (const File&, int64 startSample) const;
+
+	JUCE_DECLARE_NON_COPYABLE (AudioFormatPrefetcher);
+};
+
+#endif   // __JUCE_AUDIOFORMATPREFETCHER_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioFormatPrefetcher.h ***/
+
+
+#endif
+#ifndef __JUCE_AUDIOFORMATTRANSCODER_JUCEHEADER__
+
+/*** Start of inlined file: juce_AudioFormatTranscoder.h ***/
+#ifndef __JUCE_AUDIOFORMATTRANSCODER_JUCEHEADER__
+#define __JUCE_AUDIOFORMATTRANSCODER_JUCEHEADER__
+
+/**
+	Converts a batch of audio files from one format to another using a pool of
+	background threads.
+
+	Each file is processed as a pipeline of two stages which run as separate
+	ThreadPool jobs: a decoding stage, which reads from an AudioFormatReader and
+	performs any sample-rate conversion that's needed, and an encoding stage, which
+	pushes the decoded blocks into an AudioFormatWriter. The stages are connected by
+	a small fixed-size queue of blocks, so the memory used per file is bounded no
+	matter how long the files are.
+
+	E.g.
+	@code
+	AudioFormatManager formats;
+	formats.registerBasicFormats();
+
+	AudioFormatTranscoder transcoder (formats);
+
+	AudioFormatTranscoder::Job job (File ("~/in.wav"), File ("~/out.flac"));
+	job.bitsPerSample = 24;
+	transcoder.addJob (job);
+
+	transcoder.start();
+	transcoder.waitForCompletion (-1);
+	@endcode
+
+	@see AudioFormatManager, AudioFormatWriter, ResamplingAudioSource
+*/
+class JUCE_API  AudioFormatTranscoder
+{
+public:
+
+	/** Describes a single file conversion. */
+	struct JUCE_API  Job
+	{
+		/** Creates a job with default settings. */
+		Job (const File& sourceFile, const File& destinationFile);
+
+		/** The file to read. */
+		File sourceFile;
+
+		/** The file to create. Any existing file will be overwritten. */
+		File destinationFile;
+
+		/** The format to write. If this is null, the format will be chosen from the
+			destination file's extension. The object must stay valid until the job
+			has finished.
+		*/
+		AudioFormat* destinationFormat;
+
+		/** The sample rate to write, or 0 to keep the source's rate. */
+		double destinationSampleRate;
+
+		/** The bit depth to write, or 0 to use the source's bit depth if the destination
+			format supports it (or the highest depth that it offers if not).
+		*/
+		int bitsPerSample;
+
+		/** An index into the destination format's getQualityOptions() list. */
+		int qualityOptionIndex;
+
+		/** Metadata to pass to AudioFormat::createWriterFor(). */
+		StringPairArray metadataValues;
+	};
+
+	/** The possible states of a job. */
+	enum JobState
+	{
+		jobPending = 0,     /**< The job hasn't been started yet. */
+		jobRunning,         /**< The job is being processed. */
+		jobFinished,        /**< The job completed successfully. */
+		jobFailed,          /**< The job couldn't be completed - see JobProgress::errorMessage. */
+		jobCancelled        /**< The job was stopped by cancel(). */
+	};
+
+	/** A snapshot of the progress of one of the jobs.
+		@see getJobProgress
+	*/
+	struct JUCE_API  JobProgress
+	{
+		JobProgress() noexcept;
+
+		JobState state;
+		String errorMessage;
+
+		/** The number of samples that the destination file will contain. */
+		int64 totalSamples;
+
+		/** The number of samples that have been decoded so far. */
+		int64 samplesDecoded;
+
+		/** The number of samples that have been written so far. */
+		int64 samplesWritten;
+
+		/** The time spent on this job so far, in seconds. */
+		double elapsedSeconds;
+
+		/** The output sample rate. */
+		double sampleRate;
+
+		/** Returns the number of samples written per second of processing time. */
+		double getSamplesPerSecond() const noexcept;
+
+		/** Returns the number of seconds of audio written per second of processing time. */
+		double getSpeedRelativeToRealtime() const noexcept;
+	};
+
+	/** Creates a transcoder.
+
+		@param formatManager        the manager to use when opening the source files, and when
+									choosing destination formats by file extension. This must
+									not be deleted while the transcoder is using it
+		@param numThreads           the number of worker threads to use, or 0 to use one
+									thread per CPU core
+		@param samplesPerBlock      the size of the blocks that are passed between the stages
+		@param numBlocksPerFile     the number of blocks that can be queued between the
+									decoder and encoder of each file
+	*/
+	AudioFormatTranscoder (AudioFormatManager& formatManager,
+						   int numThreads = 0,
+						   int samplesPerBlock = 16384,
+						   int numBlocksPerFile = 8);
+
+	/** Destructor.
+		Any jobs that are still running will be cancelled.
+	*/
+	~AudioFormatTranscoder();
+
+	/** Adds a job to the list.
+		Jobs can be added at any time, even while the transcoder is running.
+		@returns the index of the new job
+	*/
+	int addJob (const Job& newJob);
+
+	/** Returns the number of jobs that have been added. */
+	int getNumJobs() const;
+
+	/** Starts processing the jobs.
+		This returns immediately; the work is done on the background threads.
+	*/
+	void start();
+
+	/** Stops all jobs as quickly as possible.
+		Any partially-written destination files will be deleted.
+	*/
+	void cancel();
+
+	/** Returns true if any jobs are still pending or running. */
+	bool isBusy() const;
+
+	/** Blocks until all jobs have completed or failed.
+		@returns false if the timeout expired first
+	*/
+	bool waitForCompletion (int timeOutMilliseconds);
+
+	/** Returns a snapshot of a job's progress. */
+	JobProgress getJobProgress (int jobIndex) const;
+
+	/** Returns the total number of samples written across all jobs. */
+	int64 getTotalSamplesWritten() const;
+
+	/** Returns the overall progress as a value between 0 and 1. */
+	double getOverallProgress() const;
+
+	/** Returns the aggregate throughput in samples per second since start() was called. */
+	double getAggregateSamplesPerSecond() const;
+
+	/** Receives callbacks when jobs finish.
+		@see AudioFormatTranscoder::addListener
+	*/
+	class JUCE_API  Listener
+	{
+	public:
+		virtual ~Listener() {}
+
+		/** Called when a job has completed, failed or been cancelled.
+			Note that this is called on one of the transcoder's worker threads.
+		*/
+		virtual void transcoderJobFinished (AudioFormatTranscoder& transcoder,
+											int jobIndex, const JobProgress& progress) = 0;
+	};
+
+	/** Registers a listener. */
+	void addListener (Listener* listener);
+
+	/** Deregisters a listener. */
+	void removeListener (Listener* listener);
+
+private:
+
+	class FileTask;
+	class DecodeStage;
+	class EncodeStage;
+	friend class FileTask;
+	friend class DecodeStage;
+	friend class EncodeStage;
+	friend class OwnedArray<FileTask>;
+
+	AudioFormatManager& formatManager;
+	ThreadPool pool;
+	OwnedArray<FileTask> tasks;
+	Array<Listener*> listeners;
+	CriticalSection lock, listenerLock;
+	const int samplesPerBlock, numBlocksPerFile, maxActiveTasks;
+	int numActiveTasks;
+	bool started;
+	double startTime, endTime;
+	WaitableEvent finishedEvent;
+
+	void startMoreTasks();
+	void taskFinished (FileTask&, JobState, const String&);
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioFormatTranscoder);
+};
+
+#endif   // __JUCE_AUDIOFORMATTRANSCODER_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioFormatTranscoder.h ***/
+
+
 #endif
 #ifndef __JUCE_AUDIOFORMATWRITER_JUCEHEADER__
 
+#endif
+#ifndef __JUCE_AUDIOLEVELANALYSER_JUCEHEADER__
+
+/*** Start of inlined file: juce_AudioLevelAnalyser.h ***/
+#ifndef __JUCE_AUDIOLEVELANALYSER_JUCEHEADER__
+#define __JUCE_AUDIOLEVELANALYSER_JUCEHEADER__
+
+/**
+	Measures the levels of a long stretch of audio in a single pass.
+
+	This reads through an AudioFormatReader in large blocks and produces the overall
+	peak and RMS levels of each channel, a set of min/max/RMS summaries at several
+	different resolutions, and optionally the integrated loudness of the material
+	as defined by ITU-R BS.1770 (i.e. the LUFS value used by EBU R128).
+
+	When analysing a file, the work can be split into regions which are processed
+	in parallel, each on its own reader.
+
+	@see AudioFormatReader::readMaxLevels
+*/
+class JUCE_API  AudioLevelAnalyser
+{
+public:
+
+	/** The settings used for an analysis. */
+	struct JUCE_API  Options
+	{
+		/** Creates a default set of options, which will scan a whole source on a
+			single thread, without measuring loudness.
+		*/
+		Options();
+
+		/** The first sample to analyse. */
+		int64 startSample;
+
+		/** The number of samples to analyse, or -1 to continue to the end of the source. */
+		int64 numSamples;
+
+		/** The number of samples read from the source at a time. */
+		int samplesPerBlock;
+
+		/** The number of threads to use when analysing a file. */
+		int numThreads;
+
+		/** The number of samples covered by each point of the summaries that should be
+			generated. Each value must be a multiple of the first (smallest) one.
+		*/
+		Array<int> summaryResolutions;
+
+		/** If true, the integrated loudness will also be measured. */
+		bool measureLoudness;
+	};
+
+	/** A set of min/max/RMS levels for consecutive sections of the source. */
+	class JUCE_API  LevelSummary
+	{
+	public:
+		/** Returns the number of source samples that each point represents. */
+		int getSamplesPerPoint() const noexcept             { return samplesPerPoint; }
+
+		/** Returns the number of points in the summary. */
+		int getNumPoints() const noexcept                   { return numPoints; }
+
+		/** Returns the number of channels in the summary. */
+		int getNumChannels() const noexcept                 { return numChannels; }
+
+		/** Returns the lowest sample value in one of the sections. */
+		float getMinimum (int channel, int point) const noexcept   { return mins [channel * numPoints + point]; }
+
+		/** Returns the highest sample value in one of the sections. */
+		float getMaximum (int channel, int point) const noexcept   { return maxs [channel * numPoints + point]; }
+
+		/** Returns the RMS level of one of the sections. */
+		float getRMSLevel (int channel, int point) const noexcept  { return rms [channel * numPoints + point]; }
+
+	private:
+		friend class AudioLevelAnalyser;
+		int samplesPerPoint, numPoints, numChannels;
+		HeapBlock<float> mins, maxs, rms;
+
+		LevelSummary (int samplesPerPoint, int numPoints, int numChannels);
+		JUCE_DECLARE_NON_COPYABLE (LevelSummary);
+	};
+
+	/** The results of an analysis. */
+	struct JUCE_API  Results
+	{
+		Results();
+
+		/** The number of samples that were analysed. */
+		int64 numSamples;
+
+		/** The lowest sample value found in each channel. */
+		Array<float> minimum;
+
+		/** The highest sample value found in each channel. */
+		Array<float> maximum;
+
+		/** The RMS level of each channel. */
+		Array<float> rmsLevel;
+
+		/** The integrated loudness in LUFS, if it was measured.
+			Silent material (or material too short to measure) will give a value of
+			minusInfinityLoudness.
+		*/
+		double integratedLoudness;
+
+		/** One summary for each of the resolutions that were requested in the options. */
+		OwnedArray<LevelSummary> summaries;
+
+	private:
+		JUCE_DECLARE_NON_COPYABLE (Results);
+	};
+
+	/** The loudness that is reported for silence. */
+	static const double minusInfinityLoudness;
+
+	/** Analyses a reader.
+
+		Because a reader can't be shared between threads, this always uses a single
+		thread, regardless of the numThreads option.
+
+		@returns false if the reader failed
+	*/
+	static bool analyse (AudioFormatReader& reader, const Options& options, Results& results);
+
+	/** Analyses a file, splitting the work across the number of threads requested in
+		the options. Each thread opens its own reader using the format manager.
+
+		@returns false if the file couldn't be read
+	*/
+	static bool analyse (AudioFormatManager& formatManager, const File& file,
+						 const Options& options, Results& results);
+
+private:
+	class RegionAnalyser;
+	class RegionJob;
+
+	AudioLevelAnalyser();
+	static bool analyseRegions (AudioFormatReader&, AudioFormatManager*, const File*, const Options&, Results&);
+
+	JUCE_DECLARE_NON_COPYABLE (AudioLevelAnalyser);
+};
+
+#endif   // __JUCE_AUDIOLEVELANALYSER_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioLevelAnalyser.h ***/
+
+
+#endif
+#ifndef __JUCE_AUDIOFORMATREADERCACHE_JUCEHEADER__
+
+/*** Start of inlined file: juce_AudioFormatReaderCache.h ***/
+#ifndef __JUCE_AUDIOFORMATREADERCACHE_JUCEHEADER__
+#define __JUCE_AUDIOFORMATREADERCACHE_JUCEHEADER__
+
+/**
+	A cache of decoded blocks of audio, which can be shared between lots of readers
+	that all take their data from the same few source readers.
+
+	The cache divides each source into fixed-size blocks, and keeps the most recently
+	used ones in memory, up to a maximum total size. Reads are sample-accurate: any
+	range of samples can be requested, and the result is exactly what the source reader
+	would have returned.
+
+	The cache is thread-safe, and it also serialises all the calls it makes to each
+	source reader, so that several threads can read from the same source through it.
+	(The source readers mustn't be used directly while they're being shared like this).
+
+	Before deleting a source reader, you must call removeSource() to get rid of any
+	blocks that refer to it.
+
+	@see AudioSubsectionReader::setCache
+*/
+class JUCE_API  AudioFormatReaderCache
+{
+public:
+
+	/** Creates a cache.
+
+		@param samplesPerBlock          the number of samples in each of the cached blocks
+		@param maximumSizeInBytes       the total amount of memory that the cached blocks may use
+	*/
+	AudioFormatReaderCache (int samplesPerBlock = 8192,
+							int64 maximumSizeInBytes = 64 * 1024 * 1024);
+
+	/** Destructor. */
+	~AudioFormatReaderCache();
+
+	/** Reads some samples from a source reader, using cached blocks where possible.
+		The parameters are the same as for AudioFormatReader::readSamples().
+	*/
+	bool read (AudioFormatReader& source,
+			   int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+			   int64 startSampleInSource, int numSamples);
+
+	/** Discards all the blocks that belong to a source reader.
+		This must be called before the reader is deleted.
+	*/
+	void removeSource (AudioFormatReader* source);
+
+	/** Discards all the cached blocks. */
+	void clear();
+
+	/** Changes the maximum amount of memory that the cached blocks may use.
+		If the cache is currently bigger than this, the least recently used blocks
+		will be discarded.
+	*/
+	void setMaximumSize (int64 maximumSizeInBytes);
+
+	/** Returns the number of samples in each cached block. */
+	int getSamplesPerBlock() const noexcept                 { return samplesPerBlock; }
+
+	//==============================================================================
+	/** Some statistics about how well the cache is performing. */
+	struct Statistics
+	{
+		/** The number of blocks that were found in the cache. */
+		int64 numHits;
+
+		/** The number of blocks that had to be read from a source. */
+		int64 numMisses;
+
+		/** The number of blocks that were discarded to make space for others. */
+		int64 numEvictions;
+
+		/** The number of blocks currently in the cache. */
+		int numBlocks;
+
+		/** The amount of memory currently used by the cached blocks. */
+		int64 sizeInBytes;
+
+		/** Returns the proportion of block lookups that were hits, from 0 to 1. */
+		double getHitRatio() const noexcept;
+	};
+
+	/** Returns the current statistics. */
+	Statistics getStatistics() const;
+
+	/** Resets the hit, miss and eviction counts. */
+	void resetStatistics();
+
+private:
+	class Block;
+	class Source;
+
+	const int samplesPerBlock;
+	int64 maximumSize, currentSize;
+	int64 numHits, numMisses, numEvictions;
+	int numBlocks;
+	OwnedArray<Source> sources;
+	Block* mostRecent;
+	Block* leastRecent;
+	CriticalSection lock;
+
+	Source& getSource (AudioFormatReader&);
+	ReferenceCountedObjectPtr<Block> findBlock (Source&, int64 blockIndex);
+	void addBlock (Block*);
+	void removeBlock (Block*);
+	void moveToFront (Block*) noexcept;
+	void unlink (Block*) noexcept;
+	void removeExcessBlocks();
+
+	JUCE_DECLARE_NON_COPYABLE (AudioFormatReaderCache);
+};
+
+#endif   // __JUCE_AUDIOFORMATREADERCACHE_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioFormatReaderCache.h ***/
+
+
 #endif
 #ifndef __JUCE_AUDIOSUBSECTIONREADER_JUCEHEADER__
 
@@ -934,6 +1588,17 @@ public:
 	/** Destructor. */
 	~AudioSubsectionReader();
 
+	/** Makes this reader get its data through a cache, which may be shared with other
+		readers that use the same source.
+
+		The cache must stay alive for as long as this reader uses it. If this reader owns its
+		source, it'll remove the source from the cache when it's deleted; otherwise the
+		owner of the source must do that before deleting it.
+
+		Pass nullptr to go back to reading the source directly.
+	*/
+	void setCache (AudioFormatReaderCache* cacheToUse) noexcept;
+
 	bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
 					  int64 startSampleInFile, int numSamples);
 
@@ -949,6 +1614,7 @@ private:
 	AudioFormatReader* const source;
 	int64 startSample, length;
 	const bool deleteSourceWhenDeleted;
+	AudioFormatReaderCache* cache;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioSubsectionReader);
 };
@@ -1183,7 +1849,35 @@ public:
 										const StringPairArray& metadataValues,
 										int qualityOptionIndex);
 
+	/** Encodes a whole file as Ogg-Vorbis, using several threads at once.
+
+		A single Vorbis stream can only be encoded serially, so to speed up long files,
+		this splits the source into sections which are encoded simultaneously, and then
+		writes them to the destination one after the other as a chained Ogg file. Any
+		Ogg-Vorbis decoder (including this one) plays a chained file back as one continuous
+		stream, so the result has the same length as the source.
+
+		Each thread opens its own reader for the source file using the format manager, and
+		the encoded sections are held in memory until it's their turn to be written.
+
+		@param formatManager        used to open the source file
+		@param sourceFile           the file to encode
+		@param destination          the stream to write the encoded data to
+		@param qualityOptionIndex   one of the indexes from getQualityOptions()
+		@param metadataValues       metadata for the writer, as used by createWriterFor()
+		@param numThreads           the number of threads to use, or 0 to use one per CPU
+		@returns true if the whole file was successfully encoded
+	*/
+	bool writeInParallel (AudioFormatManager& formatManager,
+						  const File& sourceFile,
+						  OutputStream& destination,
+						  int qualityOptionIndex,
+						  const StringPairArray& metadataValues,
+						  int numThreads = 0);
+
 private:
+	class SectionEncoder;
+
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OggVorbisAudioFormat);
 };
 
@@ -1313,6 +2007,19 @@ public:
 	*/
 	static const char* const bwavCodingHistory;
 
+	/** Metadata property name that can be passed to createWriterFor() to make the
+		writer rewrite the file's header at regular intervals while it's recording.
+
+		The value is the interval in seconds of audio. Each time this much audio has
+		been written, the sizes in the header will be updated and the stream flushed,
+		so that other processes can open the file and read everything that's been
+		recorded so far. If the value is missing or zero, the header is only updated
+		when the writer is deleted. This isn't written to the file itself.
+
+		@see createWriterFor
+	*/
+	static const char* const headerUpdateInterval;
+
 	/** Utility function to fill out the appropriate metadata for a BWAV file.
 
 		This just makes it easier than using the property names directly, and it
@@ -1333,6 +2040,14 @@ public:
 	AudioFormatReader* createReaderFor (InputStream* sourceStream,
 										bool deleteStreamIfOpeningFails);
 
+	/** Creates a writer for a WAV stream.
+
+		The stream must be able to seek back to its start position so that the header
+		can be rewritten. If the file grows beyond 4GB, the writer will automatically
+		turn it into an RF64 file, using the ds64 chunk for the sizes.
+
+		@see AudioFormat::createWriterFor, headerUpdateInterval
+	*/
 	AudioFormatWriter* createWriterFor (OutputStream* streamToWriteTo,
 										double sampleRateToUse,
 										unsigned int numberOfChannels,
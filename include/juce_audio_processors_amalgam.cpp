@@ -416,10 +416,495 @@ namespace juce
 // START_AUTOINCLUDE format/*.cpp, processors/*.cpp, format_types/*.cpp,
 // format_types/*.mm, scanning/*.cpp
 
+/*** Start of inlined file: juce_AudioPluginBatchLoader.cpp ***/
+class AudioPluginBatchLoader::Item
+{
+public:
+	Item (const int index_, const PluginDescription& description_, const MemoryBlock& state_)
+		: index (index_), description (description_), state (state_),
+		  format (nullptr), stage (waiting)
+	{
+		zerostruct (timing);
+	}
+
+	enum Stage
+	{
+		waiting,
+		loading,
+		needsMessageThread,
+		readyToDeliver,
+		delivered
+	};
+
+	void createInstance (const AudioPluginFormatManager& formatManager)
+	{
+		const double instantiationStart = Time::getMillisecondCounterHiRes();
+		instance = format->createInstanceFromDescription (description);
+
+		const double restoreStart = Time::getMillisecondCounterHiRes();
+		timing.instantiationTime = restoreStart - instantiationStart;
+
+		if (instance != nullptr)
+		{
+			if (state.getSize() > 0)
+			{
+				instance->setStateInformation (state.getData(), (int) state.getSize());
+				timing.stateRestoreTime = Time::getMillisecondCounterHiRes() - restoreStart;
+			}
+		}
+		else if (! formatManager.doesPluginStillExist (description))
+		{
+			errorMessage = TRANS ("This plug-in file no longer exists");
+		}
+		else
+		{
+			errorMessage = TRANS ("This plug-in failed to load correctly");
+		}
+
+		// (the instance keeps its own reference to the binary if it needs it)
+		binary = nullptr;
+	}
+
+	const int index;
+	const PluginDescription description;
+	const MemoryBlock state;
+	AudioPluginFormat* format;
+	ReferenceCountedObjectPtr <ReferenceCountedObject> binary;
+	ScopedPointer <AudioPluginInstance> instance;
+	String errorMessage;
+	Timing timing;
+	Stage stage;
+
+private:
+	JUCE_DECLARE_NON_COPYABLE (Item);
+};
+
+class AudioPluginBatchLoader::LoaderJob  : public ThreadPoolJob
+{
+public:
+	LoaderJob (AudioPluginBatchLoader& owner_, Item& item_)
+		: ThreadPoolJob ("Plugin loader"), owner (owner_), item (item_)
+	{
+	}
+
+	JobStatus runJob()
+	{
+		if (item.timing.createdOnMessageThread)
+		{
+			// Only the binary can be loaded here - the instance gets created later on
+			// the message thread.
+			const double loadStart = Time::getMillisecondCounterHiRes();
+			item.binary = item.format->preloadPluginBinary (item.description);
+			item.timing.binaryLoadTime = Time::getMillisecondCounterHiRes() - loadStart;
+		}
+		else
+		{
+			item.createInstance (owner.formatManager);
+		}
+
+		owner.jobFinished (item);
+		return jobHasFinished;
+	}
+
+private:
+	AudioPluginBatchLoader& owner;
+	Item& item;
+
+	JUCE_DECLARE_NON_COPYABLE (LoaderJob);
+};
+
+AudioPluginBatchLoader::AudioPluginBatchLoader (AudioPluginFormatManager& formatManager_, const int numThreads_)
+	: formatManager (formatManager_),
+	  numThreads (numThreads_ > 0 ? numThreads_ : SystemStats::getNumCpus()),
+	  listener (nullptr),
+	  startTime (0),
+	  numDelivered (0)
+{
+}
+
+AudioPluginBatchLoader::~AudioPluginBatchLoader()
+{
+	if (threadPool != nullptr)
+	{
+		// Any jobs that haven't started yet are dropped, but plugins can't be interrupted
+		// while they're loading, so this has to wait for the running ones.
+		threadPool->removeAllJobs (false, -1);
+		threadPool = nullptr;
+	}
+
+	// (this has to come after the jobs have gone, as they trigger updates when they finish)
+	cancelPendingUpdate();
+}
+
+int AudioPluginBatchLoader::addPlugin (const PluginDescription& description, const MemoryBlock& stateToRestore)
+{
+	jassert (listener == nullptr); // plugins need to be added before calling start()!
+
+	items.add (new Item (items.size(), description, stateToRestore));
+	return items.size() - 1;
+}
+
+void AudioPluginBatchLoader::start (Listener& newListener)
+{
+	jassert (listener == nullptr); // this can only be started once!
+
+	listener = &newListener;
+	startTime = Time::getMillisecondCounterHiRes();
+	threadPool = new ThreadPool (numThreads);
+
+	for (int i = 0; i < items.size(); ++i)
+	{
+		Item& item = *items.getUnchecked(i);
+
+		for (int j = 0; j < formatManager.getNumFormats(); ++j)
+		{
+			AudioPluginFormat* const f = formatManager.getFormat (j);
+
+			if (f->getName() == item.description.pluginFormatName)
+			{
+				item.format = f;
+				break;
+			}
+		}
+
+		const ScopedLock sl (lock);
+
+		if (item.format != nullptr)
+		{
+			item.timing.createdOnMessageThread = ! item.format->canCreateInstancesOnBackgroundThreads();
+			item.stage = Item::loading;
+			threadPool->addJob (new LoaderJob (*this, item), true);
+		}
+		else
+		{
+			item.errorMessage = TRANS ("The format of this plug-in isn't available");
+			item.stage = Item::readyToDeliver;
+		}
+	}
+
+	triggerAsyncUpdate();
+}
+
+bool AudioPluginBatchLoader::isFinished() const noexcept
+{
+	return listener != nullptr && numDelivered == items.size();
+}
+
+AudioPluginBatchLoader::Timing AudioPluginBatchLoader::getTiming (const int index) const
+{
+	const ScopedLock sl (lock);
+
+	if (isPositiveAndBelow (index, items.size()))
+		return items.getUnchecked (index)->timing;
+
+	Timing none;
+	zerostruct (none);
+	return none;
+}
+
+void AudioPluginBatchLoader::jobFinished (Item& item)
+{
+	{
+		const ScopedLock sl (lock);
+		item.stage = item.timing.createdOnMessageThread ? Item::needsMessageThread
+														: Item::readyToDeliver;
+	}
+
+	triggerAsyncUpdate();
+}
+
+void AudioPluginBatchLoader::handleAsyncUpdate()
+{
+	if (listener == nullptr || isFinished())
+		return;
+
+	Array <Item*> itemsToDeliver;
+	Item* itemToCreate = nullptr;
+
+	{
+		const ScopedLock sl (lock);
+
+		for (int i = 0; i < items.size(); ++i)
+		{
+			Item* const item = items.getUnchecked(i);
+
+			if (item->stage == Item::readyToDeliver)
+			{
+				item->stage = Item::delivered;
+				itemsToDeliver.add (item);
+			}
+			else if (item->stage == Item::needsMessageThread && itemToCreate == nullptr)
+			{
+				item->stage = Item::delivered;
+				itemToCreate = item;
+			}
+		}
+	}
+
+	// Only one instance gets created per callback, so that the message loop can keep
+	// running in between them.
+	if (itemToCreate != nullptr)
+	{
+		itemToCreate->createInstance (formatManager);
+		itemsToDeliver.add (itemToCreate);
+		triggerAsyncUpdate();
+	}
+
+	for (int i = 0; i < itemsToDeliver.size(); ++i)
+	{
+		Item& item = *itemsToDeliver.getUnchecked(i);
+
+		{
+			const ScopedLock sl (lock);
+			item.timing.timeUntilReady = Time::getMillisecondCounterHiRes() - startTime;
+		}
+
+		++numDelivered;
+		listener->pluginInstanceCreated (*this, item.index, item.instance.release(), item.errorMessage);
+	}
+
+	if (isFinished())
+		listener->allPluginInstancesCreated (*this);
+}
+
+#if JUCE_UNIT_TESTS && JUCE_MODAL_LOOPS_PERMITTED
+
+class AudioPluginBatchLoaderTests  : public UnitTest
+{
+public:
+	AudioPluginBatchLoaderTests() : UnitTest ("AudioPluginBatchLoader") {}
+
+	class TestInstance  : public AudioPluginInstance
+	{
+	public:
+		TestInstance (const PluginDescription& desc)
+			: description (desc), creationThread (Thread::getCurrentThreadId())
+		{
+		}
+
+		void fillInPluginDescription (PluginDescription& d) const   { d = description; }
+
+		const String getName() const                                { return description.name; }
+		void prepareToPlay (double, int)                            {}
+		void releaseResources()                                     {}
+		void processBlock (AudioSampleBuffer& buffer, MidiBuffer&)  { buffer.clear(); }
+		const String getInputChannelName (int) const                { return String::empty; }
+		const String getOutputChannelName (int) const               { return String::empty; }
+		bool isInputChannelStereoPair (int) const                   { return false; }
+		bool isOutputChannelStereoPair (int) const                  { return false; }
+		bool acceptsMidi() const                                    { return false; }
+		bool producesMidi() const                                   { return false; }
+		AudioProcessorEditor* createEditor()                        { return nullptr; }
+		bool hasEditor() const                                      { return false; }
+		int getNumParameters()                                      { return 0; }
+		const String getParameterName (int)                         { return String::empty; }
+		float getParameter (int)                                    { return 0; }
+		const String getParameterText (int)                         { return String::empty; }
+		void setParameter (int, float)                              {}
+		int getNumPrograms()                                        { return 1; }
+		int getCurrentProgram()                                     { return 0; }
+		void setCurrentProgram (int)                                {}
+		const String getProgramName (int)                           { return String::empty; }
+		void changeProgramName (int, const String&)                 {}
+		void getStateInformation (MemoryBlock&)                     {}
+
+		void setStateInformation (const void* data, int size)
+		{
+			restoredState = String::fromUTF8 (static_cast <const char*> (data), size);
+		}
+
+		const PluginDescription description;
+		const Thread::ThreadID creationThread;
+		String restoredState;
+	};
+
+	// Takes (plugin's uid * 10) milliseconds to create each plugin, so they finish in a
+	// different order from the one they were added in.
+	class TestFormat  : public AudioPluginFormat
+	{
+	public:
+		TestFormat (const String& name_, const bool backgroundThreadsAllowed_)
+			: name (name_), backgroundThreadsAllowed (backgroundThreadsAllowed_)
+		{
+		}
+
+		String getName() const                                                          { return name; }
+		void findAllTypesForFile (OwnedArray <PluginDescription>&, const String&)       {}
+		bool fileMightContainThisPluginType (const String&)                             { return true; }
+		String getNameOfPluginFromIdentifier (const String& f)                          { return f; }
+		StringArray searchPathsForPlugins (const FileSearchPath&, bool)                 { return StringArray(); }
+		FileSearchPath getDefaultLocationsToSearch()                                    { return FileSearchPath(); }
+		bool canCreateInstancesOnBackgroundThreads() const                              { return backgroundThreadsAllowed; }
+
+		bool doesPluginStillExist (const PluginDescription& desc)
+		{
+			return ! desc.name.contains ("missing");
+		}
+
+		AudioPluginInstance* createInstanceFromDescription (const PluginDescription& desc)
+		{
+			++numInstancesCreated;
+			Thread::sleep (desc.uid * 10);
+
+			if (desc.name.contains ("broken") || desc.name.contains ("missing"))
+				return nullptr;
+
+			return new TestInstance (desc);
+		}
+
+		struct Binary  : public ReferenceCountedObject {};
+
+		ReferenceCountedObjectPtr <ReferenceCountedObject> preloadPluginBinary (const PluginDescription&)
+		{
+			++numBinariesPreloaded;
+			return new Binary();
+		}
+
+		const String name;
+		const bool backgroundThreadsAllowed;
+		Atomic<int> numInstancesCreated, numBinariesPreloaded;
+	};
+
+	struct TestListener  : public AudioPluginBatchLoader::Listener
+	{
+		TestListener() : finished (false) {}
+
+		void pluginInstanceCreated (AudioPluginBatchLoader& loader, int index,
+									AudioPluginInstance* newInstance, const String& errorMessage)
+		{
+			while (instances.size() < loader.getNumPlugins())
+			{
+				instances.add (nullptr);
+				errors.add (String::empty);
+			}
+
+			order.add (index);
+			instances.set (index, dynamic_cast <TestInstance*> (newInstance));
+			errors.set (index, errorMessage);
+		}
+
+		void allPluginInstancesCreated (AudioPluginBatchLoader&)    { finished = true; }
+
+		Array<int> order;
+		OwnedArray<TestInstance> instances;
+		StringArray errors;
+		bool finished;
+	};
+
+	static PluginDescription createDescription (const String& name, const String& format, const int delay)
+	{
+		PluginDescription desc;
+		desc.name = name;
+		desc.pluginFormatName = format;
+		desc.fileOrIdentifier = "/plugins/" + name;
+		desc.uid = delay;
+		return desc;
+	}
+
+	static MemoryBlock createState (const String& text)
+	{
+		return MemoryBlock (text.toUTF8(), text.getNumBytesAsUTF8());
+	}
+
+	void runTest()
+	{
+		AudioPluginFormatManager formatManager;
+		TestFormat* const parallelFormat = new TestFormat ("ParallelTest", true);
+		TestFormat* const messageThreadFormat = new TestFormat ("MessageThreadTest", false);
+		formatManager.addFormat (parallelFormat);
+		formatManager.addFormat (messageThreadFormat);
+
+		beginTest ("Loading plugins in parallel");
+
+		{
+			AudioPluginBatchLoader loader (formatManager, 4);
+
+			loader.addPlugin (createDescription ("slow", "ParallelTest", 15), createState ("slow state"));
+			loader.addPlugin (createDescription ("broken", "ParallelTest", 8), MemoryBlock());
+			loader.addPlugin (createDescription ("missing", "ParallelTest", 1), MemoryBlock());
+			loader.addPlugin (createDescription ("quick", "ParallelTest", 2), createState ("quick state"));
+			loader.addPlugin (createDescription ("unknown", "NonexistentFormat", 0), MemoryBlock());
+			loader.addPlugin (createDescription ("gui", "MessageThreadTest", 3), createState ("gui state"));
+
+			TestListener listener;
+			loader.start (listener);
+
+			const uint32 timeout = Time::getMillisecondCounter() + 10000;
+
+			while (! listener.finished && Time::getMillisecondCounter() < timeout)
+				MessageManager::getInstance()->runDispatchLoopUntil (20);
+
+			expect (listener.finished && loader.isFinished());
+			expectEquals (listener.order.size(), loader.getNumPlugins());
+
+			// every plugin must be delivered once, with its own index..
+			for (int i = 0; i < loader.getNumPlugins(); ++i)
+				expect (listener.order.contains (i));
+
+			expect (listener.instances[0] != nullptr && listener.instances[0]->getName() == "slow");
+			expect (listener.instances[3] != nullptr && listener.instances[3]->getName() == "quick");
+			expect (listener.instances[5] != nullptr && listener.instances[5]->getName() == "gui");
+			expect (listener.instances[1] == nullptr && listener.instances[2] == nullptr && listener.instances[4] == nullptr);
+
+			// ..as soon as it's ready, rather than waiting for the ones added before it
+			expect (listener.order.indexOf (3) < listener.order.indexOf (0));
+
+			expectEquals (listener.instances[0]->restoredState, String ("slow state"));
+			expectEquals (listener.instances[3]->restoredState, String ("quick state"));
+			expectEquals (listener.instances[5]->restoredState, String ("gui state"));
+
+			expect (listener.errors[0].isEmpty() && listener.errors[3].isEmpty() && listener.errors[5].isEmpty());
+			expectEquals (listener.errors[1], TRANS ("This plug-in failed to load correctly"));
+			expectEquals (listener.errors[2], TRANS ("This plug-in file no longer exists"));
+			expectEquals (listener.errors[4], TRANS ("The format of this plug-in isn't available"));
+
+			// the message-thread format gets its binary preloaded, but its instance created here
+			expectEquals (messageThreadFormat->numBinariesPreloaded.get(), 1);
+			expect (listener.instances[5]->creationThread == Thread::getCurrentThreadId());
+			expect (loader.getTiming (5).createdOnMessageThread && ! loader.getTiming (0).createdOnMessageThread);
+			expect (listener.instances[0]->creationThread != Thread::getCurrentThreadId());
+		}
+
+		beginTest ("Deleting the loader while it's busy");
+
+		{
+			parallelFormat->numInstancesCreated = 0;
+
+			{
+				AudioPluginBatchLoader loader (formatManager, 1);
+
+				for (int i = 0; i < 10; ++i)
+					loader.addPlugin (createDescription ("plugin" + String (i), "ParallelTest", 10), MemoryBlock());
+
+				TestListener listener;
+				loader.start (listener);
+				Thread::sleep (50);
+			}
+
+			// (the loader must wait for the plugin that's being created, but not start any more)
+			const int numCreated = parallelFormat->numInstancesCreated.get();
+			expect (numCreated > 0 && numCreated < 10);
+
+			MessageManager::getInstance()->runDispatchLoopUntil (50);
+			expectEquals (parallelFormat->numInstancesCreated.get(), numCreated);
+		}
+	}
+};
+
+static AudioPluginBatchLoaderTests audioPluginBatchLoaderTests;
+
+#endif
+
+/*** End of inlined file: juce_AudioPluginBatchLoader.cpp ***/
+
+
 /*** Start of inlined file: juce_AudioPluginFormat.cpp ***/
 AudioPluginFormat::AudioPluginFormat() noexcept {}
 AudioPluginFormat::~AudioPluginFormat() {}
 
+bool AudioPluginFormat::canCreateInstancesOnBackgroundThreads() const                   { return false; }
+ReferenceCountedObjectPtr <ReferenceCountedObject> AudioPluginFormat::preloadPluginBinary (const PluginDescription&)   { return nullptr; }
+
 /*** End of inlined file: juce_AudioPluginFormat.cpp ***/
 
 
@@ -529,44 +1014,233 @@ bool AudioPluginFormatManager::doesPluginStillExist (const PluginDescription& de
 
 
 /*** Start of inlined file: juce_AudioProcessor.cpp ***/
-AudioProcessor::AudioProcessor()
-	: playHead (nullptr),
-	  sampleRate (0),
-	  blockSize (0),
-	  numInputChannels (0),
-	  numOutputChannels (0),
-	  latencySamples (0),
-	  suspended (false),
-	  nonRealtime (false)
+/* Holds the changes made by queueParameterChange() until the audio thread applies
+   them, and then holds the notifications about them until the message thread sends
+   them to the listeners.
+
+   Each parameter has a slot holding its latest queued value, and its index is only put
+   in the queue when its slot isn't already waiting to be applied, so a new change just
+   replaces any older one that's still pending and the queue can never fill up. The
+   audio thread never has to wait for a lock in here, and never posts any messages -
+   the message thread polls for the notifications with a timer.
+*/
+class AudioProcessor::ParameterQueue  : private Timer
 {
-}
+public:
+	ParameterQueue (AudioProcessor& owner_)
+		: owner (owner_),
+		  numSlots (jmax (1, owner_.getNumParameters())),
+		  incoming (2 * numSlots + 1),
+		  outgoing (queueSize),
+		  incomingIndexes ((size_t) (2 * numSlots + 1)),
+		  outgoingChanges ((size_t) queueSize),
+		  lastAudioThreadApplyTime (0)
+	{
+		latestValues.calloc ((size_t) numSlots);
+		pendingFlags.calloc ((size_t) numSlots);
+	}
 
-AudioProcessor::~AudioProcessor()
-{
-	// ooh, nasty - the editor should have been deleted before the filter
-	// that it refers to is deleted..
-	jassert (activeEditor == nullptr);
+	~ParameterQueue()
+	{
+		stopTimer();
+	}
 
-   #if JUCE_DEBUG
-	// This will fail if you've called beginParameterChangeGesture() for one
-	// or more parameters without having made a corresponding call to endParameterChangeGesture...
-	jassert (changingParams.countNumberOfSetBits() == 0);
-   #endif
-}
+	enum { queueSize = 512, timerIntervalMs = 30, audioThreadIdleMs = 250 };
 
-void AudioProcessor::setPlayHead (AudioPlayHead* const newPlayHead) noexcept
-{
-	playHead = newPlayHead;
-}
+	void add (const int parameterIndex, const float newValue)
+	{
+		if (! isPositiveAndBelow (parameterIndex, numSlots))
+		{
+			jassertfalse; // the processor must have gained some parameters since the queue was created!
+			return;
+		}
 
-void AudioProcessor::addListener (AudioProcessorListener* const newListener)
-{
-	const ScopedLock sl (listenerLock);
-	listeners.addIfNotAlreadyThere (newListener);
-}
+		latestValues [parameterIndex] = newValue;
 
-void AudioProcessor::removeListener (AudioProcessorListener* const listenerToRemove)
-{
+		// If the slot was already waiting to be applied, the new value will get picked
+		// up along with it..
+		if (pendingFlags [parameterIndex].compareAndSetBool (1, 0))
+		{
+			const SpinLock::ScopedLockType sl (writeLock);
+
+			int start1, size1, start2, size2;
+			incoming.prepareToWrite (1, start1, size1, start2, size2);
+			jassert (size1 + size2 > 0); // (this can't happen, as each index is only queued once)
+
+			incomingIndexes [size1 > 0 ? start1 : start2] = parameterIndex;
+			incoming.finishedWrite (1);
+		}
+
+		if (! isTimerRunning())
+			startTimer (timerIntervalMs);
+	}
+
+	// Called by AudioProcessor::applyQueuedParameterChanges() on the audio thread.
+	void applyOnAudioThread()
+	{
+		lastAudioThreadApplyTime = (int) Time::getMillisecondCounter();
+		apply();
+	}
+
+private:
+	struct Change
+	{
+		int parameterIndex;
+		float value;
+	};
+
+	AudioProcessor& owner;
+	const int numSlots;
+
+	// (an index can be queued again while its old entry is still being read, so the
+	// incoming queue has room for each one twice)
+	AbstractFifo incoming, outgoing;
+	HeapBlock<Atomic<float> > latestValues;
+	HeapBlock<Atomic<int> > pendingFlags;
+	HeapBlock<int> incomingIndexes;
+	HeapBlock<Change> outgoingChanges;
+	SpinLock writeLock, readLock;
+	Atomic<int> notificationsLost, lastAudioThreadApplyTime;
+
+	// Applies the queued changes, unless another thread is already doing so.
+	void apply()
+	{
+		const GenericScopedTryLock<SpinLock> sl (readLock);
+
+		if (! sl.isLocked())
+			return;
+
+		int start1, size1, start2, size2;
+		incoming.prepareToRead (incoming.getNumReady(), start1, size1, start2, size2);
+
+		const int numChanges = size1 + size2;
+
+		for (int i = 0; i < numChanges; ++i)
+		{
+			const int index = incomingIndexes [i < size1 ? start1 + i : start2 + i - size1];
+
+			// (the flag is cleared before the value is read, so that a change made after
+			// this point will queue the index again rather than getting lost)
+			if (pendingFlags [index].compareAndSetBool (0, 1))
+			{
+				const Change change = { index, latestValues [index].get() };
+				owner.setParameter (change.parameterIndex, change.value);
+				addNotification (change);
+			}
+		}
+
+		incoming.finishedRead (numChanges);
+	}
+
+	// (this is only called by the thread that holds the readLock)
+	void addNotification (const Change& change) noexcept
+	{
+		int start1, size1, start2, size2;
+		outgoing.prepareToWrite (1, start1, size1, start2, size2);
+
+		if (size1 + size2 == 0)
+		{
+			// The message thread's falling behind, so it'll have to refresh everything..
+			notificationsLost = 1;
+			return;
+		}
+
+		outgoingChanges [size1 > 0 ? start1 : start2] = change;
+		outgoing.finishedWrite (1);
+	}
+
+	void sendNotifications()
+	{
+		int start1, size1, start2, size2;
+		outgoing.prepareToRead (outgoing.getNumReady(), start1, size1, start2, size2);
+
+		const int numChanges = size1 + size2;
+
+		for (int i = 0; i < numChanges; ++i)
+		{
+			const Change change (outgoingChanges [i < size1 ? start1 + i : start2 + i - size1]);
+			owner.sendParamChangeMessageToListeners (change.parameterIndex, change.value);
+		}
+
+		outgoing.finishedRead (numChanges);
+
+		if (notificationsLost.compareAndSetBool (0, 1))
+			for (int i = 0; i < owner.getNumParameters(); ++i)
+				owner.sendParamChangeMessageToListeners (i, owner.getParameter (i));
+	}
+
+	// (the incoming queue has to be checked first, because the notifications for its
+	// changes are added before they're removed from it)
+	bool isIdle() const noexcept
+	{
+		return incoming.getNumReady() == 0
+				&& outgoing.getNumReady() == 0
+				&& notificationsLost.get() == 0;
+	}
+
+	void timerCallback()
+	{
+		// If the audio thread has stopped picking up the changes, the processor isn't being
+		// played, so they can't clash with a processBlock() call, and get applied here instead.
+		if ((int) Time::getMillisecondCounter() - lastAudioThreadApplyTime.get() > (int) audioThreadIdleMs)
+			apply();
+
+		sendNotifications();
+
+		if (isIdle())
+		{
+			stopTimer();
+
+			// (in case a change was added after the check, but before the timer stopped)
+			if (! isIdle())
+				startTimer (timerIntervalMs);
+		}
+	}
+
+	JUCE_DECLARE_NON_COPYABLE (ParameterQueue);
+};
+
+AudioProcessor::AudioProcessor()
+	: playHead (nullptr),
+	  sampleRate (0),
+	  blockSize (0),
+	  numInputChannels (0),
+	  numOutputChannels (0),
+	  latencySamples (0),
+	  suspended (false),
+	  nonRealtime (false),
+	  parameterQueue (nullptr)
+{
+}
+
+AudioProcessor::~AudioProcessor()
+{
+	// ooh, nasty - the editor should have been deleted before the filter
+	// that it refers to is deleted..
+	jassert (activeEditor == nullptr);
+
+   #if JUCE_DEBUG
+	// This will fail if you've called beginParameterChangeGesture() for one
+	// or more parameters without having made a corresponding call to endParameterChangeGesture...
+	jassert (changingParams.countNumberOfSetBits() == 0);
+   #endif
+
+	delete parameterQueue.get();
+}
+
+void AudioProcessor::setPlayHead (AudioPlayHead* const newPlayHead) noexcept
+{
+	playHead = newPlayHead;
+}
+
+void AudioProcessor::addListener (AudioProcessorListener* const newListener)
+{
+	const ScopedLock sl (listenerLock);
+	listeners.addIfNotAlreadyThere (newListener);
+}
+
+void AudioProcessor::removeListener (AudioProcessorListener* const listenerToRemove)
+{
 	const ScopedLock sl (listenerLock);
 	listeners.removeValue (listenerToRemove);
 }
@@ -609,6 +1283,34 @@ void AudioProcessor::setParameterNotifyingHost (const int parameterIndex,
 	sendParamChangeMessageToListeners (parameterIndex, newValue);
 }
 
+void AudioProcessor::queueParameterChange (const int parameterIndex, const float newValue)
+{
+	jassert (isPositiveAndBelow (parameterIndex, getNumParameters()));
+
+	ParameterQueue* queue = parameterQueue.get();
+
+	if (queue == nullptr)
+	{
+		queue = new ParameterQueue (*this);
+
+		if (! parameterQueue.compareAndSetBool (queue, nullptr))
+		{
+			delete queue;  // (another thread got there first)
+			queue = parameterQueue.get();
+		}
+	}
+
+	queue->add (parameterIndex, newValue);
+}
+
+void AudioProcessor::applyQueuedParameterChanges()
+{
+	ParameterQueue* const queue = parameterQueue.get();
+
+	if (queue != nullptr)
+		queue->applyOnAudioThread();
+}
+
 void AudioProcessor::sendParamChangeMessageToListeners (const int parameterIndex, const float newValue)
 {
 	jassert (isPositiveAndBelow (parameterIndex, getNumParameters()));
@@ -790,32 +1492,245 @@ XmlElement* AudioProcessor::getXmlFromBinary (const void* data,
 void AudioProcessorListener::audioProcessorParameterChangeGestureBegin (AudioProcessor*, int) {}
 void AudioProcessorListener::audioProcessorParameterChangeGestureEnd (AudioProcessor*, int) {}
 
-bool AudioPlayHead::CurrentPositionInfo::operator== (const CurrentPositionInfo& other) const noexcept
-{
-	return timeInSeconds == other.timeInSeconds
-		&& ppqPosition == other.ppqPosition
-		&& editOriginTime == other.editOriginTime
-		&& ppqPositionOfLastBarStart == other.ppqPositionOfLastBarStart
-		&& frameRate == other.frameRate
-		&& isPlaying == other.isPlaying
-		&& isRecording == other.isRecording
-		&& bpm == other.bpm
-		&& timeSigNumerator == other.timeSigNumerator
-		&& timeSigDenominator == other.timeSigDenominator;
-}
+#if JUCE_UNIT_TESTS
 
-bool AudioPlayHead::CurrentPositionInfo::operator!= (const CurrentPositionInfo& other) const noexcept
+class AudioProcessorParameterQueueTests  : public UnitTest
 {
-	return ! operator== (other);
-}
+public:
+	AudioProcessorParameterQueueTests() : UnitTest ("AudioProcessor parameter queue") {}
 
-void AudioPlayHead::CurrentPositionInfo::resetToDefault()
-{
-	zerostruct (*this);
-	timeSigNumerator = 4;
-	timeSigDenominator = 4;
-	bpm = 120;
-}
+	enum { numParameters = 64, numHammers = 4, numChangesPerHammer = 100000, numOverfillChanges = 10240 };
+
+	class TestProcessor  : public AudioProcessor
+	{
+	public:
+		TestProcessor()
+			: renderThread (0), numCallsOffRenderThread (0)
+		{
+			zeromem (values, sizeof (values));
+		}
+
+		const String getName() const                                { return "Test"; }
+		void prepareToPlay (double, int)                            {}
+		void releaseResources()                                     {}
+
+		void processBlock (AudioSampleBuffer& buffer, MidiBuffer&)
+		{
+			renderThread = Thread::getCurrentThreadId();
+			buffer.clear();
+		}
+
+		const String getInputChannelName (int) const                { return String::empty; }
+		const String getOutputChannelName (int) const               { return String::empty; }
+		bool isInputChannelStereoPair (int) const                   { return false; }
+		bool isOutputChannelStereoPair (int) const                  { return false; }
+		bool acceptsMidi() const                                    { return false; }
+		bool producesMidi() const                                   { return false; }
+		AudioProcessorEditor* createEditor()                        { return nullptr; }
+		bool hasEditor() const                                      { return false; }
+		int getNumParameters()                                      { return numParameters; }
+		const String getParameterName (int)                         { return String::empty; }
+		float getParameter (int index)                              { return values [index]; }
+		const String getParameterText (int)                         { return String::empty; }
+
+		void setParameter (int index, float newValue)
+		{
+			values [index] = newValue;
+			++numSetParameterCalls;
+
+			if (renderThread != Thread::getCurrentThreadId())
+				++numCallsOffRenderThread;
+		}
+
+		int getNumPrograms()                                        { return 1; }
+		int getCurrentProgram()                                     { return 0; }
+		void setCurrentProgram (int)                                {}
+		const String getProgramName (int)                           { return String::empty; }
+		void changeProgramName (int, const String&)                 {}
+		void getStateInformation (MemoryBlock&)                     {}
+		void setStateInformation (const void*, int)                 {}
+
+		float values [numParameters];
+		Thread::ThreadID volatile renderThread;
+		Atomic<int> numSetParameterCalls, numCallsOffRenderThread;
+	};
+
+	class RenderThread  : public Thread
+	{
+	public:
+		RenderThread (AudioProcessor& graph_)  : Thread ("Test render thread"), graph (graph_) {}
+
+		void run()
+		{
+			AudioSampleBuffer buffer (2, 256);
+			MidiBuffer midi;
+
+			while (! threadShouldExit())
+			{
+				graph.processBlock (buffer, midi);
+				++numBlocks;
+				wait (1);
+			}
+		}
+
+		AudioProcessor& graph;
+		Atomic<int> numBlocks;
+	};
+
+	// Each of these changes its own set of parameters, so the final values are known.
+	class ParameterHammer  : public Thread
+	{
+	public:
+		ParameterHammer (AudioProcessor& processor_, int firstParameter_)
+			: Thread ("Test parameter hammer"), processor (processor_), firstParameter (firstParameter_)
+		{
+		}
+
+		void run()
+		{
+			for (int i = 0; i < numChangesPerHammer; ++i)
+				processor.queueParameterChange (firstParameter + i % (numParameters / numHammers),
+												i / (float) numChangesPerHammer);
+		}
+
+		AudioProcessor& processor;
+		const int firstParameter;
+	};
+
+	void runTest()
+	{
+		beginTest ("Changing parameters while the graph renders");
+
+		AudioProcessorGraph graph;
+		TestProcessor* const processor = new TestProcessor();
+		graph.addNode (processor);
+		graph.setPlayConfigDetails (0, 2, 44100.0, 256);
+		graph.prepareToPlay (44100.0, 256);
+
+		RenderThread renderer (graph);
+		renderer.startThread();
+
+		while (renderer.numBlocks.get() == 0)
+			Thread::yield();
+
+		OwnedArray<ParameterHammer> hammers;
+
+		for (int i = 0; i < numHammers; ++i)
+		{
+			hammers.add (new ParameterHammer (*processor, i * (numParameters / numHammers)));
+			hammers.getLast()->startThread();
+		}
+
+		for (int i = 0; i < numHammers; ++i)
+			hammers.getUnchecked(i)->waitForThreadToExit (-1);
+
+		// (once a complete block has been rendered, all the changes must have been applied)
+		for (const int blocksSoFar = renderer.numBlocks.get(); renderer.numBlocks.get() < blocksSoFar + 2;)
+			Thread::yield();
+
+		renderer.stopThread (5000);
+		graph.releaseResources();
+
+		for (int i = 0; i < numParameters; ++i)
+		{
+			const int perHammer = numParameters / numHammers;
+			const int lastChange = numChangesPerHammer - perHammer + (i % perHammer);
+			expectEquals (processor->values [i], lastChange / (float) numChangesPerHammer);
+		}
+
+		expectEquals (processor->numCallsOffRenderThread.get(), 0);
+		expect (processor->numSetParameterCalls.get() < numHammers * numChangesPerHammer);
+
+	   #if JUCE_MODAL_LOOPS_PERMITTED
+		beginTest ("Overfilling the queue");
+
+		{
+			TestProcessor p;
+			TestListener listener;
+			p.addListener (&listener);
+
+			// (far more changes than the old fixed-size queue had room for - these must
+			// neither block nor get applied on this thread)
+			const double startTime = Time::getMillisecondCounterHiRes();
+
+			for (int i = 0; i < numOverfillChanges; ++i)
+				p.queueParameterChange (i % numParameters, i / (float) numOverfillChanges);
+
+			expect (Time::getMillisecondCounterHiRes() - startTime < 1000.0);
+			expectEquals (p.numSetParameterCalls.get(), 0);
+
+			// this pretends to be the audio thread..
+			p.applyQueuedParameterChanges();
+			expectEquals (p.numSetParameterCalls.get(), (int) numParameters);
+
+			for (int i = 0; i < numParameters; ++i)
+				expectEquals (p.values [i], (numOverfillChanges - numParameters + i) / (float) numOverfillChanges);
+
+			// ..and the listeners hear about the latest values on the message thread
+			waitForNotifications (listener, numParameters);
+			expectEquals (listener.numChanges.get(), (int) numParameters);
+			expect (listener.allOnMessageThread);
+			expectEquals (listener.lastValue, p.values [numParameters - 1]);
+
+			p.removeListener (&listener);
+		}
+
+		beginTest ("Applying changes when the processor isn't being played");
+
+		{
+			TestProcessor p;
+			TestListener listener;
+			p.addListener (&listener);
+
+			p.queueParameterChange (3, 0.75f);
+			waitForNotifications (listener, 1);
+
+			expectEquals (p.values [3], 0.75f);
+			expectEquals (p.numSetParameterCalls.get(), 1);
+			expectEquals (listener.numChanges.get(), 1);
+
+			p.removeListener (&listener);
+		}
+	   #endif
+	}
+
+	struct TestListener  : public AudioProcessorListener
+	{
+		TestListener() : lastValue (0), allOnMessageThread (true) {}
+
+		void audioProcessorParameterChanged (AudioProcessor*, int, float newValue)
+		{
+			++numChanges;
+			lastValue = newValue;
+
+			if (! MessageManager::getInstance()->isThisTheMessageThread())
+				allOnMessageThread = false;
+		}
+
+		void audioProcessorChanged (AudioProcessor*) {}
+
+		Atomic<int> numChanges;
+		float lastValue;
+		bool allOnMessageThread;
+	};
+
+   #if JUCE_MODAL_LOOPS_PERMITTED
+	static void waitForNotifications (TestListener& listener, const int numExpected)
+	{
+		const uint32 timeout = Time::getMillisecondCounter() + 5000;
+
+		while (listener.numChanges.get() < numExpected && Time::getMillisecondCounter() < timeout)
+			MessageManager::getInstance()->runDispatchLoopUntil (10);
+
+		// (give any extra notifications a chance to turn up, too)
+		MessageManager::getInstance()->runDispatchLoopUntil (100);
+	}
+   #endif
+};
+
+static AudioProcessorParameterQueueTests audioProcessorParameterQueueTests;
+
+#endif
 
 /*** End of inlined file: juce_AudioProcessor.cpp ***/
 
@@ -1029,6 +1944,7 @@ public:
 
 		AudioSampleBuffer buffer (channels, totalChans, numSamples);
 
+		processor->applyQueuedParameterChanges();
 		processor->processBlock (buffer, *sharedMidiBuffers.getUnchecked (midiBufferToUse));
 	}
 
@@ -2319,234 +3235,1743 @@ public:
 		owner_.addListener (this);
 	}
 
-	~ProcessorParameterPropertyComp()
+	~ProcessorParameterPropertyComp()
+	{
+		owner.removeListener (this);
+	}
+
+	void refresh()
+	{
+		paramHasChanged = false;
+		slider.setValue (owner.getParameter (index), false);
+	}
+
+	void audioProcessorChanged (AudioProcessor*)  {}
+
+	void audioProcessorParameterChanged (AudioProcessor*, int parameterIndex, float)
+	{
+		if (parameterIndex == index)
+			paramHasChanged = true;
+	}
+
+	void timerCallback()
+	{
+		if (paramHasChanged)
+		{
+			refresh();
+			startTimer (1000 / 50);
+		}
+		else
+		{
+			startTimer (jmin (1000 / 4, getTimerInterval() + 10));
+		}
+	}
+
+private:
+
+	class ParamSlider  : public Slider
+	{
+	public:
+		ParamSlider (AudioProcessor& owner_, const int index_)
+			: owner (owner_),
+			  index (index_)
+		{
+			setRange (0.0, 1.0, 0.0);
+			setSliderStyle (Slider::LinearBar);
+			setTextBoxIsEditable (false);
+			setScrollWheelEnabled (false);
+		}
+
+		void valueChanged()
+		{
+			const float newVal = (float) getValue();
+
+			if (owner.getParameter (index) != newVal)
+				owner.setParameter (index, newVal);
+		}
+
+		String getTextFromValue (double /*value*/)
+		{
+			return owner.getParameterText (index);
+		}
+
+	private:
+
+		AudioProcessor& owner;
+		const int index;
+
+		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParamSlider);
+	};
+
+	AudioProcessor& owner;
+	const int index;
+	bool volatile paramHasChanged;
+	ParamSlider slider;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ProcessorParameterPropertyComp);
+};
+
+GenericAudioProcessorEditor::GenericAudioProcessorEditor (AudioProcessor* const owner_)
+	: AudioProcessorEditor (owner_)
+{
+	jassert (owner_ != nullptr);
+	setOpaque (true);
+
+	addAndMakeVisible (&panel);
+
+	Array <PropertyComponent*> params;
+
+	const int numParams = owner_->getNumParameters();
+	int totalHeight = 0;
+
+	for (int i = 0; i < numParams; ++i)
+	{
+		String name (owner_->getParameterName (i));
+		if (name.trim().isEmpty())
+			name = "Unnamed";
+
+		ProcessorParameterPropertyComp* const pc = new ProcessorParameterPropertyComp (name, *owner_, i);
+		params.add (pc);
+		totalHeight += pc->getPreferredHeight();
+	}
+
+	panel.addProperties (params);
+
+	setSize (400, jlimit (25, 400, totalHeight));
+}
+
+GenericAudioProcessorEditor::~GenericAudioProcessorEditor()
+{
+}
+
+void GenericAudioProcessorEditor::paint (Graphics& g)
+{
+	g.fillAll (Colours::white);
+}
+
+void GenericAudioProcessorEditor::resized()
+{
+	panel.setBounds (getLocalBounds());
+}
+
+/*** End of inlined file: juce_GenericAudioProcessorEditor.cpp ***/
+
+
+/*** Start of inlined file: juce_PluginDescription.cpp ***/
+PluginDescription::PluginDescription()
+	: uid (0),
+	  isInstrument (false),
+	  numInputChannels (0),
+	  numOutputChannels (0)
+{
+}
+
+PluginDescription::~PluginDescription()
+{
+}
+
+PluginDescription::PluginDescription (const PluginDescription& other)
+	: name (other.name),
+	  descriptiveName (other.descriptiveName),
+	  pluginFormatName (other.pluginFormatName),
+	  category (other.category),
+	  manufacturerName (other.manufacturerName),
+	  version (other.version),
+	  fileOrIdentifier (other.fileOrIdentifier),
+	  lastFileModTime (other.lastFileModTime),
+	  uid (other.uid),
+	  isInstrument (other.isInstrument),
+	  numInputChannels (other.numInputChannels),
+	  numOutputChannels (other.numOutputChannels)
+{
+}
+
+PluginDescription& PluginDescription::operator= (const PluginDescription& other)
+{
+	name = other.name;
+	descriptiveName = other.descriptiveName;
+	pluginFormatName = other.pluginFormatName;
+	category = other.category;
+	manufacturerName = other.manufacturerName;
+	version = other.version;
+	fileOrIdentifier = other.fileOrIdentifier;
+	uid = other.uid;
+	isInstrument = other.isInstrument;
+	lastFileModTime = other.lastFileModTime;
+	numInputChannels = other.numInputChannels;
+	numOutputChannels = other.numOutputChannels;
+
+	return *this;
+}
+
+bool PluginDescription::isDuplicateOf (const PluginDescription& other) const
+{
+	return fileOrIdentifier == other.fileOrIdentifier
+			&& uid == other.uid;
+}
+
+String PluginDescription::createIdentifierString() const
+{
+	return pluginFormatName
+			+ "-" + name
+			+ "-" + String::toHexString (fileOrIdentifier.hashCode())
+			+ "-" + String::toHexString (uid);
+}
+
+XmlElement* PluginDescription::createXml() const
+{
+	XmlElement* const e = new XmlElement ("PLUGIN");
+	e->setAttribute ("name", name);
+	if (descriptiveName != name)
+		e->setAttribute ("descriptiveName", descriptiveName);
+
+	e->setAttribute ("format", pluginFormatName);
+	e->setAttribute ("category", category);
+	e->setAttribute ("manufacturer", manufacturerName);
+	e->setAttribute ("version", version);
+	e->setAttribute ("file", fileOrIdentifier);
+	e->setAttribute ("uid", String::toHexString (uid));
+	e->setAttribute ("isInstrument", isInstrument);
+	e->setAttribute ("fileTime", String::toHexString (lastFileModTime.toMilliseconds()));
+	e->setAttribute ("numInputs", numInputChannels);
+	e->setAttribute ("numOutputs", numOutputChannels);
+
+	return e;
+}
+
+bool PluginDescription::loadFromXml (const XmlElement& xml)
+{
+	if (xml.hasTagName ("PLUGIN"))
+	{
+		name                = xml.getStringAttribute ("name");
+		descriptiveName     = xml.getStringAttribute ("descriptiveName", name);
+		pluginFormatName    = xml.getStringAttribute ("format");
+		category            = xml.getStringAttribute ("category");
+		manufacturerName    = xml.getStringAttribute ("manufacturer");
+		version             = xml.getStringAttribute ("version");
+		fileOrIdentifier    = xml.getStringAttribute ("file");
+		uid                 = xml.getStringAttribute ("uid").getHexValue32();
+		isInstrument        = xml.getBoolAttribute ("isInstrument", false);
+		lastFileModTime     = Time (xml.getStringAttribute ("fileTime").getHexValue64());
+		numInputChannels    = xml.getIntAttribute ("numInputs");
+		numOutputChannels   = xml.getIntAttribute ("numOutputs");
+
+		return true;
+	}
+
+	return false;
+}
+
+/*** End of inlined file: juce_PluginDescription.cpp ***/
+
+
+/*** Start of inlined file: juce_SandboxedPluginInstance.cpp ***/
+namespace SandboxHelpers
+{
+	static const char* const sandboxFlag = "--juce-plugin-sandbox";
+
+	enum MessageType
+	{
+		helloMessage = 1,
+		createMessage,
+		prepareMessage,
+		releaseMessage,
+		resetMessage,
+		processMessage,
+		setParametersMessage,
+		getParameterTextMessage,
+		getCurrentProgramMessage,
+		setCurrentProgramMessage,
+		getProgramNameMessage,
+		changeProgramNameMessage,
+		getStateMessage,
+		setStateMessage
+	};
+
+	/* The shared memory starts with this header, which is followed by the audio channels,
+	   and then by the incoming and outgoing MIDI data.
+	*/
+	struct SharedHeader
+	{
+		int numSamples, numMidiInBytes, numMidiOutBytes;
+		bool hasPosition;
+		AudioPlayHead::CurrentPositionInfo position;
+	};
+
+	enum { midiDataSize = 65536 };
+
+	static size_t getAudioOffset() noexcept
+	{
+		return (sizeof (SharedHeader) + 15) & ~(size_t) 15;
+	}
+
+	static size_t getMidiOffset (const int numChannels, const int blockSize) noexcept
+	{
+		return getAudioOffset() + sizeof (float) * (size_t) (numChannels * blockSize);
+	}
+
+	static size_t getSharedMemorySize (const int numChannels, const int blockSize) noexcept
+	{
+		return getMidiOffset (numChannels, blockSize) + 2 * midiDataSize;
+	}
+
+	static float* getChannel (void* sharedMemory, const int channel, const int blockSize) noexcept
+	{
+		return reinterpret_cast <float*> (static_cast <char*> (sharedMemory) + getAudioOffset()) + channel * blockSize;
+	}
+
+	static File getSharedMemoryDirectory()
+	{
+	   #if JUCE_LINUX
+		const File shm ("/dev/shm");
+
+		if (shm.isDirectory())
+			return shm;
+	   #endif
+
+		return File::getSpecialLocation (File::tempDirectory);
+	}
+
+	static int writeMidi (char* dest, const MidiBuffer& midi, const int startSample, const int numSamples)
+	{
+		MidiBuffer::Iterator iter (midi);
+		iter.setNextSamplePosition (startSample);
+
+		const uint8* data;
+		int numBytes, samplePosition, size = 0;
+
+		while (iter.getNextEvent (data, numBytes, samplePosition) && samplePosition < startSample + numSamples)
+		{
+			if (size + 2 * (int) sizeof (int) + numBytes > midiDataSize)
+			{
+				jassertfalse; // too much MIDI to send in one block!
+				break;
+			}
+
+			const int header[] = { samplePosition - startSample, numBytes };
+			memcpy (dest + size, header, sizeof (header));
+			memcpy (dest + size + sizeof (header), data, (size_t) numBytes);
+			size += (int) sizeof (header) + numBytes;
+		}
+
+		return size;
+	}
+
+	// The data comes from the other process, so each record is checked before it's used. If
+	// one is damaged, this stops reading there and returns false.
+	static bool readMidi (const char* src, const int size, MidiBuffer& midi, const int sampleOffset)
+	{
+		int header[2];
+
+		for (int pos = 0; pos < size; pos += (int) sizeof (header) + header[1])
+		{
+			if (pos + (int) sizeof (header) > size)
+				return false;
+
+			memcpy (header, src + pos, sizeof (header));
+
+			// (written like this so that a huge size can't overflow)
+			if (! (header[1] > 0 && header[1] <= size - pos - (int) sizeof (header)))
+				return false;
+
+			midi.addEvent (src + pos + sizeof (header), header[1], header[0] + sampleOffset);
+		}
+
+		return size >= 0;
+	}
+
+	// Each message is an int type and an int size, followed by that many bytes of data.
+	static void appendMessage (MemoryOutputStream& out, const int type, const void* data, const size_t size)
+	{
+		out.writeInt (type);
+		out.writeInt ((int) size);
+
+		if (size > 0)
+			out.write (data, (int) size);
+	}
+
+	static bool sendData (StreamingSocket& socket, const MemoryOutputStream& data)
+	{
+		return socket.write (data.getData(), (int) data.getDataSize()) == (int) data.getDataSize();
+	}
+
+	static bool readMessage (StreamingSocket& socket, int& type, MemoryBlock& data, int& size, const int timeoutMs)
+	{
+		char header [2 * sizeof (int)];
+
+		if (socket.waitUntilReady (true, timeoutMs) != 1
+			 || socket.read (header, sizeof (header), true) != (int) sizeof (header))
+			return false;
+
+		type = (int) ByteOrder::littleEndianInt (header);
+		size = (int) ByteOrder::littleEndianInt (header + sizeof (int));
+
+		if (size < 0)
+			return false;
+
+		data.ensureSize ((size_t) size);
+		return size == 0 || socket.read (data.getData(), size, true) == size;
+	}
+}
+
+// Reads (and throws away) anything that the sandbox prints, because it would get stuck
+// once the pipe was full otherwise. This finishes when the process exits.
+class SandboxedPluginInstance::OutputReader  : public Thread
+{
+public:
+	OutputReader (SandboxedPluginInstance& owner_)
+		: Thread ("Plugin sandbox output"), owner (owner_)
+	{
+		startThread();
+	}
+
+	~OutputReader()
+	{
+		stopThread (5000);
+	}
+
+	void run()
+	{
+		char buffer [1024];
+
+		while (owner.process.readProcessOutput (buffer, sizeof (buffer)) > 0)
+		{}
+
+		// The process is only reaped while holding the lock, and killProcess() checks the flag
+		// under the same lock, so it can never signal a process ID that has been reused.
+		while (! threadShouldExit())
+		{
+			{
+				const ScopedLock sl (owner.processLock);
+
+				if (! owner.process.isRunning())
+				{
+					owner.processFinished = true;
+					break;
+				}
+			}
+
+			Thread::sleep (5);
+		}
+	}
+
+private:
+	SandboxedPluginInstance& owner;
+
+	JUCE_DECLARE_NON_COPYABLE (OutputReader);
+};
+
+// This runs inside the sandbox process, and hosts the real plugin.
+class SandboxedPluginInstance::PluginServer  : private AudioProcessorListener,
+											   private AudioPlayHead
+{
+public:
+	PluginServer()
+		: sharedNumChannels (0), sharedBlockSize (0),
+		  ignoreParameterChanges (false), processorChanged (false)
+	{
+	}
+
+	~PluginServer()
+	{
+		if (plugin != nullptr)
+			plugin->removeListener (this);
+
+		plugin = nullptr;
+		sharedMemory = nullptr;
+	}
+
+	bool connect (const int port, const String& token)
+	{
+		if (! socket.connect ("127.0.0.1", port, 5000))
+			return false;
+
+		MemoryOutputStream hello, message;
+		hello.writeString (token);
+		SandboxHelpers::appendMessage (message, SandboxHelpers::helloMessage, hello.getData(), hello.getDataSize());
+		return SandboxHelpers::sendData (socket, message);
+	}
+
+	void run()
+	{
+		using namespace SandboxHelpers;
+
+		MemoryBlock data;
+		MemoryOutputStream result, message;
+		int type, size;
+
+		while (readMessage (socket, type, data, size, -1))
+		{
+			MemoryInputStream in (data.getData(), (size_t) size, false);
+
+			if (type == setParametersMessage)
+			{
+				setParameters (in);
+				continue;   // (no reply is needed for these)
+			}
+
+			result.reset();
+
+			if (! handleMessage (type, in, result))
+				break;
+
+			message.reset();
+			MemoryOutputStream reply;
+			writeParameterChanges (reply);
+			reply << result.getMemoryBlock();
+			appendMessage (message, type, reply.getData(), reply.getDataSize());
+
+			if (! sendData (socket, message))
+				break;
+		}
+	}
+
+private:
+	StreamingSocket socket;
+	ScopedPointer<AudioPluginInstance> plugin;
+	ScopedPointer<MemoryMappedFile> sharedMemory;
+	String sharedMemoryFile;
+	int sharedNumChannels, sharedBlockSize;
+	HeapBlock<float*> channels;
+	MidiBuffer midi;
+	CriticalSection changesLock;
+	Array<int> changedParameters;
+	Array<float> changedValues;
+	bool ignoreParameterChanges, processorChanged;
+
+	SandboxHelpers::SharedHeader& getHeader() const noexcept
+	{
+		return *static_cast <SandboxHelpers::SharedHeader*> (sharedMemory->getData());
+	}
+
+	bool handleMessage (const int type, InputStream& in, MemoryOutputStream& result)
+	{
+		using namespace SandboxHelpers;
+
+		if (type == createMessage)
+			return createPlugin (in, result);
+
+		if (plugin == nullptr)
+			return false;
+
+		switch (type)
+		{
+			case prepareMessage:            prepare (in, result); break;
+			case releaseMessage:            plugin->releaseResources(); break;
+			case resetMessage:              plugin->reset(); break;
+			case processMessage:            process(); break;
+			case getParameterTextMessage:   result.writeString (plugin->getParameterText (in.readInt())); break;
+			case getCurrentProgramMessage:  result.writeInt (plugin->getCurrentProgram()); break;
+			case getProgramNameMessage:     result.writeString (plugin->getProgramName (in.readInt())); break;
+
+			case setCurrentProgramMessage:
+				plugin->setCurrentProgram (in.readInt());
+				writeParameterValues (result);
+				break;
+
+			case changeProgramNameMessage:
+			{
+				const int index = in.readInt();
+				plugin->changeProgramName (index, in.readString());
+				break;
+			}
+
+			case getStateMessage:
+			{
+				MemoryBlock state;
+
+				if (in.readBool())
+					plugin->getCurrentProgramStateInformation (state);
+				else
+					plugin->getStateInformation (state);
+
+				result << state;
+				break;
+			}
+
+			case setStateMessage:
+			{
+				const bool currentProgramOnly = in.readBool();
+				MemoryBlock state;
+				in.readIntoMemoryBlock (state);
+
+				if (currentProgramOnly)
+					plugin->setCurrentProgramStateInformation (state.getData(), (int) state.getSize());
+				else
+					plugin->setStateInformation (state.getData(), (int) state.getSize());
+
+				writeParameterValues (result);
+				break;
+			}
+
+			default:
+				return false;
+		}
+
+		return true;
+	}
+
+	bool createPlugin (InputStream& in, MemoryOutputStream& result)
+	{
+		PluginDescription description;
+		String errorMessage;
+
+		ScopedPointer<XmlElement> xml (XmlDocument::parse (in.readString()));
+
+		if (xml != nullptr && description.loadFromXml (*xml))
+			plugin = AudioPluginFormatManager::getInstance()->createPluginInstance (description, errorMessage);
+
+		result.writeBool (plugin != nullptr);
+
+		if (plugin == nullptr)
+		{
+			result.writeString (errorMessage.isNotEmpty() ? errorMessage
+														  : TRANS ("This plug-in failed to load correctly"));
+			return true;
+		}
+
+		plugin->addListener (this);
+		plugin->setPlayHead (this);
+		plugin->fillInPluginDescription (description);
+
+		result.writeString (plugin->getName());
+		result.writeString (ScopedPointer<XmlElement> (description.createXml())->createDocument (String::empty, true, false));
+		result.writeBool (plugin->acceptsMidi());
+		result.writeBool (plugin->producesMidi());
+		result.writeInt (plugin->getLatencySamples());
+		writeChannelInfo (result);
+
+		const int numParameters = plugin->getNumParameters();
+		result.writeInt (numParameters);
+
+		for (int i = 0; i < numParameters; ++i)
+			result.writeString (plugin->getParameterName (i));
+
+		writeParameterValues (result);
+		result.writeInt (plugin->getNumPrograms());
+		return true;
+	}
+
+	void writeChannelInfo (MemoryOutputStream& result) const
+	{
+		const int numIns = plugin->getNumInputChannels();
+		const int numOuts = plugin->getNumOutputChannels();
+
+		result.writeInt (numIns);
+
+		for (int i = 0; i < numIns; ++i)
+		{
+			result.writeString (plugin->getInputChannelName (i));
+			result.writeBool (plugin->isInputChannelStereoPair (i));
+		}
+
+		result.writeInt (numOuts);
+
+		for (int i = 0; i < numOuts; ++i)
+		{
+			result.writeString (plugin->getOutputChannelName (i));
+			result.writeBool (plugin->isOutputChannelStereoPair (i));
+		}
+	}
+
+	void writeParameterValues (MemoryOutputStream& result) const
+	{
+		const int numParameters = plugin->getNumParameters();
+		result.writeInt (numParameters);
+
+		for (int i = 0; i < numParameters; ++i)
+			result.writeFloat (plugin->getParameter (i));
+	}
+
+	void prepare (InputStream& in, MemoryOutputStream& result)
+	{
+		const double sampleRate = in.readDouble();
+		const int blockSize = in.readInt();
+		const bool nonRealtime = in.readBool();
+		const File file (in.readString());
+		const int numChannels = in.readInt();
+		const int maxBlockSize = in.readInt();
+
+		if (sharedMemory == nullptr || file.getFullPathName() != sharedMemoryFile)
+		{
+			sharedMemory = new MemoryMappedFile (file, MemoryMappedFile::readWrite);
+			sharedMemoryFile = file.getFullPathName();
+			sharedNumChannels = numChannels;
+			sharedBlockSize = maxBlockSize;
+			channels.malloc ((size_t) numChannels);
+
+			if (sharedMemory->getSize() < SandboxHelpers::getSharedMemorySize (numChannels, maxBlockSize))
+				sharedMemory = nullptr;
+			else
+				for (int i = 0; i < numChannels; ++i)
+					channels[i] = SandboxHelpers::getChannel (sharedMemory->getData(), i, maxBlockSize);
+		}
+
+		plugin->setNonRealtime (nonRealtime);
+		plugin->setPlayConfigDetails (plugin->getNumInputChannels(), plugin->getNumOutputChannels(),
+									  sampleRate, blockSize);
+		plugin->prepareToPlay (sampleRate, blockSize);
+
+		midi.ensureSize (SandboxHelpers::midiDataSize);
+
+		result.writeBool (sharedMemory != nullptr);
+		result.writeInt (plugin->getLatencySamples());
+		writeChannelInfo (result);
+	}
+
+	void process()
+	{
+		if (sharedMemory == nullptr)
+			return;
+
+		using namespace SandboxHelpers;
+		SharedHeader& header = getHeader();
+		char* const midiData = static_cast <char*> (sharedMemory->getData()) + getMidiOffset (sharedNumChannels, sharedBlockSize);
+		const int numSamples = jlimit (0, sharedBlockSize, header.numSamples);
+
+		midi.clear();
+
+		if (! readMidi (midiData, jmin ((int) midiDataSize, header.numMidiInBytes), midi, 0))
+			jassertfalse; // the host sent some damaged MIDI, so only the events before it get used
+
+		AudioSampleBuffer buffer (channels, sharedNumChannels, numSamples);
+		plugin->processBlock (buffer, midi);
+
+		header.numMidiOutBytes = writeMidi (midiData + midiDataSize, midi, 0, numSamples);
+	}
+
+	void setParameters (InputStream& in)
+	{
+		if (plugin == nullptr)
+			return;
+
+		const ScopedValueSetter<bool> svs (ignoreParameterChanges, true);
+
+		for (int num = in.readInt(); --num >= 0;)
+		{
+			const int index = in.readInt();
+			plugin->setParameter (index, in.readFloat());
+		}
+	}
+
+	void writeParameterChanges (MemoryOutputStream& reply)
+	{
+		const ScopedLock sl (changesLock);
+
+		reply.writeInt (changedParameters.size());
+
+		for (int i = 0; i < changedParameters.size(); ++i)
+		{
+			reply.writeInt (changedParameters.getUnchecked (i));
+			reply.writeFloat (changedValues.getUnchecked (i));
+		}
+
+		reply.writeBool (processorChanged);
+
+		changedParameters.clearQuick();
+		changedValues.clearQuick();
+		processorChanged = false;
+	}
+
+	void audioProcessorParameterChanged (AudioProcessor*, int parameterIndex, float newValue)
+	{
+		if (! ignoreParameterChanges)
+		{
+			const ScopedLock sl (changesLock);
+			changedParameters.add (parameterIndex);
+			changedValues.add (newValue);
+		}
+	}
+
+	void audioProcessorChanged (AudioProcessor*)
+	{
+		const ScopedLock sl (changesLock);
+		processorChanged = true;
+	}
+
+	bool getCurrentPosition (CurrentPositionInfo& result)
+	{
+		if (sharedMemory == nullptr || ! getHeader().hasPosition)
+			return false;
+
+		result = getHeader().position;
+		return true;
+	}
+
+	JUCE_DECLARE_NON_COPYABLE (PluginServer);
+};
+
+SandboxedPluginInstance::SandboxedPluginInstance (const PluginDescription& description_, const int timeoutMs_)
+	: description (description_),
+	  name (description_.name),
+	  timeoutMs (timeoutMs_),
+	  sharedNumChannels (0),
+	  sharedBlockSize (0),
+	  numPrograms (0),
+	  wantsMidi (false),
+	  makesMidi (false),
+	  processFinished (false),
+	  crashed (false)
+{
+}
+
+SandboxedPluginInstance::~SandboxedPluginInstance()
+{
+	{
+		// (the sandbox quits when its connection is closed)
+		const ScopedLock sl (connectionLock);
+		socket = nullptr;
+	}
+
+	// (the output reader finishes once it has reaped the process)
+	if (outputReader != nullptr && ! outputReader->waitForThreadToExit (timeoutMs))
+		killProcess();
+
+	outputReader = nullptr;
+	sharedMemory = nullptr;
+	sharedMemoryFile.deleteFile();
+}
+
+SandboxedPluginInstance* SandboxedPluginInstance::createInstance (const PluginDescription& description,
+																  const String& sandboxCommandLine,
+																  String& errorMessage,
+																  const int timeoutMs)
+{
+	ScopedPointer<SandboxedPluginInstance> instance (new SandboxedPluginInstance (description, timeoutMs));
+
+	if (instance->launch (sandboxCommandLine, errorMessage))
+		return instance.release();
+
+	return nullptr;
+}
+
+bool SandboxedPluginInstance::launch (const String& commandLine, String& errorMessage)
+{
+	using namespace SandboxHelpers;
+
+	StreamingSocket listener;
+	int port = 0;
+
+	for (int attempts = 100; --attempts >= 0 && port == 0;)
+	{
+		const int portToTry = 49152 + Random::getSystemRandom().nextInt (16383);
+
+		if (listener.createListener (portToTry, "127.0.0.1"))
+			port = portToTry;
+	}
+
+	const String token (String::toHexString (Random::getSystemRandom().nextInt64()));
+
+	if (port == 0 || ! process.start (commandLine + " " + sandboxFlag + " " + String (port) + " " + token))
+	{
+		errorMessage = TRANS ("The plug-in sandbox couldn't be started");
+		return false;
+	}
+
+	outputReader = new OutputReader (*this);
+
+	if (listener.waitUntilReady (true, timeoutMs) == 1)
+		socket = listener.waitForNextConnection();
+
+	int type = 0, size = 0;
+
+	if (socket == nullptr
+		 || ! readMessage (*socket, type, replyData, size, timeoutMs)
+		 || type != helloMessage
+		 || MemoryInputStream (replyData.getData(), (size_t) size, false).readString() != token)
+	{
+		errorMessage = TRANS ("The plug-in sandbox didn't respond");
+		sandboxFailed();
+		return false;
+	}
+
+	MemoryOutputStream args;
+	args.writeString (ScopedPointer<XmlElement> (description.createXml())->createDocument (String::empty, true, false));
+
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (! transact (createMessage, args, &result))
+	{
+		errorMessage = TRANS ("The plug-in crashed while it was being loaded");
+		return false;
+	}
+
+	MemoryInputStream in (result, false);
+
+	if (! in.readBool())
+	{
+		errorMessage = in.readString();
+		return false;
+	}
+
+	readPluginInfo (in);
+	return true;
+}
+
+void SandboxedPluginInstance::readPluginInfo (InputStream& in)
+{
+	name = in.readString();
+
+	ScopedPointer<XmlElement> xml (XmlDocument::parse (in.readString()));
+
+	if (xml != nullptr)
+		description.loadFromXml (*xml);
+
+	wantsMidi = in.readBool();
+	makesMidi = in.readBool();
+	setLatencySamples (in.readInt());
+	readChannelInfo (in);
+
+	for (int num = in.readInt(); --num >= 0;)
+		parameterNames.add (in.readString());
+
+	readParameterValues (in);
+	numPrograms = in.readInt();
+
+	// (with space for every parameter, the queue of changes never needs to grow)
+	pendingParameterChanges.ensureStorageAllocated (parameterNames.size());
+}
+
+bool SandboxedPluginInstance::createSharedMemory (const int blockSize)
+{
+	using namespace SandboxHelpers;
+
+	const File newFile (getSharedMemoryDirectory().getNonexistentChildFile ("juce_plugin_sandbox", ".tmp", false));
+	const int numChannels = jmax (1, getNumInputChannels(), getNumOutputChannels());
+	const MemoryBlock initialData (getSharedMemorySize (numChannels, blockSize), true);
+
+	if (newFile.replaceWithData (initialData.getData(), initialData.getSize()))
+	{
+		ScopedPointer<MemoryMappedFile> newMemory (new MemoryMappedFile (newFile, MemoryMappedFile::readWrite));
+
+		if (newMemory->getData() != nullptr)
+		{
+			sharedMemory = newMemory;
+			sharedMemoryFile = newFile;
+			sharedNumChannels = numChannels;
+			sharedBlockSize = blockSize;
+			return true;
+		}
+	}
+
+	newFile.deleteFile();
+	return false;
+}
+
+bool SandboxedPluginInstance::transact (const int messageType, const void* const args, const size_t argsSize,
+										const int timeout, MemoryBlock* const result)
+{
+	using namespace SandboxHelpers;
+
+	if (crashed || socket == nullptr)
+		return false;
+
+	requestData.reset();
+
+	{
+		// Any parameter changes that have been made since the last request get sent first.
+		const ScopedLock sl (parameterLock);
+
+		if (pendingParameterChanges.size() > 0)
+		{
+			const int numChanges = pendingParameterChanges.size();
+			requestData.writeInt (setParametersMessage);
+			requestData.writeInt ((int) sizeof (int) * (1 + 2 * numChanges));
+			requestData.writeInt (numChanges);
+
+			for (int i = 0; i < numChanges; ++i)
+			{
+				const ParameterChange& change = pendingParameterChanges.getReference (i);
+				requestData.writeInt (change.index);
+				requestData.writeFloat (change.value);
+			}
+
+			pendingParameterChanges.clearQuick();
+		}
+	}
+
+	appendMessage (requestData, messageType, args, argsSize);
+
+	int replyType = 0, replySize = 0;
+
+	if (! (sendData (*socket, requestData)
+			&& readMessage (*socket, replyType, replyData, replySize, timeout)
+			&& replyType == messageType))
+	{
+		sandboxFailed();
+		return false;
+	}
+
+	MemoryInputStream in (replyData.getData(), (size_t) replySize, false);
+	handleParameterChanges (in);
+
+	if (result != nullptr)
+		*result = MemoryBlock (static_cast <const char*> (replyData.getData()) + in.getPosition(),
+							   (size_t) in.getNumBytesRemaining());
+
+	return true;
+}
+
+bool SandboxedPluginInstance::transact (const int messageType, const MemoryOutputStream& args, MemoryBlock* const result)
+{
+	return transact (messageType, args.getData(), args.getDataSize(), timeoutMs, result);
+}
+
+void SandboxedPluginInstance::killProcess()
+{
+	const ScopedLock sl (processLock);
+
+	// (once the process has been reaped, its ID could belong to something else)
+	if (! processFinished)
+		process.kill();
+}
+
+void SandboxedPluginInstance::sandboxFailed()
+{
+	crashed = true;
+	killProcess();
+
+	if (socket != nullptr)
+		socket->close();
+}
+
+void SandboxedPluginInstance::handleParameterChanges (InputStream& in)
+{
+	for (int num = in.readInt(); --num >= 0;)
+	{
+		const int index = in.readInt();
+		const float newValue = in.readFloat();
+
+		if (isPositiveAndBelow (index, parameterNames.size()))
+		{
+			{
+				const ScopedLock sl (parameterLock);
+				parameterValues.set (index, newValue);
+			}
+
+			sendParamChangeMessageToListeners (index, newValue);
+		}
+	}
+
+	if (in.readBool())
+		updateHostDisplay();
+}
+
+void SandboxedPluginInstance::readChannelInfo (InputStream& in)
+{
+	inputChannelNames.clear();
+	outputChannelNames.clear();
+	inputStereoPairs.clear();
+	outputStereoPairs.clear();
+
+	const int numIns = in.readInt();
+
+	for (int i = 0; i < numIns; ++i)
+	{
+		inputChannelNames.add (in.readString());
+		inputStereoPairs.setBit (i, in.readBool());
+	}
+
+	const int numOuts = in.readInt();
+
+	for (int i = 0; i < numOuts; ++i)
+	{
+		outputChannelNames.add (in.readString());
+		outputStereoPairs.setBit (i, in.readBool());
+	}
+
+	setPlayConfigDetails (numIns, numOuts, getSampleRate(), getBlockSize());
+}
+
+void SandboxedPluginInstance::readParameterValues (InputStream& in)
+{
+	const ScopedLock sl (parameterLock);
+	parameterValues.clearQuick();
+
+	for (int num = in.readInt(); --num >= 0;)
+		parameterValues.add (in.readFloat());
+}
+
+//==============================================================================
+void SandboxedPluginInstance::fillInPluginDescription (PluginDescription& desc) const
+{
+	desc = description;
+}
+
+const String SandboxedPluginInstance::getName() const
+{
+	return name;
+}
+
+void SandboxedPluginInstance::prepareToPlay (double newSampleRate, int estimatedSamplesPerBlock)
+{
+	const ScopedLock sl (connectionLock);
+
+	const File oldFile (sharedMemoryFile);
+	const int blockSize = jmax (16, estimatedSamplesPerBlock);
+
+	if (sharedMemory == nullptr || blockSize > sharedBlockSize)
+		if (! createSharedMemory (blockSize))
+			sharedMemory = nullptr;
+
+	if (sharedMemory == nullptr)
+		return;
+
+	MemoryOutputStream args;
+	args.writeDouble (newSampleRate);
+	args.writeInt (estimatedSamplesPerBlock);
+	args.writeBool (isNonRealtime());
+	args.writeString (sharedMemoryFile.getFullPathName());
+	args.writeInt (sharedNumChannels);
+	args.writeInt (sharedBlockSize);
+
+	MemoryBlock result;
+
+	if (transact (SandboxHelpers::prepareMessage, args, &result))
+	{
+		MemoryInputStream in (result, false);
+
+		if (! in.readBool())
+			sharedMemory = nullptr;  // (the sandbox couldn't map it)
+
+		setLatencySamples (in.readInt());
+		readChannelInfo (in);
+
+		// if this fails, the plugin's channel layout has grown since it was loaded..
+		jassert (jmax (getNumInputChannels(), getNumOutputChannels()) <= sharedNumChannels);
+	}
+
+	setPlayConfigDetails (getNumInputChannels(), getNumOutputChannels(), newSampleRate, estimatedSamplesPerBlock);
+
+	// (the sandbox has switched over to the new block of memory by now)
+	if (oldFile != sharedMemoryFile)
+		oldFile.deleteFile();
+
+	midiOut.ensureSize (SandboxHelpers::midiDataSize);
+}
+
+void SandboxedPluginInstance::releaseResources()
+{
+	const ScopedLock sl (connectionLock);
+	transact (SandboxHelpers::releaseMessage, MemoryOutputStream(), nullptr);
+}
+
+void SandboxedPluginInstance::reset()
+{
+	const ScopedLock sl (connectionLock);
+	transact (SandboxHelpers::resetMessage, MemoryOutputStream(), nullptr);
+}
+
+void SandboxedPluginInstance::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
+{
+	const int numSamples = buffer.getNumSamples();
+
+	// If another thread is in the middle of a request, this block can't wait for it.
+	const ScopedTryLock sl (connectionLock);
+
+	if (sl.isLocked() && sharedMemory != nullptr && ! crashed)
+	{
+		midiOut.clear();
+
+		for (int pos = 0; pos < numSamples && ! crashed;)
+		{
+			const int numThisTime = jmin (sharedBlockSize, numSamples - pos);
+
+			if (! processChunk (buffer, pos, numThisTime, midiMessages))
+				break;
+
+			pos += numThisTime;
+		}
+
+		if (! crashed)
+		{
+			midiMessages.swapWith (midiOut);
+			return;
+		}
+	}
+
+	for (int i = 0; i < getNumOutputChannels(); ++i)
+		buffer.clear (i, 0, numSamples);
+
+	midiMessages.clear();
+}
+
+bool SandboxedPluginInstance::processChunk (AudioSampleBuffer& buffer, const int startSample,
+											const int numSamples, const MidiBuffer& midiIn)
+{
+	using namespace SandboxHelpers;
+
+	char* const shared = static_cast <char*> (sharedMemory->getData());
+	char* const midiData = shared + getMidiOffset (sharedNumChannels, sharedBlockSize);
+	SharedHeader& header = *reinterpret_cast <SharedHeader*> (shared);
+
+	header.numSamples = numSamples;
+	header.numMidiInBytes = writeMidi (midiData, midiIn, startSample, numSamples);
+	header.numMidiOutBytes = 0;
+
+	AudioPlayHead* const playHead = getPlayHead();
+	header.hasPosition = playHead != nullptr && playHead->getCurrentPosition (header.position);
+
+	const int numIns  = jmin (getNumInputChannels(),  buffer.getNumChannels());
+	const int numOuts = jmin (getNumOutputChannels(), buffer.getNumChannels(), sharedNumChannels);
+
+	for (int i = 0; i < sharedNumChannels; ++i)
+	{
+		float* const dest = getChannel (shared, i, sharedBlockSize);
+
+		if (i < numIns)
+			memcpy (dest, buffer.getSampleData (i, startSample), sizeof (float) * (size_t) numSamples);
+		else
+			zeromem (dest, sizeof (float) * (size_t) numSamples);
+	}
+
+	if (! transact (processMessage, nullptr, 0, isNonRealtime() ? timeoutMs : jmin (timeoutMs, 1000), nullptr))
+		return false;
+
+	for (int i = 0; i < numOuts; ++i)
+		buffer.copyFrom (i, startSample, getChannel (shared, i, sharedBlockSize), numSamples);
+
+	// (if the sandbox has written junk into the shared memory, it can't be trusted any more)
+	if (! readMidi (midiData + midiDataSize, jmin ((int) midiDataSize, header.numMidiOutBytes), midiOut, startSample))
+	{
+		sandboxFailed();
+		return false;
+	}
+
+	return true;
+}
+
+//==============================================================================
+const String SandboxedPluginInstance::getInputChannelName (int index) const
+{
+	return inputChannelNames [index];
+}
+
+const String SandboxedPluginInstance::getOutputChannelName (int index) const
+{
+	return outputChannelNames [index];
+}
+
+bool SandboxedPluginInstance::isInputChannelStereoPair (int index) const
+{
+	return inputStereoPairs [index];
+}
+
+bool SandboxedPluginInstance::isOutputChannelStereoPair (int index) const
+{
+	return outputStereoPairs [index];
+}
+
+bool SandboxedPluginInstance::acceptsMidi() const     { return wantsMidi; }
+bool SandboxedPluginInstance::producesMidi() const    { return makesMidi; }
+
+AudioProcessorEditor* SandboxedPluginInstance::createEditor()
+{
+	return new GenericAudioProcessorEditor (this);
+}
+
+bool SandboxedPluginInstance::hasEditor() const
+{
+	return true;
+}
+
+//==============================================================================
+int SandboxedPluginInstance::getNumParameters()
+{
+	return parameterNames.size();
+}
+
+const String SandboxedPluginInstance::getParameterName (int index)
+{
+	return parameterNames [index];
+}
+
+float SandboxedPluginInstance::getParameter (int index)
+{
+	const ScopedLock sl (parameterLock);
+	return parameterValues [index];
+}
+
+void SandboxedPluginInstance::setParameter (int index, float newValue)
+{
+	const ScopedLock sl (parameterLock);
+
+	if (isPositiveAndBelow (index, parameterValues.size()))
+	{
+		parameterValues.set (index, newValue);
+
+		// The change gets sent along with the next request, which will normally be the next block.
+		for (int i = pendingParameterChanges.size(); --i >= 0;)
+		{
+			ParameterChange& change = pendingParameterChanges.getReference (i);
+
+			if (change.index == index)
+			{
+				change.value = newValue;
+				return;
+			}
+		}
+
+		const ParameterChange change = { index, newValue };
+		pendingParameterChanges.add (change);
+	}
+}
+
+const String SandboxedPluginInstance::getParameterText (int index)
+{
+	MemoryOutputStream args;
+	args.writeInt (index);
+
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (transact (SandboxHelpers::getParameterTextMessage, args, &result))
+		return MemoryInputStream (result, false).readString();
+
+	return String (getParameter (index), 2);
+}
+
+//==============================================================================
+int SandboxedPluginInstance::getNumPrograms()
+{
+	return numPrograms;
+}
+
+int SandboxedPluginInstance::getCurrentProgram()
+{
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (transact (SandboxHelpers::getCurrentProgramMessage, MemoryOutputStream(), &result))
+		return MemoryInputStream (result, false).readInt();
+
+	return 0;
+}
+
+void SandboxedPluginInstance::setCurrentProgram (int index)
+{
+	MemoryOutputStream args;
+	args.writeInt (index);
+
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (transact (SandboxHelpers::setCurrentProgramMessage, args, &result))
+	{
+		MemoryInputStream in (result, false);
+		readParameterValues (in);
+		updateHostDisplay();
+	}
+}
+
+const String SandboxedPluginInstance::getProgramName (int index)
+{
+	MemoryOutputStream args;
+	args.writeInt (index);
+
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (transact (SandboxHelpers::getProgramNameMessage, args, &result))
+		return MemoryInputStream (result, false).readString();
+
+	return String::empty;
+}
+
+void SandboxedPluginInstance::changeProgramName (int index, const String& newName)
+{
+	MemoryOutputStream args;
+	args.writeInt (index);
+	args.writeString (newName);
+
+	const ScopedLock sl (connectionLock);
+	transact (SandboxHelpers::changeProgramNameMessage, args, nullptr);
+}
+
+//==============================================================================
+void SandboxedPluginInstance::getStateInformation (MemoryBlock& destData)
+{
+	MemoryOutputStream args;
+	args.writeBool (false);
+
+	const ScopedLock sl (connectionLock);
+
+	if (! transact (SandboxHelpers::getStateMessage, args, &destData))
+		destData.setSize (0);
+}
+
+void SandboxedPluginInstance::getCurrentProgramStateInformation (MemoryBlock& destData)
+{
+	MemoryOutputStream args;
+	args.writeBool (true);
+
+	const ScopedLock sl (connectionLock);
+
+	if (! transact (SandboxHelpers::getStateMessage, args, &destData))
+		destData.setSize (0);
+}
+
+void SandboxedPluginInstance::setStateInformation (const void* data, int sizeInBytes)
+{
+	MemoryOutputStream args;
+	args.writeBool (false);
+	args.write (data, sizeInBytes);
+
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (transact (SandboxHelpers::setStateMessage, args, &result))
+	{
+		MemoryInputStream in (result, false);
+		readParameterValues (in);
+	}
+}
+
+void SandboxedPluginInstance::setCurrentProgramStateInformation (const void* data, int sizeInBytes)
+{
+	MemoryOutputStream args;
+	args.writeBool (true);
+	args.write (data, sizeInBytes);
+
+	MemoryBlock result;
+	const ScopedLock sl (connectionLock);
+
+	if (transact (SandboxHelpers::setStateMessage, args, &result))
+	{
+		MemoryInputStream in (result, false);
+		readParameterValues (in);
+	}
+}
+
+//==============================================================================
+bool SandboxedPluginInstance::performHostingIfRequested (const String& commandLine)
+{
+	StringArray args;
+	args.addTokens (commandLine, true);
+	args.removeEmptyStrings();
+
+	for (int i = 0; i < args.size(); ++i)
+		args.set (i, args[i].unquoted());
+
+	const int flagIndex = args.indexOf (SandboxHelpers::sandboxFlag);
+
+	if (flagIndex < 0)
+		return false;
+
+	PluginServer server;
+
+	if (server.connect (args [flagIndex + 1].getIntValue(), args [flagIndex + 2]))
+		server.run();
+
+	return true;
+}
+
+#if JUCE_UNIT_TESTS && (JUCE_LINUX || JUCE_MAC)
+
+class SandboxedPluginInstanceTests  : public UnitTest
+{
+public:
+	SandboxedPluginInstanceTests() : UnitTest ("SandboxedPluginInstance") {}
+
+	enum { testBlockSize = 512, numBenchmarkBlocks = 200 };
+
+	// Applies a gain, and echoes each incoming note an octave higher.
+	class TestPlugin  : public AudioPluginInstance
 	{
-		owner.removeListener (this);
-	}
+	public:
+		TestPlugin() : gain (0.5f)        { setPlayConfigDetails (2, 2, 44100.0, testBlockSize); }
+
+		void fillInPluginDescription (PluginDescription& d) const   { d = createDescription(); }
+		const String getName() const                                { return "Sandbox test"; }
+		void prepareToPlay (double, int)                            {}
+		void releaseResources()                                     {}
+
+		void processBlock (AudioSampleBuffer& buffer, MidiBuffer& midi)
+		{
+			buffer.applyGain (0, buffer.getNumSamples(), gain);
+
+			MidiBuffer output;
+			MidiBuffer::Iterator iter (midi);
+			MidiMessage m;
+			int pos;
+
+			while (iter.getNextEvent (m, pos))
+				if (m.isNoteOn())
+					output.addEvent (MidiMessage::noteOn (m.getChannel(), m.getNoteNumber() + 12, m.getVelocity()), pos);
+
+			midi.swapWith (output);
+		}
+
+		const String getInputChannelName (int) const                { return String::empty; }
+		const String getOutputChannelName (int) const               { return String::empty; }
+		bool isInputChannelStereoPair (int) const                   { return true; }
+		bool isOutputChannelStereoPair (int) const                  { return true; }
+		bool acceptsMidi() const                                    { return true; }
+		bool producesMidi() const                                   { return true; }
+		AudioProcessorEditor* createEditor()                        { return nullptr; }
+		bool hasEditor() const                                      { return false; }
+		int getNumParameters()                                      { return 1; }
+		const String getParameterName (int)                         { return "Gain"; }
+		float getParameter (int)                                    { return gain; }
+		const String getParameterText (int)                         { return String (gain); }
+		void setParameter (int, float newValue)                     { gain = newValue; }
+		int getNumPrograms()                                        { return 1; }
+		int getCurrentProgram()                                     { return 0; }
+		void setCurrentProgram (int)                                {}
+		const String getProgramName (int)                           { return String::empty; }
+		void changeProgramName (int, const String&)                 {}
+		void getStateInformation (MemoryBlock&)                     {}
+		void setStateInformation (const void*, int)                 {}
+
+		float gain;
+	};
 
-	void refresh()
+	class TestFormat  : public AudioPluginFormat
 	{
-		paramHasChanged = false;
-		slider.setValue (owner.getParameter (index), false);
-	}
+	public:
+		String getName() const                                                          { return "SandboxTest"; }
+		void findAllTypesForFile (OwnedArray <PluginDescription>&, const String&)       {}
+		bool fileMightContainThisPluginType (const String&)                             { return false; }
+		String getNameOfPluginFromIdentifier (const String& f)                          { return f; }
+		bool doesPluginStillExist (const PluginDescription&)                            { return true; }
+		StringArray searchPathsForPlugins (const FileSearchPath&, bool)                 { return StringArray(); }
+		FileSearchPath getDefaultLocationsToSearch()                                    { return FileSearchPath(); }
 
-	void audioProcessorChanged (AudioProcessor*)  {}
+		AudioPluginInstance* createInstanceFromDescription (const PluginDescription& desc)
+		{
+			return desc.pluginFormatName == getName() ? new TestPlugin() : nullptr;
+		}
+	};
 
-	void audioProcessorParameterChanged (AudioProcessor*, int parameterIndex, float)
+	static PluginDescription createDescription()
 	{
-		if (parameterIndex == index)
-			paramHasChanged = true;
+		PluginDescription desc;
+		desc.name = "Sandbox test";
+		desc.pluginFormatName = "SandboxTest";
+		desc.fileOrIdentifier = "SandboxTest";
+		desc.numInputChannels = 2;
+		desc.numOutputChannels = 2;
+		return desc;
 	}
 
-	void timerCallback()
+	/* Rather than launching another copy of the app, the sandbox "process" is a script that
+	   just writes down the arguments it was given, and the server is run on a thread here.
+	   The script waits until the server has taken its arguments, and then quits.
+	*/
+	class ServerThread  : public Thread
 	{
-		if (paramHasChanged)
+	public:
+		ServerThread (const File& argsFile_)
+			: Thread ("Sandbox test server"), argsFile (argsFile_)
 		{
-			refresh();
-			startTimer (1000 / 50);
 		}
-		else
+
+		void run()
 		{
-			startTimer (jmin (1000 / 4, getTimerInterval() + 10));
+			const uint32 timeout = Time::getMillisecondCounter() + 10000;
+
+			while (! argsFile.existsAsFile())
+			{
+				if (threadShouldExit() || Time::getMillisecondCounter() > timeout)
+					return;
+
+				Thread::sleep (5);
+			}
+
+			const String args (argsFile.loadFileAsString());
+			argsFile.deleteFile();
+
+			SandboxedPluginInstance::performHostingIfRequested (args);
 		}
-	}
 
-private:
+	private:
+		const File argsFile;
+	};
 
-	class ParamSlider  : public Slider
+	static void fillBlock (AudioSampleBuffer& buffer, MidiBuffer& midi)
 	{
-	public:
-		ParamSlider (AudioProcessor& owner_, const int index_)
-			: owner (owner_),
-			  index (index_)
+		for (int i = 0; i < buffer.getNumSamples(); ++i)
 		{
-			setRange (0.0, 1.0, 0.0);
-			setSliderStyle (Slider::LinearBar);
-			setTextBoxIsEditable (false);
-			setScrollWheelEnabled (false);
+			*buffer.getSampleData (0, i) = (float) std::sin (i * 0.1);
+			*buffer.getSampleData (1, i) = (float) std::cos (i * 0.1);
 		}
 
-		void valueChanged()
-		{
-			const float newVal = (float) getValue();
+		midi.clear();
+		midi.addEvent (MidiMessage::noteOn (1, 60, (uint8) 100), 0);
+		midi.addEvent (MidiMessage::noteOn (1, 64, (uint8) 100), 100);
+		midi.addEvent (MidiMessage::noteOff (1, 60), 200);
+		midi.addEvent (MidiMessage::noteOn (2, 67, (uint8) 100), testBlockSize - 1);
+	}
 
-			if (owner.getParameter (index) != newVal)
-				owner.setParameter (index, newVal);
-		}
+	static bool midiBuffersMatch (const MidiBuffer& a, const MidiBuffer& b)
+	{
+		MidiBuffer::Iterator i1 (a), i2 (b);
+		const uint8 *d1, *d2;
+		int n1, n2, p1, p2;
 
-		String getTextFromValue (double /*value*/)
+		for (;;)
 		{
-			return owner.getParameterText (index);
+			const bool more1 = i1.getNextEvent (d1, n1, p1);
+			const bool more2 = i2.getNextEvent (d2, n2, p2);
+
+			if (more1 != more2)
+				return false;
+
+			if (! more1)
+				return true;
+
+			if (n1 != n2 || p1 != p2 || memcmp (d1, d2, (size_t) n1) != 0)
+				return false;
 		}
+	}
 
-	private:
+	void expectSameBlock (AudioPluginInstance& local, AudioPluginInstance& sandboxed)
+	{
+		AudioSampleBuffer localBuffer (2, testBlockSize), sandboxedBuffer (2, testBlockSize);
+		MidiBuffer localMidi, sandboxedMidi;
 
-		AudioProcessor& owner;
-		const int index;
+		fillBlock (localBuffer, localMidi);
+		fillBlock (sandboxedBuffer, sandboxedMidi);
 
-		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParamSlider);
-	};
+		local.processBlock (localBuffer, localMidi);
+		sandboxed.processBlock (sandboxedBuffer, sandboxedMidi);
 
-	AudioProcessor& owner;
-	const int index;
-	bool volatile paramHasChanged;
-	ParamSlider slider;
+		for (int chan = 0; chan < 2; ++chan)
+			expect (memcmp (localBuffer.getSampleData (chan), sandboxedBuffer.getSampleData (chan),
+							sizeof (float) * testBlockSize) == 0);
 
-	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ProcessorParameterPropertyComp);
-};
+		expectEquals (sandboxedMidi.getNumEvents(), 3);
+		expect (midiBuffersMatch (localMidi, sandboxedMidi));
+	}
 
-GenericAudioProcessorEditor::GenericAudioProcessorEditor (AudioProcessor* const owner_)
-	: AudioProcessorEditor (owner_)
-{
-	jassert (owner_ != nullptr);
-	setOpaque (true);
+	double timeBlocks (AudioPluginInstance& plugin)
+	{
+		AudioSampleBuffer buffer (2, testBlockSize);
+		MidiBuffer midi;
 
-	addAndMakeVisible (&panel);
+		const double start = Time::getMillisecondCounterHiRes();
 
-	Array <PropertyComponent*> params;
+		for (int i = 0; i < numBenchmarkBlocks; ++i)
+		{
+			fillBlock (buffer, midi);
+			plugin.processBlock (buffer, midi);
+		}
 
-	const int numParams = owner_->getNumParameters();
-	int totalHeight = 0;
+		return (Time::getMillisecondCounterHiRes() - start) * 1000.0 / numBenchmarkBlocks;
+	}
 
-	for (int i = 0; i < numParams; ++i)
+	void runTest()
 	{
-		String name (owner_->getParameterName (i));
-		if (name.trim().isEmpty())
-			name = "Unnamed";
+		beginTest ("Reading damaged MIDI");
 
-		ProcessorParameterPropertyComp* const pc = new ProcessorParameterPropertyComp (name, *owner_, i);
-		params.add (pc);
-		totalHeight += pc->getPreferredHeight();
-	}
+		{
+			MidiBuffer source, result;
+			source.addEvent (MidiMessage::noteOn (1, 60, (uint8) 100), 10);
+			source.addEvent (MidiMessage::noteOn (1, 64, (uint8) 100), 20);
 
-	panel.addProperties (params);
+			char data [64];
+			const int size = SandboxHelpers::writeMidi (data, source, 0, testBlockSize);
 
-	setSize (400, jlimit (25, 400, totalHeight));
-}
+			expect (SandboxHelpers::readMidi (data, size, result, 0));
+			expect (midiBuffersMatch (source, result));
 
-GenericAudioProcessorEditor::~GenericAudioProcessorEditor()
-{
-}
+			const int recordSize = size / 2;
+			int& secondEventSize = reinterpret_cast <int*> (data + recordSize)[1];
+			const int originalSize = secondEventSize;
 
-void GenericAudioProcessorEditor::paint (Graphics& g)
-{
-	g.fillAll (Colours::white);
-}
+			const int badSizes[] = { 0, -3, 4, 0x7fffffff };
 
-void GenericAudioProcessorEditor::resized()
-{
-	panel.setBounds (getLocalBounds());
-}
+			for (int i = 0; i < numElementsInArray (badSizes); ++i)
+			{
+				secondEventSize = badSizes[i];
+				result.clear();
 
-/*** End of inlined file: juce_GenericAudioProcessorEditor.cpp ***/
+				// (the first event is fine, so that one still gets through)
+				expect (! SandboxHelpers::readMidi (data, size, result, 0));
+				expectEquals (result.getNumEvents(), 1);
+			}
 
+			secondEventSize = originalSize;
+			result.clear();
+			expect (! SandboxHelpers::readMidi (data, size - 1, result, 0));
+			expect (! SandboxHelpers::readMidi (data, recordSize + 5, result, 0));
+		}
 
-/*** Start of inlined file: juce_PluginDescription.cpp ***/
-PluginDescription::PluginDescription()
-	: uid (0),
-	  isInstrument (false),
-	  numInputChannels (0),
-	  numOutputChannels (0)
-{
-}
+		beginTest ("Running a block in-process and in the sandbox");
 
-PluginDescription::~PluginDescription()
-{
-}
+		{
+			static bool formatAdded = false;
 
-PluginDescription::PluginDescription (const PluginDescription& other)
-	: name (other.name),
-	  descriptiveName (other.descriptiveName),
-	  pluginFormatName (other.pluginFormatName),
-	  category (other.category),
-	  manufacturerName (other.manufacturerName),
-	  version (other.version),
-	  fileOrIdentifier (other.fileOrIdentifier),
-	  lastFileModTime (other.lastFileModTime),
-	  uid (other.uid),
-	  isInstrument (other.isInstrument),
-	  numInputChannels (other.numInputChannels),
-	  numOutputChannels (other.numOutputChannels)
-{
-}
+			if (! formatAdded)
+			{
+				AudioPluginFormatManager::getInstance()->addFormat (new TestFormat());
+				formatAdded = true;
+			}
 
-PluginDescription& PluginDescription::operator= (const PluginDescription& other)
-{
-	name = other.name;
-	descriptiveName = other.descriptiveName;
-	pluginFormatName = other.pluginFormatName;
-	category = other.category;
-	manufacturerName = other.manufacturerName;
-	version = other.version;
-	fileOrIdentifier = other.fileOrIdentifier;
-	uid = other.uid;
-	isInstrument = other.isInstrument;
-	lastFileModTime = other.lastFileModTime;
-	numInputChannels = other.numInputChannels;
-	numOutputChannels = other.numOutputChannels;
+			const File dir (File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("juce_SandboxTest", String::empty, false));
+			dir.createDirectory();
 
-	return *this;
-}
+			const File script (dir.getChildFile ("sandbox.sh"));
+			const File argsFile (dir.getChildFile ("args.txt"));
 
-bool PluginDescription::isDuplicateOf (const PluginDescription& other) const
-{
-	return fileOrIdentifier == other.fileOrIdentifier
-			&& uid == other.uid;
-}
+			// (written as raw data, because replaceWithText() would add carriage-returns)
+			const String scriptText ("echo \"$@\" > " + argsFile.getFullPathName().quoted() + ".tmp\n"
+									 "mv " + argsFile.getFullPathName().quoted() + ".tmp " + argsFile.getFullPathName().quoted() + "\n"
+									 "while [ -f " + argsFile.getFullPathName().quoted() + " ]; do sleep 0.05; done\n");
 
-String PluginDescription::createIdentifierString() const
-{
-	return pluginFormatName
-			+ "-" + name
-			+ "-" + String::toHexString (fileOrIdentifier.hashCode())
-			+ "-" + String::toHexString (uid);
-}
+			script.replaceWithData (scriptText.toUTF8(), scriptText.getNumBytesAsUTF8());
 
-XmlElement* PluginDescription::createXml() const
-{
-	XmlElement* const e = new XmlElement ("PLUGIN");
-	e->setAttribute ("name", name);
-	if (descriptiveName != name)
-		e->setAttribute ("descriptiveName", descriptiveName);
+			ServerThread server (argsFile);
+			server.startThread();
 
-	e->setAttribute ("format", pluginFormatName);
-	e->setAttribute ("category", category);
-	e->setAttribute ("manufacturer", manufacturerName);
-	e->setAttribute ("version", version);
-	e->setAttribute ("file", fileOrIdentifier);
-	e->setAttribute ("uid", String::toHexString (uid));
-	e->setAttribute ("isInstrument", isInstrument);
-	e->setAttribute ("fileTime", String::toHexString (lastFileModTime.toMilliseconds()));
-	e->setAttribute ("numInputs", numInputChannels);
-	e->setAttribute ("numOutputs", numOutputChannels);
+			String error;
+			ScopedPointer<SandboxedPluginInstance> sandboxed (SandboxedPluginInstance::createInstance (createDescription(),
+																									  "/bin/sh " + script.getFullPathName().quoted(),
+																									  error, 5000));
+			expect (sandboxed != nullptr, error);
 
-	return e;
-}
+			if (sandboxed != nullptr)
+			{
+				TestPlugin local;
 
-bool PluginDescription::loadFromXml (const XmlElement& xml)
-{
-	if (xml.hasTagName ("PLUGIN"))
-	{
-		name                = xml.getStringAttribute ("name");
-		descriptiveName     = xml.getStringAttribute ("descriptiveName", name);
-		pluginFormatName    = xml.getStringAttribute ("format");
-		category            = xml.getStringAttribute ("category");
-		manufacturerName    = xml.getStringAttribute ("manufacturer");
-		version             = xml.getStringAttribute ("version");
-		fileOrIdentifier    = xml.getStringAttribute ("file");
-		uid                 = xml.getStringAttribute ("uid").getHexValue32();
-		isInstrument        = xml.getBoolAttribute ("isInstrument", false);
-		lastFileModTime     = Time (xml.getStringAttribute ("fileTime").getHexValue64());
-		numInputChannels    = xml.getIntAttribute ("numInputs");
-		numOutputChannels   = xml.getIntAttribute ("numOutputs");
+				expectEquals (sandboxed->getName(), local.getName());
+				expectEquals (sandboxed->getNumParameters(), 1);
+				expect (sandboxed->acceptsMidi() && sandboxed->producesMidi());
 
-		return true;
+				local.prepareToPlay (44100.0, testBlockSize);
+				sandboxed->prepareToPlay (44100.0, testBlockSize);
+
+				expectSameBlock (local, *sandboxed);
+
+				// (parameter changes get sent along with the next block)
+				local.setParameter (0, 0.25f);
+				sandboxed->setParameter (0, 0.25f);
+				expectSameBlock (local, *sandboxed);
+				expectEquals (sandboxed->getParameter (0), 0.25f);
+
+				const double localTime = timeBlocks (local);
+				const double sandboxedTime = timeBlocks (*sandboxed);
+
+				logMessage ("Microseconds per " + String ((int) testBlockSize) + "-sample block: in-process "
+							 + String (localTime, 1) + ", sandboxed " + String (sandboxedTime, 1));
+
+				expect (! sandboxed->hasCrashed());
+				sandboxed = nullptr;
+			}
+
+			expect (server.waitForThreadToExit (5000));
+			server.stopThread (1000);
+			dir.deleteRecursively();
+		}
 	}
+};
 
-	return false;
-}
+static SandboxedPluginInstanceTests sandboxedPluginInstanceTests;
 
-/*** End of inlined file: juce_PluginDescription.cpp ***/
+#endif
+
+/*** End of inlined file: juce_SandboxedPluginInstance.cpp ***/
 
 
 /*** Start of inlined file: juce_VSTPluginFormat.cpp ***/
@@ -3135,8 +5560,31 @@ public:
 		return activeModules;
 	}
 
-	static ModuleHandle* findOrCreateModule (const File& file)
+	// (modules can be preloaded on background threads, so the list needs a lock)
+	static CriticalSection& getActiveModulesLock()
+	{
+		static CriticalSection lock;
+		return lock;
+	}
+
+	typedef ReferenceCountedObjectPtr <ModuleHandle> Ptr;
+
+	// This hides ReferenceCountedObject::decReferenceCount() from Ptr, so that a module's
+	// count can only reach zero while the list is locked, and it's taken out of the list
+	// (by the destructor) before the lock is released. That stops findModule() from
+	// taking a new reference to a module that's already being deleted.
+	void decReferenceCount() noexcept
+	{
+		const ScopedLock sl (getActiveModulesLock());
+		ReferenceCountedObject::decReferenceCount();
+	}
+
+	// The reference is taken while the list is locked, so that another thread can't
+	// delete the module in between finding it and using it.
+	static Ptr findModule (const File& file)
 	{
+		const ScopedLock sl (getActiveModulesLock());
+
 		for (int i = getActiveModules().size(); --i >= 0;)
 		{
 			ModuleHandle* const module = getActiveModules().getUnchecked(i);
@@ -3145,23 +5593,68 @@ public:
 				return module;
 		}
 
+		return nullptr;
+	}
+
+	static Ptr findOrCreateModule (const File& file)
+	{
+		// (the lock is held until the new module is in the list, so that another thread
+		// can't load a second copy of the same file in the meantime)
+		const ScopedLock sl (getActiveModulesLock());
+		const Ptr existing (findModule (file));
+
+		if (existing != nullptr)
+			return existing;
+
 		_fpreset(); // (doesn't do any harm)
 
 		const IdleCallRecursionPreventer icrp;
 		shellUIDToCreate = 0;
 
-		log ("Attempting to load VST: " + file.getFullPathName());
+		log ("Attempting to load VST: " + file.getFullPathName());
+
+		Ptr m (new ModuleHandle (file));
+
+		if (m->open())
+			m->addToActiveModules();
+		else
+			m = nullptr;
+
+		_fpreset(); // (doesn't do any harm)
+
+		return m;
+	}
+
+   #if JUCE_WINDOWS || JUCE_LINUX
+	// Loads a module without touching any of the globals that are used while creating
+	// an instance, so that this can be called on a background thread.
+	static Ptr preloadModule (const File& file)
+	{
+		const ScopedLock sl (getActiveModulesLock());
+		const Ptr existing (findModule (file));
+
+		if (existing != nullptr)
+			return existing;
 
-		ScopedPointer <ModuleHandle> m (new ModuleHandle (file));
+		Ptr m (new ModuleHandle (file));
 
 		if (! m->open())
-			m = nullptr;
-
-		_fpreset(); // (doesn't do any harm)
+			return nullptr;
 
-		return m.release();
+		m->addToActiveModules();
+		return m;
 	}
 
+	// A preloaded module is handed out as a plain ReferenceCountedObject, which would
+	// bypass the locked decReferenceCount() above, so it gets wrapped in one of these.
+	struct PreloadedModule  : public ReferenceCountedObject
+	{
+		PreloadedModule (const Ptr& module_) : module (module_) {}
+
+		const Ptr module;
+	};
+   #endif
+
 	ModuleHandle (const File& file_)
 		: file (file_),
 		  moduleMain (0)
@@ -3169,8 +5662,6 @@ public:
 		  , fragId (0), resHandle (0), bundleRef (0), resFileId (0)
 		 #endif
 	{
-		getActiveModules().add (this);
-
 	   #if JUCE_WINDOWS || JUCE_LINUX
 		fullParentDirectoryPathName = file_.getParentDirectory().getFullPathName();
 	   #elif JUCE_MAC
@@ -3182,10 +5673,20 @@ public:
 
 	~ModuleHandle()
 	{
-		getActiveModules().removeValue (this);
+		{
+			const ScopedLock sl (getActiveModulesLock());
+			getActiveModules().removeValue (this);
+		}
+
 		close();
 	}
 
+	void addToActiveModules()
+	{
+		const ScopedLock sl (getActiveModulesLock());
+		getActiveModules().add (this);
+	}
+
 #if JUCE_WINDOWS || JUCE_LINUX
 	DynamicLibrary module;
 	String fullParentDirectoryPathName;
@@ -5547,7 +8048,7 @@ AudioPluginInstance* VSTPluginFormat::createInstanceFromDescription (const Plugi
 		const File previousWorkingDirectory (File::getCurrentWorkingDirectory());
 		file.getParentDirectory().setAsCurrentWorkingDirectory();
 
-		const ReferenceCountedObjectPtr <ModuleHandle> module (ModuleHandle::findOrCreateModule (file));
+		const ModuleHandle::Ptr module (ModuleHandle::findOrCreateModule (file));
 
 		if (module != nullptr)
 		{
@@ -5572,6 +8073,23 @@ AudioPluginInstance* VSTPluginFormat::createInstanceFromDescription (const Plugi
 	return result.release();
 }
 
+ReferenceCountedObjectPtr <ReferenceCountedObject> VSTPluginFormat::preloadPluginBinary (const PluginDescription& desc)
+{
+   #if JUCE_WINDOWS || JUCE_LINUX
+	if (fileMightContainThisPluginType (desc.fileOrIdentifier))
+	{
+		const ModuleHandle::Ptr module (ModuleHandle::preloadModule (File (desc.fileOrIdentifier)));
+
+		if (module != nullptr)
+			return new ModuleHandle::PreloadedModule (module);
+	}
+   #else
+	(void) desc; // (on the Mac, opening a VST needs calls that aren't safe on other threads)
+   #endif
+
+	return nullptr;
+}
+
 bool VSTPluginFormat::fileMightContainThisPluginType (const String& fileOrIdentifier)
 {
 	const File f (fileOrIdentifier);
@@ -7091,7 +9609,87 @@ FileSearchPath AudioUnitPluginFormat::getDefaultLocationsToSearch()
 
 
 /*** Start of inlined file: juce_KnownPluginList.cpp ***/
-KnownPluginList::KnownPluginList()  {}
+namespace
+{
+	Time getPluginFileModTime (const String& fileOrIdentifier)
+	{
+		if (fileOrIdentifier.startsWithChar ('/') || fileOrIdentifier[1] == ':')
+			return File (fileOrIdentifier).getLastModificationTime();
+
+		return Time();
+	}
+
+	bool timesAreDifferent (const Time& t1, const Time& t2) noexcept
+	{
+		return t1 != t2 || t1 == Time();
+	}
+
+	enum { menuIdBase = 0x324503f4 };
+
+	// The cache file is a header followed by a journal of changes, each of which is
+	// stored as a record type byte, a payload size, and then the payload itself.
+	const int cacheFileMagic = (int) ByteOrder::littleEndianInt ("KPLc");
+
+	enum
+	{
+		cacheFileVersion = 1,
+		cacheHeaderSize = 8,
+		cacheRecordHeaderSize = 5
+	};
+
+	enum CacheRecordType
+	{
+		typeAddedRecord = 1,
+		typeRemovedRecord,
+		blacklistAddedRecord,
+		blacklistRemovedRecord
+	};
+
+	void writeDescription (OutputStream& out, const PluginDescription& d)
+	{
+		out.writeString (d.name);
+		out.writeString (d.descriptiveName);
+		out.writeString (d.pluginFormatName);
+		out.writeString (d.category);
+		out.writeString (d.manufacturerName);
+		out.writeString (d.version);
+		out.writeString (d.fileOrIdentifier);
+		out.writeInt (d.uid);
+		out.writeBool (d.isInstrument);
+		out.writeInt64 (d.lastFileModTime.toMilliseconds());
+		out.writeInt (d.numInputChannels);
+		out.writeInt (d.numOutputChannels);
+	}
+
+	void readDescription (InputStream& in, PluginDescription& d)
+	{
+		d.name              = in.readString();
+		d.descriptiveName   = in.readString();
+		d.pluginFormatName  = in.readString();
+		d.category          = in.readString();
+		d.manufacturerName  = in.readString();
+		d.version           = in.readString();
+		d.fileOrIdentifier  = in.readString();
+		d.uid               = in.readInt();
+		d.isInstrument      = in.readBool();
+		d.lastFileModTime   = Time (in.readInt64());
+		d.numInputChannels  = in.readInt();
+		d.numOutputChannels = in.readInt();
+	}
+
+	void writeRecord (OutputStream& out, const int recordType, const MemoryOutputStream& payload)
+	{
+		out.writeByte ((char) recordType);
+		out.writeInt ((int) payload.getDataSize());
+		out.write (payload.getData(), (int) payload.getDataSize());
+	}
+}
+
+KnownPluginList::KnownPluginList()
+	: numCacheRecords (0)
+{
+}
+
 KnownPluginList::~KnownPluginList() {}
 
 void KnownPluginList::clear()
@@ -7099,87 +9697,115 @@ void KnownPluginList::clear()
 	if (types.size() > 0)
 	{
 		types.clear();
+		typesByFile.clear();
+		typesByIdentifier.clear();
+
+		writeCache();
 		sendChangeMessage();
 	}
 }
 
 PluginDescription* KnownPluginList::getTypeForFile (const String& fileOrIdentifier) const
 {
-	for (int i = 0; i < types.size(); ++i)
-		if (types.getUnchecked(i)->fileOrIdentifier == fileOrIdentifier)
-			return types.getUnchecked(i);
-
-	return nullptr;
+	return typesByFile [fileOrIdentifier].getFirst();
 }
 
 PluginDescription* KnownPluginList::getTypeForIdentifierString (const String& identifierString) const
 {
-	for (int i = 0; i < types.size(); ++i)
-		if (types.getUnchecked(i)->createIdentifierString() == identifierString)
-			return types.getUnchecked(i);
+	return typesByIdentifier [identifierString];
+}
+
+bool KnownPluginList::addType (const PluginDescription& type)
+{
+	const bool isNew = addTypeWithoutNotifying (type);
+
+	appendToCache (typeAddedRecord, &type, String::empty);
+
+	if (isNew)
+		sendChangeMessage();
+
+	return isNew;
+}
+
+PluginDescription* KnownPluginList::findDuplicateOf (const PluginDescription& type) const
+{
+	const Array <PluginDescription*> typesInFile (typesByFile [type.fileOrIdentifier]);
+
+	for (int i = typesInFile.size(); --i >= 0;)
+		if (typesInFile.getUnchecked(i)->isDuplicateOf (type))
+			return typesInFile.getUnchecked(i);
 
 	return nullptr;
 }
 
-bool KnownPluginList::addType (const PluginDescription& type)
+bool KnownPluginList::addTypeWithoutNotifying (const PluginDescription& type)
 {
-	for (int i = types.size(); --i >= 0;)
+	PluginDescription* const existing = findDuplicateOf (type);
+
+	if (existing != nullptr)
 	{
-		if (types.getUnchecked(i)->isDuplicateOf (type))
-		{
-			// strange - found a duplicate plugin with different info..
-			jassert (types.getUnchecked(i)->name == type.name);
-			jassert (types.getUnchecked(i)->isInstrument == type.isInstrument);
+		// strange - found a duplicate plugin with different info..
+		jassert (existing->name == type.name);
+		jassert (existing->isInstrument == type.isInstrument);
 
-			*types.getUnchecked(i) = type;
-			return false;
-		}
+		typesByIdentifier.remove (existing->createIdentifierString());
+		*existing = type;
+		typesByIdentifier.set (existing->createIdentifierString(), existing);
+		return false;
 	}
 
-	types.add (new PluginDescription (type));
-	sendChangeMessage();
+	PluginDescription* const newType = new PluginDescription (type);
+	types.add (newType);
+
+	Array <PluginDescription*> typesInFile (typesByFile [newType->fileOrIdentifier]);
+	typesInFile.add (newType);
+	typesByFile.set (newType->fileOrIdentifier, typesInFile);
+	typesByIdentifier.set (newType->createIdentifierString(), newType);
 	return true;
 }
 
 void KnownPluginList::removeType (const int index)
 {
-	types.remove (index);
-	sendChangeMessage();
-}
+	const PluginDescription* const type = types [index];
 
-namespace
-{
-	Time getPluginFileModTime (const String& fileOrIdentifier)
+	if (type != nullptr)
 	{
-		if (fileOrIdentifier.startsWithChar ('/') || fileOrIdentifier[1] == ':')
-			return File (fileOrIdentifier).getLastModificationTime();
+		const PluginDescription removedType (*type);
+		removeTypeWithoutNotifying (type);
 
-		return Time();
+		appendToCache (typeRemovedRecord, &removedType, String::empty);
+		sendChangeMessage();
 	}
+}
 
-	bool timesAreDifferent (const Time& t1, const Time& t2) noexcept
-	{
-		return t1 != t2 || t1 == Time();
-	}
+void KnownPluginList::removeTypeWithoutNotifying (const PluginDescription* const type)
+{
+	Array <PluginDescription*> typesInFile (typesByFile [type->fileOrIdentifier]);
+	typesInFile.removeValue (const_cast <PluginDescription*> (type));
 
-	enum { menuIdBase = 0x324503f4 };
+	if (typesInFile.size() > 0)
+		typesByFile.set (type->fileOrIdentifier, typesInFile);
+	else
+		typesByFile.remove (type->fileOrIdentifier);
+
+	if (typesByIdentifier [type->createIdentifierString()] == type)
+		typesByIdentifier.remove (type->createIdentifierString());
+
+	types.removeObject (type);
 }
 
 bool KnownPluginList::isListingUpToDate (const String& fileOrIdentifier) const
 {
-	if (getTypeForFile (fileOrIdentifier) == 0)
+	const Array <PluginDescription*> typesInFile (typesByFile [fileOrIdentifier]);
+
+	if (typesInFile.size() == 0)
 		return false;
 
-	for (int i = types.size(); --i >= 0;)
-	{
-		const PluginDescription* const d = types.getUnchecked(i);
+	const Time modTime (getPluginFileModTime (fileOrIdentifier));
 
-		if (d->fileOrIdentifier == fileOrIdentifier
-			 && timesAreDifferent (d->lastFileModTime, getPluginFileModTime (fileOrIdentifier)))
-		{
+	for (int i = typesInFile.size(); --i >= 0;)
+		if (timesAreDifferent (typesInFile.getUnchecked(i)->lastFileModTime, modTime))
 			return false;
-		}
-	}
 
 	return true;
 }
@@ -7195,14 +9821,16 @@ bool KnownPluginList::scanAndAddFile (const String& fileOrIdentifier,
 		 && getTypeForFile (fileOrIdentifier) != nullptr)
 	{
 		bool needsRescanning = false;
+		const Array <PluginDescription*> typesInFile (typesByFile [fileOrIdentifier]);
+		const Time modTime (getPluginFileModTime (fileOrIdentifier));
 
-		for (int i = types.size(); --i >= 0;)
+		for (int i = typesInFile.size(); --i >= 0;)
 		{
-			const PluginDescription* const d = types.getUnchecked(i);
+			const PluginDescription* const d = typesInFile.getUnchecked(i);
 
-			if (d->fileOrIdentifier == fileOrIdentifier && d->pluginFormatName == format.getName())
+			if (d->pluginFormatName == format.getName())
 			{
-				if (timesAreDifferent (d->lastFileModTime, getPluginFileModTime (fileOrIdentifier)))
+				if (timesAreDifferent (d->lastFileModTime, modTime))
 					needsRescanning = true;
 				else
 					typesFound.add (new PluginDescription (*d));
@@ -7231,6 +9859,262 @@ bool KnownPluginList::scanAndAddFile (const String& fileOrIdentifier,
 	return addedOne;
 }
 
+void KnownPluginList::addToBlacklist (const String& pluginFileOrIdentifier)
+{
+	if (! isBlacklisted (pluginFileOrIdentifier))
+	{
+		setBlacklistEntry (pluginFileOrIdentifier, getPluginFileModTime (pluginFileOrIdentifier));
+		appendToCache (blacklistAddedRecord, nullptr, pluginFileOrIdentifier);
+		sendChangeMessage();
+	}
+}
+
+void KnownPluginList::removeFromBlacklist (const String& pluginFileOrIdentifier)
+{
+	if (removeBlacklistEntry (pluginFileOrIdentifier))
+	{
+		appendToCache (blacklistRemovedRecord, nullptr, pluginFileOrIdentifier);
+		sendChangeMessage();
+	}
+}
+
+bool KnownPluginList::isBlacklisted (const String& pluginFileOrIdentifier) const
+{
+	const int index = blacklist.indexOf (pluginFileOrIdentifier);
+
+	return index >= 0 && blacklistModTimes.getUnchecked (index) == getPluginFileModTime (pluginFileOrIdentifier);
+}
+
+void KnownPluginList::removeChangedFilesFromBlacklist()
+{
+	for (int i = blacklist.size(); --i >= 0;)
+		if (! isBlacklisted (blacklist[i]))
+			removeFromBlacklist (blacklist[i]);
+}
+
+void KnownPluginList::setBlacklistEntry (const String& pluginFileOrIdentifier, const Time& modTime)
+{
+	const int index = blacklist.indexOf (pluginFileOrIdentifier);
+
+	if (index >= 0)
+	{
+		blacklistModTimes.set (index, modTime);
+	}
+	else
+	{
+		blacklist.add (pluginFileOrIdentifier);
+		blacklistModTimes.add (modTime);
+	}
+}
+
+bool KnownPluginList::removeBlacklistEntry (const String& pluginFileOrIdentifier)
+{
+	const int index = blacklist.indexOf (pluginFileOrIdentifier);
+
+	if (index < 0)
+		return false;
+
+	blacklist.remove (index);
+	blacklistModTimes.remove (index);
+	return true;
+}
+
+void KnownPluginList::clearBlacklistedFiles()
+{
+	if (blacklist.size() > 0)
+	{
+		blacklist.clear();
+		blacklistModTimes.clear();
+		writeCache();
+		sendChangeMessage();
+	}
+}
+
+void KnownPluginList::setCacheFile (const File& newCacheFile)
+{
+	if (newCacheFile == cacheFile)
+		return;
+
+	cacheFile = newCacheFile;
+
+	if (cacheFile.existsAsFile())
+	{
+		// The file's contents replace whatever's in the list..
+		types.clear();
+		typesByFile.clear();
+		typesByIdentifier.clear();
+		blacklist.clear();
+		blacklistModTimes.clear();
+
+		loadCache();
+		sendChangeMessage();
+	}
+	else
+	{
+		writeCache();
+	}
+}
+
+void KnownPluginList::loadCache()
+{
+	numCacheRecords = 0;
+
+	MemoryBlock data;
+	int64 numBytesUsed = 0;
+
+	if (cacheFile.loadFileAsData (data) && data.getSize() >= (size_t) cacheHeaderSize)
+	{
+		MemoryInputStream in (data, false);
+
+		if (in.readInt() == cacheFileMagic && in.readInt() == cacheFileVersion)
+		{
+			numBytesUsed = in.getPosition();
+
+			while (in.getNumBytesRemaining() >= cacheRecordHeaderSize)
+			{
+				const int recordType = in.readByte();
+				const int payloadSize = in.readInt();
+
+				if (payloadSize < 0 || payloadSize > in.getNumBytesRemaining())
+					break;
+
+				MemoryInputStream payload (addBytesToPointer (data.getData(), (int) in.getPosition()),
+										   (size_t) payloadSize, false);
+				applyCacheRecord (recordType, payload);
+
+				in.skipNextBytes (payloadSize);
+				numBytesUsed = in.getPosition();
+				++numCacheRecords;
+			}
+		}
+	}
+
+	// If the end of the file is damaged (e.g. the app crashed while writing it), it needs
+	// to be rewritten, or new records would get appended after the junk.
+	if (numBytesUsed != (int64) data.getSize())
+		writeCache();
+}
+
+void KnownPluginList::applyCacheRecord (const int recordType, InputStream& payload)
+{
+	switch (recordType)
+	{
+		case typeAddedRecord:
+		{
+			PluginDescription desc;
+			readDescription (payload, desc);
+			addTypeWithoutNotifying (desc);
+			break;
+		}
+
+		case typeRemovedRecord:
+		{
+			PluginDescription desc;
+			desc.fileOrIdentifier = payload.readString();
+			desc.uid = payload.readInt();
+
+			const PluginDescription* const existing = findDuplicateOf (desc);
+
+			if (existing != nullptr)
+				removeTypeWithoutNotifying (existing);
+
+			break;
+		}
+
+		case blacklistAddedRecord:
+		{
+			const String fileOrIdentifier (payload.readString());
+
+			// (older caches didn't store the file's time, so those entries are assumed to be current)
+			setBlacklistEntry (fileOrIdentifier, payload.isExhausted() ? getPluginFileModTime (fileOrIdentifier)
+																	   : Time (payload.readInt64()));
+			break;
+		}
+
+		case blacklistRemovedRecord:    removeBlacklistEntry (payload.readString()); break;
+		default:                        break; // (records from a newer version get ignored)
+	}
+}
+
+void KnownPluginList::appendToCache (const int recordType, const PluginDescription* const type, const String& text)
+{
+	if (cacheFile == File::nonexistent)
+		return;
+
+	// Once the journal has built up a lot of stale entries, a fresh copy of the
+	// list gets written instead.
+	if (numCacheRecords > 2 * (types.size() + blacklist.size()) + 64 || ! cacheFile.existsAsFile())
+	{
+		writeCache();
+		return;
+	}
+
+	MemoryOutputStream payload;
+
+	if (recordType == typeAddedRecord)
+	{
+		writeDescription (payload, *type);
+	}
+	else if (recordType == typeRemovedRecord)
+	{
+		payload.writeString (type->fileOrIdentifier);
+		payload.writeInt (type->uid);
+	}
+	else
+	{
+		payload.writeString (text);
+
+		if (recordType == blacklistAddedRecord)
+			payload.writeInt64 (blacklistModTimes [blacklist.indexOf (text)].toMilliseconds());
+	}
+
+	FileOutputStream out (cacheFile);
+
+	if (out.openedOk())
+	{
+		writeRecord (out, recordType, payload);
+		++numCacheRecords;
+	}
+}
+
+void KnownPluginList::writeCache()
+{
+	if (cacheFile == File::nonexistent)
+		return;
+
+	TemporaryFile temp (cacheFile);
+
+	{
+		FileOutputStream out (temp.getFile());
+
+		if (! out.openedOk())
+			return;
+
+		out.writeInt (cacheFileMagic);
+		out.writeInt (cacheFileVersion);
+
+		MemoryOutputStream payload;
+
+		for (int i = 0; i < types.size(); ++i)
+		{
+			payload.reset();
+			writeDescription (payload, *types.getUnchecked(i));
+			writeRecord (out, typeAddedRecord, payload);
+		}
+
+		for (int i = 0; i < blacklist.size(); ++i)
+		{
+			payload.reset();
+			payload.writeString (blacklist[i]);
+			payload.writeInt64 (blacklistModTimes.getUnchecked(i).toMilliseconds());
+			writeRecord (out, blacklistAddedRecord, payload);
+		}
+	}
+
+	if (temp.overwriteTargetFileWithTemporary())
+		numCacheRecords = types.size() + blacklist.size();
+}
+
 void KnownPluginList::scanAndAddDragAndDroppedFiles (const StringArray& files,
 													 OwnedArray <PluginDescription>& typesFound)
 {
@@ -7302,6 +10186,7 @@ void KnownPluginList::sort (const SortMethod method)
 		PluginSorter sorter (method);
 		types.sort (sorter, true);
 
+		writeCache();
 		sendChangeMessage();
 	}
 }
@@ -7313,23 +10198,45 @@ XmlElement* KnownPluginList::createXml() const
 	for (int i = 0; i < types.size(); ++i)
 		e->addChildElement (types.getUnchecked(i)->createXml());
 
+	for (int i = 0; i < blacklist.size(); ++i)
+	{
+		XmlElement* const b = e->createNewChildElement ("BLACKLISTED");
+		b->setAttribute ("id", blacklist[i]);
+		b->setAttribute ("fileTime", String::toHexString (blacklistModTimes.getUnchecked(i).toMilliseconds()));
+	}
+
 	return e;
 }
 
 void KnownPluginList::recreateFromXml (const XmlElement& xml)
 {
-	clear();
-
-	if (xml.hasTagName ("KNOWNPLUGINS"))
 	{
-		forEachXmlChildElement (xml, e)
+		// (rather than appending each item to the cache, it gets rewritten once at the end)
+		const ScopedValueSetter<File> cacheDisabler (cacheFile, File::nonexistent);
+
+		clear();
+		clearBlacklistedFiles();
+
+		if (xml.hasTagName ("KNOWNPLUGINS"))
 		{
-			PluginDescription info;
+			forEachXmlChildElement (xml, e)
+			{
+				PluginDescription info;
+
+				if (e->hasTagName ("BLACKLISTED"))
+				{
+					const String id (e->getStringAttribute ("id"));
 
-			if (info.loadFromXml (*e))
-				addType (info);
+					setBlacklistEntry (id, e->hasAttribute ("fileTime") ? Time (e->getStringAttribute ("fileTime").getHexValue64())
+																		: getPluginFileModTime (id));
+				}
+				else if (info.loadFromXml (*e))
+					addType (info);
+			}
 		}
 	}
+
+	writeCache();
 }
 
 // This is used to turn a bunch of paths into a nested menu structure.
@@ -7500,10 +10407,296 @@ int KnownPluginList::getIndexChosenByMenu (const int menuResultCode) const
 	return isPositiveAndBelow (i, types.size()) ? i : -1;
 }
 
+#if JUCE_UNIT_TESTS
+
+class KnownPluginListTests  : public UnitTest
+{
+public:
+	KnownPluginListTests() : UnitTest ("KnownPluginList") {}
+
+	static PluginDescription createType (const int index)
+	{
+		PluginDescription desc;
+		desc.name = "Plugin " + String (index);
+		desc.pluginFormatName = "Test";
+		desc.fileOrIdentifier = "/plugins/plugin" + String (index);
+		desc.uid = 1000 + index;
+		desc.lastFileModTime = Time (2012, 5, 1, 12, index, 0);
+		return desc;
+	}
+
+	void expectSameContents (const KnownPluginList& a, const KnownPluginList& b)
+	{
+		ScopedPointer<XmlElement> xmlA (a.createXml()), xmlB (b.createXml());
+		expect (xmlA->isEquivalentTo (xmlB, false));
+	}
+
+	void runTest()
+	{
+		const File cacheFile (File::getSpecialLocation (File::tempDirectory)
+								.getNonexistentChildFile ("juce_PluginCache", ".dat", false));
+
+		beginTest ("Replaying the cache journal");
+
+		KnownPluginList list;
+		list.addType (createType (0));
+		list.setCacheFile (cacheFile);
+		expect (cacheFile.existsAsFile());
+
+		for (int i = 1; i < 5; ++i)
+			list.addType (createType (i));
+
+		list.removeType (1);
+		list.addToBlacklist ("/plugins/crashy");
+		list.addToBlacklist ("/plugins/hangy");
+		list.removeFromBlacklist ("/plugins/crashy");
+
+		const int64 sizeBeforeLastChange = cacheFile.getSize();
+		list.addType (createType (5));
+		expect (cacheFile.getSize() > sizeBeforeLastChange);
+
+		{
+			KnownPluginList reloaded;
+			reloaded.setCacheFile (cacheFile);
+
+			expectEquals (reloaded.getNumTypes(), 5);
+			expect (reloaded.getTypeForFile ("/plugins/plugin1") == nullptr);
+			expect (reloaded.getTypeForFile ("/plugins/plugin5") != nullptr);
+			expect (reloaded.getTypeForFile ("/plugins/plugin3")->lastFileModTime == createType (3).lastFileModTime);
+			expect (reloaded.isBlacklisted ("/plugins/hangy") && ! reloaded.isBlacklisted ("/plugins/crashy"));
+			expectSameContents (list, reloaded);
+		}
+
+		beginTest ("Recovering from a damaged tail");
+
+		{
+			// chop the last record in half, as if the app had crashed while writing it..
+			MemoryBlock data;
+			cacheFile.loadFileAsData (data);
+			cacheFile.replaceWithData (data.getData(), (size_t) sizeBeforeLastChange + 10);
+
+			KnownPluginList reloaded;
+			reloaded.setCacheFile (cacheFile);
+
+			expectEquals (reloaded.getNumTypes(), 4);
+			expect (reloaded.getTypeForFile ("/plugins/plugin5") == nullptr);
+			expect (reloaded.isBlacklisted ("/plugins/hangy"));
+
+			// (the junk must have been cut off, or this change would get lost after it)
+			reloaded.addType (createType (6));
+
+			KnownPluginList reloadedAgain;
+			reloadedAgain.setCacheFile (cacheFile);
+			expectEquals (reloadedAgain.getNumTypes(), 5);
+			expect (reloadedAgain.getTypeForFile ("/plugins/plugin6") != nullptr);
+			expectSameContents (reloaded, reloadedAgain);
+		}
+
+		{
+			// ..and a record that claims to be bigger than the rest of the file
+			FileOutputStream out (cacheFile);
+			out.writeByte (1);
+			out.writeInt (0x7fffffff);
+		}
+
+		{
+			KnownPluginList reloaded;
+			reloaded.setCacheFile (cacheFile);
+			expectEquals (reloaded.getNumTypes(), 5);
+			expect (reloaded.getTypeForFile ("/plugins/plugin6") != nullptr);
+		}
+
+		beginTest ("Compacting the cache file");
+
+		{
+			KnownPluginList reloaded;
+			reloaded.setCacheFile (cacheFile);
+
+			const int64 initialSize = cacheFile.getSize();
+
+			for (int i = 0; i < 500; ++i)
+			{
+				reloaded.addToBlacklist ("/plugins/flaky");
+				reloaded.removeFromBlacklist ("/plugins/flaky");
+			}
+
+			// (1000 records would take well over 20K if it kept appending them)
+			expect (cacheFile.getSize() < initialSize + 4000);
+
+			KnownPluginList reloadedAgain;
+			reloadedAgain.setCacheFile (cacheFile);
+			expectSameContents (reloaded, reloadedAgain);
+			expect (! reloadedAgain.isBlacklisted ("/plugins/flaky"));
+		}
+
+		beginTest ("Blacklisting a file that gets updated");
+
+		{
+			const File plugin (File::getSpecialLocation (File::tempDirectory)
+								 .getNonexistentChildFile ("juce_BlacklistedPlugin", ".so", false));
+			plugin.replaceWithText ("x");
+			plugin.setLastModificationTime (Time (2012, 5, 1, 12, 0, 0));
+
+			KnownPluginList reloaded;
+			reloaded.setCacheFile (cacheFile);
+			reloaded.addToBlacklist (plugin.getFullPathName());
+
+			{
+				KnownPluginList reloadedAgain;
+				reloadedAgain.setCacheFile (cacheFile);
+				expect (reloadedAgain.isBlacklisted (plugin.getFullPathName()));
+				expectSameContents (reloaded, reloadedAgain);
+
+				KnownPluginList fromXml;
+				const ScopedPointer<XmlElement> xml (reloaded.createXml());
+				fromXml.recreateFromXml (*xml);
+				expectSameContents (reloaded, fromXml);
+			}
+
+			plugin.setLastModificationTime (Time (2012, 6, 1, 12, 0, 0));
+			expect (! reloaded.isBlacklisted (plugin.getFullPathName()));
+			expect (reloaded.getBlacklistedFiles().contains (plugin.getFullPathName()));
+
+			reloaded.removeChangedFilesFromBlacklist();
+			expect (! reloaded.getBlacklistedFiles().contains (plugin.getFullPathName()));
+			expect (reloaded.isBlacklisted ("/plugins/hangy"));
+
+			KnownPluginList reloadedAgain;
+			reloadedAgain.setCacheFile (cacheFile);
+			expectSameContents (reloaded, reloadedAgain);
+
+			plugin.deleteFile();
+		}
+
+		cacheFile.deleteFile();
+	}
+};
+
+static KnownPluginListTests knownPluginListTests;
+
+#endif
+
 /*** End of inlined file: juce_KnownPluginList.cpp ***/
 
 
 /*** Start of inlined file: juce_PluginDirectoryScanner.cpp ***/
+namespace PluginScannerHelpers
+{
+	static const char* const workerScanFlag = "--juce-plugin-scan";
+	static const char* const resultsTag = "SCANRESULTS";
+}
+
+// Runs a worker process that scans one file, and collects its output on a background thread.
+class PluginDirectoryScanner::ScanWorker  : public Thread
+{
+public:
+	ScanWorker (WaitableEvent& finished_, const String& fileOrIdentifier_, const String& commandLine_)
+		: Thread ("Plugin scan worker"),
+		  fileOrIdentifier (fileOrIdentifier_),
+		  commandLine (commandLine_),
+		  finished (finished_),
+		  startTime (Time::getMillisecondCounter()),
+		  started (false),
+		  processFinished (false)
+	{
+	}
+
+	~ScanWorker()
+	{
+		kill();
+		stopThread (5000);
+	}
+
+	void run()
+	{
+		{
+			const ScopedLock sl (processLock);
+			started = (! processFinished) && process.start (commandLine);
+		}
+
+		if (started)
+		{
+			// (this only returns when the process exits, or gets killed)
+			output = process.readAllProcessOutput();
+
+			// The process is only reaped while holding the lock, and kill() checks the flag
+			// under the same lock, so it can never signal a process ID that has been reused.
+			for (;;)
+			{
+				{
+					const ScopedLock sl (processLock);
+
+					if (! process.isRunning())
+					{
+						processFinished = true;
+						break;
+					}
+				}
+
+				Thread::sleep (5);
+			}
+		}
+
+		{
+			const ScopedLock sl (processLock);
+			processFinished = true;
+		}
+
+		finished.signal();
+	}
+
+	bool hasTimedOut (const int timeoutMs) const noexcept
+	{
+		return timeoutMs > 0 && (int) (Time::getMillisecondCounter() - startTime) > timeoutMs;
+	}
+
+	void kill()
+	{
+		const ScopedLock sl (processLock);
+
+		// (once the process has been reaped, its ID could belong to something else)
+		if (! processFinished)
+		{
+			if (started)
+				process.kill();
+			else
+				processFinished = true; // (stops it being launched at all)
+		}
+	}
+
+	bool failedToStart() const noexcept         { return ! (started || isThreadRunning()); }
+
+	// Returns the scan results, or nullptr if the worker didn't finish properly.
+	XmlElement* getResults() const
+	{
+		using namespace PluginScannerHelpers;
+
+		// (the plugin may have written its own junk to stdout, so just look for our results)
+		const String xml (output.fromLastOccurrenceOf ("<" + String (resultsTag), true, false)
+								.upToLastOccurrenceOf (">", true, false));
+
+		ScopedPointer<XmlElement> results (XmlDocument::parse (xml));
+
+		if (results != nullptr && ! results->hasTagName (resultsTag))
+			results = nullptr;
+
+		return results.release();
+	}
+
+	const String fileOrIdentifier;
+
+private:
+	const String commandLine;
+	WaitableEvent& finished;
+	const uint32 startTime;
+	ChildProcess process;
+	CriticalSection processLock;
+	String output;
+	bool started, processFinished;
+
+	JUCE_DECLARE_NON_COPYABLE (ScanWorker);
+};
+
 PluginDirectoryScanner::PluginDirectoryScanner (KnownPluginList& listToAddTo,
 												AudioPluginFormat& formatToLookFor,
 												FileSearchPath directoriesToSearch,
@@ -7513,12 +10706,17 @@ PluginDirectoryScanner::PluginDirectoryScanner (KnownPluginList& listToAddTo,
 	  format (formatToLookFor),
 	  deadMansPedalFile (deadMansPedalFile_),
 	  nextIndex (0),
-	  progress (0)
+	  progress (0),
+	  maxNumWorkers (0),
+	  workerTimeoutMs (0)
 {
 	directoriesToSearch.removeRedundantPaths();
 
 	filesOrIdentifiersToScan = format.searchPathsForPlugins (directoriesToSearch, recursive);
 
+	// Any plugins that have been updated since they were blacklisted get another chance..
+	list.removeChangedFilesFromBlacklist();
+
 	// If any plugins have crashed recently when being loaded, move them to the
 	// end of the list to give the others a chance to load correctly..
 	const StringArray crashedPlugins (getDeadMansPedalFile());
@@ -7535,6 +10733,16 @@ PluginDirectoryScanner::PluginDirectoryScanner (KnownPluginList& listToAddTo,
 
 PluginDirectoryScanner::~PluginDirectoryScanner()
 {
+	workers.clear();
+}
+
+void PluginDirectoryScanner::scanInWorkerProcesses (const String& commandLine, const int numWorkers, const int timeoutMs)
+{
+	jassert (nextIndex == 0); // this needs to be set up before scanning starts!
+
+	workerCommandLine = commandLine;
+	maxNumWorkers = jmax (0, numWorkers);
+	workerTimeoutMs = timeoutMs;
 }
 
 const String PluginDirectoryScanner::getNextPluginFileThatWillBeScanned() const
@@ -7542,11 +10750,21 @@ const String PluginDirectoryScanner::getNextPluginFileThatWillBeScanned() const
 	return format.getNameOfPluginFromIdentifier (filesOrIdentifiersToScan [nextIndex]);
 }
 
+bool PluginDirectoryScanner::shouldScan (const String& file, const bool dontRescanIfAlreadyInList) const
+{
+	return file.isNotEmpty()
+			&& ! list.isBlacklisted (file)
+			&& ! (dontRescanIfAlreadyInList && list.isListingUpToDate (file));
+}
+
 bool PluginDirectoryScanner::scanNextFile (const bool dontRescanIfAlreadyInList)
 {
+	if (maxNumWorkers > 0)
+		return scanNextFilesInWorkers (dontRescanIfAlreadyInList);
+
 	String file (filesOrIdentifiersToScan [nextIndex]);
 
-	if (file.isNotEmpty() && ! list.isListingUpToDate (file))
+	if (shouldScan (file, dontRescanIfAlreadyInList))
 	{
 		OwnedArray <PluginDescription> typesFound;
 
@@ -7581,6 +10799,125 @@ bool PluginDirectoryScanner::skipNextFile()
 	return nextIndex < filesOrIdentifiersToScan.size();
 }
 
+bool PluginDirectoryScanner::scanNextFilesInWorkers (const bool dontRescanIfAlreadyInList)
+{
+	using namespace PluginScannerHelpers;
+
+	while (workers.size() < maxNumWorkers && nextIndex < filesOrIdentifiersToScan.size())
+	{
+		const String file (filesOrIdentifiersToScan [nextIndex++]);
+
+		if (shouldScan (file, dontRescanIfAlreadyInList))
+		{
+			ScanWorker* const worker = new ScanWorker (workerFinished, file,
+													   workerCommandLine + " " + workerScanFlag
+														 + " " + format.getName().quoted()
+														 + " " + file.quoted());
+			workers.add (worker);
+			worker->startThread();
+		}
+	}
+
+	if (workers.size() > 0)
+	{
+		workerFinished.wait (100);
+
+		for (int i = 0; i < workers.size(); ++i)
+		{
+			ScanWorker* const worker = workers.getUnchecked(i);
+
+			if (worker->isThreadRunning() && worker->hasTimedOut (workerTimeoutMs))
+				worker->kill(); // (its thread will stop as soon as the process has gone)
+
+			if (! worker->isThreadRunning())
+			{
+				addWorkerResults (*worker);
+				workers.remove (i--);
+			}
+		}
+	}
+
+	const int numFiles = filesOrIdentifiersToScan.size();
+	progress = numFiles > 0 ? (nextIndex - workers.size()) / (float) numFiles : 1.0f;
+
+	return nextIndex < numFiles || workers.size() > 0;
+}
+
+void PluginDirectoryScanner::addWorkerResults (ScanWorker& worker)
+{
+	const ScopedPointer<XmlElement> results (worker.getResults());
+
+	if (worker.failedToStart())
+	{
+		jassertfalse; // the worker command line you gave to scanInWorkerProcesses() doesn't work!
+		failedFiles.add (worker.fileOrIdentifier);
+		return;
+	}
+
+	if (results == nullptr)
+	{
+		// the worker crashed or hung, so don't try this one again..
+		list.addToBlacklist (worker.fileOrIdentifier);
+		failedFiles.add (worker.fileOrIdentifier);
+		return;
+	}
+
+	int numFound = 0;
+
+	forEachXmlChildElement (*results, e)
+	{
+		PluginDescription desc;
+
+		if (desc.loadFromXml (*e))
+		{
+			list.addType (desc);
+			++numFound;
+		}
+	}
+
+	if (numFound == 0)
+		failedFiles.add (worker.fileOrIdentifier);
+}
+
+bool PluginDirectoryScanner::performScanIfRequested (const String& commandLine)
+{
+	using namespace PluginScannerHelpers;
+
+	StringArray args;
+	args.addTokens (commandLine, true);
+	args.removeEmptyStrings();
+
+	const int flagIndex = args.indexOf (workerScanFlag);
+
+	if (flagIndex < 0)
+		return false;
+
+	const String formatName (args [flagIndex + 1].unquoted());
+	const String fileOrIdentifier (args [flagIndex + 2].unquoted());
+
+	XmlElement results (resultsTag);
+	AudioPluginFormatManager* const formatManager = AudioPluginFormatManager::getInstance();
+
+	for (int i = 0; i < formatManager->getNumFormats(); ++i)
+	{
+		AudioPluginFormat* const f = formatManager->getFormat (i);
+
+		if (f->getName() == formatName)
+		{
+			OwnedArray <PluginDescription> found;
+			f->findAllTypesForFile (found, fileOrIdentifier);
+
+			for (int j = 0; j < found.size(); ++j)
+				results.addChildElement (found.getUnchecked(j)->createXml());
+
+			break;
+		}
+	}
+
+	std::cout << results.createDocument (String::empty, true, false) << std::endl;
+	return true;
+}
+
 StringArray PluginDirectoryScanner::getDeadMansPedalFile()
 {
 	StringArray lines;
@@ -7600,6 +10937,147 @@ void PluginDirectoryScanner::setDeadMansPedalFile (const StringArray& newContent
 		deadMansPedalFile.replaceWithText (newContents.joinIntoString ("\n"), true, true);
 }
 
+#if JUCE_UNIT_TESTS && (JUCE_LINUX || JUCE_MAC)
+
+class PluginDirectoryScannerTests  : public UnitTest
+{
+public:
+	PluginDirectoryScannerTests() : UnitTest ("PluginDirectoryScanner") {}
+
+	// A format whose "plugins" are just the files it's given - the worker script does the scanning.
+	class ScanTestFormat  : public AudioPluginFormat
+	{
+	public:
+		ScanTestFormat (const StringArray& files_) : files (files_) {}
+
+		String getName() const                                                          { return "ScanTest"; }
+		void findAllTypesForFile (OwnedArray <PluginDescription>&, const String&)       {}
+		AudioPluginInstance* createInstanceFromDescription (const PluginDescription&)   { return nullptr; }
+		bool fileMightContainThisPluginType (const String&)                             { return true; }
+		String getNameOfPluginFromIdentifier (const String& f)                          { return f; }
+		bool doesPluginStillExist (const PluginDescription&)                            { return true; }
+		StringArray searchPathsForPlugins (const FileSearchPath&, bool)                 { return files; }
+		FileSearchPath getDefaultLocationsToSearch()                                    { return FileSearchPath(); }
+
+	private:
+		const StringArray files;
+	};
+
+	static int countLines (const File& f)
+	{
+		StringArray lines;
+		f.readLines (lines);
+		lines.removeEmptyStrings();
+		return lines.size();
+	}
+
+	static void scanAll (PluginDirectoryScanner& scanner, const bool dontRescan)
+	{
+		const uint32 timeout = Time::getMillisecondCounter() + 20000;
+
+		while (scanner.scanNextFile (dontRescan) && Time::getMillisecondCounter() < timeout)
+		{}
+	}
+
+	void runTest()
+	{
+		beginTest ("Scanning in worker processes");
+
+		const File dir (File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("juce_ScanTest", String::empty, false));
+		dir.createDirectory();
+
+		const File script (dir.getChildFile ("worker.sh"));
+		const File launches (dir.getChildFile ("launches.txt"));
+
+		// (written as raw data, because replaceWithText() would add carriage-returns)
+		const String scriptText ("echo \"$3\" >> " + launches.getFullPathName().quoted() + "\n"
+								 "case \"$3\" in\n"
+								 "  *crash*) kill -SEGV $$ ;;\n"
+								 "  *hang*) exec sleep 30 ;;\n"
+								 "  *) cat \"$3\" ;;\n"
+								 "esac\n");
+
+		script.replaceWithData (scriptText.toUTF8(), scriptText.getNumBytesAsUTF8());
+
+		const Time modTime (2012, 5, 1, 12, 0, 0);
+		StringArray files;
+
+		for (int i = 0; i < 2; ++i)
+		{
+			const File f (dir.getChildFile ("good" + String (i)));
+
+			PluginDescription desc;
+			desc.name = "Test plugin " + String (i);
+			desc.pluginFormatName = "ScanTest";
+			desc.fileOrIdentifier = f.getFullPathName();
+			desc.lastFileModTime = modTime;
+			desc.uid = 1234 + i;
+
+			XmlElement results ("SCANRESULTS");
+			results.addChildElement (desc.createXml());
+
+			// (the junk is there to make sure it can cope with plugins that print things)
+			f.replaceWithText ("some junk <from the plugin>\n" + results.createDocument (String::empty, true, false));
+			f.setLastModificationTime (modTime);
+			files.add (f.getFullPathName());
+		}
+
+		files.add (dir.getChildFile ("crash").getFullPathName());
+		files.add (dir.getChildFile ("hang").getFullPathName());
+
+		ScanTestFormat format (files);
+		KnownPluginList list;
+		const String commandLine ("/bin/sh " + script.getFullPathName().quoted());
+
+		{
+			PluginDirectoryScanner scanner (list, format, FileSearchPath(), false, File::nonexistent);
+			scanner.scanInWorkerProcesses (commandLine, 2, 1500);
+			scanAll (scanner, true);
+
+			expectEquals (list.getNumTypes(), 2);
+			expect (list.getTypeForFile (files[0]) != nullptr && list.getTypeForFile (files[0])->uid == 1234);
+			expect (list.getTypeForFile (files[1]) != nullptr && list.getTypeForFile (files[1])->uid == 1235);
+			expect (list.isListingUpToDate (files[0]) && list.isListingUpToDate (files[1]));
+
+			expect (! list.isBlacklisted (files[0]) && ! list.isBlacklisted (files[1]));
+			expect (list.isBlacklisted (files[2]) && list.isBlacklisted (files[3]));
+
+			expectEquals (scanner.getFailedFiles().size(), 2);
+			expect (scanner.getFailedFiles().contains (files[2]) && scanner.getFailedFiles().contains (files[3]));
+			expectEquals (countLines (launches), 4);
+		}
+
+		beginTest ("Rescanning in worker processes");
+
+		{
+			PluginDirectoryScanner scanner (list, format, FileSearchPath(), false, File::nonexistent);
+			scanner.scanInWorkerProcesses (commandLine, 2, 1500);
+			scanAll (scanner, true);
+
+			// (everything's either up to date or blacklisted)
+			expectEquals (countLines (launches), 4);
+			expectEquals (scanner.getFailedFiles().size(), 0);
+		}
+
+		{
+			PluginDirectoryScanner scanner (list, format, FileSearchPath(), false, File::nonexistent);
+			scanner.scanInWorkerProcesses (commandLine, 2, 1500);
+			scanAll (scanner, false);
+
+			// (the good files get scanned again, but not the blacklisted ones)
+			expectEquals (countLines (launches), 6);
+			expectEquals (list.getNumTypes(), 2);
+			expectEquals (scanner.getFailedFiles().size(), 0);
+		}
+
+		dir.deleteRecursively();
+	}
+};
+
+static PluginDirectoryScannerTests pluginDirectoryScannerTests;
+
+#endif
+
 /*** End of inlined file: juce_PluginDirectoryScanner.cpp ***/
 
 
@@ -7610,7 +11088,8 @@ PluginListComponent::PluginListComponent (KnownPluginList& listToEdit,
 	: list (listToEdit),
 	  deadMansPedalFile (deadMansPedalFile_),
 	  optionsButton ("Options..."),
-	  propertiesToUse (propertiesToUse_)
+	  propertiesToUse (propertiesToUse_),
+	  numScanWorkers (0)
 {
 	listBox.setModel (this);
 	addAndMakeVisible (&listBox);
@@ -7629,6 +11108,12 @@ PluginListComponent::~PluginListComponent()
 	list.removeChangeListener (this);
 }
 
+void PluginListComponent::scanInWorkerProcesses (const String& commandLine, const int numWorkers)
+{
+	workerCommandLine = commandLine;
+	numScanWorkers = numWorkers;
+}
+
 void PluginListComponent::resized()
 {
 	listBox.setBounds (0, 0, getWidth(), getHeight() - 30);
@@ -7845,6 +11330,9 @@ void PluginListComponent::scanFor (AudioPluginFormat* format)
 
 	PluginDirectoryScanner scanner (list, *format, path, true, deadMansPedalFile);
 
+	if (numScanWorkers > 0)
+		scanner.scanInWorkerProcesses (workerCommandLine, numScanWorkers);
+
 	for (;;)
 	{
 		aw.setMessage (TRANS("Testing:\n\n") + scanner.getNextPluginFileThatWillBeScanned());
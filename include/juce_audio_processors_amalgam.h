@@ -62,121 +62,6 @@ namespace juce
 {
 
 // START_AUTOINCLUDE processors, format, format_types, scanning
-#ifndef __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
-
-/*** Start of inlined file: juce_AudioPlayHead.h ***/
-#ifndef __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
-#define __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
-
-/**
-	A subclass of AudioPlayHead can supply information about the position and
-	status of a moving play head during audio playback.
-
-	One of these can be supplied to an AudioProcessor object so that it can find
-	out about the position of the audio that it is rendering.
-
-	@see AudioProcessor::setPlayHead, AudioProcessor::getPlayHead
-*/
-class JUCE_API  AudioPlayHead
-{
-protected:
-
-	AudioPlayHead() {}
-
-public:
-	virtual ~AudioPlayHead() {}
-
-	/** Frame rate types. */
-	enum FrameRateType
-	{
-		fps24           = 0,
-		fps25           = 1,
-		fps2997         = 2,
-		fps30           = 3,
-		fps2997drop     = 4,
-		fps30drop       = 5,
-		fpsUnknown      = 99
-	};
-
-	/** This structure is filled-in by the AudioPlayHead::getCurrentPosition() method.
-	*/
-	struct JUCE_API  CurrentPositionInfo
-	{
-		/** The tempo in BPM */
-		double bpm;
-
-		/** Time signature numerator, e.g. the 3 of a 3/4 time sig */
-		int timeSigNumerator;
-		/** Time signature denominator, e.g. the 4 of a 3/4 time sig */
-		int timeSigDenominator;
-
-		/** The current play position, in seconds from the start of the edit. */
-		double timeInSeconds;
-
-		/** For timecode, the position of the start of the edit, in seconds from 00:00:00:00. */
-		double editOriginTime;
-
-		/** The current play position in pulses-per-quarter-note.
-
-			This is the number of quarter notes since the edit start.
-		*/
-		double ppqPosition;
-
-		/** The position of the start of the last bar, in pulses-per-quarter-note.
-
-			This is the number of quarter notes from the start of the edit to the
-			start of the current bar.
-
-			Note - this value may be unavailable on some hosts, e.g. Pro-Tools. If
-			it's not available, the value will be 0.
-		*/
-		double ppqPositionOfLastBarStart;
-
-		/** The video frame rate, if applicable. */
-		FrameRateType frameRate;
-
-		/** True if the transport is currently playing. */
-		bool isPlaying;
-
-		/** True if the transport is currently recording.
-
-			(When isRecording is true, then isPlaying will also be true).
-		*/
-		bool isRecording;
-
-		/** The current cycle start position in pulses-per-quarter-note.
-			Note that not all hosts or plugin formats may provide this value.
-			@see isLooping
-		*/
-		double ppqLoopStart;
-
-		/** The current cycle end position in pulses-per-quarter-note.
-			Note that not all hosts or plugin formats may provide this value.
-			@see isLooping
-		*/
-		double ppqLoopEnd;
-
-		/** True if the transport is currently looping. */
-		bool isLooping;
-
-		bool operator== (const CurrentPositionInfo& other) const noexcept;
-		bool operator!= (const CurrentPositionInfo& other) const noexcept;
-
-		void resetToDefault();
-	};
-
-	/** Fills-in the given structure with details about the transport's
-		position at the start of the current processing block.
-	*/
-	virtual bool getCurrentPosition (CurrentPositionInfo& result) = 0;
-};
-
-#endif   // __JUCE_AUDIOPLAYHEAD_JUCEHEADER__
-
-/*** End of inlined file: juce_AudioPlayHead.h ***/
-
-
-#endif
 #ifndef __JUCE_AUDIOPLUGININSTANCE_JUCEHEADER__
 
 /*** Start of inlined file: juce_AudioPluginInstance.h ***/
@@ -692,6 +577,36 @@ public:
 	void setParameterNotifyingHost (int parameterIndex,
 									float newValue);
 
+	/** Changes a parameter without making the audio thread wait for the calling thread.
+
+		Unlike setParameterNotifyingHost(), this doesn't call setParameter() straight away.
+		The change is added to a lock-free queue, and gets applied on the audio thread by
+		applyQueuedParameterChanges() just before the next block is processed. If the same
+		parameter is changed several times between two blocks, only its latest value is
+		used. The listeners are then told about the new values asynchronously, in batches,
+		on the message thread.
+
+		The changes aren't timestamped, so everything that's waiting takes effect at the
+		start of the next block, rather than at the point in the block where it was made.
+
+		The queue holds the latest value for each parameter, so it never fills up, and the
+		calling thread never has to wait for the audio thread. If applyQueuedParameterChanges()
+		hasn't been called for about a quarter of a second, the processor is assumed not to
+		be playing, and the changes get applied on the message thread instead.
+
+		This can be called by several threads at once, but not by the audio thread.
+	*/
+	void queueParameterChange (int parameterIndex, float newValue);
+
+	/** Applies any changes that were made with queueParameterChange().
+
+		Hosts should call this on the audio thread just before each call to processBlock() -
+		AudioProcessorGraph and AudioProcessorPlayer do this for the processors that they
+		play. It never blocks: if another thread is already applying the changes, it
+		returns straight away.
+	*/
+	void applyQueuedParameterChanges();
+
 	/** Returns true if the host can automate this parameter.
 
 		By default, this returns true for all parameters.
@@ -863,6 +778,10 @@ private:
 	CriticalSection callbackLock, listenerLock;
 	String inputSpeakerArrangement, outputSpeakerArrangement;
 
+	class ParameterQueue;
+	friend class ParameterQueue;
+	Atomic<ParameterQueue*> parameterQueue;
+
    #if JUCE_DEBUG
 	BigInteger changingParams;
    #endif
@@ -1128,6 +1047,28 @@ public:
 	*/
 	virtual FileSearchPath getDefaultLocationsToSearch() = 0;
 
+	/** Returns true if createInstanceFromDescription() can be called on background
+		threads, and for several plugins at the same time, and if the instances it
+		creates can have their state restored on a background thread.
+
+		AudioPluginBatchLoader uses this to decide which plugins it can create in
+		parallel. The default is false, so instances are only created on the message
+		thread.
+	*/
+	virtual bool canCreateInstancesOnBackgroundThreads() const;
+
+	/** Loads the binary that contains a plugin, without creating an instance of it.
+
+		Loading the binary is often the slowest part of creating a plugin, so for
+		formats that need to create their instances on the message thread,
+		AudioPluginBatchLoader calls this for several plugins in parallel beforehand.
+
+		This can be called on any thread. The object returned keeps the binary loaded
+		for as long as it's referenced, so it should be kept until the instance has been
+		created. The default implementation returns nullptr.
+	*/
+	virtual ReferenceCountedObjectPtr <ReferenceCountedObject> preloadPluginBinary (const PluginDescription& desc);
+
 protected:
 
 	AudioPluginFormat() noexcept;
@@ -1235,12 +1176,12 @@ public:
 	/** Returns the number of types currently in the list.
 		@see getType
 	*/
-	int getNumTypes() const noexcept                                { return types.size(); }
+	int getNumTypes() const                                         { return types.size(); }
 
 	/** Returns one of the types.
 		@see getNumTypes
 	*/
-	PluginDescription* getType (int index) const noexcept           { return types [index]; }
+	PluginDescription* getType (int index) const                    { return types [index]; }
 
 	/** Looks for a type in the list which comes from this file.
 	*/
@@ -1288,6 +1229,57 @@ public:
 	void scanAndAddDragAndDroppedFiles (const StringArray& filenames,
 										OwnedArray <PluginDescription>& typesFound);
 
+	/** Adds a plugin file to the list of ones that shouldn't be scanned.
+
+		A PluginDirectoryScanner that's using worker processes will add any plugins
+		that crash or hang while being scanned to this list, and scanners will skip
+		over any files in it.
+
+		The file's modification time is stored with the entry, so that if the plugin
+		gets updated, it'll no longer count as blacklisted.
+	*/
+	void addToBlacklist (const String& pluginFileOrIdentifier);
+
+	/** Removes a file from the blacklist, so that it'll get scanned again. */
+	void removeFromBlacklist (const String& pluginFileOrIdentifier);
+
+	/** Returns true if this file has been added to the blacklist, and hasn't been
+		modified since then.
+	*/
+	bool isBlacklisted (const String& pluginFileOrIdentifier) const;
+
+	/** Removes any files from the blacklist that have been modified (or deleted) since
+		they were added to it.
+
+		A PluginDirectoryScanner calls this when it's created.
+	*/
+	void removeChangedFilesFromBlacklist();
+
+	/** Returns the files that are currently blacklisted. */
+	const StringArray& getBlacklistedFiles() const                  { return blacklist; }
+
+	/** Clears the blacklist. */
+	void clearBlacklistedFiles();
+
+	/** Makes the list keep a copy of itself in a binary cache file.
+
+		This is much quicker than saving and reloading the list as XML when there are a
+		lot of plugins. Each change made to the list gets appended to the file rather
+		than rewriting the whole thing, and the file is only rewritten when it has built
+		up a lot of out-of-date entries.
+
+		If the file already exists, it's read straight away and its contents replace
+		whatever is in the list (if its end has been damaged, e.g. by a crash while it
+		was being written, the file gets rewritten with whatever could be read). If the
+		file doesn't exist, it gets created from the list's current contents.
+
+		Pass File::nonexistent to stop using a cache file.
+	*/
+	void setCacheFile (const File& cacheFile);
+
+	/** Returns the file that was passed to setCacheFile(). */
+	const File& getCacheFile() const noexcept                       { return cacheFile; }
+
 	/** Sort methods used to change the order of the plugins in the list.
 	*/
 	enum SortMethod
@@ -1329,6 +1321,23 @@ public:
 private:
 
 	OwnedArray <PluginDescription> types;
+	HashMap <String, Array <PluginDescription*> > typesByFile;
+	HashMap <String, PluginDescription*> typesByIdentifier;
+	StringArray blacklist;
+	Array <Time> blacklistModTimes;
+	File cacheFile;
+	int numCacheRecords;
+
+	PluginDescription* findDuplicateOf (const PluginDescription&) const;
+	bool addTypeWithoutNotifying (const PluginDescription&);
+	void removeTypeWithoutNotifying (const PluginDescription*);
+	void setBlacklistEntry (const String& pluginFileOrIdentifier, const Time& modTime);
+	bool removeBlacklistEntry (const String& pluginFileOrIdentifier);
+
+	void loadCache();
+	void applyCacheRecord (int recordType, InputStream& payload);
+	void appendToCache (int recordType, const PluginDescription* type, const String& text);
+	void writeCache();
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (KnownPluginList);
 };
@@ -1765,6 +1774,314 @@ private:
 #endif
 #ifndef __JUCE_PLUGINDESCRIPTION_JUCEHEADER__
 
+#endif
+#ifndef __JUCE_SANDBOXEDPLUGININSTANCE_JUCEHEADER__
+
+/*** Start of inlined file: juce_SandboxedPluginInstance.h ***/
+#ifndef __JUCE_SANDBOXEDPLUGININSTANCE_JUCEHEADER__
+#define __JUCE_SANDBOXEDPLUGININSTANCE_JUCEHEADER__
+
+/**
+	A plugin instance that runs the real plugin in a separate process, so that if the
+	plugin crashes or hangs, it can't take the host down with it.
+
+	Use createInstance() to launch a sandbox process and load a plugin into it. The
+	sandbox is started by running a command line that you supply - normally this will
+	be your own application's executable, which must register the same plugin formats
+	with its AudioPluginFormatManager and then pass its command line to
+	performHostingIfRequested() as soon as it starts up.
+
+	Audio and MIDI are passed to and from the sandbox through a block of shared memory,
+	and each call to processBlock() makes a single round trip to the other process, so
+	no extra latency is added. Parameter changes are queued up and sent along with the
+	next block. The plugin's parameters, programs and state are all available, but it
+	can't show its own editor, so createEditor() returns a GenericAudioProcessorEditor.
+
+	If the sandbox process dies or stops responding, hasCrashed() will return true, and
+	from then on the instance will just output silence.
+
+	@see AudioPluginFormatManager, PluginDirectoryScanner::scanInWorkerProcesses
+*/
+class JUCE_API  SandboxedPluginInstance  : public AudioPluginInstance
+{
+public:
+
+	/** Destructor.
+		This shuts down the sandbox process.
+	*/
+	~SandboxedPluginInstance();
+
+	/** Launches a sandbox process and creates an instance of a plugin inside it.
+
+		The sandbox is launched by running sandboxCommandLine with some extra arguments
+		added to it. If the plugin can't be loaded, this returns nullptr and sets the
+		error message.
+
+		timeoutMs is the longest that the sandbox is allowed to take to respond to a
+		request before it's assumed to have hung and gets killed. When the instance isn't
+		running in non-realtime mode, processBlock() will wait for at most a second.
+	*/
+	static SandboxedPluginInstance* createInstance (const PluginDescription& description,
+													const String& sandboxCommandLine,
+													String& errorMessage,
+													int timeoutMs = 10000);
+
+	/** A sandbox process launched by createInstance() should call this as soon as it
+		starts.
+
+		If the command line is one that createInstance() created, this loads the plugin
+		and runs it until the host process closes the connection, and then returns true,
+		after which the process should quit. If the command line isn't a sandbox request,
+		it just returns false.
+	*/
+	static bool performHostingIfRequested (const String& commandLine);
+
+	/** Returns true if the sandbox process has died or stopped responding. */
+	bool hasCrashed() const noexcept                { return crashed; }
+
+	//==============================================================================
+	/** @internal */
+	void fillInPluginDescription (PluginDescription& description) const;
+	/** @internal */
+	const String getName() const;
+	/** @internal */
+	void prepareToPlay (double sampleRate, int estimatedSamplesPerBlock);
+	/** @internal */
+	void releaseResources();
+	/** @internal */
+	void processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages);
+	/** @internal */
+	void reset();
+	/** @internal */
+	const String getInputChannelName (int index) const;
+	/** @internal */
+	const String getOutputChannelName (int index) const;
+	/** @internal */
+	bool isInputChannelStereoPair (int index) const;
+	/** @internal */
+	bool isOutputChannelStereoPair (int index) const;
+	/** @internal */
+	bool acceptsMidi() const;
+	/** @internal */
+	bool producesMidi() const;
+	/** @internal */
+	AudioProcessorEditor* createEditor();
+	/** @internal */
+	bool hasEditor() const;
+	/** @internal */
+	int getNumParameters();
+	/** @internal */
+	const String getParameterName (int index);
+	/** @internal */
+	float getParameter (int index);
+	/** @internal */
+	const String getParameterText (int index);
+	/** @internal */
+	void setParameter (int index, float newValue);
+	/** @internal */
+	int getNumPrograms();
+	/** @internal */
+	int getCurrentProgram();
+	/** @internal */
+	void setCurrentProgram (int index);
+	/** @internal */
+	const String getProgramName (int index);
+	/** @internal */
+	void changeProgramName (int index, const String& newName);
+	/** @internal */
+	void getStateInformation (MemoryBlock& destData);
+	/** @internal */
+	void getCurrentProgramStateInformation (MemoryBlock& destData);
+	/** @internal */
+	void setStateInformation (const void* data, int sizeInBytes);
+	/** @internal */
+	void setCurrentProgramStateInformation (const void* data, int sizeInBytes);
+
+private:
+	//==============================================================================
+	class OutputReader;
+	class PluginServer;
+	friend class PluginServer;
+
+	struct ParameterChange
+	{
+		int index;
+		float value;
+	};
+
+	PluginDescription description;
+	String name;
+	const int timeoutMs;
+	ChildProcess process;
+	ScopedPointer<OutputReader> outputReader;
+	ScopedPointer<StreamingSocket> socket;
+	File sharedMemoryFile;
+	ScopedPointer<MemoryMappedFile> sharedMemory;
+	int sharedNumChannels, sharedBlockSize;
+	CriticalSection connectionLock, parameterLock, processLock;
+	MemoryOutputStream requestData;
+	MemoryBlock replyData;
+	MidiBuffer midiOut;
+	Array<float> parameterValues;
+	Array<ParameterChange> pendingParameterChanges;
+	StringArray parameterNames, inputChannelNames, outputChannelNames;
+	BigInteger inputStereoPairs, outputStereoPairs;
+	int numPrograms;
+	bool wantsMidi, makesMidi;
+	bool processFinished;
+	bool volatile crashed;
+
+	SandboxedPluginInstance (const PluginDescription&, int timeoutMs);
+
+	bool launch (const String& commandLine, String& errorMessage);
+	bool createSharedMemory (int blockSize);
+	bool transact (int messageType, const void* args, size_t argsSize, int timeout, MemoryBlock* result);
+	bool transact (int messageType, const MemoryOutputStream& args, MemoryBlock* result);
+	void sandboxFailed();
+	void killProcess();
+	bool processChunk (AudioSampleBuffer& buffer, int startSample, int numSamples, const MidiBuffer& midiIn);
+	void readPluginInfo (InputStream& in);
+	void readChannelInfo (InputStream& in);
+	void readParameterValues (InputStream& in);
+	void handleParameterChanges (InputStream& in);
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxedPluginInstance);
+};
+
+#endif   // __JUCE_SANDBOXEDPLUGININSTANCE_JUCEHEADER__
+
+/*** End of inlined file: juce_SandboxedPluginInstance.h ***/
+
+
+#endif
+#ifndef __JUCE_AUDIOPLUGINBATCHLOADER_JUCEHEADER__
+
+/*** Start of inlined file: juce_AudioPluginBatchLoader.h ***/
+#ifndef __JUCE_AUDIOPLUGINBATCHLOADER_JUCEHEADER__
+#define __JUCE_AUDIOPLUGINBATCHLOADER_JUCEHEADER__
+
+/**
+	Creates a whole set of plugin instances in the background, e.g. when a session
+	is being opened.
+
+	Add the plugins to it with addPlugin(), along with any state that should be
+	restored into them, and then call start(). Plugins whose format allows it (see
+	AudioPluginFormat::canCreateInstancesOnBackgroundThreads()) get created and have
+	their state restored on a pool of threads, in parallel. The others have to be
+	created on the message thread, but their binaries are loaded on the pool
+	beforehand where possible, and they're created one at a time from asynchronous
+	callbacks, so the message loop keeps running while they load.
+
+	Each new instance is passed to the Listener on the message thread as soon as it's
+	ready, and the time spent loading each one is available from getTiming(). To
+	measure how long it takes before a session can be heard, compare the time of
+	your first audio callback with getStartTime().
+
+	@see AudioPluginFormatManager
+*/
+class JUCE_API  AudioPluginBatchLoader  : private AsyncUpdater
+{
+public:
+
+	/** Creates a loader which will use the given format manager to create its plugins.
+
+		If numThreads is 0, the loader uses one thread for each CPU core.
+	*/
+	AudioPluginBatchLoader (AudioPluginFormatManager& formatManager, int numThreads = 0);
+
+	/** Destructor.
+		If any plugins are still being loaded on the background threads, this waits for
+		them to finish, and deletes any instances that haven't yet been given to the listener.
+	*/
+	~AudioPluginBatchLoader();
+
+	/** Adds a plugin that should be created.
+
+		If stateToRestore isn't empty, it's passed to the new instance's
+		setStateInformation() method before the instance is handed over.
+		This must be called before start(). It returns the index that will be used to
+		refer to this plugin in the listener callbacks.
+	*/
+	int addPlugin (const PluginDescription& description, const MemoryBlock& stateToRestore);
+
+	/** Returns the number of plugins that have been added. */
+	int getNumPlugins() const noexcept                      { return items.size(); }
+
+	/** Receives the plugins that an AudioPluginBatchLoader creates. */
+	class JUCE_API  Listener
+	{
+	public:
+		/** Destructor. */
+		virtual ~Listener() {}
+
+		/** Called on the message thread when one of the plugins has been created.
+
+			The listener takes ownership of the new instance. If the plugin couldn't
+			be loaded, newInstance will be nullptr, and errorMessage will say why.
+		*/
+		virtual void pluginInstanceCreated (AudioPluginBatchLoader& loader, int index,
+											AudioPluginInstance* newInstance,
+											const String& errorMessage) = 0;
+
+		/** Called on the message thread after all the plugins have been passed to
+			pluginInstanceCreated().
+		*/
+		virtual void allPluginInstancesCreated (AudioPluginBatchLoader& loader) = 0;
+	};
+
+	/** Starts loading the plugins.
+		The listener must stay valid until all the plugins have been created, or until
+		this object is deleted.
+	*/
+	void start (Listener& listener);
+
+	/** Returns true once every plugin has been passed to the listener. */
+	bool isFinished() const noexcept;
+
+	/** The time spent creating one of the plugins, in milliseconds. */
+	struct Timing
+	{
+		double binaryLoadTime;          /**< Time spent in AudioPluginFormat::preloadPluginBinary(). */
+		double instantiationTime;       /**< Time spent in AudioPluginFormat::createInstanceFromDescription(). */
+		double stateRestoreTime;        /**< Time spent in AudioProcessor::setStateInformation(). */
+		double timeUntilReady;          /**< Time between start() and the instance being handed to the listener. */
+		bool createdOnMessageThread;    /**< True if the format required the instance to be created on the message thread. */
+	};
+
+	/** Returns the timing information for one of the plugins.
+		These values are only complete once the plugin has been passed to the listener.
+	*/
+	Timing getTiming (int index) const;
+
+	/** Returns the value of Time::getMillisecondCounterHiRes() when start() was called. */
+	double getStartTime() const noexcept                    { return startTime; }
+
+private:
+
+	class Item;
+	class LoaderJob;
+	friend class LoaderJob;
+
+	AudioPluginFormatManager& formatManager;
+	const int numThreads;
+	OwnedArray <Item> items;
+	ScopedPointer <ThreadPool> threadPool;
+	CriticalSection lock;
+	Listener* listener;
+	double startTime;
+	int numDelivered;
+
+	void jobFinished (Item&);
+	void handleAsyncUpdate();
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginBatchLoader);
+};
+
+#endif   // __JUCE_AUDIOPLUGINBATCHLOADER_JUCEHEADER__
+
+/*** End of inlined file: juce_AudioPluginBatchLoader.h ***/
+
+
 #endif
 #ifndef __JUCE_AUDIOPLUGINFORMAT_JUCEHEADER__
 
@@ -2080,6 +2397,7 @@ public:
 	StringArray searchPathsForPlugins (const FileSearchPath& directoriesToSearch, bool recursive);
 	bool doesPluginStillExist (const PluginDescription& desc);
 	FileSearchPath getDefaultLocationsToSearch();
+	ReferenceCountedObjectPtr <ReferenceCountedObject> preloadPluginBinary (const PluginDescription& desc);
 
 private:
 
@@ -2144,6 +2462,27 @@ public:
 	/** Destructor. */
 	~PluginDirectoryScanner();
 
+	/** Makes the scanner load each plugin in a separate worker process, rather than
+		in this one.
+
+		Each worker is launched by running workerCommandLine with some extra arguments
+		added to it, which name the format and the plugin file to scan. This will
+		normally be your own application's executable, which should pass its command
+		line to performScanIfRequested() when it starts up.
+
+		Up to numWorkers files are scanned at the same time. If a plugin crashes its
+		worker or takes longer than timeoutMs to scan, it gets added to the
+		KnownPluginList's blacklist, and future scans will skip it until the file
+		changes.
+
+		Note that if the worker command line launches a program that never calls
+		performScanIfRequested(), each worker will just sit there until it times out,
+		and every file that's scanned will end up blacklisted.
+
+		Call this before the first call to scanNextFile().
+	*/
+	void scanInWorkerProcesses (const String& workerCommandLine, int numWorkers, int timeoutMs = 30000);
+
 	/** Tries the next likely-looking file.
 
 		If dontRescanIfAlreadyInList is true, then the file will only be loaded and
@@ -2151,6 +2490,10 @@ public:
 		time has changed since the list was created. If dontRescanIfAlreadyInList is
 		false, the file will always be reloaded and tested.
 
+		When worker processes are being used, this launches workers for any files
+		that aren't being scanned yet, and then waits briefly for some of them to
+		finish, adding their results to the list.
+
 		Returns false when there are no more files to try.
 	*/
 	bool scanNextFile (bool dontRescanIfAlreadyInList);
@@ -2177,8 +2520,21 @@ public:
 	*/
 	const StringArray& getFailedFiles() const noexcept              { return failedFiles; }
 
+	/** A worker process launched by scanInWorkerProcesses() should call this as
+		soon as it starts.
+
+		If the command line is one that the scanner created, this scans the file that
+		it names, writes the types that it finds to stdout for the scanner to read,
+		and returns true, after which the process should quit. The plugin formats
+		must have been registered with the AudioPluginFormatManager before calling
+		this. If the command line isn't a scan request, it just returns false.
+	*/
+	static bool performScanIfRequested (const String& commandLine);
+
 private:
 
+	class ScanWorker;
+
 	KnownPluginList& list;
 	AudioPluginFormat& format;
 	StringArray filesOrIdentifiersToScan;
@@ -2187,8 +2543,16 @@ private:
 	int nextIndex;
 	float progress;
 
+	OwnedArray <ScanWorker> workers;
+	WaitableEvent workerFinished;
+	String workerCommandLine;
+	int maxNumWorkers, workerTimeoutMs;
+
 	StringArray getDeadMansPedalFile();
 	void setDeadMansPedalFile (const StringArray& newContents);
+	bool shouldScan (const String& file, bool dontRescanIfAlreadyInList) const;
+	bool scanNextFilesInWorkers (bool dontRescanIfAlreadyInList);
+	void addWorkerResults (ScanWorker&);
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginDirectoryScanner);
 };
@@ -2232,6 +2596,11 @@ public:
 	/** Destructor. */
 	~PluginListComponent();
 
+	/** Makes the component scan for plugins using worker processes.
+		@see PluginDirectoryScanner::scanInWorkerProcesses
+	*/
+	void scanInWorkerProcesses (const String& workerCommandLine, int numWorkers);
+
 	/** @internal */
 	void resized();
 	/** @internal */
@@ -2253,6 +2622,8 @@ private:
 	TextButton optionsButton;
 	PropertiesFile* propertiesToUse;
 	int typeToScan;
+	String workerCommandLine;
+	int numScanWorkers;
 
 	void scanFor (AudioPluginFormat*);
 	static void optionsMenuStaticCallback (int result, PluginListComponent*);
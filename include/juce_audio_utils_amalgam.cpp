@@ -1549,27 +1549,34 @@ private:
 	char values[2];
 };
 
-class AudioThumbnail::LevelDataSource   : public TimeSliceClient
+class AudioThumbnail::LevelDataSource   : public TimeSliceClient,
+										  private ThreadPool::JobSelector
 {
 public:
 	LevelDataSource (AudioThumbnail& owner_, AudioFormatReader* newReader, int64 hash)
 		: lengthInSamples (0), numSamplesFinished (0), sampleRate (0), numChannels (0),
-		  hashCode (hash), owner (owner_), reader (newReader)
+		  hashCode (hash), owner (owner_), reader (newReader), lastReaderUseTime (0)
 	{
 	}
 
 	LevelDataSource (AudioThumbnail& owner_, InputSource* source_)
 		: lengthInSamples (0), numSamplesFinished (0), sampleRate (0), numChannels (0),
-		  hashCode (source_->hashCode()), owner (owner_), source (source_)
+		  hashCode (source_->hashCode()), owner (owner_), source (source_), lastReaderUseTime (0)
 	{
 	}
 
 	~LevelDataSource()
 	{
+		// (the jobs check shouldExit() between chunks, so this won't be long, but it has to
+		// wait for them all, as they're deleted along with this object)
+		owner.cache.getThumbnailThreadPool().removeAllJobs (true, -1, this);
 		owner.cache.removeTimeSliceClient (this);
 	}
 
-	enum { timeBeforeDeletingReader = 3000 };
+	enum { timeBeforeDeletingReader = 3000,
+		   thumbSamplesPerRegion = 2048,
+		   maxAttemptsPerRegion = 3,
+		   msBetweenAttempts = 200 };
 
 	void initialise (int64 numSamplesFinished_)
 	{
@@ -1585,10 +1592,12 @@ public:
 			numChannels = reader->numChannels;
 			sampleRate = reader->sampleRate;
 
-			if (lengthInSamples <= 0 || isFullyLoaded())
+			// when there's an InputSource, each region opens its own reader
+			if (source != nullptr)
 				reader = nullptr;
-			else
-				owner.cache.addTimeSliceClient (this);
+
+			if (lengthInSamples > 0 && ! isFullyLoaded())
+				startRegionJobs();
 		}
 	}
 
@@ -1627,39 +1636,18 @@ public:
 
 	int useTimeSlice()
 	{
-		if (isFullyLoaded())
-		{
-			if (reader != nullptr && source != nullptr)
-			{
-				if (Time::getMillisecondCounter() > lastReaderUseTime + timeBeforeDeletingReader)
-					releaseResources();
-				else
-					return 200;
-			}
-
-			return -1;
-		}
-
-		bool justFinished = false;
+		const ScopedLock sl (readerLock);
 
+		// (a reader that was given to us directly is kept until the thumbnail is cleared)
+		if (reader != nullptr && source != nullptr)
 		{
-			const ScopedLock sl (readerLock);
-
-			createReader();
+			if (Time::getMillisecondCounter() <= lastReaderUseTime + timeBeforeDeletingReader)
+				return 200;
 
-			if (reader != nullptr)
-			{
-				if (! readNextBlock())
-					return 0;
-
-				justFinished = true;
-			}
+			reader = nullptr;
 		}
 
-		if (justFinished)
-			owner.cache.storeThumb (owner, hashCode);
-
-		return 200;
+		return -1;
 	}
 
 	bool isFullyLoaded() const noexcept
@@ -1667,22 +1655,107 @@ public:
 		return numSamplesFinished >= lengthInSamples;
 	}
 
-	inline int sampleToThumbSample (const int64 originalSample) const noexcept
-	{
-		return (int) (originalSample / owner.samplesPerThumbSample);
-	}
-
 	int64 lengthInSamples, numSamplesFinished;
 	double sampleRate;
 	unsigned int numChannels;
 	int64 hashCode;
 
 private:
+	//==============================================================================
+	/*  Scans one region of the source, passing its levels to the thumbnail a chunk at
+		a time so that the waveform fills in progressively.
+
+		If the source can't be read, the job tries again a few times, carrying on from
+		where it got to. After that it gives up, and the region is left unfinished, so
+		the thumbnail never counts as fully loaded and doesn't get cached.
+	*/
+	class RegionJob  : public ThreadPoolJob
+	{
+	public:
+		RegionJob (LevelDataSource& owner_, const int64 startSample_, const int64 endSample_)
+			: ThreadPoolJob ("thumbnail region"),
+			  owner (owner_), nextSample (startSample_), endSample (endSample_), numFailures (0)
+		{
+		}
+
+		JobStatus runJob()
+		{
+			const int samplesPerThumbSample = owner.owner.samplesPerThumbSample;
+			const int thumbSamplesPerChunk = jmax (1, 65536 / samplesPerThumbSample);
+			const int numChans = jmin (2, (int) owner.numChannels);
+
+			ScopedPointer<AudioFormatReader> regionReader (owner.createRegionReader());
+
+			if (owner.source != nullptr && regionReader == nullptr)
+				return readFailed();
+
+			AudioSampleBuffer buffer (numChans, thumbSamplesPerChunk * samplesPerThumbSample);
+			HeapBlock<MinMaxValue> levelData ((size_t) (thumbSamplesPerChunk * numChans));
+			MinMaxValue* levels[2] = { levelData, levelData + thumbSamplesPerChunk };
+
+			while (nextSample < endSample)
+			{
+				if (shouldExit())
+					return jobHasFinished;
+
+				const int64 pos = nextSample;
+				const int numToDo = (int) jmin ((int64) buffer.getNumSamples(), endSample - pos);
+
+				if (! owner.readSamples (regionReader, buffer, pos, numToDo))
+					return readFailed();
+
+				const int numThumbSamps = (numToDo + samplesPerThumbSample - 1) / samplesPerThumbSample;
+
+				for (int chan = 0; chan < numChans; ++chan)
+				{
+					for (int i = 0; i < numThumbSamps; ++i)
+					{
+						const int start = i * samplesPerThumbSample;
+						float low, high;
+						FloatVectorOperations::findMinAndMax (buffer.getSampleData (chan, start),
+															  jmin (samplesPerThumbSample, numToDo - start), low, high);
+						levels[chan][i].setFloat (low, high);
+					}
+				}
+
+				owner.owner.setLevels (levels, (int) (pos / samplesPerThumbSample), numChans, numThumbSamps);
+				nextSample = pos + numToDo;
+			}
+
+			owner.regionFinished();
+			return jobHasFinished;
+		}
+
+		LevelDataSource& owner;
+
+	private:
+		int64 nextSample;
+		const int64 endSample;
+		int numFailures;
+
+		JobStatus readFailed()
+		{
+			if (++numFailures >= maxAttemptsPerRegion)
+				return jobHasFinished;
+
+			for (int i = msBetweenAttempts / 20; --i >= 0 && ! shouldExit();)
+				Thread::sleep (20);
+
+			return jobNeedsRunningAgain;
+		}
+
+		JUCE_DECLARE_NON_COPYABLE (RegionJob);
+	};
+
+	friend class RegionJob;
+
 	AudioThumbnail& owner;
 	ScopedPointer <InputSource> source;
 	ScopedPointer <AudioFormatReader> reader;
 	CriticalSection readerLock;
 	uint32 lastReaderUseTime;
+	OwnedArray<RegionJob> jobs;
+	Atomic<int> numRegionsPending;
 
 	void createReader()
 	{
@@ -1695,50 +1768,77 @@ private:
 		}
 	}
 
-	bool readNextBlock()
+	AudioFormatReader* createRegionReader() const
 	{
-		jassert (reader != nullptr);
+		if (source != nullptr)
+		{
+			InputStream* const audioFileStream = source->createInputStream();
+
+			if (audioFileStream != nullptr)
+				return owner.formatManagerToUse.createReaderFor (audioFileStream);
+		}
+
+		return nullptr;
+	}
 
-		if (! isFullyLoaded())
+	bool readSamples (AudioFormatReader* regionReader, AudioSampleBuffer& buffer,
+					  const int64 startSample, const int numSamples)
+	{
+		if (regionReader != nullptr)
 		{
-			const int numToDo = (int) jmin (256 * (int64) owner.samplesPerThumbSample, lengthInSamples - numSamplesFinished);
+			regionReader->read (&buffer, 0, numSamples, startSample, true, true);
+			return true;
+		}
 
-			if (numToDo > 0)
-			{
-				int64 startSample = numSamplesFinished;
+		// without an InputSource, the regions have to take turns with the one reader
+		const ScopedLock sl (readerLock);
 
-				const int firstThumbIndex = sampleToThumbSample (startSample);
-				const int lastThumbIndex  = sampleToThumbSample (startSample + numToDo);
-				const int numThumbSamps = lastThumbIndex - firstThumbIndex;
+		if (reader == nullptr)
+			return false;
 
-				HeapBlock<MinMaxValue> levelData ((size_t) numThumbSamps * 2);
-				MinMaxValue* levels[2] = { levelData, levelData + numThumbSamps };
+		reader->read (&buffer, 0, numSamples, startSample, true, true);
+		lastReaderUseTime = Time::getMillisecondCounter();
+		return true;
+	}
 
-				for (int i = 0; i < numThumbSamps; ++i)
-				{
-					float lowestLeft, highestLeft, lowestRight, highestRight;
+	void startRegionJobs()
+	{
+		const int64 samplesPerRegion = thumbSamplesPerRegion * (int64) owner.samplesPerThumbSample;
+		const int64 firstSample = (numSamplesFinished / owner.samplesPerThumbSample) * owner.samplesPerThumbSample;
 
-					reader->readMaxLevels ((firstThumbIndex + i) * owner.samplesPerThumbSample, owner.samplesPerThumbSample,
-										   lowestLeft, highestLeft, lowestRight, highestRight);
+		for (int64 start = firstSample; start < lengthInSamples; start += samplesPerRegion)
+			jobs.add (new RegionJob (*this, start, jmin (lengthInSamples, start + samplesPerRegion)));
 
-					levels[0][i].setFloat (lowestLeft, highestLeft);
-					levels[1][i].setFloat (lowestRight, highestRight);
-				}
+		numRegionsPending = jobs.size();
 
-				{
-					const ScopedUnlock su (readerLock);
-					owner.setLevels (levels, firstThumbIndex, 2, numThumbSamps);
-				}
+		for (int i = 0; i < jobs.size(); ++i)
+			owner.cache.getThumbnailThreadPool().addJob (jobs.getUnchecked (i), false);
+	}
 
-				numSamplesFinished += numToDo;
-				lastReaderUseTime = Time::getMillisecondCounter();
-			}
+	void regionFinished()
+	{
+		if (--numRegionsPending == 0)
+		{
+			numSamplesFinished = lengthInSamples;
+
+			if (owner.isFullyLoaded())
+				owner.cache.storeThumb (owner, hashCode);
 		}
+	}
 
-		return isFullyLoaded();
+	bool isJobSuitable (ThreadPoolJob* job)
+	{
+		const RegionJob* const regionJob = dynamic_cast <RegionJob*> (job);
+		return regionJob != nullptr && &(regionJob->owner) == this;
 	}
+
+	JUCE_DECLARE_NON_COPYABLE (LevelDataSource);
 };
 
+/*  The level data for one channel, stored as a pyramid of min/max values where each
+	level has half the resolution of the one below it, so that any range can be
+	summarised by looking at only a handful of values.
+*/
 class AudioThumbnail::ThumbData
 {
 public:
@@ -1768,14 +1868,22 @@ public:
 			char mx = -128;
 			char mn = 127;
 
+			// Covers the range with the biggest aligned blocks available from each level
 			while (startSample <= endSample)
 			{
-				const MinMaxValue& v = data.getReference (startSample);
+				int level = 0;
+
+				while (level < mipLevels.size()
+						&& (startSample & ((2 << level) - 1)) == 0
+						&& startSample + (2 << level) - 1 <= endSample)
+					++level;
+
+				const MinMaxValue& v = getLevel (level).getReference (startSample >> level);
 
 				if (v.getMinValue() < mn)  mn = v.getMinValue();
 				if (v.getMaxValue() > mx)  mx = v.getMaxValue();
 
-				++startSample;
+				startSample += (1 << level);
 			}
 
 			if (mn <= mx)
@@ -1799,6 +1907,39 @@ public:
 
 		for (int i = 0; i < numValues; ++i)
 			dest[i] = source[i];
+
+		updateLevels (startIndex, startIndex + numValues);
+	}
+
+	/** Recalculates the lower-resolution levels for a range of the full-resolution data. */
+	void updateLevels (int start, int end)
+	{
+		const Array<MinMaxValue>* source = &data;
+
+		for (int i = 0; i < mipLevels.size(); ++i)
+		{
+			Array<MinMaxValue>& dest = *mipLevels.getUnchecked (i);
+			start >>= 1;
+			end = (end + 1) >> 1;
+
+			for (int j = start; j < end; ++j)
+			{
+				const MinMaxValue& v1 = source->getReference (j * 2);
+				char mn = v1.getMinValue();
+				char mx = v1.getMaxValue();
+
+				if (j * 2 + 1 < source->size())
+				{
+					const MinMaxValue& v2 = source->getReference (j * 2 + 1);
+					mn = jmin (mn, v2.getMinValue());
+					mx = jmax (mx, v2.getMaxValue());
+				}
+
+				dest.getReference (j).set (mn, mx);
+			}
+
+			source = &dest;
+		}
 	}
 
 	void resetPeak() noexcept
@@ -1810,9 +1951,11 @@ public:
 	{
 		if (peakLevel < 0)
 		{
-			for (int i = 0; i < data.size(); ++i)
+			const Array<MinMaxValue>& top = getLevel (mipLevels.size());
+
+			for (int i = 0; i < top.size(); ++i)
 			{
-				const int peak = data[i].getPeak();
+				const int peak = top.getReference (i).getPeak();
 				if (peak > peakLevel)
 					peakLevel = peak;
 			}
@@ -1823,13 +1966,40 @@ public:
 
 private:
 	Array <MinMaxValue> data;
+	OwnedArray <Array <MinMaxValue> > mipLevels;
 	int peakLevel;
 
+	const Array<MinMaxValue>& getLevel (const int level) const noexcept
+	{
+		return level == 0 ? data : *mipLevels.getUnchecked (level - 1);
+	}
+
 	void ensureSize (const int thumbSamples)
 	{
-		const int extraNeeded = thumbSamples - data.size();
+		const int oldSize = data.size();
+		const int extraNeeded = thumbSamples - oldSize;
+
 		if (extraNeeded > 0)
+		{
 			data.insertMultiple (-1, MinMaxValue(), extraNeeded);
+
+			int size = data.size();
+
+			for (int i = 0; size > 1; ++i)
+			{
+				size = (size + 1) / 2;
+
+				if (i >= mipLevels.size())
+					mipLevels.add (new Array<MinMaxValue>());
+
+				Array<MinMaxValue>& level = *mipLevels.getUnchecked (i);
+
+				if (level.size() < size)
+					level.insertMultiple (-1, MinMaxValue(), size - level.size());
+			}
+
+			updateLevels (jmax (0, oldSize - 1), data.size());
+		}
 	}
 };
 
@@ -1839,7 +2009,7 @@ public:
 	CachedWindow()
 		: cachedStart (0), cachedTimePerPixel (0),
 		  numChannelsCached (0), numSamplesCached (0),
-		  cacheNeedsRefilling (true)
+		  cacheNeedsRefilling (true), numColumnsAllocated (0)
 	{
 	}
 
@@ -1868,18 +2038,32 @@ public:
 				const float midY = (topY + bottomY) * 0.5f;
 				const float vscale = verticalZoomFactor * (bottomY - topY) / 256.0f;
 
-				const MinMaxValue* cacheData = getData (channelNum, clip.getX() - area.getX());
+				const MinMaxValue* const cacheData = getData (channelNum, clip.getX() - area.getX());
+				const int numColumns = clip.getWidth();
 
-				int x = clip.getX();
-				for (int w = clip.getWidth(); --w >= 0;)
+				// The column extents are worked out in one tight loop, and then handed to the
+				// renderer as a single batch, rather than drawing each column as a separate line.
+				if (numColumns > numColumnsAllocated)
 				{
-					if (cacheData->isNonZero())
-						g.drawVerticalLine (x, jmax (midY - cacheData->getMaxValue() * vscale - 0.3f, topY),
-											   jmin (midY - cacheData->getMinValue() * vscale + 0.3f, bottomY));
+					numColumnsAllocated = numColumns;
+					columnTops.realloc ((size_t) numColumns);
+					columnBottoms.realloc ((size_t) numColumns);
+				}
 
-					++x;
-					++cacheData;
+				for (int i = 0; i < numColumns; ++i)
+				{
+					if (cacheData[i].isNonZero())
+					{
+						columnTops[i]    = jmax (midY - cacheData[i].getMaxValue() * vscale - 0.3f, topY);
+						columnBottoms[i] = jmin (midY - cacheData[i].getMinValue() * vscale + 0.3f, bottomY);
+					}
+					else
+					{
+						columnTops[i] = columnBottoms[i] = topY;
+					}
 				}
+
+				g.drawVerticalLines (clip.getX(), columnTops, columnBottoms, numColumns);
 			}
 		}
 	}
@@ -1889,6 +2073,8 @@ private:
 	double cachedStart, cachedTimePerPixel;
 	int numChannelsCached, numSamplesCached;
 	bool cacheNeedsRefilling;
+	HeapBlock<float> columnTops, columnBottoms;
+	int numColumnsAllocated;
 
 	void refillCache (const int numSamples, double startTime, const double endTime,
 					  const double sampleRate, const int numChannels, const int samplesPerThumbSample,
@@ -2023,6 +2209,7 @@ void AudioThumbnail::clearChannelData()
 {
 	window->invalidate();
 	channels.clear();
+	finishedRanges.clear();
 	totalSamples = numSamplesFinished = 0;
 	numChannels = 0;
 	sampleRate = 0;
@@ -2032,8 +2219,8 @@ void AudioThumbnail::clearChannelData()
 
 void AudioThumbnail::reset (int newNumChannels, double newSampleRate, int64 totalSamplesInSource)
 {
-	const ScopedLock sl (lock);
 	clear();
+	const ScopedLock sl (lock);
 
 	numChannels = newNumChannels;
 	sampleRate = newSampleRate;
@@ -2071,6 +2258,12 @@ void AudioThumbnail::loadFrom (InputStream& rawInput)
 	for (int i = 0; i < numThumbnailSamples; ++i)
 		for (int chan = 0; chan < numChannels; ++chan)
 			channels.getUnchecked(chan)->getData(i)->read (input);
+
+	for (int chan = 0; chan < numChannels; ++chan)
+		channels.getUnchecked(chan)->updateLevels (0, numThumbnailSamples);
+
+	if (numSamplesFinished > 0)
+		finishedRanges.addRange (Range<int64> (0, numSamplesFinished));
 }
 
 void AudioThumbnail::saveTo (OutputStream& output) const
@@ -2191,8 +2384,11 @@ void AudioThumbnail::setLevels (const MinMaxValue* const* values, int thumbIndex
 	const int64 start = thumbIndex * (int64) samplesPerThumbSample;
 	const int64 end = (thumbIndex + numValues) * (int64) samplesPerThumbSample;
 
-	if (numSamplesFinished >= start && end > numSamplesFinished)
-		numSamplesFinished = end;
+	// (blocks can arrive in any order, but only the finished part at the start is counted)
+	finishedRanges.addRange (Range<int64> (start, end));
+
+	if (finishedRanges.getRange (0).getStart() <= 0)
+		numSamplesFinished = jmax (numSamplesFinished, finishedRanges.getRange (0).getEnd());
 
 	totalSamples = jmax (numSamplesFinished, totalSamples);
 	window->invalidate();
@@ -2271,6 +2467,222 @@ void AudioThumbnail::drawChannels (Graphics& g, const Rectangle<int>& area, doub
 	}
 }
 
+#if JUCE_UNIT_TESTS
+
+class AudioThumbnailTests  : public UnitTest
+{
+public:
+	AudioThumbnailTests() : UnitTest ("AudioThumbnail") {}
+
+	void runTest()
+	{
+		const int numThumbs = 24, width = 800, rowHeight = 40;
+		const double sampleRate = 44100.0;
+		const int numSamples = (int) sampleRate * 30;
+
+		AudioFormatManager formatManager;
+		AudioThumbnailCache cache (numThumbs);
+		OwnedArray<AudioThumbnail> thumbs;
+
+		{
+			AudioSampleBuffer buffer (2, (int) sampleRate);
+			Random r (123);
+
+			for (int i = 0; i < numThumbs; ++i)
+			{
+				AudioThumbnail* const thumb = new AudioThumbnail (512, formatManager, cache);
+				thumbs.add (thumb);
+				thumb->reset (2, sampleRate, numSamples);
+
+				for (int pos = 0; pos < numSamples; pos += buffer.getNumSamples())
+				{
+					for (int s = 0; s < buffer.getNumSamples(); ++s)
+					{
+						const float level = 0.5f * (r.nextFloat() * 2.0f - 1.0f);
+						*buffer.getSampleData (0, s) = level;
+						*buffer.getSampleData (1, s) = level * 0.5f;
+					}
+
+					thumb->addBlock (pos, buffer, 0, buffer.getNumSamples());
+				}
+			}
+		}
+
+		Image image (Image::RGB, width, numThumbs * rowHeight, true);
+
+		beginTest ("Drawing");
+		{
+			{
+				Graphics g (image);
+				g.setColour (Colours::white);
+				thumbs[0]->drawChannel (g, Rectangle<int> (0, 0, width, rowHeight), 0.0, 30.0, 0, 1.0f);
+			}
+
+			// the waveform should fill the middle of the row, but not reach its edges
+			expect (image.getPixelAt (width / 2, rowHeight / 2) == Colours::white);
+			expect (image.getPixelAt (width / 2, 1) == Colours::black);
+			expect (image.getPixelAt (width / 2, rowHeight - 2) == Colours::black);
+		}
+
+		beginTest ("Rendering speed");
+		{
+			const int numFrames = 20;
+			const double startTime = Time::getMillisecondCounterHiRes();
+
+			for (int frame = 0; frame < numFrames; ++frame)
+			{
+				Graphics g (image);
+				g.fillAll (Colours::black);
+				g.setColour (Colours::white);
+
+				// (scrolling the view each time means that the cached columns get refilled)
+				for (int i = 0; i < numThumbs; ++i)
+					thumbs[i]->drawChannels (g, Rectangle<int> (0, i * rowHeight, width, rowHeight),
+											 frame * 0.1, frame * 0.1 + 20.0, 1.0f);
+			}
+
+			logMessage ("Rendered " + String (numThumbs) + " thumbnails at "
+						 + String ((Time::getMillisecondCounterHiRes() - startTime) / numFrames, 2) + " ms per frame");
+
+			expect (image.getPixelAt (width / 2, (numThumbs - 1) * rowHeight + rowHeight / 4) == Colours::white);
+		}
+
+		testMinMaxPyramid (formatManager, cache);
+		testOutOfOrderBlocks (formatManager, cache);
+	}
+
+private:
+	enum { samplesPerThumbSample = 512, numTestThumbSamples = 1000 };
+
+	// Each thumb sample gets one low and one high peak, at levels that can be stored exactly.
+	static void fillTestThumb (AudioThumbnail& thumb, Array<int>& lows, Array<int>& highs, Random& r)
+	{
+		AudioSampleBuffer buffer (1, samplesPerThumbSample);
+
+		// (with this sample rate, each second of the thumbnail is one of its samples)
+		thumb.reset (1, (double) samplesPerThumbSample, (int64) numTestThumbSamples * samplesPerThumbSample);
+
+		for (int i = 0; i < numTestThumbSamples; ++i)
+		{
+			lows.add (1 + r.nextInt (127));
+			highs.add (1 + r.nextInt (127));
+
+			buffer.clear();
+			*buffer.getSampleData (0, r.nextInt (samplesPerThumbSample / 2)) = -lows.getLast() / 127.0f;
+			*buffer.getSampleData (0, samplesPerThumbSample / 2 + r.nextInt (samplesPerThumbSample / 2)) = highs.getLast() / 127.0f;
+
+			thumb.addBlock ((int64) i * samplesPerThumbSample, buffer, 0, samplesPerThumbSample);
+		}
+	}
+
+	void testMinMaxPyramid (AudioFormatManager& formatManager, AudioThumbnailCache& cache)
+	{
+		beginTest ("Min/max at each zoom level");
+
+		AudioThumbnail thumb (samplesPerThumbSample, formatManager, cache);
+		Array<int> lows, highs;
+		Random r (0x1357);
+		fillTestThumb (thumb, lows, highs, r);
+
+		// Ranges of every power-of-two length and the lengths either side of them, each
+		// at several offsets, so that every level of the pyramid gets used, both aligned
+		// and unaligned.
+		for (int length = 1; length <= numTestThumbSamples; length *= 2)
+		{
+			for (int lengthDelta = -1; lengthDelta <= 1; ++lengthDelta)
+			{
+				const int numThumbSamples = jmax (1, length + lengthDelta);
+
+				for (int j = 0; j < 20; ++j)
+				{
+					const int start = j == 0 ? 0 : r.nextInt (numTestThumbSamples);
+					const int last = jmin (numTestThumbSamples - 1, start + numThumbSamples);
+					int expectedLow = 0, expectedHigh = 0;
+
+					for (int i = start; i <= last; ++i)
+					{
+						expectedLow = jmax (expectedLow, lows.getUnchecked (i));
+						expectedHigh = jmax (expectedHigh, highs.getUnchecked (i));
+					}
+
+					float minValue, maxValue;
+					thumb.getApproximateMinMax (start, start + numThumbSamples, 0, minValue, maxValue);
+
+					expectEquals (roundToInt (minValue * 128.0f), -expectedLow);
+					expectEquals (roundToInt (maxValue * 128.0f), expectedHigh);
+				}
+			}
+		}
+	}
+
+	void testOutOfOrderBlocks (AudioFormatManager& formatManager, AudioThumbnailCache& cache)
+	{
+		beginTest ("Merging blocks that arrive out of order");
+
+		AudioThumbnail inOrder (samplesPerThumbSample, formatManager, cache);
+		Array<int> lows, highs;
+		Random r (0x2468);
+		fillTestThumb (inOrder, lows, highs, r);
+
+		// The same data is added in regions of 40 thumb samples, in a shuffled order
+		const int regionSize = 40;
+		const int numRegions = (numTestThumbSamples + regionSize - 1) / regionSize;
+		Array<int> order;
+
+		for (int i = 0; i < numRegions; ++i)
+			order.insert (r.nextInt (i + 1), i);
+
+		AudioThumbnail shuffled (samplesPerThumbSample, formatManager, cache);
+		shuffled.reset (1, (double) samplesPerThumbSample, (int64) numTestThumbSamples * samplesPerThumbSample);
+
+		AudioSampleBuffer buffer (1, regionSize * samplesPerThumbSample);
+		bool hasAddedFirstRegion = false;
+
+		for (int i = 0; i < numRegions; ++i)
+		{
+			const int region = order.getUnchecked (i);
+			const int start = region * regionSize;
+			const int num = jmin (regionSize, numTestThumbSamples - start);
+
+			buffer.clear();
+
+			for (int j = 0; j < num; ++j)
+			{
+				*buffer.getSampleData (0, j * samplesPerThumbSample) = -lows.getUnchecked (start + j) / 127.0f;
+				*buffer.getSampleData (0, j * samplesPerThumbSample + 1) = highs.getUnchecked (start + j) / 127.0f;
+			}
+
+			shuffled.addBlock ((int64) start * samplesPerThumbSample, buffer, 0, num * samplesPerThumbSample);
+
+			// only the unbroken run of finished regions from the start should count
+			hasAddedFirstRegion = hasAddedFirstRegion || region == 0;
+
+			if (! hasAddedFirstRegion)
+				expect (shuffled.getNumSamplesFinished() == 0);
+
+			expect (shuffled.isFullyLoaded() == (i == numRegions - 1));
+		}
+
+		expect (shuffled.getNumSamplesFinished() == (int64) numTestThumbSamples * samplesPerThumbSample);
+
+		for (int i = 0; i < 200; ++i)
+		{
+			const int start = r.nextInt (numTestThumbSamples);
+			const int end = start + 1 + r.nextInt (numTestThumbSamples - start);
+
+			float min1, max1, min2, max2;
+			inOrder.getApproximateMinMax (start, end, 0, min1, max1);
+			shuffled.getApproximateMinMax (start, end, 0, min2, max2);
+
+			expect (min1 == min2 && max1 == max2);
+		}
+	}
+};
+
+static AudioThumbnailTests audioThumbnailTests;
+
+#endif
+
 /*** End of inlined file: juce_AudioThumbnail.cpp ***/
 
 
@@ -2307,9 +2719,29 @@ private:
 	JUCE_LEAK_DETECTOR (ThumbnailCacheEntry);
 };
 
-AudioThumbnailCache::AudioThumbnailCache (const int maxNumThumbsToStore_)
+class AudioThumbnailCache::DiskCacheEntry
+{
+public:
+	DiskCacheEntry (const int64 hash_, const int64 size_, const Time& lastUsed_)
+		: hash (hash_), size (size_), lastUsed (lastUsed_)
+	{
+	}
+
+	int64 hash, size;
+	Time lastUsed;
+
+private:
+	JUCE_LEAK_DETECTOR (DiskCacheEntry);
+};
+
+AudioThumbnailCache::AudioThumbnailCache (const int maxNumThumbsToStore_,
+										  const int numThumbnailThreads)
 	: TimeSliceThread ("thumb cache"),
-	  maxNumThumbsToStore (maxNumThumbsToStore_)
+	  maxNumThumbsToStore (maxNumThumbsToStore_),
+	  threadPool (numThumbnailThreads > 0 ? new ThreadPool (numThumbnailThreads)
+										  : new ThreadPool()),
+	  maxDiskCacheSize (0), diskCacheSize (0),
+	  numMemoryHits (0), numDiskHits (0), numMisses (0), numDiskEvictions (0)
 {
 	jassert (maxNumThumbsToStore > 0);
 	startThread (2);
@@ -2347,11 +2779,33 @@ int AudioThumbnailCache::findOldestThumb() const
 	return oldest;
 }
 
+AudioThumbnailCache::ThumbnailCacheEntry* AudioThumbnailCache::createThumbFor (const int64 hash)
+{
+	ThumbnailCacheEntry* const te = new ThumbnailCacheEntry (hash);
+
+	if (thumbs.size() < maxNumThumbsToStore)
+		thumbs.add (te);
+	else
+		thumbs.set (findOldestThumb(), te);
+
+	return te;
+}
+
 bool AudioThumbnailCache::loadThumb (AudioThumbnailBase& thumb, const int64 hashCode)
 {
 	const ScopedLock sl (lock);
 	ThumbnailCacheEntry* te = findThumbFor (hashCode);
 
+	if (te != nullptr)
+	{
+		++numMemoryHits;
+	}
+	else if (loadFromDisk (hashCode))
+	{
+		++numDiskHits;
+		te = findThumbFor (hashCode);
+	}
+
 	if (te != nullptr)
 	{
 		te->lastUsed = Time::getMillisecondCounter();
@@ -2361,27 +2815,34 @@ bool AudioThumbnailCache::loadThumb (AudioThumbnailBase& thumb, const int64 hash
 		return true;
 	}
 
+	++numMisses;
 	return false;
 }
 
 void AudioThumbnailCache::storeThumb (const AudioThumbnailBase& thumb,
 									  const int64 hashCode)
 {
-	const ScopedLock sl (lock);
-	ThumbnailCacheEntry* te = findThumbFor (hashCode);
+	MemoryBlock dataForDisk;
 
-	if (te == nullptr)
 	{
-		te = new ThumbnailCacheEntry (hashCode);
+		const ScopedLock sl (lock);
+		ThumbnailCacheEntry* te = findThumbFor (hashCode);
 
-		if (thumbs.size() < maxNumThumbsToStore)
-			thumbs.add (te);
-		else
-			thumbs.set (findOldestThumb(), te);
+		if (te == nullptr)
+			te = createThumbFor (hashCode);
+
+		{
+			MemoryOutputStream out (te->data, false);
+			thumb.saveTo (out);
+		}
+
+		if (diskCacheDirectory != File::nonexistent)
+			dataForDisk = te->data;
 	}
 
-	MemoryOutputStream out (te->data, false);
-	thumb.saveTo (out);
+	// (the file is written without holding the lock, so that loading other thumbs isn't held up)
+	if (dataForDisk.getSize() > 0)
+		writeToDisk (hashCode, dataForDisk);
 }
 
 void AudioThumbnailCache::clear()
@@ -2421,6 +2882,338 @@ void AudioThumbnailCache::writeToStream (OutputStream& out)
 		thumbs.getUnchecked(i)->write (out);
 }
 
+//==============================================================================
+/*  Each file in the disk cache holds a header followed by the data from AudioThumbnail::saveTo(),
+	which already stores each point as a pair of 8-bit min/max values:
+
+		int     magic number ("ThmD")
+		int64   the hash code of the source
+		int64   the number of bytes of thumbnail data that follow
+*/
+static inline int getThumbnailDiskFileMagicHeader() noexcept
+{
+	return (int) ByteOrder::littleEndianInt ("ThmD");
+}
+
+enum { thumbnailDiskFileHeaderSize = 20 };
+
+void AudioThumbnailCache::setDiskCacheDirectory (const File& directory, const int64 maxSizeInBytes)
+{
+	const ScopedLock sl (lock);
+
+	diskEntries.clear();
+	diskCacheSize = 0;
+	diskCacheDirectory = directory;
+	maxDiskCacheSize = maxSizeInBytes;
+
+	if (directory != File::nonexistent)
+	{
+		directory.createDirectory();
+
+		Array<File> files;
+		directory.findChildFiles (files, File::findFiles, false, "*.thumb");
+
+		for (int i = 0; i < files.size(); ++i)
+		{
+			const File& f = files.getReference (i);
+			const int64 size = f.getSize();
+
+			diskEntries.add (new DiskCacheEntry (f.getFileNameWithoutExtension().getHexValue64(),
+												 size, f.getLastAccessTime()));
+			diskCacheSize += size;
+		}
+
+		applyDiskCacheSizeLimit();
+	}
+}
+
+void AudioThumbnailCache::clearDiskCache()
+{
+	const ScopedLock sl (lock);
+
+	for (int i = diskEntries.size(); --i >= 0;)
+		removeDiskEntry (i);
+}
+
+AudioThumbnailCache::DiskCacheEntry* AudioThumbnailCache::findDiskEntryFor (const int64 hash) const
+{
+	for (int i = diskEntries.size(); --i >= 0;)
+		if (diskEntries.getUnchecked(i)->hash == hash)
+			return diskEntries.getUnchecked(i);
+
+	return nullptr;
+}
+
+File AudioThumbnailCache::getDiskCacheFile (const int64 hash) const
+{
+	return diskCacheDirectory.getChildFile (String::toHexString (hash) + ".thumb");
+}
+
+bool AudioThumbnailCache::loadFromDisk (const int64 hash)
+{
+	DiskCacheEntry* const de = findDiskEntryFor (hash);
+
+	if (de == nullptr)
+		return false;
+
+	const File file (getDiskCacheFile (hash));
+
+	{
+		const MemoryMappedFile mappedFile (file, MemoryMappedFile::readOnly);
+		const char* const data = static_cast <const char*> (mappedFile.getData());
+
+		if (data != nullptr && mappedFile.getSize() >= thumbnailDiskFileHeaderSize)
+		{
+			MemoryInputStream header (data, thumbnailDiskFileHeaderSize, false);
+			const int magic = header.readInt();
+			const int64 storedHash = header.readInt64();
+			const int64 dataSize = header.readInt64();
+
+			if (magic == getThumbnailDiskFileMagicHeader()
+				 && storedHash == hash
+				 && dataSize == (int64) mappedFile.getSize() - thumbnailDiskFileHeaderSize)
+			{
+				createThumbFor (hash)->data = MemoryBlock (data + thumbnailDiskFileHeaderSize, (size_t) dataSize);
+
+				de->lastUsed = Time::getCurrentTime();
+				file.setLastAccessTime (de->lastUsed);
+				return true;
+			}
+		}
+	}
+
+	// the file has gone missing or is damaged, so forget about it..
+	removeDiskEntry (diskEntries.indexOf (de));
+	return false;
+}
+
+void AudioThumbnailCache::writeToDisk (const int64 hash, const MemoryBlock& data)
+{
+	File file;
+
+	{
+		const ScopedLock sl (lock);
+
+		if (diskCacheDirectory == File::nonexistent)
+			return;
+
+		file = getDiskCacheFile (hash);
+	}
+
+	const TemporaryFile temp (file);
+
+	{
+		ScopedPointer <FileOutputStream> out (temp.getFile().createOutputStream());
+
+		if (out == nullptr)
+			return;
+
+		out->writeInt (getThumbnailDiskFileMagicHeader());
+		out->writeInt64 (hash);
+		out->writeInt64 ((int64) data.getSize());
+		out->write (data.getData(), data.getSize());
+	}
+
+	const int64 size = temp.getFile().getSize();
+
+	if (size != (int64) data.getSize() + thumbnailDiskFileHeaderSize)
+		return;
+
+	const ScopedLock sl (lock);
+
+	// (the directory may have been changed while the file was being written)
+	if (file.getParentDirectory() != diskCacheDirectory
+		 || ! temp.overwriteTargetFileWithTemporary())
+		return;
+
+	DiskCacheEntry* de = findDiskEntryFor (hash);
+
+	if (de == nullptr)
+	{
+		de = new DiskCacheEntry (hash, 0, Time());
+		diskEntries.add (de);
+	}
+
+	diskCacheSize += size - de->size;
+	de->size = size;
+	de->lastUsed = Time::getCurrentTime();
+
+	applyDiskCacheSizeLimit();
+}
+
+void AudioThumbnailCache::removeDiskEntry (const int index)
+{
+	const DiskCacheEntry* const de = diskEntries [index];
+
+	if (de != nullptr)
+	{
+		getDiskCacheFile (de->hash).deleteFile();
+		diskCacheSize -= de->size;
+		diskEntries.remove (index);
+	}
+}
+
+void AudioThumbnailCache::applyDiskCacheSizeLimit()
+{
+	while (diskCacheSize > maxDiskCacheSize && diskEntries.size() > 0)
+	{
+		int oldest = 0;
+
+		for (int i = diskEntries.size(); --i > 0;)
+			if (diskEntries.getUnchecked(i)->lastUsed < diskEntries.getUnchecked (oldest)->lastUsed)
+				oldest = i;
+
+		removeDiskEntry (oldest);
+		++numDiskEvictions;
+	}
+}
+
+//==============================================================================
+double AudioThumbnailCache::Statistics::getHitRatio() const noexcept
+{
+	const int64 total = numMemoryHits + numDiskHits + numMisses;
+	return total > 0 ? (numMemoryHits + numDiskHits) / (double) total : 0.0;
+}
+
+AudioThumbnailCache::Statistics AudioThumbnailCache::getStatistics() const
+{
+	const ScopedLock sl (lock);
+
+	Statistics s;
+	s.numMemoryHits = numMemoryHits;
+	s.numDiskHits = numDiskHits;
+	s.numMisses = numMisses;
+	s.numDiskEvictions = numDiskEvictions;
+	s.numDiskEntries = diskEntries.size();
+	s.diskSizeInBytes = diskCacheSize;
+	return s;
+}
+
+void AudioThumbnailCache::resetStatistics()
+{
+	const ScopedLock sl (lock);
+
+	numMemoryHits = numDiskHits = numMisses = numDiskEvictions = 0;
+}
+
+#if JUCE_UNIT_TESTS
+
+class AudioThumbnailCacheTests  : public UnitTest
+{
+public:
+	AudioThumbnailCacheTests() : UnitTest ("AudioThumbnailCache") {}
+
+	void runTest()
+	{
+		const File directory (File::getSpecialLocation (File::tempDirectory)
+								.getNonexistentChildFile ("juce_thumbcache_test", String::empty, false));
+
+		// (only one thumb is kept in memory, so that the others have to come from the disk)
+		AudioFormatManager formatManager;
+		AudioThumbnailCache cache (1, 1);
+		AudioThumbnail thumb (512, formatManager, cache), loadedThumb (512, formatManager, cache);
+		Random r (0x9876);
+
+		thumb.reset (1, 44100.0, 44100);
+		AudioSampleBuffer buffer (1, 44100);
+
+		for (int i = 0; i < buffer.getNumSamples(); ++i)
+			*buffer.getSampleData (0, i) = r.nextFloat() * 2.0f - 1.0f;
+
+		thumb.addBlock (0, buffer, 0, buffer.getNumSamples());
+		int64 fileSize = 0;
+
+		beginTest ("Disk cache LRU eviction");
+		{
+			cache.setDiskCacheDirectory (directory);
+			cache.storeThumb (thumb, 1);
+			fileSize = cache.getStatistics().diskSizeInBytes;
+			expect (fileSize > 0);
+
+			// room for three thumbnails
+			cache.setDiskCacheDirectory (directory, fileSize * 3);
+			Thread::sleep (20);
+			cache.storeThumb (thumb, 2);
+			Thread::sleep (20);
+			cache.storeThumb (thumb, 3);
+			Thread::sleep (20);
+
+			// using the first one again makes the second the least recently used
+			expect (cache.loadThumb (loadedThumb, 1));
+			Thread::sleep (20);
+			cache.storeThumb (thumb, 4);
+
+			const AudioThumbnailCache::Statistics stats (cache.getStatistics());
+			expect (stats.numDiskEvictions == 1);
+			expectEquals (stats.numDiskEntries, 3);
+			expect (stats.diskSizeInBytes == fileSize * 3);
+			expect (! getFile (directory, 2).exists());
+			expect (getFile (directory, 1).exists() && getFile (directory, 3).exists() && getFile (directory, 4).exists());
+
+			expect (! cache.loadThumb (loadedThumb, 2));
+			expect (cache.loadThumb (loadedThumb, 3));
+			expect (loadedThumb.getNumSamplesFinished() == thumb.getNumSamplesFinished());
+		}
+
+		beginTest ("Statistics");
+		{
+			cache.resetStatistics();
+
+			expect (cache.loadThumb (loadedThumb, 3));    // still in memory
+			expect (cache.loadThumb (loadedThumb, 4));    // from the disk
+			expect (cache.loadThumb (loadedThumb, 1));    // from the disk
+			expect (! cache.loadThumb (loadedThumb, 2));  // gone
+
+			const AudioThumbnailCache::Statistics stats (cache.getStatistics());
+			expect (stats.numMemoryHits == 1);
+			expect (stats.numDiskHits == 2);
+			expect (stats.numMisses == 1);
+			expect (stats.numDiskEvictions == 0);
+			expectEquals (stats.getHitRatio(), 0.75);
+		}
+
+		beginTest ("Damaged cache files");
+		{
+			// a file full of junk, a truncated copy of a good one, and a good one with the wrong name
+			MemoryBlock goodData;
+			expect (getFile (directory, 1).loadFileAsData (goodData));
+
+			getFile (directory, 5).replaceWithText ("this isn't a thumbnail");
+			getFile (directory, 6).replaceWithData (goodData.getData(), goodData.getSize() - 10);
+			getFile (directory, 7).replaceWithData (goodData.getData(), goodData.getSize());
+
+			AudioThumbnailCache newCache (1, 1);
+			newCache.setDiskCacheDirectory (directory, fileSize * 10);
+			expectEquals (newCache.getStatistics().numDiskEntries, 6);
+
+			for (int64 hash = 5; hash <= 7; ++hash)
+			{
+				expect (! newCache.loadThumb (loadedThumb, hash));
+				expect (! getFile (directory, hash).exists());
+			}
+
+			expectEquals (newCache.getStatistics().numDiskEntries, 3);
+			expect (newCache.loadThumb (loadedThumb, 1));
+
+			newCache.clearDiskCache();
+			expectEquals (newCache.getStatistics().numDiskEntries, 0);
+		}
+
+		cache.setDiskCacheDirectory (File::nonexistent);
+		directory.deleteRecursively();
+	}
+
+private:
+	static File getFile (const File& directory, const int64 hash)
+	{
+		return directory.getChildFile (String::toHexString (hash) + ".thumb");
+	}
+};
+
+static AudioThumbnailCacheTests audioThumbnailCacheTests;
+
+#endif
+
 /*** End of inlined file: juce_AudioThumbnailCache.cpp ***/
 
 
@@ -3402,6 +4195,7 @@ void AudioProcessorPlayer::audioDeviceIOCallback (const float** const inputChann
 		}
 		else
 		{
+			processor->applyQueuedParameterChanges();
 			processor->processBlock (buffer, incomingMidi);
 		}
 	}
@@ -278,7 +278,9 @@ class AudioThumbnailCache;
 	The class will asynchronously scan the wavefile to create its scaled-down view,
 	so you should make your UI repaint itself as this data comes in. To do this, the
 	AudioThumbnail is a ChangeBroadcaster, and will broadcast a message when its
-	listeners should repaint themselves.
+	listeners should repaint themselves. Long files are split into regions which are
+	scanned in parallel by the AudioThumbnailCache's thread pool, so the waveform may
+	fill in out of order.
 
 	The thumbnail stores an internal low-res version of the wave data, and this can
 	be loaded and saved to avoid having to scan the file again.
@@ -445,6 +447,7 @@ private:
 
 	int32 samplesPerThumbSample;
 	int64 totalSamples, numSamplesFinished;
+	SparseSet<int64> finishedRanges;
 	int32 numChannels;
 	double sampleRate;
 	CriticalSection lock;
@@ -472,9 +475,9 @@ private:
 /**
 	An instance of this class is used to manage multiple AudioThumbnail objects.
 
-	The cache runs a single background thread that is shared by all the thumbnails
-	that need it, and it maintains a set of low-res previews in memory, to avoid
-	having to re-scan audio files too often.
+	The cache runs a background thread and a pool of worker threads which are shared
+	by all the thumbnails that need them, and it maintains a set of low-res previews in
+	memory, to avoid having to re-scan audio files too often.
 
 	@see AudioThumbnail
 */
@@ -486,8 +489,12 @@ public:
 
 		The maxNumThumbsToStore parameter lets you specify how many previews should
 		be kept in memory at once.
+
+		The numThumbnailThreads parameter sets the number of threads used to scan
+		audio files - if it's 0, one thread per CPU core will be used.
 	*/
-	explicit AudioThumbnailCache (int maxNumThumbsToStore);
+	explicit AudioThumbnailCache (int maxNumThumbsToStore,
+								  int numThumbnailThreads = 0);
 
 	/** Destructor. */
 	~AudioThumbnailCache();
@@ -522,16 +529,91 @@ public:
 	*/
 	void writeToStream (OutputStream& stream);
 
+	/** Returns the pool of threads that the thumbnails use to scan their audio files. */
+	ThreadPool& getThumbnailThreadPool() noexcept       { return *threadPool; }
+
+	//==============================================================================
+	/** Makes the cache keep a copy of every thumbnail it stores in a directory on disk.
+
+		Each thumbnail goes into its own small file, named after the hash code of its
+		source. When a thumbnail is needed again and isn't in memory, its file is
+		memory-mapped and loaded, so re-opening files that have been seen before shows
+		their waveforms straight away without reading any audio.
+
+		When the files in the directory add up to more than maxSizeInBytes, the ones
+		that were least recently used are deleted.
+
+		The cache only sees hash codes, so if you're using FileInputSource objects,
+		create them with useFileTimeInHashGeneration = true - then a file that gets
+		modified will have a new hash, rather than picking up its old thumbnail.
+
+		Pass File::nonexistent to stop using a disk cache.
+	*/
+	void setDiskCacheDirectory (const File& directory,
+								int64 maxSizeInBytes = 256 * 1024 * 1024);
+
+	/** Returns the directory set by setDiskCacheDirectory(). */
+	const File& getDiskCacheDirectory() const noexcept  { return diskCacheDirectory; }
+
+	/** Deletes all the thumbnail files from the disk cache directory. */
+	void clearDiskCache();
+
+	//==============================================================================
+	/** Some statistics about how well the cache is performing. */
+	struct Statistics
+	{
+		/** The number of thumbnails that were found in memory. */
+		int64 numMemoryHits;
+
+		/** The number of thumbnails that were loaded from the disk cache. */
+		int64 numDiskHits;
+
+		/** The number of thumbnails that had to be generated from their audio. */
+		int64 numMisses;
+
+		/** The number of files deleted from the disk cache to make space for others. */
+		int64 numDiskEvictions;
+
+		/** The number of thumbnails currently in the disk cache. */
+		int numDiskEntries;
+
+		/** The total size of the files in the disk cache. */
+		int64 diskSizeInBytes;
+
+		/** Returns the proportion of lookups that were hits (in memory or on disk), from 0 to 1. */
+		double getHitRatio() const noexcept;
+	};
+
+	/** Returns the current statistics. */
+	Statistics getStatistics() const;
+
+	/** Resets the hit, miss and eviction counts. */
+	void resetStatistics();
+
 private:
 
 	class ThumbnailCacheEntry;
+	class DiskCacheEntry;
 	friend class OwnedArray<ThumbnailCacheEntry>;
+	friend class OwnedArray<DiskCacheEntry>;
 	OwnedArray<ThumbnailCacheEntry> thumbs;
+	OwnedArray<DiskCacheEntry> diskEntries;
 	CriticalSection lock;
 	int maxNumThumbsToStore;
+	ScopedPointer<ThreadPool> threadPool;
+	File diskCacheDirectory;
+	int64 maxDiskCacheSize, diskCacheSize;
+	int64 numMemoryHits, numDiskHits, numMisses, numDiskEvictions;
 
 	ThumbnailCacheEntry* findThumbFor (int64 hash) const;
+	ThumbnailCacheEntry* createThumbFor (int64 hash);
 	int findOldestThumb() const;
+	DiskCacheEntry* findDiskEntryFor (int64 hash) const;
+	File getDiskCacheFile (int64 hash) const;
+	bool loadFromDisk (int64 hash);
+	void writeToDisk (int64 hash, const MemoryBlock& data);
+	void removeDiskEntry (int index);
+	void applyDiskCacheSizeLimit();
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioThumbnailCache);
 };
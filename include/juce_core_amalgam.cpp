@@ -7007,12 +7007,25 @@ namespace SocketHelpers
 	   #endif
 	}
 
+	static void preventInheritance (const int handle) noexcept
+	{
+	   #if ! JUCE_WINDOWS
+		// (otherwise any child processes that get launched would keep the socket open)
+		fcntl (handle, F_SETFD, FD_CLOEXEC);
+	   #else
+		(void) handle;
+	   #endif
+	}
+
 	static bool resetSocketOptions (const int handle, const bool isDatagram, const bool allowBroadcast) noexcept
 	{
 		const int sndBufSize = 65536;
 		const int rcvBufSize = 65536;
 		const int one = 1;
 
+		if (handle > 0)
+			preventInheritance (handle);
+
 		return handle > 0
 				&& setsockopt (handle, SOL_SOCKET, SO_RCVBUF, (const char*) &rcvBufSize, sizeof (rcvBufSize)) == 0
 				&& setsockopt (handle, SOL_SOCKET, SO_SNDBUF, (const char*) &sndBufSize, sizeof (sndBufSize)) == 0
@@ -7352,6 +7365,8 @@ bool StreamingSocket::createListener (const int newPortNumber, const String& loc
 	if (handle < 0)
 		return false;
 
+	SocketHelpers::preventInheritance (handle);
+
 	const int reuse = 1;
 	setsockopt (handle, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof (reuse));
 
@@ -27222,6 +27237,11 @@ public:
 
 		if (pipe (pipeHandles) == 0)
 		{
+			// (stops any other processes that get launched from keeping this pipe open - the
+			// child's copy of the write end is made by dup2(), which clears the flag again)
+			fcntl (pipeHandles[0], F_SETFD, FD_CLOEXEC);
+			fcntl (pipeHandles[1], F_SETFD, FD_CLOEXEC);
+
 			const pid_t result = fork();
 
 			if (result < 0)
@@ -27268,9 +27288,9 @@ public:
 	{
 		if (childPID != 0)
 		{
-			int childState;
+			int childState = 0;
 			const int pid = waitpid (childPID, &childState, WNOHANG);
-			return pid > 0 && ! (WIFEXITED (childState) || WIFSIGNALED (childState));
+			return pid == 0 || (pid > 0 && ! (WIFEXITED (childState) || WIFSIGNALED (childState)));
 		}
 
 		return false;
@@ -27312,6 +27332,10 @@ bool ChildProcess::start (const String& command)
 	if (tokens.size() == 0)
 		return false;
 
+	// (quotes are only there to group arguments, so they mustn't get passed on)
+	for (int i = 0; i < tokens.size(); ++i)
+		tokens.set (i, tokens[i].unquoted());
+
 	activeProcess = new ActiveProcess (tokens);
 
 	if (activeProcess->childPID == 0)
@@ -29202,7 +29226,7 @@ MemoryMappedFile::MemoryMappedFile (const File& file, MemoryMappedFile::AccessMo
 	jassert (mode == readOnly || mode == readWrite);
 
 	DWORD accessMode = GENERIC_READ, createType = OPEN_EXISTING;
-	DWORD protect = PAGE_READONLY, access = FILE_MAP_READ;
+	DWORD protect = PAGE_READONLY, access = FILE_MAP_READ, shareMode = FILE_SHARE_READ;
 
 	if (mode == readWrite)
 	{
@@ -29210,9 +29234,10 @@ MemoryMappedFile::MemoryMappedFile (const File& file, MemoryMappedFile::AccessMo
 		createType = OPEN_ALWAYS;
 		protect = PAGE_READWRITE;
 		access = FILE_MAP_ALL_ACCESS;
+		shareMode = FILE_SHARE_READ | FILE_SHARE_WRITE; // (so that other processes can share the memory)
 	}
 
-	HANDLE h = CreateFile (file.getFullPathName().toWideCharPointer(), accessMode, FILE_SHARE_READ, 0,
+	HANDLE h = CreateFile (file.getFullPathName().toWideCharPointer(), accessMode, shareMode, 0,
 						   createType, FILE_ATTRIBUTE_NORMAL, 0);
 
 	if (h != INVALID_HANDLE_VALUE)
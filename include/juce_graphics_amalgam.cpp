@@ -5527,6 +5527,14 @@ LowLevelGraphicsContext::~LowLevelGraphicsContext()
 {
 }
 
+void LowLevelGraphicsContext::drawVerticalLines (const int startX, const float* const tops,
+												 const float* const bottoms, const int numLines)
+{
+	for (int i = 0; i < numLines; ++i)
+		if (bottoms[i] > tops[i])
+			drawVerticalLine (startX + i, tops[i], bottoms[i]);
+}
+
 Graphics::Graphics (const Image& imageToDrawOnto)
 	: context (imageToDrawOnto.createLowLevelContext()),
 	  contextToDelete (context),
@@ -6035,6 +6043,15 @@ void Graphics::drawHorizontalLine (const int y, float left, float right) const
 	context->drawHorizontalLine (y, left, right);
 }
 
+void Graphics::drawVerticalLines (const int startX, const float* const tops,
+								  const float* const bottoms, const int numLines) const
+{
+	jassert (numLines == 0 || (tops != nullptr && bottoms != nullptr));
+
+	if (numLines > 0)
+		context->drawVerticalLines (startX, tops, bottoms, numLines);
+}
+
 void Graphics::drawLine (const float x1, const float y1, const float x2, const float y2) const
 {
 	context->drawLine (Line<float> (x1, y1, x2, y2));
@@ -8604,6 +8621,34 @@ public:
 		}
 	}
 
+	void fillVerticalLines (const int startX, const float* const tops, const float* const bottoms, const int numLines)
+	{
+		if (clip != nullptr)
+		{
+			if (transform.isOnlyTranslated && fillType.isColour())
+			{
+				// (same as calling fillRect for each line, but the destination only gets set up once)
+				Image::BitmapData destData (image, Image::BitmapData::readWrite);
+				const PixelARGB colour (fillType.colour.getPixelARGB());
+
+				for (int i = 0; i < numLines; ++i)
+				{
+					if (bottoms[i] > tops[i])
+					{
+						const Rectangle<float> r ((float) (startX + i), tops[i], 1.0f, bottoms[i] - tops[i]);
+						clip->fillRectWithColour (destData, transform.translated (r), colour);
+					}
+				}
+			}
+			else
+			{
+				for (int i = 0; i < numLines; ++i)
+					if (bottoms[i] > tops[i])
+						fillRect (Rectangle<float> ((float) (startX + i), tops[i], 1.0f, bottoms[i] - tops[i]));
+			}
+		}
+	}
+
 	void fillPath (const Path& path, const AffineTransform& t)
 	{
 		if (clip != nullptr)
@@ -8887,6 +8932,12 @@ void LowLevelGraphicsSoftwareRenderer::drawHorizontalLine (const int y, float le
 		savedState->fillRect (Rectangle<float> (left, (float) y, right - left, 1.0f));
 }
 
+void LowLevelGraphicsSoftwareRenderer::drawVerticalLines (const int startX, const float* const tops,
+														  const float* const bottoms, const int numLines)
+{
+	savedState->fillVerticalLines (startX, tops, bottoms, numLines);
+}
+
 void LowLevelGraphicsSoftwareRenderer::drawGlyph (int glyphNumber, const AffineTransform& transform)
 {
 	Font& f = savedState->font;
@@ -4759,6 +4759,16 @@ public:
 	*/
 	void drawHorizontalLine (int y, float left, float right) const;
 
+	/** Draws a row of adjacent vertical lines in one go.
+
+		This has the same effect as calling drawVerticalLine() for x positions
+		startX, startX + 1, etc., with the tops and bottoms taken from the arrays
+		that are passed in, but is much quicker when there are a lot of lines, as the
+		renderer only has to prepare itself once. Any lines whose bottom isn't
+		below their top are skipped.
+	*/
+	void drawVerticalLines (int startX, const float* tops, const float* bottoms, int numLines) const;
+
 	/** Fills a path using the currently selected colour or brush.
 	*/
 	void fillPath (const Path& path,
@@ -6375,6 +6385,7 @@ public:
 	virtual void drawLine (const Line <float>& line) = 0;
 	virtual void drawVerticalLine (int x, float top, float bottom) = 0;
 	virtual void drawHorizontalLine (int y, float left, float right) = 0;
+	virtual void drawVerticalLines (int startX, const float* tops, const float* bottoms, int numLines);
 
 	virtual void setFont (const Font& newFont) = 0;
 	virtual const Font& getFont() = 0;
@@ -6951,6 +6962,7 @@ public:
 
 	void drawVerticalLine (int x, float top, float bottom);
 	void drawHorizontalLine (int x, float top, float bottom);
+	void drawVerticalLines (int startX, const float* tops, const float* bottoms, int numLines);
 
 	void setFont (const Font&);
 	const Font& getFont();